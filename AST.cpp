@@ -8,6 +8,7 @@
 #include <assert.h>
 #include <string.h>
 #include <string>
+#include <vector>
 using namespace std;
 
 
@@ -23,9 +24,26 @@ namespace js2cpp {
 
 	AST::~AST()
 	{
-		delete first;
-		delete second;
-		delete third;
+		if (!first && !second && !third) {
+			return;
+		}
+		// Lists hang thousands deep off second (or third), so take
+		// the tree apart with an explicit stack instead of recursing.
+		std::vector<AST*> doomed;
+		doomed.push_back(first);
+		doomed.push_back(second);
+		doomed.push_back(third);
+		while (!doomed.empty()) {
+			AST* n = doomed.back();
+			doomed.pop_back();
+			if (n) {
+				doomed.push_back(n->first);
+				doomed.push_back(n->second);
+				doomed.push_back(n->third);
+				n->first = n->second = n->third = NULL;
+				delete n;
+			}
+		}
 	}
 
 
@@ -48,6 +66,7 @@ namespace js2cpp {
 	{
 		assert(!scope);
 		scope = s;
+		s->SetTree(this);
 	} // Attach
 
 	AST*& LoopBody(AST* loop_node)
@@ -134,4 +153,21 @@ namespace js2cpp {
 		return expr->second;
 	}
 
+	void Walk(AST* tree, NodeVisitor visit, void* context)
+	{
+		vector<AST*> stack;
+		if (tree) {
+			stack.push_back(tree);
+		}
+		while (!stack.empty()) {
+			AST* node = stack.back();
+			stack.pop_back();
+			visit(node, context);
+			// push in reverse so first is visited first
+			if (node->third) stack.push_back(node->third);
+			if (node->second) stack.push_back(node->second);
+			if (node->first) stack.push_back(node->first);
+		}
+	} // Walk
+
 } // namespace js2cpp
@@ -27,6 +27,7 @@ namespace js2cpp
 
 		void Attach(aScope* scope);
 		aScope* Scope(int nUp=0) const;
+		bool HasScope(void) const { return scope != NULL; }
 
 		void TracePrint(FILE *f, int depth=0);
 
@@ -53,6 +54,12 @@ namespace js2cpp
 	AST*& LeftOperand(AST* expr);		// binary ops, and postfix unary ops
 	AST*& RightOperand(AST* expr);		// binary ops and prefix unary ops
 
+	// tree walking
+	typedef void (*NodeVisitor)(AST* node, void* context);
+	void Walk(AST* tree, NodeVisitor visit, void* context);
+	// Call visit on every node of tree, in pre-order.
+	// Uses an explicit stack, so long lists can't overflow the C stack.
+
 } // namespace
 
 #endif
@@ -29,12 +29,17 @@ tail_recursion:
 			fprintf(f, "%*cNULL\n", depth+3-1, ' ');
 		}
 		if (tree->second) {
+			if (type==tCOMMA && !tree->third) {
+				// rest of an element or argument list, at the same depth
+				tree = tree->second;
+				goto tail_recursion;
+			}
 			TreePrint(f, tree->second, depth+3);
 		} else if (tree->third) {
 			fprintf(f, "%*cNULL\n", depth+3-1, ' ');
 		}
 		if (tree->third) {
-			if (Type(tree)==tSTATLIST) {
+			if (type==tSTATLIST || type==tOBJLIT || type==tCOMMA) {
 				tree = tree->third;
 				goto tail_recursion;
 			} else {
@@ -0,0 +1,114 @@
+#!/bin/sh
+# compare.sh - compare two runs in a corpus.sh history
+#
+# usage: bench/compare.sh [history] [threshold %] [baseline run]
+#
+# Compares the last run in the history (corpus.jsonl) with the run
+# before it, or with the baseline run given (its "run" date), program
+# by program: js2cpp, compile and run time, binary size, and peak RSS
+# of the compile and the run. A measure more than threshold percent
+# (5) worse is flagged as a regression; so is a program that worked
+# and now fails, or whose output changed. Times within 1 ms are
+# taken as noise. Exits 1 if there were any.
+
+HISTORY=${1:-corpus.jsonl}
+THRESHOLD=${2:-5}
+BASE=${3:-}
+
+[ -r "$HISTORY" ] || { echo "compare: cannot read $HISTORY" >&2; exit 2; }
+
+awk -v threshold="$THRESHOLD" -v base="$BASE" '
+function parse(line, kv,    m, key, val) {
+	# the members of one flat JSON object
+	split("", kv)
+	while (match(line, /"[a-z_0-9]+": ("([^"\\]|\\.)*"|[-+0-9.eE]+|true|false|null)/)) {
+		m = substr(line, RSTART, RLENGTH)
+		line = substr(line, RSTART + RLENGTH)
+		key = substr(m, 2)
+		sub(/".*/, "", key)
+		val = m
+		sub(/^"[a-z_0-9]+": /, "", val)
+		if (val ~ /^"/) {
+			val = substr(val, 2, length(val) - 2)
+		}
+		kv[key] = val
+	}
+}
+{
+	parse($0, kv)
+	if (!("run" in kv) || !("program" in kv)) {
+		next
+	}
+	run = kv["run"]
+	if (!(run in seen)) {
+		seen[run] = 1
+		runs[++nruns] = run
+	}
+	p = kv["program"]
+	if (!((run, p) in had)) {
+		had[run, p] = 1
+		if (!(p in known)) {
+			known[p] = 1
+			programs[++nprograms] = p
+		}
+	}
+	for (k in kv) {
+		data[run, p, k] = kv[k]
+	}
+}
+END {
+	if (nruns < 2 && base == "") {
+		print "compare: need two runs in the history"
+		exit 2
+	}
+	new = runs[nruns]
+	old = base != "" ? base : runs[nruns - 1]
+	if (!(old in seen)) {
+		print "compare: no run " old
+		exit 2
+	}
+	if (old == new) {
+		print "compare: the baseline is the last run"
+		exit 2
+	}
+	nm = split("js2cpp_ms compile_ms binary_bytes run_ms compile_kb run_kb", measures, " ")
+	printf "%s (%s) -> %s (%s), threshold %s%%\n\n", old, data[old, programs[1], "rev"], new, data[new, programs[1], "rev"], threshold
+	printf "%-10s %-13s %12s %12s %8s\n", "program", "measure", "before", "after", "change"
+	bad = 0
+	for (i = 1; i <= nprograms; i++) {
+		p = programs[i]
+		if (!((old, p) in had) || !((new, p) in had)) {
+			printf "%-10s %s\n", p, ((new, p) in had) ? "new" : "gone"
+			continue
+		}
+		if (data[old, p, "status"] != data[new, p, "status"]) {
+			flag = data[old, p, "status"] == "ok" ? "  REGRESSION" : ""
+			bad += flag != ""
+			printf "%-10s %-13s %s -> %s%s\n", p, "status", data[old, p, "status"], data[new, p, "status"], flag
+		}
+		if (data[old, p, "status"] == "ok" && data[new, p, "status"] == "ok" &&
+				data[old, p, "output"] != data[new, p, "output"]) {
+			bad++
+			printf "%-10s %-13s %s -> %s  REGRESSION\n", p, "output", data[old, p, "output"], data[new, p, "output"]
+		}
+		for (j = 1; j <= nm; j++) {
+			m = measures[j]
+			if (!((old, p, m) in data) || !((new, p, m) in data)) {
+				continue
+			}
+			a = data[old, p, m] + 0
+			b = data[new, p, m] + 0
+			change = a ? 100 * (b - a) / a : 0
+			flag = ""
+			if (change > threshold + 0 && !(m ~ /_ms$/ && b - a < 1)) {
+				flag = "  REGRESSION"
+				bad++
+			} else if (change < -threshold) {
+				flag = "  better"
+			}
+			printf "%-10s %-13s %12s %12s %+7.1f%%%s\n", p, m, data[old, p, m], data[new, p, m], change, flag
+		}
+	}
+	printf "\n%d regression%s\n", bad, bad == 1 ? "" : "s"
+	exit bad != 0
+}' "$HISTORY"
@@ -0,0 +1,117 @@
+#!/bin/sh
+# corpus.sh - compile and run the benchmark corpus, keeping a history
+#
+# usage: bench/corpus.sh [js2cpp] [runs] [history]
+#
+# Each program in bench/corpus, and utils.js, goes through js2cpp and
+# the C++ compiler (linked against the runtime, built once) and is run
+# RUNS times. A line per program is added to the history file (JSON,
+# one object per line; corpus.jsonl): js2cpp ms and peak KB, compile
+# ms and peak KB, binary bytes, run ms (fastest run) and peak KB, and
+# the first line the program printed. A stage that fails says so in
+# status, with the first line of its errors, and the rest is left out.
+# bench/compare.sh compares the last run against an earlier one.
+#
+# js2cpp itself builds here too, from the translator sources:
+#   $CXX -std=c++98 -o js2cpp js2cpp.cpp jsargs.cpp jslex.cpp \
+#     jssrctxt.cpp jsparse.cpp jsregex.cpp AST.cpp ASTprint.cpp scope.cpp \
+#     phases.cpp codegen.cpp log.cpp stringtab.cpp
+#
+# Targets: 32-bit x86 only, Linux or another POSIX system (on an x86-64
+# host, -m32 and the 32-bit libraries). The runtime finds a function's
+# arguments on the stack after its nargs (ARGV_), which is where 32-bit
+# x86 passes them and x86-64 or ARM do not. ISO C++, not GNU: typeof
+# is a member name.
+
+JS2CPP=${1:-./js2cpp}
+RUNS=${2:-3}
+HISTORY=${3:-corpus.jsonl}
+CXX=${CXX:-g++}
+CXXFLAGS=${CXXFLAGS:--O2}
+case $(uname -m) in
+i?86)	ARCH= ;;
+x86_64|amd64)	ARCH=-m32 ;;
+*)	echo "corpus.sh: $(uname -m) is not a supported target (32-bit x86)" >&2; exit 1 ;;
+esac
+CXXFLAGS="$ARCH -std=c++11 $CXXFLAGS"
+BENCH=$(cd "$(dirname "$0")" && pwd)
+RT=$(cd "$BENCH/.." && pwd)
+TMP=${TMPDIR:-/tmp}/js2cpp_corpus.$$
+mkdir -p "$TMP" || exit 1
+trap 'rm -rf "$TMP"' 0
+
+case $JS2CPP in /*) ;; *) JS2CPP=$(pwd)/$JS2CPP ;; esac
+case $HISTORY in /*) ;; *) HISTORY=$(pwd)/$HISTORY ;; esac
+
+$CXX -O2 -o "$TMP/runstat" "$BENCH/runstat.cpp" || exit 1
+for f in jscpprt jsatom jstyped jsmath jsjson jsregex jsregexp jsevent jsconsole jsfs \
+		jsisolate jsparallel jsstats jsheap jsinstr jsfeedback jsmain; do
+	$CXX $CXXFLAGS -I"$RT" -c -o "$TMP/$f.o" "$RT/$f.cpp" || exit 1
+done
+
+RUN=$(date +%Y-%m-%dT%H:%M:%S)
+REV=$(cd "$RT" && git rev-parse --short HEAD 2>/dev/null) || REV=unknown
+
+quote()
+# $1 as a JSON string
+{
+	printf '"%s"' "$(printf '%s' "$1" | head -1 | sed 's/\\/\\\\/g; s/"/\\"/g; s/	/ /g')"
+}
+
+printf '%-10s %10s %10s %10s %10s %9s  %s\n' program js2cpp-ms compile-ms bytes run-ms peak-KB status
+for js in "$BENCH"/corpus/*.js "$RT/utils.js"; do
+	name=$(basename "$js" .js)
+	dir=$TMP/$name
+	mkdir "$dir" && cp "$js" "$dir/" || exit 1
+	cd "$dir" || exit 1
+	status=ok
+	error=
+	fields=
+	cms=- bytes=- runms=- runkb=-
+
+	"$TMP/runstat" stat "$JS2CPP" "$name.js" > js2cpp.log 2>&1
+	read jms jkb rc < stat
+	fields="\"js2cpp_ms\": $jms, \"js2cpp_kb\": $jkb"
+	if [ "$rc" != 0 ] || grep -q " [1-9][0-9]* error(s)" js2cpp.log || [ ! -s "$name.cpp" ]; then
+		status="js2cpp failed ($rc)"
+		error=$(grep -E "error [0-9]+:|Assertion|rror:" js2cpp.log | head -1)
+	else
+		"$TMP/runstat" stat $CXX $CXXFLAGS -I"$RT" -o "$name" "$name.cpp" "$TMP"/*.o -lpthread > cc.log 2>&1
+		read cms ckb rc < stat
+		fields="$fields, \"compile_ms\": $cms, \"compile_kb\": $ckb"
+		if [ "$rc" != 0 ]; then
+			status="compile failed ($rc)"
+			error=$(grep -i "error" cc.log | head -1)
+		else
+			bytes=$(wc -c < "$name" | tr -d ' ')
+			fields="$fields, \"binary_bytes\": $bytes"
+			i=0
+			while [ $i -lt "$RUNS" ]; do
+				"$TMP/runstat" stat "./$name" > out.txt 2> err.txt
+				read ms kb rc < stat
+				if [ "$rc" != 0 ]; then
+					status="run failed ($rc)"
+					error=$(head -1 err.txt)
+					break
+				fi
+				if [ "$runms" = - ] || [ "$(echo "$ms < $runms" | awk '{ print ($1 < $3) }')" = 1 ]; then
+					runms=$ms
+				fi
+				if [ "$runkb" = - ] || [ "$kb" -gt "$runkb" ]; then
+					runkb=$kb
+				fi
+				i=$((i+1))
+			done
+			if [ "$status" = ok ]; then
+				fields="$fields, \"run_ms\": $runms, \"run_kb\": $runkb, \"output\": $(quote "$(head -1 out.txt)")"
+			fi
+		fi
+	fi
+	if [ -n "$error" ]; then
+		fields="$fields, \"error\": $(quote "$error")"
+	fi
+	printf '{"run": "%s", "rev": "%s", "cxx": %s, "program": "%s", "status": "%s", %s}\n' \
+		"$RUN" "$REV" "$(quote "$CXX $CXXFLAGS")" "$name" "$status" "$fields" >> "$HISTORY"
+	printf '%-10s %10s %10s %10s %10s %9s  %s\n' "$name" "$jms" "$cms" "$bytes" "$runms" "$runkb" "$status"
+	cd "$TMP" || exit 1
+done
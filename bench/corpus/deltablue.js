@@ -0,0 +1,715 @@
+// deltablue.js - the DeltaBlue incremental constraint solver (Freeman-
+// Benson and Maloney), after the version in the V8 benchmark suite:
+// the chain and projection tests. A class hierarchy with virtual
+// methods, many small objects and collections of them.
+//
+// Written for what js2cpp compiles today: subclasses get their
+// prototype from an instance of the base (no Function.prototype.call
+// for super calls, so constructors initialize the base fields with a
+// helper), OrderedCollection keeps its own count instead of using
+// push and splice, and there is no ?:, do-while or <=.
+
+/////////////////////////////////////////////////////////////////////
+// OrderedCollection
+
+function OrderedCollection()
+{
+	this.elms = new Array();
+	this.count = 0;
+}
+
+OrderedCollection.prototype.add = function(elm)
+{
+	this.elms[this.count] = elm;
+	this.count++;
+}
+
+OrderedCollection.prototype.at = function(index)
+{
+	return this.elms[index];
+}
+
+OrderedCollection.prototype.size = function()
+{
+	return this.count;
+}
+
+OrderedCollection.prototype.removeFirst = function()
+{
+	var first = this.elms[0];
+	for (var i = 1; i < this.count; i++) {
+		this.elms[i - 1] = this.elms[i];
+	}
+	this.count--;
+	this.elms[this.count] = null;
+	return first;
+}
+
+OrderedCollection.prototype.remove = function(elm)
+{
+	var index = 0;
+	for (var i = 0; i < this.count; i++) {
+		var value = this.elms[i];
+		if (value != elm) {
+			this.elms[index] = value;
+			index++;
+		}
+	}
+	for (var j = index; j < this.count; j++) {
+		this.elms[j] = null;
+	}
+	this.count = index;
+}
+
+/////////////////////////////////////////////////////////////////////
+// Strength
+
+function Strength(strengthValue, name)
+{
+	this.strengthValue = strengthValue;
+	this.name = name;
+}
+
+function stronger(s1, s2)
+{
+	return s1.strengthValue < s2.strengthValue;
+}
+
+function weaker(s1, s2)
+{
+	return s1.strengthValue > s2.strengthValue;
+}
+
+function weakestOf(s1, s2)
+{
+	if (weaker(s1, s2)) {
+		return s1;
+	}
+	return s2;
+}
+
+var REQUIRED = new Strength(0, "required");
+var STRONG_PREFERRED = new Strength(1, "strongPreferred");
+var PREFERRED = new Strength(2, "preferred");
+var STRONG_DEFAULT = new Strength(3, "strongDefault");
+var NORMAL = new Strength(4, "normal");
+var WEAK_DEFAULT = new Strength(5, "weakDefault");
+var WEAKEST = new Strength(6, "weakest");
+
+Strength.prototype.nextWeaker = function()
+{
+	var v = this.strengthValue;
+	if (v == 0) return STRONG_PREFERRED;
+	if (v == 1) return PREFERRED;
+	if (v == 2) return STRONG_DEFAULT;
+	if (v == 3) return NORMAL;
+	if (v == 4) return WEAK_DEFAULT;
+	return WEAKEST;
+}
+
+/////////////////////////////////////////////////////////////////////
+// Constraint
+
+function Constraint()
+{
+}
+
+Constraint.prototype.addConstraint = function()
+{
+	this.addToGraph();
+	planner.incrementalAdd(this);
+}
+
+Constraint.prototype.satisfy = function(mark)
+{
+	this.chooseMethod(mark);
+	if (!this.isSatisfied()) {
+		if (this.strength == REQUIRED) {
+			console.log("Could not satisfy a required constraint!");
+		}
+		return null;
+	}
+	this.markInputs(mark);
+	var out = this.output();
+	var overridden = out.determinedBy;
+	if (overridden != null) {
+		overridden.markUnsatisfied();
+	}
+	out.determinedBy = this;
+	if (!planner.addPropagate(this, mark)) {
+		console.log("Cycle encountered");
+	}
+	out.mark = mark;
+	return overridden;
+}
+
+Constraint.prototype.destroyConstraint = function()
+{
+	if (this.isSatisfied()) {
+		planner.incrementalRemove(this);
+	} else {
+		this.removeFromGraph();
+	}
+}
+
+Constraint.prototype.isInput = function()
+{
+	return false;
+}
+
+/////////////////////////////////////////////////////////////////////
+// UnaryConstraint
+
+function initUnary(c, v, strength)
+{
+	c.strength = strength;
+	c.myOutput = v;
+	c.satisfied = false;
+	c.addConstraint();
+}
+
+function UnaryConstraint()
+{
+}
+
+UnaryConstraint.prototype = new Constraint();
+
+UnaryConstraint.prototype.addToGraph = function()
+{
+	this.myOutput.addConstraint(this);
+	this.satisfied = false;
+}
+
+UnaryConstraint.prototype.chooseMethod = function(mark)
+{
+	this.satisfied = (this.myOutput.mark != mark) &&
+		stronger(this.strength, this.myOutput.walkStrength);
+}
+
+UnaryConstraint.prototype.isSatisfied = function()
+{
+	return this.satisfied;
+}
+
+UnaryConstraint.prototype.markInputs = function(mark)
+{
+	// has no inputs
+}
+
+UnaryConstraint.prototype.output = function()
+{
+	return this.myOutput;
+}
+
+UnaryConstraint.prototype.recalculate = function()
+{
+	this.myOutput.walkStrength = this.strength;
+	this.myOutput.stay = !this.isInput();
+	if (this.myOutput.stay) {
+		this.execute();
+	}
+}
+
+UnaryConstraint.prototype.markUnsatisfied = function()
+{
+	this.satisfied = false;
+}
+
+UnaryConstraint.prototype.inputsKnown = function()
+{
+	return true;
+}
+
+UnaryConstraint.prototype.removeFromGraph = function()
+{
+	if (this.myOutput != null) {
+		this.myOutput.removeConstraint(this);
+	}
+	this.satisfied = false;
+}
+
+/////////////////////////////////////////////////////////////////////
+// StayConstraint, EditConstraint
+
+function StayConstraint(v, str)
+{
+	initUnary(this, v, str);
+}
+
+StayConstraint.prototype = new UnaryConstraint();
+
+StayConstraint.prototype.execute = function()
+{
+	// stay constraints do nothing
+}
+
+function EditConstraint(v, str)
+{
+	initUnary(this, v, str);
+}
+
+EditConstraint.prototype = new UnaryConstraint();
+
+EditConstraint.prototype.isInput = function()
+{
+	return true;
+}
+
+EditConstraint.prototype.execute = function()
+{
+	// edit constraints do nothing
+}
+
+/////////////////////////////////////////////////////////////////////
+// BinaryConstraint
+
+var NONE = 0;
+var FORWARD = 1;
+var BACKWARD = 2;
+
+function initBinary(c, var1, var2, strength)
+{
+	c.strength = strength;
+	c.v1 = var1;
+	c.v2 = var2;
+	c.direction = NONE;
+}
+
+function BinaryConstraint()
+{
+}
+
+BinaryConstraint.prototype = new Constraint();
+
+BinaryConstraint.prototype.chooseMethod = function(mark)
+{
+	if (this.v1.mark == mark) {
+		this.direction = NONE;
+		if (this.v2.mark != mark && stronger(this.strength, this.v2.walkStrength)) {
+			this.direction = FORWARD;
+		}
+	}
+	if (this.v2.mark == mark) {
+		this.direction = NONE;
+		if (this.v1.mark != mark && stronger(this.strength, this.v1.walkStrength)) {
+			this.direction = BACKWARD;
+		}
+	}
+	if (weaker(this.v1.walkStrength, this.v2.walkStrength)) {
+		this.direction = NONE;
+		if (stronger(this.strength, this.v1.walkStrength)) {
+			this.direction = BACKWARD;
+		}
+	} else {
+		this.direction = BACKWARD;
+		if (stronger(this.strength, this.v2.walkStrength)) {
+			this.direction = FORWARD;
+		}
+	}
+}
+
+BinaryConstraint.prototype.addToGraph = function()
+{
+	this.v1.addConstraint(this);
+	this.v2.addConstraint(this);
+	this.direction = NONE;
+}
+
+BinaryConstraint.prototype.isSatisfied = function()
+{
+	return this.direction != NONE;
+}
+
+BinaryConstraint.prototype.markInputs = function(mark)
+{
+	this.input().mark = mark;
+}
+
+BinaryConstraint.prototype.input = function()
+{
+	if (this.direction == FORWARD) {
+		return this.v1;
+	}
+	return this.v2;
+}
+
+BinaryConstraint.prototype.output = function()
+{
+	if (this.direction == FORWARD) {
+		return this.v2;
+	}
+	return this.v1;
+}
+
+BinaryConstraint.prototype.recalculate = function()
+{
+	var ihn = this.input();
+	var out = this.output();
+	out.walkStrength = weakestOf(this.strength, ihn.walkStrength);
+	out.stay = ihn.stay;
+	if (out.stay) {
+		this.execute();
+	}
+}
+
+BinaryConstraint.prototype.markUnsatisfied = function()
+{
+	this.direction = NONE;
+}
+
+BinaryConstraint.prototype.inputsKnown = function(mark)
+{
+	var i = this.input();
+	return i.mark == mark || i.stay || i.determinedBy == null;
+}
+
+BinaryConstraint.prototype.removeFromGraph = function()
+{
+	if (this.v1 != null) {
+		this.v1.removeConstraint(this);
+	}
+	if (this.v2 != null) {
+		this.v2.removeConstraint(this);
+	}
+	this.direction = NONE;
+}
+
+/////////////////////////////////////////////////////////////////////
+// ScaleConstraint: v2 = v1 * scale + offset
+
+function ScaleConstraint(src, scale, offset, dest, strength)
+{
+	this.direction = NONE;
+	this.scale = scale;
+	this.offset = offset;
+	initBinary(this, src, dest, strength);
+	this.addConstraint();
+}
+
+ScaleConstraint.prototype = new BinaryConstraint();
+
+ScaleConstraint.prototype.addToGraph = function()
+{
+	this.v1.addConstraint(this);
+	this.v2.addConstraint(this);
+	this.scale.addConstraint(this);
+	this.offset.addConstraint(this);
+	this.direction = NONE;
+}
+
+ScaleConstraint.prototype.removeFromGraph = function()
+{
+	if (this.v1 != null) this.v1.removeConstraint(this);
+	if (this.v2 != null) this.v2.removeConstraint(this);
+	if (this.scale != null) this.scale.removeConstraint(this);
+	if (this.offset != null) this.offset.removeConstraint(this);
+	this.direction = NONE;
+}
+
+ScaleConstraint.prototype.markInputs = function(mark)
+{
+	this.input().mark = mark;
+	this.scale.mark = mark;
+	this.offset.mark = mark;
+}
+
+ScaleConstraint.prototype.execute = function()
+{
+	if (this.direction == FORWARD) {
+		this.v2.value = this.v1.value * this.scale.value + this.offset.value;
+	} else {
+		this.v1.value = (this.v2.value - this.offset.value) / this.scale.value;
+	}
+}
+
+ScaleConstraint.prototype.recalculate = function()
+{
+	var ihn = this.input();
+	var out = this.output();
+	out.walkStrength = weakestOf(this.strength, ihn.walkStrength);
+	out.stay = ihn.stay && this.scale.stay && this.offset.stay;
+	if (out.stay) {
+		this.execute();
+	}
+}
+
+/////////////////////////////////////////////////////////////////////
+// EqualityConstraint: v1 == v2
+
+function EqualityConstraint(var1, var2, strength)
+{
+	initBinary(this, var1, var2, strength);
+	this.addConstraint();
+}
+
+EqualityConstraint.prototype = new BinaryConstraint();
+
+EqualityConstraint.prototype.execute = function()
+{
+	this.output().value = this.input().value;
+}
+
+/////////////////////////////////////////////////////////////////////
+// Variable
+
+function Variable(name, initialValue)
+{
+	this.value = initialValue;
+	this.constraints = new OrderedCollection();
+	this.determinedBy = null;
+	this.mark = 0;
+	this.walkStrength = WEAKEST;
+	this.stay = true;
+	this.name = name;
+}
+
+Variable.prototype.addConstraint = function(c)
+{
+	this.constraints.add(c);
+}
+
+Variable.prototype.removeConstraint = function(c)
+{
+	this.constraints.remove(c);
+	if (this.determinedBy == c) {
+		this.determinedBy = null;
+	}
+}
+
+/////////////////////////////////////////////////////////////////////
+// Planner
+
+function Planner()
+{
+	this.currentMark = 0;
+}
+
+Planner.prototype.incrementalAdd = function(c)
+{
+	var mark = this.newMark();
+	var overridden = c.satisfy(mark);
+	while (overridden != null) {
+		overridden = overridden.satisfy(mark);
+	}
+}
+
+Planner.prototype.incrementalRemove = function(c)
+{
+	var out = c.output();
+	c.markUnsatisfied();
+	c.removeFromGraph();
+	var unsatisfied = this.removePropagateFrom(out);
+	var strength = REQUIRED;
+	while (strength != WEAKEST) {
+		for (var i = 0; i < unsatisfied.size(); i++) {
+			var u = unsatisfied.at(i);
+			if (u.strength == strength) {
+				this.incrementalAdd(u);
+			}
+		}
+		strength = strength.nextWeaker();
+	}
+}
+
+Planner.prototype.newMark = function()
+{
+	this.currentMark++;
+	return this.currentMark;
+}
+
+Planner.prototype.makePlan = function(sources)
+{
+	var mark = this.newMark();
+	var plan = new Plan();
+	var todo = sources;
+	while (todo.size() > 0) {
+		var c = todo.removeFirst();
+		if (c.output().mark != mark && c.inputsKnown(mark)) {
+			plan.addConstraint(c);
+			c.output().mark = mark;
+			this.addConstraintsConsumingTo(c.output(), todo);
+		}
+	}
+	return plan;
+}
+
+Planner.prototype.extractPlanFromConstraints = function(constraints)
+{
+	var sources = new OrderedCollection();
+	for (var i = 0; i < constraints.size(); i++) {
+		var c = constraints.at(i);
+		if (c.isInput() && c.isSatisfied()) {
+			sources.add(c);
+		}
+	}
+	return this.makePlan(sources);
+}
+
+Planner.prototype.addPropagate = function(c, mark)
+{
+	var todo = new OrderedCollection();
+	todo.add(c);
+	while (todo.size() > 0) {
+		var d = todo.removeFirst();
+		if (d.output().mark == mark) {
+			this.incrementalRemove(c);
+			return false;
+		}
+		d.recalculate();
+		this.addConstraintsConsumingTo(d.output(), todo);
+	}
+	return true;
+}
+
+Planner.prototype.removePropagateFrom = function(out)
+{
+	out.determinedBy = null;
+	out.walkStrength = WEAKEST;
+	out.stay = true;
+	var unsatisfied = new OrderedCollection();
+	var todo = new OrderedCollection();
+	todo.add(out);
+	while (todo.size() > 0) {
+		var v = todo.removeFirst();
+		for (var i = 0; i < v.constraints.size(); i++) {
+			var c = v.constraints.at(i);
+			if (!c.isSatisfied()) {
+				unsatisfied.add(c);
+			}
+		}
+		var determining = v.determinedBy;
+		for (var j = 0; j < v.constraints.size(); j++) {
+			var next = v.constraints.at(j);
+			if (next != determining && next.isSatisfied()) {
+				next.recalculate();
+				todo.add(next.output());
+			}
+		}
+	}
+	return unsatisfied;
+}
+
+Planner.prototype.addConstraintsConsumingTo = function(v, coll)
+{
+	var determining = v.determinedBy;
+	var cc = v.constraints;
+	for (var i = 0; i < cc.size(); i++) {
+		var c = cc.at(i);
+		if (c != determining && c.isSatisfied()) {
+			coll.add(c);
+		}
+	}
+}
+
+/////////////////////////////////////////////////////////////////////
+// Plan
+
+function Plan()
+{
+	this.v = new OrderedCollection();
+}
+
+Plan.prototype.addConstraint = function(c)
+{
+	this.v.add(c);
+}
+
+Plan.prototype.size = function()
+{
+	return this.v.size();
+}
+
+Plan.prototype.constraintAt = function(index)
+{
+	return this.v.at(index);
+}
+
+Plan.prototype.execute = function()
+{
+	for (var i = 0; i < this.size(); i++) {
+		this.constraintAt(i).execute();
+	}
+}
+
+/////////////////////////////////////////////////////////////////////
+// The tests
+
+var planner = null;
+var failures = 0;
+
+function chainTest(n)
+{
+	planner = new Planner();
+	var prev = null;
+	var first = null;
+	var last = null;
+	for (var i = 0; i < n + 1; i++) {
+		var v = new Variable("v", 0);
+		if (prev != null) {
+			new EqualityConstraint(prev, v, REQUIRED);
+		}
+		if (i == 0) first = v;
+		if (i == n) last = v;
+		prev = v;
+	}
+	new StayConstraint(last, STRONG_DEFAULT);
+	var edit = new EditConstraint(first, PREFERRED);
+	var edits = new OrderedCollection();
+	edits.add(edit);
+	var plan = planner.extractPlanFromConstraints(edits);
+	for (var j = 0; j < 100; j++) {
+		first.value = j;
+		plan.execute();
+		if (last.value != j) {
+			failures++;
+		}
+	}
+}
+
+function change(v, newValue)
+{
+	var edit = new EditConstraint(v, PREFERRED);
+	var edits = new OrderedCollection();
+	edits.add(edit);
+	var plan = planner.extractPlanFromConstraints(edits);
+	for (var i = 0; i < 10; i++) {
+		v.value = newValue;
+		plan.execute();
+	}
+	edit.destroyConstraint();
+}
+
+function projectionTest(n)
+{
+	planner = new Planner();
+	var scale = new Variable("scale", 10);
+	var offset = new Variable("offset", 1000);
+	var src = null;
+	var dst = null;
+	var dests = new OrderedCollection();
+	for (var i = 0; i < n; i++) {
+		src = new Variable("src", i);
+		dst = new Variable("dst", i);
+		dests.add(dst);
+		new StayConstraint(src, NORMAL);
+		new ScaleConstraint(src, scale, offset, dst, REQUIRED);
+	}
+	change(src, 17);
+	if (dst.value != 1170) failures++;
+	change(dst, 1050);
+	if (src.value != 5) failures++;
+	change(scale, 5);
+	for (var j = 0; j < n - 1; j++) {
+		if (dests.at(j).value != j * 5 + 1000) failures++;
+	}
+	change(offset, 2000);
+	for (var k = 0; k < n - 1; k++) {
+		if (dests.at(k).value != k * 5 + 2000) failures++;
+	}
+}
+
+for (var r = 0; r < 50; r++) {
+	chainTest(100);
+	projectionTest(100);
+}
+console.log("deltablue", failures == 0);
@@ -0,0 +1,68 @@
+// json.js - munging JSON-like data: records made from literals,
+// written out with JSON.stringify, read back with JSON.parse, then
+// filtered, grouped and summarized into a report that is written
+// out again.
+
+var REGIONS = ["north", "south", "east", "west", "central"];
+
+function makeOrders(n)
+{
+	var orders = new Array();
+	for (var i = 0; i < n; i++) {
+		orders[i] = {
+			id: i,
+			customer: "c" + (i % 97),
+			region: REGIONS[i % 5],
+			items: [ { sku: "s" + (i % 13), qty: 1 + i % 4, price: 2.5 + i % 10 },
+					 { sku: "s" + (i % 7), qty: 1 + i % 3, price: 1.25 + i % 5 } ],
+			paid: i % 3 != 0
+		};
+	}
+	return orders;
+}
+
+function orderTotal(order)
+{
+	var total = 0;
+	for (var i = 0; i < order.items.length; i++) {
+		var item = order.items[i];
+		total = total + item.qty * item.price;
+	}
+	return total;
+}
+
+function summarize(orders)
+{
+	var byRegion = {};
+	var count = 0;
+	for (var i = 0; i < orders.length; i++) {
+		var o = orders[i];
+		if (o.paid) {
+			var r = byRegion[o.region];
+			if (r == undefined) {
+				r = { region: o.region, orders: 0, revenue: 0 };
+				byRegion[o.region] = r;
+			}
+			r.orders = r.orders + 1;
+			r.revenue = r.revenue + orderTotal(o);
+			count++;
+		}
+	}
+	var report = { paid: count, regions: new Array() };
+	for (var k = 0; k < REGIONS.length; k++) {
+		report.regions[k] = byRegion[REGIONS[k]];
+	}
+	return report;
+}
+
+var text = JSON.stringify(makeOrders(5000));
+var size = 0;
+var revenue = 0;
+for (var r = 0; r < 10; r++) {
+	var orders = JSON.parse(text);
+	var report = summarize(orders);
+	var out = JSON.stringify(report);
+	size = size + text.length + out.length;
+	revenue = revenue + JSON.parse(out).regions[0].revenue;
+}
+console.log("json", size, revenue);
@@ -0,0 +1,119 @@
+// oo.js - property-heavy object-oriented code: records with many
+// fields, methods on prototypes reading and writing them, objects
+// made from literals, and properties looked up by computed keys.
+
+function Account(id, owner)
+{
+	this.id = id;
+	this.owner = owner;
+	this.balance = 0;
+	this.deposits = 0;
+	this.withdrawals = 0;
+	this.fees = 0;
+	this.interest = 0;
+	this.frozen = false;
+	this.history = new Array();
+	this.historyLength = 0;
+}
+
+Account.prototype.record = function(kind, amount)
+{
+	this.history[this.historyLength] = { kind: kind, amount: amount, balance: this.balance };
+	this.historyLength++;
+}
+
+Account.prototype.deposit = function(amount)
+{
+	if (this.frozen) {
+		return false;
+	}
+	this.balance = this.balance + amount;
+	this.deposits = this.deposits + amount;
+	this.record("deposit", amount);
+	return true;
+}
+
+Account.prototype.withdraw = function(amount)
+{
+	if (this.frozen || amount > this.balance) {
+		this.fees = this.fees + 1;
+		this.balance = this.balance - 1;
+		return false;
+	}
+	this.balance = this.balance - amount;
+	this.withdrawals = this.withdrawals + amount;
+	this.record("withdraw", amount);
+	return true;
+}
+
+Account.prototype.accrue = function(rate)
+{
+	var i = this.balance * rate;
+	this.interest = this.interest + i;
+	this.balance = this.balance + i;
+}
+
+function Bank()
+{
+	this.accounts = new Array();
+	this.count = 0;
+	this.byOwner = {};
+	this.stats = { opened: 0, transfers: 0, failed: 0 };
+}
+
+Bank.prototype.open = function(owner)
+{
+	var a = new Account(this.count, owner);
+	this.accounts[this.count] = a;
+	this.count++;
+	this.byOwner["owner:" + owner] = a;
+	this.stats.opened = this.stats.opened + 1;
+	return a;
+}
+
+Bank.prototype.transfer = function(from, to, amount)
+{
+	if (from.withdraw(amount)) {
+		to.deposit(amount);
+		this.stats.transfers = this.stats.transfers + 1;
+	} else {
+		this.stats.failed = this.stats.failed + 1;
+	}
+}
+
+Bank.prototype.find = function(owner)
+{
+	return this.byOwner["owner:" + owner];
+}
+
+Bank.prototype.total = function()
+{
+	var sum = 0;
+	for (var i = 0; i < this.count; i++) {
+		sum = sum + this.accounts[i].balance;
+	}
+	return sum;
+}
+
+function run()
+{
+	var bank = new Bank();
+	var n = 200;
+	for (var i = 0; i < n; i++) {
+		bank.open("p" + i).deposit(1000 + i);
+	}
+	for (var t = 0; t < 100000; t++) {
+		var from = bank.find("p" + (t * 7 % n));
+		var to = bank.find("p" + (t * 13 % n));
+		bank.transfer(from, to, t % 50);
+		if (t % 1000 == 0) {
+			for (var k = 0; k < bank.count; k++) {
+				bank.accounts[k].accrue(0.001);
+			}
+		}
+	}
+	return bank;
+}
+
+var bank = run();
+console.log("oo", Math.round(bank.total()), bank.stats.transfers, bank.stats.failed);
@@ -0,0 +1,58 @@
+// strings.js - building strings: concatenation in loops, numbers to
+// text, and taking the text apart again with split and replace.
+// String allocation and copying dominate.
+
+function csvLine(i)
+{
+	var line = "row" + i;
+	for (var c = 0; c < 8; c++) {
+		line = line + "," + (i * 8 + c) * 0.25;
+	}
+	return line;
+}
+
+function buildTable(rows)
+{
+	var text = "";
+	for (var i = 0; i < rows; i++) {
+		text += csvLine(i);
+		text += "\n";
+	}
+	return text;
+}
+
+function sumFields(text)
+{
+	var lines = text.split("\n");
+	var sum = 0;
+	for (var i = 0; i < lines.length; i++) {
+		var fields = lines[i].split(",");
+		for (var j = 1; j < fields.length; j++) {
+			sum = sum + 1 * fields[j];		// (no Number() yet)
+		}
+	}
+	return sum;
+}
+
+function escapeHtml(s)
+{
+	return s.replace(/&/g, "&amp;").replace(/</g, "&lt;").replace(/>/g, "&gt;");
+}
+
+function page(n)
+{
+	var html = "<ul>";
+	for (var i = 0; i < n; i++) {
+		html = html + "<li class=\"item\">" + escapeHtml("a < b & c > d " + i) + "</li>";
+	}
+	return html + "</ul>";
+}
+
+var total = 0;
+var length = 0;
+for (var r = 0; r < 20; r++) {
+	var table = buildTable(500);
+	total = total + sumFields(table);
+	length = length + table.length + page(500).length;
+}
+console.log("strings", total, length);
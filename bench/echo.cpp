@@ -0,0 +1,192 @@
+// echo.cpp - event loop round trips over loopback
+//
+// An echo server and its clients on one loop, through jsevent.cpp's
+// C interface: each client sends a message, waits for all of it to
+// come back, and sends the next. Reports round trips per second, and
+// how many times a 1 ms interval timer got to run meanwhile.
+//
+// Build it against the runtime (for 32-bit x86, see corpus.sh), e.g.
+//	g++ -m32 -std=c++11 -O2 -I.. echo.cpp ../jscpprt.cpp ../jsatom.cpp ../jsjson.cpp ../jstyped.cpp ../jsmath.cpp
+//		../jsregex.cpp ../jsregexp.cpp ../jsevent.cpp ../jsconsole.cpp ../jsisolate.cpp ../jsparallel.cpp
+//		-lpthread
+// usage: echo [connections] [round trips per connection] [message bytes]
+
+#ifdef _WIN32
+#include "windows.h"
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifndef _WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#define closesocket close
+#endif
+#include "jscpprt.h"
+
+static int nconns, ntrips, msglen;
+static char* message;
+static int done;			// clients finished
+static long ticks;
+static timer_* ticker;
+static int listener;
+static watcher_* listenw;
+
+static void Setup(int fd)
+{
+#ifdef _WIN32
+	unsigned long on = 1;
+	ioctlsocket(fd, FIONBIO, &on);
+#else
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+#endif
+	int one = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (const char*)&one, sizeof one);
+}
+
+// server side: send back whatever comes in
+static void OnEcho(int fd, int events, void* context)
+{
+	char buf[65536];
+	int n = recv(fd, buf, sizeof buf, 0);
+	if (n <= 0) {
+		unwatch_(*(watcher_**)context);
+		closesocket(fd);
+		return;
+	}
+	for (int sent = 0; sent < n; ) {
+		int k = send(fd, buf + sent, n - sent, 0);
+		if (k > 0) {
+			sent += k;
+		}
+	}
+}
+
+static void OnAccept(int fd, int events, void* context)
+{
+	int s;
+	while ((s = accept(fd, NULL, NULL)) >= 0) {
+		Setup(s);
+		watcher_** w = new watcher_*;		// OnEcho's context, to unwatch itself
+		*w = watch_(s, OnEcho, w);
+		watchevents_(*w, IO_READ);
+	}
+}
+
+// client side
+struct client_
+{
+	int			fd;
+	watcher_*	w;
+	int			trips;		// completed
+	int			got;		// bytes of the current echo
+};
+
+static void Finish(void)
+{
+	if (++done == nconns) {
+		unwatch_(listenw);
+		closesocket(listener);
+		cleartimer_(ticker);
+	}
+}
+
+static void OnClient(int fd, int events, void* context)
+{
+	client_* c = (client_*)context;
+	char buf[65536];
+	int n = recv(fd, buf, sizeof buf, 0);
+	if (n <= 0) {
+		return;
+	}
+	c->got += n;
+	if (c->got < msglen) {
+		return;
+	}
+	c->got = 0;
+	if (++c->trips == ntrips) {
+		unwatch_(c->w);
+		closesocket(fd);
+		Finish();
+		return;
+	}
+	send(fd, message, msglen, 0);
+}
+
+static double Seconds(void)
+// wall clock
+{
+#ifdef _WIN32
+	return GetTickCount() / 1000.0;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+#endif
+}
+
+static void OnTick(void* context)
+{
+	ticks++;
+}
+
+int main(int argc, char* argv[])
+{
+	nconns = argc > 1 ? atoi(argv[1]) : 16;
+	ntrips = argc > 2 ? atoi(argv[2]) : 20000;
+	msglen = argc > 3 ? atoi(argv[3]) : 64;
+	message = (char*)malloc(msglen);
+	memset(message, 'x', msglen);
+#ifdef _WIN32
+	WSADATA wsa;
+	WSAStartup(MAKEWORD(1, 1), &wsa);
+#endif
+
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof addr);
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = 0;
+	listener = socket(AF_INET, SOCK_STREAM, 0);
+	if (bind(listener, (struct sockaddr*)&addr, sizeof addr) < 0 || listen(listener, 128) < 0) {
+		perror("listen");
+		return 1;
+	}
+#ifdef _WIN32
+	int alen = sizeof addr;
+#else
+	socklen_t alen = sizeof addr;
+#endif
+	getsockname(listener, (struct sockaddr*)&addr, &alen);
+	Setup(listener);
+	listenw = watch_(listener, OnAccept, NULL);
+	watchevents_(listenw, IO_READ);
+
+	for (int i = 0; i < nconns; i++) {
+		client_* c = new client_;
+		c->fd = socket(AF_INET, SOCK_STREAM, 0);
+		if (connect(c->fd, (struct sockaddr*)&addr, sizeof addr) < 0) {
+			perror("connect");
+			return 1;
+		}
+		Setup(c->fd);
+		c->trips = c->got = 0;
+		c->w = watch_(c->fd, OnClient, c);
+		watchevents_(c->w, IO_READ);
+		send(c->fd, message, msglen, 0);
+	}
+	ticker = settimer_(1, 1, OnTick, NULL);
+
+	double t0 = Seconds();
+	runloop_();
+	double secs = Seconds() - t0;
+	long trips = (long)nconns * ntrips;
+	printf("echo: %d connections, %d-byte messages\n", nconns, msglen);
+	printf("  %ld round trips in %.2f s, %.0f/s, %ld timer ticks\n", trips, secs, trips / secs, ticks);
+	return 0;
+}
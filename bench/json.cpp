@@ -0,0 +1,75 @@
+// json.cpp - JSON.parse / JSON.stringify throughput
+//
+// Builds a document of about MB megabytes - an array of records with
+// the same keys, numbers, strings with and without escapes, nested
+// arrays - and reports MB/s for parsing it and for writing it back.
+//
+// Build it against the runtime, e.g.
+//	cl /O2 /EHsc /I.. json.cpp ..\jscpprt.cpp ..\jsatom.cpp ..\jsjson.cpp ..\jstyped.cpp ..\jsmath.cpp ..\jsregex.cpp ..\jsregexp.cpp ..\jsconsole.cpp
+//		..\jsevent.cpp ..\jsisolate.cpp ..\jsparallel.cpp
+// usage: json [MB] [runs]
+
+#ifdef _WIN32
+#include "windows.h"
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "jscpprt.h"
+
+static char* MakeDocument(int bytes, int& len)
+{
+	int cap = bytes + 4096;
+	char* doc = (char*)malloc(cap);
+	len = 0;
+	doc[len++] = '[';
+	for (int i = 0; len < bytes; i++) {
+		if (i) {
+			doc[len++] = ',';
+		}
+		len += sprintf(doc + len,
+			"{\"id\":%d,\"name\":\"record number %d\",\"price\":%d.%02d,"
+			"\"ratio\":%.6f,\"active\":%s,\"tags\":[\"red\",\"green\",\"blue\"],"
+			"\"note\":\"line one\\nline \\\"two\\\"\",\"pos\":{\"x\":%d,\"y\":-%d}}",
+			i, i, i % 1000, i % 100, i / 7.0, (i & 1) ? "true" : "false", i * 3, i % 17);
+		if (len + 512 > cap) {
+			break;
+		}
+	}
+	doc[len++] = ']';
+	doc[len] = 0;
+	return doc;
+}
+
+static double Seconds(clock_t t0)
+{
+	return (double)(clock() - t0) / CLOCKS_PER_SEC;
+}
+
+int main(int argc, char* argv[])
+{
+	int mb = argc > 1 ? atoi(argv[1]) : 16;
+	int runs = argc > 2 ? atoi(argv[2]) : 5;
+	int len;
+	char* doc = MakeDocument(mb << 20, len);
+	value_ v;
+	clock_t t0 = clock();
+	int r;
+	for (r = 0; r < runs; r++) {
+		v = JSON_parse_(doc, len);
+	}
+	double parse = Seconds(t0);
+	value_ text;
+	t0 = clock();
+	for (r = 0; r < runs; r++) {
+		text = JSON_stringify_(v);
+	}
+	double stringify = Seconds(t0);
+	int outlen = strlen(text.v.s);
+	printf("json: %.1f MB document, %d runs\n", len / 1048576.0, runs);
+	printf("  parse      %8.1f MB/s\n", runs * (len / 1048576.0) / parse);
+	printf("  stringify  %8.1f MB/s (%.1f MB out)\n", runs * (outlen / 1048576.0) / stringify, outlen / 1048576.0);
+	free(doc);
+	return 0;
+}
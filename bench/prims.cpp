@@ -0,0 +1,466 @@
+// prims.cpp - microbenchmarks of the runtime's primitives
+//
+// Each benchmark does one operation n times, on values set up beforehand;
+// n is doubled until a run takes MS milliseconds, then RUNS runs are
+// timed and the median and fastest ns per operation reported. Results
+// go to stdout as JSON, to keep and compare across runtime changes;
+// progress goes to stderr.
+//
+// The runtime has no Array.prototype.push of its own: "push" is
+// a[a.length] = v, which is what atref does past the end.
+//
+// Build it against the runtime (for 32-bit x86, see corpus.sh), e.g.
+//	g++ -m32 -std=c++11 -O2 -I.. prims.cpp ../jscpprt.cpp ../jsatom.cpp ../jsjson.cpp ../jstyped.cpp ../jsmath.cpp
+//		../jsregex.cpp ../jsregexp.cpp ../jsevent.cpp ../jsconsole.cpp ../jsfs.cpp ../jsisolate.cpp
+//		../jsparallel.cpp ../jsstats.cpp ../jsheap.cpp ../jsinstr.cpp ../jsfeedback.cpp -lpthread
+// usage: prims [name prefix] [MS] [RUNS] > prims.json
+
+#ifdef _WIN32
+#include "windows.h"
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include "jscpprt.h"
+#include "jsrtpriv.h"
+#include "sugar.h"
+#include "version.h"
+
+#define MAXPROPS	64
+#define MAXRUNS		31
+
+// results go somewhere the compiler can't see through
+static value_			sink[64];
+static volatile double	dsink;
+
+static value_			nums[64];		// 0.5, 1.5, ...
+static value_			strs[64];		// "s0", "s1", ... (not atoms)
+static value_			numstrs[64];	// "0.5", "1.5", ...
+static const char*		ids[MAXPROPS];	// atoms "p0", "p1", ...
+static value_			keys[MAXPROPS];	// the same, as values
+static value_			obj;			// props properties, in the property list
+static value_			shaped;			// props properties, in slots
+static shape_			shape;
+static value_			arr;			// 1024 numbers
+static int				props;			// for the current dot/at benchmark
+static int				arity;			// for the current call benchmark
+
+/////////////////////////////////////////////////////////////////////
+// The operations
+
+static void Construct(long n)
+{
+	for (long i = 0; i < n; i++) {
+		sink[i & 63] = value_((double)i);
+	}
+}
+
+static void ConstructString(long n)
+{
+	const char* s = "text";
+	for (long i = 0; i < n; i++) {
+		sink[i & 63] = value_(s);
+	}
+}
+
+static void Copy(long n)
+{
+	for (long i = 0; i < n; i++) {
+		sink[i & 63] = nums[(i + 1) & 63];
+	}
+}
+
+static void Add(long n)
+{
+	for (long i = 0; i < n; i++) {
+		sink[i & 63] = nums[i & 63] + nums[(i + 1) & 63];
+	}
+}
+
+static void Mul(long n)
+{
+	for (long i = 0; i < n; i++) {
+		sink[i & 63] = nums[i & 63] * nums[(i + 1) & 63];
+	}
+}
+
+static void Less(long n)
+{
+	int k = 0;
+	for (long i = 0; i < n; i++) {
+		k += nums[i & 63] < nums[(i + 7) & 63];
+	}
+	dsink = k;
+}
+
+static void ToInt32(long n)
+{
+	long k = 0;
+	for (long i = 0; i < n; i++) {
+		k += nums[i & 63].toInt32();
+	}
+	dsink = k;
+}
+
+static void NumToString(long n)
+{
+	for (long i = 0; i < n; i++) {
+		sink[i & 63] = nums[i & 63].toString();
+	}
+}
+
+static void StringToNum(long n)
+{
+	double d = 0;
+	for (long i = 0; i < n; i++) {
+		d += numstrs[i & 63].toNumber();
+	}
+	dsink = d;
+}
+
+static void Concat(long n)
+{
+	for (long i = 0; i < n; i++) {
+		sink[i & 63] = strs[i & 63] + strs[(i + 1) & 63];
+	}
+}
+
+static void ConcatNum(long n)
+{
+	for (long i = 0; i < n; i++) {
+		sink[i & 63] = strs[i & 63] + nums[i & 63];
+	}
+}
+
+static void IdenticalNum(long n)
+{
+	int k = 0;
+	for (long i = 0; i < n; i++) {
+		k += identical_(nums[i & 63], nums[(i + 1) & 63]).toBool();
+	}
+	dsink = k;
+}
+
+static void IdenticalStr(long n)
+{
+	int k = 0;
+	for (long i = 0; i < n; i++) {
+		k += identical_(strs[i & 63], strs[(i + 1) & 63]).toBool();
+	}
+	dsink = k;
+}
+
+static void IdenticalObj(long n)
+{
+	int k = 0;
+	for (long i = 0; i < n; i++) {
+		k += identical_(obj, (i & 1) ? obj : shaped).toBool();
+	}
+	dsink = k;
+}
+
+// each of the props properties in turn
+static void Dot(long n)
+{
+	for (long i = 0; i < n; i++) {
+		sink[i & 63] = obj.dot(ids[i % props]);
+	}
+}
+
+static void DotSlots(long n)
+{
+	for (long i = 0; i < n; i++) {
+		sink[i & 63] = shaped.dot(ids[i % props]);
+	}
+}
+
+static void DotMiss(long n)
+{
+	const char* missing = intern_("missing");
+	for (long i = 0; i < n; i++) {
+		sink[i & 63] = obj.dot(missing);
+	}
+}
+
+static void DotRef(long n)
+{
+	for (long i = 0; i < n; i++) {
+		obj.dotref(ids[i % props]) = nums[i & 63];
+	}
+}
+
+static void DotRefSlots(long n)
+{
+	for (long i = 0; i < n; i++) {
+		shaped.dotref(ids[i % props]) = nums[i & 63];
+	}
+}
+
+static void At(long n)
+{
+	for (long i = 0; i < n; i++) {
+		sink[i & 63] = obj.at(keys[i % props]);
+	}
+}
+
+static void AtRef(long n)
+{
+	for (long i = 0; i < n; i++) {
+		obj.atref(keys[i % props]) = nums[i & 63];
+	}
+}
+
+static void Push(long n)
+{
+	value_ a = MakeArray_(0);
+	array_* p = (array_*)a.v.o;
+	for (long i = 0; i < n; i++) {
+		a.atref(value_(p->len)) = nums[i & 63];
+	}
+	sink[0] = a;
+	delete p;
+}
+
+static void Index(long n)
+{
+	for (long i = 0; i < n; i++) {
+		sink[i & 63] = arr.at(value_((double)(i & 1023)));
+	}
+}
+
+static void IndexRef(long n)
+{
+	for (long i = 0; i < n; i++) {
+		arr.atref(value_((double)(i & 1023))) = nums[i & 63];
+	}
+}
+
+static void Elt(long n)
+{
+	array_* a = (array_*)arr.v.o;
+	for (long i = 0; i < n; i++) {
+		sink[i & 63] = a->elt(i & 1023);
+	}
+}
+
+// the sum of its arguments, read as a compiled function would
+class sum_ : public func_
+{
+public:
+	sum_() : func_(0) {}
+	virtual value_ call(value_ this_, int nargs_, ...)
+	{
+		double d = 0;
+		va_list ap;
+		va_start(ap, nargs_);
+		for (int i = 0; i < nargs_; i++) {
+			d += va_arg(ap, value_).v.d;
+		}
+		va_end(ap);
+		return value_(d);
+	}
+};
+
+static sum_ sum;
+
+static void Call(long n)
+{
+	value_ f = value_((func_*)&sum);
+	value_ t;
+	value_* a = nums;
+	long i;
+	switch (arity) {
+	case 0:
+		for (i = 0; i < n; i++) {
+			sink[i & 63] = f.toFunc()->call(t, 0);
+		}
+		break;
+	case 1:
+		for (i = 0; i < n; i++) {
+			sink[i & 63] = f.toFunc()->call(t, 1, a[i & 63]);
+		}
+		break;
+	case 2:
+		for (i = 0; i < n; i++) {
+			sink[i & 63] = f.toFunc()->call(t, 2, a[i & 63], a[1]);
+		}
+		break;
+	case 4:
+		for (i = 0; i < n; i++) {
+			sink[i & 63] = f.toFunc()->call(t, 4, a[i & 63], a[1], a[2], a[3]);
+		}
+		break;
+	case 8:
+		for (i = 0; i < n; i++) {
+			sink[i & 63] = f.toFunc()->call(t, 8, a[i & 63], a[1], a[2], a[3], a[4], a[5], a[6], a[7]);
+		}
+		break;
+	}
+}
+
+/////////////////////////////////////////////////////////////////////
+// Setting up
+
+static void Setup(void)
+{
+	char buf[32];
+	int i;
+	for (i = 0; i < 64; i++) {
+		nums[i] = value_(i + 0.5);
+		sprintf(buf, "s%d", i);
+		strs[i] = value_((const char*)strdup(buf));
+		sprintf(buf, "%d.5", i);
+		numstrs[i] = value_((const char*)strdup(buf));
+	}
+	for (i = 0; i < MAXPROPS; i++) {
+		sprintf(buf, "p%d", i);
+		ids[i] = intern_(buf);
+		keys[i] = value_(ids[i]);
+	}
+	arr = MakeArray_(0);
+	for (i = 0; i < 1024; i++) {
+		arr.atref(value_(i)) = nums[i & 63];
+	}
+}
+
+static void Objects(int n)
+// obj and shaped with properties p0 ... p(n-1)
+{
+	props = n;
+	obj = value_(new obj_);
+	int i;
+	for (i = 0; i < n; i++) {
+		obj.dotref(ids[i]) = nums[i & 63];
+	}
+	shape.count = n;
+	shape.ids = ids;
+	shape.name = NULL;
+	shaped = value_(NewShaped_(&shape, nums));
+}
+
+/////////////////////////////////////////////////////////////////////
+// Timing
+
+struct bench_
+{
+	const char*	name;
+	void		(*fn)(long n);
+	int			props;		// or 0
+	int			arity;		// or -1
+};
+
+static const bench_ benches[] = {
+	{ "value/construct_number",	Construct,		0, -1 },
+	{ "value/construct_string",	ConstructString, 0, -1 },
+	{ "value/copy",				Copy,			0, -1 },
+	{ "value/add",				Add,			0, -1 },
+	{ "value/mul",				Mul,			0, -1 },
+	{ "value/less",				Less,			0, -1 },
+	{ "value/toint32",			ToInt32,		0, -1 },
+	{ "convert/number_to_string", NumToString,	0, -1 },
+	{ "convert/string_to_number", StringToNum,	0, -1 },
+	{ "string/concat",			Concat,			0, -1 },
+	{ "string/concat_number",	ConcatNum,		0, -1 },
+	{ "identical/number",		IdenticalNum,	0, -1 },
+	{ "identical/string",		IdenticalStr,	0, -1 },
+	{ "identical/object",		IdenticalObj,	0, -1 },
+	{ "obj/dot/1",				Dot,			1, -1 },
+	{ "obj/dot/4",				Dot,			4, -1 },
+	{ "obj/dot/16",				Dot,			16, -1 },
+	{ "obj/dot/64",				Dot,			64, -1 },
+	{ "obj/dot_miss/16",		DotMiss,		16, -1 },
+	{ "obj/dot_slots/1",		DotSlots,		1, -1 },
+	{ "obj/dot_slots/4",		DotSlots,		4, -1 },
+	{ "obj/dot_slots/16",		DotSlots,		16, -1 },
+	{ "obj/dot_slots/64",		DotSlots,		64, -1 },
+	{ "obj/dotref/1",			DotRef,			1, -1 },
+	{ "obj/dotref/16",			DotRef,			16, -1 },
+	{ "obj/dotref/64",			DotRef,			64, -1 },
+	{ "obj/dotref_slots/16",	DotRefSlots,	16, -1 },
+	{ "obj/at/1",				At,				1, -1 },
+	{ "obj/at/16",				At,				16, -1 },
+	{ "obj/at/64",				At,				64, -1 },
+	{ "obj/atref/1",			AtRef,			1, -1 },
+	{ "obj/atref/16",			AtRef,			16, -1 },
+	{ "obj/atref/64",			AtRef,			64, -1 },
+	{ "array/push",				Push,			0, -1 },
+	{ "array/at",				Index,			0, -1 },
+	{ "array/atref",			IndexRef,		0, -1 },
+	{ "array/elt",				Elt,			0, -1 },
+	{ "call/0",					Call,			0, 0 },
+	{ "call/1",					Call,			0, 1 },
+	{ "call/2",					Call,			0, 2 },
+	{ "call/4",					Call,			0, 4 },
+	{ "call/8",					Call,			0, 8 },
+};
+
+static void Prepare(const bench_& b)
+{
+	if (b.props) {
+		Objects(b.props);
+	}
+	arity = b.arity;
+}
+
+static double Time(const bench_& b, long n)
+// ms for n operations
+{
+	Prepare(b);
+	double t0 = performance_now_();
+	b.fn(n);
+	return performance_now_() - t0;
+}
+
+static int ByValue(const void* a, const void* b)
+{
+	double x = *(const double*)a, y = *(const double*)b;
+	return x < y ? -1 : x > y;
+}
+
+int main(int argc, char* argv[])
+{
+	const char* only = argc > 1 ? argv[1] : "";
+	double ms = argc > 2 ? atof(argv[2]) : 50;
+	int runs = argc > 3 ? atoi(argv[3]) : 5;
+	if (runs < 1 || runs > MAXRUNS) {
+		runs = 5;
+	}
+	Setup();
+
+	char date[32];
+	time_t now = time(NULL);
+	strftime(date, sizeof date, "%Y-%m-%dT%H:%M:%S", localtime(&now));
+	printf("{\n\"context\": {\"date\": \"%s\", \"js2cpp\": \"%d.%02d.%02d\", \"ms_per_run\": %g, \"runs\": %d, "
+		"\"js_stats\": %s},\n\"benchmarks\": [",
+		date, APP_MAJOR, APP_MINOR, APP_BUILD, ms, runs,
+#ifdef JS_STATS
+		"true"
+#else
+		"false"
+#endif
+		);
+	const char* sep = "";
+	for (int i = 0; i < LENGTH(benches); i++) {
+		const bench_& b = benches[i];
+		if (strncmp(b.name, only, strlen(only))) {
+			continue;
+		}
+		long n = 1;
+		while (Time(b, n) < ms && n < (1L << 30)) {
+			n *= 2;
+		}
+		double ns[MAXRUNS];
+		for (int r = 0; r < runs; r++) {
+			ns[r] = Time(b, n) * 1e6 / n;
+		}
+		qsort(ns, runs, sizeof ns[0], ByValue);
+		fprintf(stderr, "%-28s %10.2f ns\n", b.name, ns[runs / 2]);
+		printf("%s\n{\"name\": \"%s\", \"iterations\": %ld, \"ns_per_op\": %.3f, \"min_ns_per_op\": %.3f}",
+			sep, b.name, n, ns[runs / 2], ns[0]);
+		sep = ",";
+	}
+	printf("\n]\n}\n");
+	return 0;
+}
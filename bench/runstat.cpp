@@ -0,0 +1,68 @@
+// runstat.cpp - run a command, and note its wall time and peak RSS
+//
+// For corpus.sh, which times js2cpp, the C++ compiler and the
+// compiled programs with it: GNU time isn't everywhere, and the shell
+// can't get at a child's rusage. POSIX only.
+//
+// Build it with e.g.
+//	g++ -O2 runstat.cpp -o runstat
+// usage: runstat file command [args...]
+// The command's output goes where runstat's does; file gets a line
+//	ms peak-kb status
+// status is the exit code, or 128 + the signal that ended it.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+static double Now(void)
+// monotonic ms
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1e3 + t.tv_nsec / 1e6;
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 3) {
+		fprintf(stderr, "usage: runstat file command [args...]\n");
+		return 2;
+	}
+	double t0 = Now();
+	pid_t pid = fork();
+	if (pid < 0) {
+		perror("runstat: fork");
+		return 2;
+	}
+	if (pid == 0) {
+		execvp(argv[2], argv + 2);
+		perror(argv[2]);
+		_exit(127);
+	}
+	int status;
+	struct rusage ru;
+	if (wait4(pid, &status, 0, &ru) < 0) {
+		perror("runstat: wait4");
+		return 2;
+	}
+	double ms = Now() - t0;
+	long kb = ru.ru_maxrss;
+#ifdef __APPLE__
+	kb /= 1024;			// (bytes there)
+#endif
+	int code = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+	FILE* f = fopen(argv[1], "w");
+	if (!f) {
+		perror(argv[1]);
+		return 2;
+	}
+	fprintf(f, "%.3f %ld %d\n", ms, kb, code);
+	fclose(f);
+	return 0;
+}
@@ -0,0 +1,48 @@
+#!/bin/sh
+# startup.sh - time the startup of a generated program
+#
+# usage: bench/startup.sh [js2cpp] [functions] [runs]
+#
+# Writes a script with many functions, string and number literals,
+# object shapes and constructors but almost nothing to do, compiles
+# it, and runs it repeatedly. What's left is the cost of getting to
+# and through jsmain_: with constant-initialized statics that should
+# be exec, the dynamic linker and jsinit_ interning the atoms.
+#
+# Targets: 32-bit x86, as for corpus.sh (which says why).
+
+JS2CPP=${1:-./js2cpp}
+NFUNC=${2:-500}
+RUNS=${3:-200}
+CXX=${CXX:-g++}
+case $(uname -m) in
+i?86)	ARCH= ;;
+x86_64|amd64)	ARCH=-m32 ;;
+*)	echo "startup.sh: $(uname -m) is not a supported target (32-bit x86)" >&2; exit 1 ;;
+esac
+RT=$(cd "$(dirname "$0")/.." && pwd)
+TMP=${TMPDIR:-/tmp}/js2cpp_startup.$$
+mkdir -p "$TMP" || exit 1
+trap 'rm -rf "$TMP"' 0
+
+i=0
+while [ $i -lt $NFUNC ]; do
+	echo "function f$i(a, b) { this.x$i = a; this.y = \"s$i\"; return {k$i: $i, v: b}; }"
+	echo "var o$i = new f$i($i, \"t$i\");"
+	i=$((i+1))
+done > "$TMP/startup.js"
+
+(cd "$TMP" && "$JS2CPP" startup.js) > /dev/null || exit 1
+$CXX $ARCH -std=c++11 -O2 -I"$RT" -o "$TMP/startup" "$TMP/startup.cpp" \
+	"$RT/jscpprt.cpp" "$RT/jsatom.cpp" "$RT/jstyped.cpp" "$RT/jsmath.cpp" "$RT/jsjson.cpp" \
+	"$RT/jsregex.cpp" "$RT/jsregexp.cpp" "$RT/jsevent.cpp" "$RT/jsconsole.cpp" "$RT/jsfs.cpp" \
+	"$RT/jsisolate.cpp" "$RT/jsparallel.cpp" "$RT/jsstats.cpp" "$RT/jsheap.cpp" "$RT/jsinstr.cpp" "$RT/jsfeedback.cpp" "$RT/jsmain.cpp" -lpthread || exit 1
+
+start=$(date +%s%N)
+i=0
+while [ $i -lt $RUNS ]; do
+	"$TMP/startup" > /dev/null
+	i=$((i+1))
+done
+end=$(date +%s%N)
+echo "startup: $NFUNC functions, $RUNS runs, $(( (end - start) / RUNS / 1000 )) us/run"
@@ -12,30 +12,687 @@
 #include <stdio.h>
 #include <new>
 #include <string>
+#include <algorithm>
+#include "sugar.h"
+#include "jshash.h"
 
 namespace js2cpp {
 
+	std::string CLiteral(const char *s);
+
 	int ListLength(AST* list)
 	{
-		if (!list) {
-			return 0;
+		int n = 0;
+		while (list && Type(list)==tCOMMA) {
+			n++;
+			list = list->second;
+		}
+		return list ? n+1 : n;
+	} // ListLength
+
+	bool IsSimple(AST* tree)
+	{
+		// Can tree be evaluated twice with no side effects?
+		switch (Type(tree)) {
+		case tIDENT:
+		case tNUMBER:
+		case tTHIS:
+			return true;
+		default:
+			return false;
+		} // switch
+	} // IsSimple
+
+	// Typed array constructors (see jstyped.cpp)
+	static const char* const typed_ctors[] = {
+		"Int8Array", "Uint8Array", "Uint8ClampedArray", "Int16Array", "Uint16Array",
+		"Int32Array", "Uint32Array", "Float32Array", "Float64Array"
+	};
+
+	struct StoreCounter {
+		const char*	id;			// variable name (interned)
+		int			count;		// stores seen
+	};
+
+	static bool IsId(AST* tree, const char* id)
+	{
+		return tree && Type(tree)==tIDENT && Name(tree)==id;
+	}
+
+	static void CountStore(AST* node, void* context)
+	{
+		StoreCounter& sc = *(StoreCounter*)context;
+		TokenType tt = Type(node);
+		if (isAssOp(tt)) {
+			if (IsId(LHS(node), sc.id)) sc.count++;
+		} else if (tt==tPLUSPLUS || tt==tMINUSMINUS) {
+			if (IsId(node->first, sc.id) || IsId(node->second, sc.id)) sc.count++;
+		} else if (tt==tVAR || tt==tCOMMA) {
+			// var x = e, and the ', y = e' links of a var list.
+			// (A comma expression x,e counts too - harmless.)
+			if (IsId(node->first, sc.id) && node->second) sc.count++;
+		} else if (tt==tIN) {
+			// for (x in o), for (var x in o)
+			AST* v = node->first;
+			if (v && Type(v)==tVAR) v = v->first;
+			if (IsId(v, sc.id)) sc.count++;
+		}
+	} // CountStore
+
+	const char* CodeGenerator::TypedArrayKind(AST* expr)
+	{
+		// If expr is a variable whose only store is its initializer
+		// 'var x = new T(...)', with T one of the global typed array
+		// constructors, return the name of T. Otherwise NULL.
+		if (!expr || Type(expr)!=tIDENT) {
+			return NULL;
+		}
+		Binding decl;
+		aScope* owner;
+		if (!ActiveScope()->FindDeclaration(Name(expr), decl, owner) || !decl.isVar()) {
+			return NULL;
+		}
+		std::pair<aScope*,const char*> key(owner, Name(expr));
+		TypedVars::iterator it = typedVars.find(key);
+		if (it != typedVars.end()) {
+			return (*it).second;
+		}
+		const char* kind = NULL;
+		AST* init = decl.Initialiser();
+		AST* cons = (init && Type(init)==tNEW) ? RightOperand(init) : NULL;
+		if (cons && Type(cons)==tLPAREN) {
+			cons = cons->first;
 		}
-		if (Type(list)==tCOMMA) {
-			int n = 1;
-			if (list->second) {
-				n += ListLength(list->second);
+		Binding cdecl;
+		aScope* cowner;
+		if (cons && Type(cons)==tIDENT &&
+			owner->FindDeclaration(Name(cons), cdecl, cowner) &&
+			cowner==global_scope && cdecl.isExtern()) {
+			for (int i = 0; i < LENGTH(typed_ctors); i++) {
+				if (0==strcmp(Name(cons), typed_ctors[i])) {
+					kind = typed_ctors[i];
+				}
 			}
-			return n;
+		}
+		AST* tree = owner->Tree();
+		if (kind && (Type(tree)==tFUNCTION || Type(tree)==tFUNEX)) {
+			// a formal parameter gets stored by every call
+			for (AST* f = Formals(tree); f; f = f->third) {
+				if (IsId(f->first, Name(expr))) {
+					kind = NULL;
+				}
+			}
+		}
+		if (kind) {
+			StoreCounter sc = { Name(expr), 0 };
+			Walk(tree, CountStore, &sc);
+			if (sc.count != 1) {
+				kind = NULL;
+			}
+		}
+		typedVars[key] = kind;
+		return kind;
+	} // TypedArrayKind
+
+	// what IsPure knows about a function
+	enum {
+		PURE_PENDING,			// being looked at (it calls itself)
+		PURE_YES,
+		PURE_NO,
+	};
+
+	static bool Within(aScope* s, aScope* outer)
+	{
+		// is s outer, or a scope nested in it?
+		for (; s; s = s->Parent()) {
+			if (s==outer) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	static bool IsExternIn(aScope* scope, AST* expr, const char* name = NULL)
+	{
+		// Is expr a predefined global (name, if given) as seen from scope?
+		Binding decl;
+		aScope* owner;
+		return expr && Type(expr)==tIDENT && (!name || 0==strcmp(Name(expr), name)) &&
+			   scope->FindDeclaration(Name(expr), decl, owner) && decl.isExtern();
+	}
+
+	bool CodeGenerator::IsPure(AST* fun)
+	{
+		// Can calls of fun run on several threads at once (see the
+		// parallel array methods)? It must store to no variable it
+		// doesn't declare itself, and into no object but those it
+		// has just made, and call nothing but functions like that,
+		// Math's, and String, Number and Boolean. Nor may it read a
+		// prototype (or new Object), which makes one on first use.
+		// Recorded in its funcinfo_.
+		std::map<AST*,int>::iterator it = purity.find(fun);
+		if (it != purity.end() && (*it).second != PURE_PENDING) {
+			return (*it).second==PURE_YES;
+		}
+		bool bAssumed = false;
+		bool bPure = Purity(fun, bAssumed);
+		// all it assumed was that it is pure itself
+		purity[fun] = bPure ? PURE_YES : PURE_NO;
+		return bPure;
+	} // IsPure
+
+	bool CodeGenerator::Purity(AST* fun, bool& bAssumed)
+	{
+		std::map<AST*,int>::iterator it = purity.find(fun);
+		if (it != purity.end()) {
+			if ((*it).second==PURE_PENDING) {
+				// recursion: pure unless something else says not
+				bAssumed = true;
+				return true;
+			}
+			return (*it).second==PURE_YES;
+		}
+		purity[fun] = PURE_PENDING;
+		bool bInner = false;
+		bool bPure = PureTree(fun, bInner);
+		if (!bPure) {
+			purity[fun] = PURE_NO;
+		} else if (!bInner) {
+			purity[fun] = PURE_YES;
 		} else {
-			return 1;
+			// rests on a caller being pure: ask again another time
+			purity.erase(fun);
+			bAssumed = true;
 		}
-	} // ListLength
+		return bPure;
+	} // Purity
+
+	bool CodeGenerator::PureTree(AST* fun, bool& bAssumed)
+	{
+		// look at every node of fun's body, and of the functions
+		// nested in it, each identifier in its own scope
+		aScope* fs = fun->Scope();
+		std::vector<std::pair<AST*,aScope*> > stack;
+		if (FuncBody(fun)) {
+			stack.push_back(std::make_pair(FuncBody(fun), fs));
+		}
+		while (!stack.empty()) {
+			AST* node = stack.back().first;
+			aScope* scope = stack.back().second;
+			stack.pop_back();
+			TokenType tt = Type(node);
+			if (tt==tLBRACE) {
+				// a block's list nodes wear their statements' tokens
+				for (AST* list = node; list; list = list->third) {
+					if (list->first) {
+						stack.push_back(std::make_pair(list->first, scope));
+					}
+				}
+				continue;
+			}
+			if (tt==tFOR) {
+				// and a for's (init; test; step) node wears the '('
+				AST* h = LoopExpr(node);
+				if (h && h->third) stack.push_back(std::make_pair(h->third, scope));
+				if (h && h->second) stack.push_back(std::make_pair(h->second, scope));
+				if (h && h->first) stack.push_back(std::make_pair(h->first, scope));
+				if (LoopBody(node)) stack.push_back(std::make_pair(LoopBody(node), scope));
+				continue;
+			}
+			if (tt==tFUNCTION || tt==tFUNEX) {
+				if (FuncBody(node)) {
+					stack.push_back(std::make_pair(FuncBody(node), node->Scope()));
+				}
+				continue;
+			}
+			if (isAssOp(tt)) {
+				if (!PureStore(LHS(node), scope, fs)) {
+					return false;
+				}
+			} else if (tt==tPLUSPLUS || tt==tMINUSMINUS) {
+				if (!PureStore(IsPrefix(node) ? RightOperand(node) : LeftOperand(node), scope, fs)) {
+					return false;
+				}
+			} else if (tt==tIN) {
+				// for (x in o) stores x; x in o only reads it
+				AST* v = node->first;
+				if (v && (Type(v)==tDOT || Type(v)==tLBRACKET) && !PureStore(v, scope, fs)) {
+					return false;
+				}
+			} else if (tt==tDELETE || tt==tWITH) {
+				return false;
+			} else if (tt==tDOT) {
+				AST* id = RightOperand(node);
+				if (id && Type(id)==tIDENT && 0==strcmp(Name(id), "prototype")) {
+					return false;
+				}
+			} else if (tt==tLPAREN) {
+				if (!PureCall(node->first, scope, fs, bAssumed)) {
+					return false;
+				}
+			} else if (tt==tNEW) {
+				// the built-in constructors make a new object and that's all
+				// (but Object's is made with its prototype, see construct_)
+				AST* op = RightOperand(node);
+				AST* cons = (op && Type(op)==tLPAREN) ? op->first : op;
+				if (!IsExternIn(scope, cons) || IsExternIn(scope, cons, "Object")) {
+					return false;
+				}
+				if (op && Type(op)==tLPAREN) {
+					if (op->second) {
+						stack.push_back(std::make_pair(op->second, scope));
+					}
+					continue;
+				}
+			}
+			if (node->third) stack.push_back(std::make_pair(node->third, scope));
+			if (node->second) stack.push_back(std::make_pair(node->second, scope));
+			if (node->first) stack.push_back(std::make_pair(node->first, scope));
+		}
+		return true;
+	} // PureTree
+
+	bool CodeGenerator::PureStore(AST* target, aScope* scope, aScope* fs)
+	{
+		// Does storing to target leave everything outside the function
+		// with scope fs alone?
+		if (!target) {
+			return false;
+		}
+		Binding decl;
+		aScope* owner;
+		switch (Type(target)) {
+		case tIDENT:
+			// an undeclared one is a global
+			return scope->FindDeclaration(Name(target), decl, owner) && Within(owner, fs);
+		case tDOT:
+		case tLBRACKET:
+			return FreshLocal(target->first, scope, fs);
+		default:
+			return false;
+		}
+	} // PureStore
+
+	bool CodeGenerator::PureCall(AST* callee, aScope* scope, aScope* fs, bool& bAssumed)
+	{
+		if (!callee) {
+			return false;
+		}
+		if (Type(callee)==tDOT) {
+			return IsExternIn(scope, LeftOperand(callee), "Math");
+		}
+		Binding decl;
+		aScope* owner;
+		if (Type(callee)!=tIDENT || !scope->FindDeclaration(Name(callee), decl, owner)) {
+			return false;
+		}
+		if (decl.isExtern()) {
+			const char* id = Name(callee);
+			return 0==strcmp(id, "String") || 0==strcmp(id, "Number") || 0==strcmp(id, "Boolean");
+		}
+		if (!decl.isFunction() || Reassigned(owner, Name(callee))) {
+			return false;
+		}
+		// one nested in this function is being looked at already
+		return Within(owner, fs) || Purity(decl.Definition(), bAssumed);
+	} // PureCall
+
+	bool CodeGenerator::FreshLocal(AST* expr, aScope* scope, aScope* fs)
+	{
+		// Is expr a variable of this function's that only ever holds an
+		// object it made itself: var o = {...}, [...] or new T(n), T a
+		// typed array and n its length, stored just the once? (A typed
+		// array made on a buffer, new T(buf), shares the buffer.)
+		Binding decl;
+		aScope* owner;
+		if (!expr || Type(expr)!=tIDENT ||
+			!scope->FindDeclaration(Name(expr), decl, owner) || !Within(owner, fs) || !decl.isVar()) {
+			return false;
+		}
+		AST* init = decl.Initialiser();
+		if (!init || (Type(init)!=tOBJLIT && Type(init)!=tARRAYLIT && Type(init)!=tNEW)) {
+			return false;
+		}
+		if (Type(init)==tNEW) {
+			AST* op = RightOperand(init);
+			if (!op || Type(op)!=tLPAREN || !op->second || Type(op->second)==tCOMMA) {
+				return false;
+			}
+			AST* n = op->second;
+			bool bLength = IsNumeric(n) ||
+				(Type(n)==tDOT && RightOperand(n) && 0==strcmp(Name(RightOperand(n)), "length"));
+			bool bTyped = false;
+			for (int i = 0; i < LENGTH(typed_ctors); i++) {
+				bTyped = bTyped || IsExternIn(owner, op->first, typed_ctors[i]);
+			}
+			if (!bTyped || !bLength) {
+				return false;
+			}
+		}
+		StoreCounter sc = { Name(expr), 0 };
+		Walk(owner->Tree(), CountStore, &sc);
+		return sc.count==1;
+	} // FreshLocal
+
+	bool CodeGenerator::Reassigned(aScope* owner, const char* id)
+	{
+		// is the function id, declared in owner, ever stored over?
+		std::pair<aScope*,const char*> key(owner, id);
+		std::map<std::pair<aScope*,const char*>,bool>::iterator it = reassigned.find(key);
+		if (it != reassigned.end()) {
+			return (*it).second;
+		}
+		StoreCounter sc = { id, 0 };
+		Walk(owner->Tree(), CountStore, &sc);
+		reassigned[key] = sc.count != 0;
+		return sc.count != 0;
+	} // Reassigned
+
+	bool CodeGenerator::TypedElementOp(AST* tree)
+	{
+		// tree is an assignment or ++/-- - if its target is an
+		// element of a known typed array, emit a direct typed
+		// store and return true.
+		TokenType tt = Type(tree);
+		AST* target = isAssOp(tt) ? LHS(tree) : (IsPrefix(tree) ? RightOperand(tree) : LeftOperand(tree));
+		if (!target || Type(target)!=tLBRACKET) {
+			return false;
+		}
+		const char* kind = TypedArrayKind(target->first);
+		if (!kind) {
+			return false;
+		}
+		AST* recv = target->first;
+		AST* index = target->second;
+		if (tt==tASSIGN) {
+			emitf("%s_put_(", kind);
+			ExprValue(recv);
+			emit(",");
+			ExprNumber(index);
+			emit(",(");
+			ExprValue(RHS(tree));
+			emit("))");
+			return true;
+		}
+		// everything else reads the element first
+		if (!IsSimple(index)) {
+			return false;
+		}
+		const char* op = NULL;
+		switch (tt) {
+		case tPLUSPLUS:
+		case tMINUSMINUS:
+			emitf("%s_add_(", kind);
+			ExprValue(recv);
+			emit(",");
+			ExprNumber(index);
+			emitf(",%s,%s)", tt==tPLUSPLUS ? "1" : "-1", IsPrefix(tree) ? "false" : "true");
+			return true;
+		case tASSPLUS:
+			// (a string on the right makes it a concatenation)
+			if (!IsNumeric(RHS(tree))) {
+				return false;
+			}
+			op = "+";
+			break;
+		case tASSMINUS:	op = "-"; break;
+		case tASSMUL:	op = "*"; break;
+		case tASSDIV:	op = "/"; break;
+		default:
+			return false;
+		} // switch
+		emitf("%s_put_(", kind);
+		ExprValue(recv);
+		emit(",");
+		ExprNumber(index);
+		emitf(",value_(%s_getd_(", kind);
+		ExprValue(recv);
+		emit(",");
+		ExprNumber(index);
+		emitf(")%s", op);
+		ExprNumber(RHS(tree));
+		emit("))");
+		return true;
+	} // TypedElementOp
+
+	bool CodeGenerator::ElementOp(AST* tree)
+	{
+		// tree is a compound assignment or ++/-- on o[x] that
+		// TypedElementOp didn't take: emit it as a get, the op and a
+		// put, o and x evaluated once and in order (a typed array's
+		// elements have no value_ for atref to return)
+		TokenType tt = Type(tree);
+		AST* target = isAssOp(tt) ? LHS(tree) : (IsPrefix(tree) ? RightOperand(tree) : LeftOperand(tree));
+		if (!target || Type(target)!=tLBRACKET || !bTemps) {
+			return false;
+		}
+		const char* op = NULL;		// a value_ operator
+		const char* fn = NULL;		// or an int32 one, in jscpprt.h
+		switch (tt) {
+		case tPLUSPLUS:
+		case tMINUSMINUS:
+			break;
+		case tASSPLUS:	op = "+"; break;
+		case tASSMINUS:	op = "-"; break;
+		case tASSMUL:	op = "*"; break;
+		case tASSDIV:	op = "/"; break;
+		case tASSREM:	op = "%"; break;
+		case tASSSL:	fn = "shl_"; break;
+		case tASSSRSX:	fn = "shr_"; break;
+		case tASSSRZX:	fn = "ushr_"; break;
+		case tASSAND:	fn = "band_"; break;
+		case tASSOR:	fn = "bor_"; break;
+		case tASSXOR:	fn = "bxor_"; break;
+		default:
+			return false;
+		} // switch
+		emit("(");
+		std::string o = Once(target->first);
+		std::string x = Once(target->second);
+		if (op || fn) {
+			// the old value is read before the right side runs
+			int old = Temp();
+			emitf("tmp%d_=%s.at(%s),", old, o.c_str(), x.c_str());
+			if (op) {
+				emitf("%s.put(%s,tmp%d_%s(", o.c_str(), x.c_str(), old, op);
+			} else {
+				emitf("%s.put(%s,%s(tmp%d_,", o.c_str(), x.c_str(), fn, old);
+			}
+			ExprValue(RHS(tree));
+			emit(")))");
+		} else {
+			emitf("eltinc_(%s,%s,%d,%s))", o.c_str(), x.c_str(), tt==tPLUSPLUS ? 1 : -1,
+				IsPrefix(tree) ? "false" : "true");
+		}
+		return true;
+	} // ElementOp
+
+	// Math methods, and the clocks, that compile to direct calls on
+	// doubles. (See the Math section of jscpprt.h for the *_*_ ones,
+	// the rest are plain libm which compilers treat as builtins.)
+	static const struct {
+		const char*	object;		// a predefined global
+		const char*	name;		// object.name
+		const char*	cfunc;		// C function
+		int			nargs;		// arguments it takes, -1 = any number
+	} math_intrinsics[] = {
+		{ "Math",			"abs",		"fabs",					1 },
+		{ "Math",			"acos",		"acos",					1 },
+		{ "Math",			"asin",		"asin",					1 },
+		{ "Math",			"atan",		"atan",					1 },
+		{ "Math",			"atan2",	"atan2",				2 },
+		{ "Math",			"ceil",		"ceil",					1 },
+		{ "Math",			"cos",		"cos",					1 },
+		{ "Math",			"exp",		"exp",					1 },
+		{ "Math",			"floor",	"floor",				1 },
+		{ "Math",			"log",		"log",					1 },
+		{ "Math",			"max",		"Math_max_",			-1 },
+		{ "Math",			"min",		"Math_min_",			-1 },
+		{ "Math",			"pow",		"Math_pow_",			2 },
+		{ "Math",			"random",	"Math_random_",			0 },
+		{ "Math",			"round",	"Math_round_",			1 },
+		{ "Math",			"sin",		"sin",					1 },
+		{ "Math",			"sqrt",		"sqrt",					1 },
+		{ "Math",			"tan",		"tan",					1 },
+		{ "Date",			"now",		"Date_now_",			0 },
+		{ "performance",	"now",		"performance_now_",		0 },
+	};
+
+	static const struct {
+		const char*	name;
+		const char*	value;
+	} math_constants[] = {
+		{ "E",			"2.718281828459045" },
+		{ "LN10",		"2.302585092994046" },
+		{ "LN2",		"0.6931471805599453" },
+		{ "LOG10E",		"0.4342944819032518" },
+		{ "LOG2E",		"1.4426950408889634" },
+		{ "PI",			"3.141592653589793" },
+		{ "SQRT1_2",	"0.7071067811865476" },
+		{ "SQRT2",		"1.4142135623730951" },
+	};
+
+	bool CodeGenerator::IsGlobal(AST* expr, const char* name)
+	{
+		// Is expr a reference to the predefined global 'name'
+		// (not shadowed by anything in the active scope)?
+		if (!expr || Type(expr)!=tIDENT || strcmp(Name(expr), name)) {
+			return false;
+		}
+		Binding decl;
+		aScope* owner;
+		return ActiveScope()->FindDeclaration(Name(expr), decl, owner) &&
+			   owner==global_scope && decl.isExtern();
+	} // IsGlobal
+
+	int CodeGenerator::MathIntrinsic(AST* call)
+	{
+		// If call is Math.f(args) (or Date.now() etc.) with a lowerable
+		// f and the right number of args, return f's index in
+		// math_intrinsics, else -1
+		if (Type(call)!=tLPAREN || !call->first || Type(call->first)!=tDOT) {
+			return -1;
+		}
+		AST* func = call->first;
+		int n = ListLength(call->second);
+		for (int m = 0; m < LENGTH(math_intrinsics); m++) {
+			if (0==strcmp(RightOperand(func)->Name(), math_intrinsics[m].name) &&
+				IsGlobal(LeftOperand(func), math_intrinsics[m].object)) {
+				if (math_intrinsics[m].nargs < 0 || math_intrinsics[m].nargs==n) {
+					return m;
+				}
+				break;
+			}
+		}
+		return -1;
+	} // MathIntrinsic
+
+	const char* CodeGenerator::MathConstant(AST* dot)
+	{
+		// If dot is Math.PI etc. return the value as C++ text
+		if (Type(dot)!=tDOT || !IsGlobal(LeftOperand(dot), "Math")) {
+			return NULL;
+		}
+		for (int i = 0; i < LENGTH(math_constants); i++) {
+			if (0==strcmp(RightOperand(dot)->Name(), math_constants[i].name)) {
+				return math_constants[i].value;
+			}
+		}
+		return NULL;
+	} // MathConstant
+
+	void CodeGenerator::EmitMathCall(AST* call, int m)
+	{
+		// Emit a lowered Math call, as a double-valued expression
+		const char* cfunc = math_intrinsics[m].cfunc;
+		std::vector<AST*> args;
+		for (AST* list = call->second; list; list = Type(list)==tCOMMA ? list->second : NULL) {
+			args.push_back(Type(list)==tCOMMA ? list->first : list);
+		}
+		int n = args.size(), i;
+		// (arguments with effects are evaluated in order, beforehand)
+		std::vector<std::string> use;
+		bool bOpen = InOrder(args, true, use);
+		if (math_intrinsics[m].nargs >= 0) {
+			emitf("%s(", cfunc);
+			for (i = 0; i < n; i++) {
+				if (i) emit(",");
+				MathArg(args[i], use[i]);
+			}
+			emit(bOpen ? "))" : ")");
+			return;
+		}
+		// min, max: fold pairwise
+		bool bMax = (0==strcmp(math_intrinsics[m].name, "max"));
+		if (n==0) {
+			emit(bMax ? "(-HUGE_VAL)" : "(HUGE_VAL)");
+			return;
+		}
+		for (i = 1; i < (n > 1 ? n : 2); i++) {
+			emitf("%s(", cfunc);
+		}
+		if (n==1) {
+			// ToNumber of the one arg
+			ExprNumber(args[0]);
+			emit(bMax ? ",-HUGE_VAL)" : ",HUGE_VAL)");
+			return;
+		}
+		MathArg(args[0], use[0]);
+		for (i = 1; i < n; i++) {
+			emit(",");
+			MathArg(args[i], use[i]);
+			emit(")");
+		}
+		if (bOpen) {
+			emit(")");
+		}
+	} // EmitMathCall
+
+	void CodeGenerator::MathArg(AST* arg, const std::string& use)
+	{	// one of a Math call's arguments, or what InOrder put it in
+		if (use.empty()) {
+			ExprNumber(arg);
+		} else {
+			emit(use.c_str());
+		}
+	}
+
+	bool CodeGenerator::IsNumeric(AST* tree)
+	{
+		// Is tree known to produce a number?
+		switch (Type(tree)) {
+		case tNUMBER:
+			return true;
+		case tLPAREN:
+			return MathIntrinsic(tree) >= 0;
+		case tDOT:
+			return MathConstant(tree) != NULL;
+		case tLBRACKET:
+			return TypedArrayKind(tree->first) != NULL;
+		case tSPLAT:
+		case tDIV:
+		case tREM:
+			return true;
+		case tMINUS:
+			return true;			// unary or binary, always numeric
+		case tPLUS:
+			// unary + is ToNumber, binary + only if both sides are numbers
+			return !tree->first || (IsNumeric(tree->first) && IsNumeric(tree->second));
+		default:
+			return false;
+		} // switch
+	} // IsNumeric
 
 	int CodeGenerator::ArgCount(AST* fun)
 	{
 		// Return the number of arguments expected by function fun
 		assert(Type(fun)==tFUNCTION || Type(fun)==tFUNEX);
-		return ListLength(Formals(fun));
+		// formals are chained through third, see Parser::FormalParams
+		int n = 0;
+		for (AST* f = Formals(fun); f && f->first; f = f->third) {
+			n++;
+		}
+		return n;
 	}
 
 	const char* CodeGenerator::FuncName(AST* fun)
@@ -56,7 +713,24 @@ namespace js2cpp {
 
 	CodeGenerator::CodeGenerator(CodeSink* pcode, ErrorSink* perr)
 	: m_psink(pcode),
-	  err(*perr)
+	  err(*perr),
+	  nTemps(0),
+	  bTemps(false),
+	  bSnapshot(false),
+	  bIsolate(false),
+	  bHeapProf(false),
+	  curSite(0),
+	  siting(NULL),
+	  curFunction(""),
+	  bInstrument(false),
+	  bFeedback(false),
+	  nSpecialized(0),
+	  restStatements(NULL),
+	  bLines(false),
+	  cppLine(0),
+	  jsLine(0),
+	  jsLineAt(0),
+	  jsFile(NULL)
 	{
 		memset(spaces, ' ', sizeof spaces - 1);
 		indent_str = spaces + (sizeof spaces) - 1;
@@ -89,6 +763,10 @@ namespace js2cpp {
 	void CodeGenerator::emit(const char *pz)
 	{
 		m_psink->emit(pz);
+		// (--lines needs to know where it is in the .cpp)
+		for (const char* p = pz; *p; p++) {
+			cppLine += (*p == '\n');
+		}
 	}
 
 	void CodeGenerator::emitf(const char *pz,...)
@@ -98,7 +776,7 @@ namespace js2cpp {
 		
 		va_start( arg_ptr, pz );
 		if (_vsnprintf(buffer, sizeof buffer, pz, arg_ptr) >= 0) {
-			m_psink->emit(buffer);
+			emit(buffer);
 		} else {
 			// presumably buffer overflow
 			const int BIGSIZE = 65536;
@@ -106,11 +784,14 @@ namespace js2cpp {
 			if (!bigbuf) {
 				throw std::bad_alloc();
 			}
+			// (the first try used up the arguments)
+			va_end(arg_ptr);
+			va_start(arg_ptr, pz);
 			if (_vsnprintf(bigbuf, BIGSIZE, pz, arg_ptr) < 0) {
 				delete[] bigbuf;
 				throw "CodeGenerator::emitf buffer overflow";
 			}
-			m_psink->emit(bigbuf);
+			emit(bigbuf);
 			delete[] bigbuf;
 		}
 		va_end(arg_ptr);
@@ -125,23 +806,910 @@ namespace js2cpp {
 		emit("// definitions\n\n");
 		local_scope = NULL;
 		global_scope = tree->Scope();
+		HeapSite none = { NULL, 0, NULL, NULL };
+		heapSites.push_back(none);
 
+		EmitStatics(tree);
 		TopLevelDefs(tree);
+		EmitSnapshot();
 		emit("\n");
+		if (bHeapProf) {
+			emit("extern const heapsite_ heapsites_[];\n");
+			emit("extern const int nheapsites_;\n\n");
+		}
+		if (bInstrument) {
+			emit("extern const fninfo_ jsfunctions_[];\n");
+			emit("extern const int njsfunctions_;\n\n");
+		}
+		if (bFeedback) {
+			emit("extern const fbsite_ fbsites_[];\n");
+			emit("extern const int nfbsites_;\n\n");
+		}
 		emit("int jsmain_(...)\n");
 		emit("{\n");
 		indent();
+		if (bIsolate) {
+			emitf("%sglobals_ globals;\n", indent_str);
+			emitf("%sglobalsp_ = &globals;\n", indent_str);
+		}
+		if (bHeapProf) {
+			emitf("%sheapprofile_(heapsites_, nheapsites_);\n", indent_str);
+		}
+		if (bInstrument) {
+			emitf("%sinstrument_(jsfunctions_, njsfunctions_);\n", indent_str);
+		}
+		if (bFeedback) {
+			emitf("%sfeedback_(fbsites_, nfbsites_);\n", indent_str);
+		}
 		emit("// dynamic global initialization\n");
+		if (!initCode.empty()) {
+			if (bIsolate) {
+				// the literal pool is shared: the first isolate interns it
+				emitf("%sstatic long jsinit_once_;\n", indent_str);
+				emitf("%sonce_(&jsinit_once_, jsinit_);\n", indent_str);
+			} else {
+				emitf("%sjsinit_();\n", indent_str);
+			}
+		}
 		InitializeVars(tree);
-		emit("\n");
-		TopLevelStatements(tree);
+		TempStatements(restStatements, true);
+		CppLines();
+		emitf("%srunloop_();\n", indent_str);
 		emitf("%sreturn 0;\n", indent_str);
 		dedent();
 		emit("} // jsmain_\n\n");
+		EmitHeapSites();
+		EmitFunctionTable();
+		EmitFeedbackSites();
+		if (!profile.empty()) {
+			emitf("// --profile: %d sites specialized\n\n", nSpecialized);
+		}
+		// jsmain.cpp runs it on several threads only if it can
+		emitf("extern const int jsisolate_ = %d;\n\n", bIsolate ? 1 : 0);
 		emit("//------- end of module\n");
 	}
 
 
+	static std::string Quoted(const char* s)
+	// s as a C++ string literal
+	{
+		std::string q = "\"";
+		for (; *s; s++) {
+			if (*s=='\\' || *s=='\"') {
+				q += '\\';
+			}
+			q += *s;
+		}
+		return q + "\"";
+	}
+
+	static const char* NumberLiteral(AST* e, bool& bNeg)
+	// e is N or -N: return the text of N
+	{
+		bNeg = false;
+		if (Type(e)==tMINUS && !e->first && e->second) {
+			bNeg = true;
+			e = e->second;
+		}
+		return Type(e)==tNUMBER ? Name(e) : NULL;
+	}
+
+	static TokenType ConstArrayType(AST* lit)
+	// tNUMBER or tSTRING if every element of lit is one, else tEOF
+	{
+		AST* list = lit->first;
+		if (!list) {
+			return tEOF;
+		}
+		bool bNeg;
+		AST* e = list->first;
+		TokenType tt = !e ? tEOF :
+					   NumberLiteral(e, bNeg) ? tNUMBER :
+					   Type(e)==tSTRING ? tSTRING : tEOF;
+		for (; tt != tEOF && list; list = list->second) {
+			e = list->first;
+			if (!e || (tt==tNUMBER ? !NumberLiteral(e, bNeg) : Type(e)!=tSTRING)) {
+				tt = tEOF;
+			}
+		}
+		return tt;
+	}
+
+	void CodeGenerator::CollectStatic(AST* node, void* context)
+	{
+		// Walk visitor: give each non-empty object literal a shape,
+		// and each all-constant array literal a static table.
+		CodeGenerator* cg = (CodeGenerator*)context;
+		switch (Type(node)) {
+		case tSTRING:
+			cg->PoolString(CLiteral(Name(node)));
+			return;
+		case tNUMBER:
+			if (cg->numIndex.find(Name(node))==cg->numIndex.end()) {
+				cg->numIndex[Name(node)] = cg->numPool.size();
+				cg->numPool.push_back(Name(node));
+			}
+			return;
+		case tDOT:
+			// property id
+			cg->PoolId(Name(RightOperand(node)));
+			return;
+		case tREGEX:
+			if (cg->regexIndex.find(Name(node))==cg->regexIndex.end()) {
+				cg->regexIndex[Name(node)] = cg->regexes.size();
+				cg->regexes.push_back(node);
+			}
+			return;
+		case tNEW:
+			{
+				// (a block's list nodes after the first have the type of
+				// the token their statement starts with: no operand)
+				AST* cons = node->second;
+				if (!cons) {
+					return;
+				}
+				if (Type(cons)==tLPAREN) {
+					cons = cons->first;
+				}
+				if (cons && Type(cons)==tIDENT &&
+					std::find(cg->newTargets.begin(), cg->newTargets.end(), Name(cons))==cg->newTargets.end()) {
+					cg->newTargets.push_back(Name(cons));
+				}
+			}
+			return;
+		case tASSIGN:
+			{
+				// F.prototype.m = function..., F.prototype = { m: function... }
+				AST* lhs = LHS(node);
+				AST* rhs = RHS(node);
+				if (!lhs || Type(lhs)!=tDOT || !rhs) {
+					return;
+				}
+				AST* base = LeftOperand(lhs);
+				if (Type(base)==tDOT && 0==strcmp(Name(RightOperand(base)), "prototype") &&
+					Type(LeftOperand(base))==tIDENT && Type(rhs)==tFUNEX) {
+					cg->protoMethods[Name(LeftOperand(base))].push_back(rhs);
+				} else if (0==strcmp(Name(RightOperand(lhs)), "prototype") &&
+					Type(base)==tIDENT && Type(rhs)==tOBJLIT) {
+					for (AST* e = rhs; e && e->first; e = e->third) {
+						if (e->second && Type(e->second)==tFUNEX) {
+							cg->protoMethods[Name(base)].push_back(e->second);
+						}
+					}
+				}
+			}
+			return;
+		default:
+			break;
+		}
+		if (Type(node)==tARRAYLIT && ConstArrayType(node)!=tEOF) {
+			cg->litArrays[node] = cg->constArrays.size();
+			cg->constArrays.push_back(node);
+			return;
+		}
+		if (Type(node)!=tOBJLIT || !node->first) {
+			return;
+		}
+		Keys keys;
+		std::string sig;
+		for (AST* e = node; e; e = e->third) {
+			const char* key = Name(e->first);
+			// a repeated key keeps its first slot
+			Keys::iterator k = keys.begin();
+			while (k != keys.end() && *k != key) {
+				++k;
+			}
+			if (k == keys.end()) {
+				cg->PoolId(key);
+				keys.push_back(key);
+				sig += key;
+				sig += ",";
+			}
+		}
+		std::map<std::string,int>::iterator ii = cg->shapeIndex.find(sig);
+		int n;
+		if (ii == cg->shapeIndex.end()) {
+			n = cg->shapes.size();
+			cg->shapes.push_back(keys);
+			cg->shapeIndex[sig] = n;
+		} else {
+			n = (*ii).second;
+		}
+		cg->litShapes[node] = n;
+	} // CollectStatic
+
+	int CodeGenerator::PoolString(const std::string& lit)
+	{
+		std::map<std::string,int>::iterator ii = strIndex.find(lit);
+		if (ii != strIndex.end()) {
+			return (*ii).second;
+		}
+		strIndex[lit] = strPool.size();
+		strPool.push_back(lit);
+		return strPool.size()-1;
+	} // PoolString
+
+	int CodeGenerator::PoolId(const char* name)
+	{
+		std::string lit("\"");
+		lit += name;
+		lit += "\"";
+		return PoolString(lit);
+	} // PoolId
+
+	void CodeGenerator::EmitId(const char* name)
+	{
+		// property ids must be atoms
+		std::string lit("\"");
+		lit += name;
+		lit += "\"";
+		std::map<std::string,int>::iterator ii = strIndex.find(lit);
+		if (ii != strIndex.end()) {
+			emitf("str_[%d].v.s", (*ii).second);
+		} else {
+			emitf("intern_(%s)", lit.c_str());
+		}
+	} // EmitId
+
+	void CodeGenerator::EmitPool(void)
+	{
+		// Every distinct string literal and property id is interned
+		// once, by jsinit_, with its length and hash worked out here.
+		// Numbers are boxed once. The code then just uses str_[i], num_[i].
+		// Both tables are constant-initialized: no code runs before main.
+		int i;
+		if (!strPool.empty()) {
+			emit("// constant pool\n");
+			emit("static atom_ atoms_[] = {\n");
+			for (i = 0; i < (int)strPool.size(); i++) {
+				const std::string& lit = strPool[i];
+				if (lit.find('\\')==std::string::npos) {
+					// no escapes, so the text is what's between the quotes
+					int len = lit.size()-2;
+					emitf("\t{ %s, %d, 0x%08xu },\n", lit.c_str(), len, jshash_(lit.c_str()+1, len));
+				} else {
+					emitf("\t{ %s, -1, 0 },\n", lit.c_str());
+				}
+			}
+			emit("};\n");
+			emit("static value_ str_[] = {");
+			for (i = 0; i < (int)strPool.size(); i++) {
+				emitf("%svalue_(%s)", i ? (i % 4 ? ", " : ",\n\t") : "\n\t", strPool[i].c_str());
+			}
+			emit("\n};\n");
+			char line[64];
+			sprintf(line, "\tfor (i = 0; i < %d; i++) {\n", strPool.size());
+			initCode += "\tint i;\n";
+			initCode += line;
+			initCode += "\t\tstr_[i].v.s = intern_(atoms_[i]);\n\t}\n";
+		}
+		if (!numPool.empty()) {
+			emit("static value_ num_[] = {");
+			for (i = 0; i < (int)numPool.size(); i++) {
+				emitf("%svalue_((double)%s)", i ? (i % 4 ? ", " : ",\n\t") : "\n\t", numPool[i]);
+			}
+			emit("\n};\n");
+		}
+	} // EmitPool
+
+	static void ThisStores(AST* body, std::vector<const char*>& keys)
+	// Add the x of each this.x = ... in body to keys, in source
+	// order, skipping nested functions (their this is another object).
+	{
+		std::vector<AST*> stack;
+		stack.push_back(body);
+		while (!stack.empty()) {
+			AST* n = stack.back();
+			stack.pop_back();
+			if (!n || Type(n)==tFUNEX || Type(n)==tFUNCTION) {
+				continue;
+			}
+			if (isAssOp(Type(n)) && LHS(n) && Type(LHS(n))==tDOT &&
+				Type(LeftOperand(LHS(n)))==tTHIS) {
+				const char* id = Name(RightOperand(LHS(n)));
+				if (std::find(keys.begin(), keys.end(), id)==keys.end()) {
+					keys.push_back(id);
+				}
+			}
+			stack.push_back(n->third);
+			stack.push_back(n->second);
+			stack.push_back(n->first);
+		}
+	} // ThisStores
+
+	void CodeGenerator::PredictLayouts(AST* tree)
+	{
+		// For each global function F used as new F, predict the
+		// properties of its instances: what F's body stores into this,
+		// then what the methods on F.prototype store into it.
+		for (int i = 0; i < (int)newTargets.size(); i++) {
+			const char* name = newTargets[i];
+			Binding decl;
+			aScope* owner;
+			if (!global_scope->FindDeclaration(name, decl, owner) ||
+				owner!=global_scope || !decl.isFunction() || !FuncBody(decl.Definition())) {
+				continue;
+			}
+			// F = something else would void the guess
+			StoreCounter sc = { name, 0 };
+			Walk(tree, CountStore, &sc);
+			if (sc.count != 0) {
+				continue;
+			}
+			Keys keys;
+			ThisStores(FuncBody(decl.Definition()), keys);
+			std::vector<AST*>& methods = protoMethods[name];
+			for (int m = 0; m < (int)methods.size(); m++) {
+				ThisStores(FuncBody(methods[m]), keys);
+			}
+			if (!keys.empty()) {
+				for (int k = 0; k < (int)keys.size(); k++) {
+					PoolId(keys[k]);
+				}
+				layouts[name] = keys;
+			}
+		}
+	} // PredictLayouts
+
+	void CodeGenerator::EmitLayouts(void)
+	{
+		if (layouts.empty()) {
+			return;
+		}
+		emit("// instance layouts\n");
+		for (std::map<const char*,Keys>::iterator ii = layouts.begin(); ii != layouts.end(); ++ii) {
+			const char* name = (*ii).first;
+			Keys& keys = (*ii).second;
+			std::string ids(name);
+			ids += "_layout_ids_";
+			EmitIdTable(ids.c_str(), keys);
+			// (each isolate learns its own)
+			emitf("static %slayout_ %s_layout_ = { { %d, %s_layout_ids_, \"new %s\" }, %d };\n",
+				bIsolate ? "JS_THREAD " : "", name, keys.size(), name, name, keys.size());
+		}
+		emit("\n");
+	} // EmitLayouts
+
+	static std::string CBytes(const char* s, int n)
+	{
+		// any n bytes => C++ string literal
+		std::string lit("\"");
+		for (int i = 0; i < n; i++) {
+			unsigned char c = s[i];
+			if (c=='\\' || c=='\"' || c=='?') {
+				lit += '\\';			// \? so no trigraphs
+				lit += c;
+			} else if (c < ' ' || c >= 0x7F) {
+				char octal[8];
+				sprintf(octal, "\\%03o", c);
+				lit += octal;
+			} else {
+				lit += c;
+			}
+		}
+		return lit + "\"";
+	}
+
+	void CodeGenerator::EmitRegexes(void)
+	{
+		// Each regex literal is compiled now, by the same compiler
+		// new RegExp uses at run time, and its program emitted as
+		// static data: all rx_ does is wrap it in a RegExp object.
+		static const char* ops[] = {
+			"RX_CHAR", "RX_ANY", "RX_CLASS", "RX_SPLIT", "RX_JMP", "RX_SAVE",
+			"RX_BOL", "RX_EOL", "RX_WORDB", "RX_NWORDB", "RX_MATCH", "RX_CLEAR",
+		};
+		static const char* skips[] = {
+			"RX_SKIP_NONE", "RX_SKIP_PREFIX", "RX_SKIP_FIRST", "RX_SKIP_ANCHORED",
+		};
+		if (!regexes.empty()) {
+			emit("// regular expressions\n");
+		}
+		for (int r = 0; r < (int)regexes.size(); r++) {
+			const char* text = Name(regexes[r]);
+			const char* close = strrchr(text, '/');
+			const char* err = "bad flags";
+			int flags = rxflags_(close + 1);
+			rxprog_* prog = flags < 0 ? NULL : rxcompile_(text + 1, close - text - 1, flags, &err);
+			if (!prog) {
+				std::string msg("invalid regular expression ");
+				msg += text;
+				msg += ": ";
+				msg += err;
+				Error(E_SEMANTIC, regexes[r], msg.c_str());
+				emitf("static const rxprog_ rx%d_ = { 0 };\n", r);
+				continue;
+			}
+			emitf("static const rxinst_ rx%d_inst_[] = {", r);
+			int i, nclasses = 0;
+			for (i = 0; i < prog->ninst; i++) {
+				const rxinst_& in = prog->inst[i];
+				emit(i % 8 ? " " : "\n\t");
+				emitf("{%s,%d,%d},", ops[in.op], in.x, in.y);
+				if (in.op==RX_CLASS && in.x >= nclasses) {
+					nclasses = in.x + 1;
+				}
+			}
+			emit("\n};\n");
+			if (nclasses) {
+				emitf("static const unsigned char rx%d_classes_[] = {", r);
+				for (i = 0; i < 32 * nclasses; i++) {
+					emitf("%s%d,", i % 32 ? "" : "\n\t", prog->classes[i]);
+				}
+				emit("\n};\n");
+			}
+			emitf("static const rxprog_ rx%d_ = { %s, %d, %d, rx%d_inst_, ",
+				r, CBytes(prog->source, strlen(prog->source)).c_str(), prog->flags, prog->ninst, r);
+			if (nclasses) {
+				emitf("rx%d_classes_, ", r);
+			} else {
+				emit("0, ");
+			}
+			emitf("%d, %s", prog->ngroups, skips[prog->skip]);
+			if (prog->skip==RX_SKIP_PREFIX) {
+				emitf(", %s, %d", CBytes(prog->prefix, prog->prefixlen).c_str(), prog->prefixlen);
+			} else if (prog->skip==RX_SKIP_FIRST) {
+				emit(", 0, 0, {");
+				for (i = 0; i < 32; i++) {
+					emitf("%s%d", i ? "," : "", prog->first[i]);
+				}
+				emit("}");
+			}
+			emit(" };\n");
+			rxfree_(prog);
+		}
+		if (!regexes.empty()) {
+			emit("\n");
+		}
+	} // EmitRegexes
+
+	void CodeGenerator::EmitIdTable(const char* name, Keys& keys)
+	{
+		// A table of property ids, initialized to the plain literals
+		// and pointed at the atoms by jsinit_.
+		emitf("static const char* %s[] = {", name);
+		int k;
+		for (k = 0; k < (int)keys.size(); k++) {
+			emitf("%s\"%s\"", k ? "," : "", keys[k]);
+		}
+		emit("};\n");
+		for (k = 0; k < (int)keys.size(); k++) {
+			char index[32];
+			std::string lit("\"");
+			lit += keys[k];
+			lit += "\"";
+			sprintf(index, "[%d] = ", k);
+			initCode += "\t";
+			initCode += name;
+			initCode += index;
+			std::map<std::string,int>::iterator ii = strIndex.find(lit);
+			if (ii != strIndex.end()) {
+				sprintf(index, "str_[%d].v.s;\n", (*ii).second);
+				initCode += index;
+			} else {
+				initCode += "intern_(" + lit + ");\n";
+			}
+		}
+	} // EmitIdTable
+
+	void CodeGenerator::EmitInit(void)
+	{
+		// Interning is the one thing the linker can't do for us,
+		// so it happens here, first thing in jsmain_.
+		if (initCode.empty()) {
+			return;
+		}
+		emit("static void jsinit_(void)\n{\n");
+		emit(initCode.c_str());
+		emit("} // jsinit_\n\n");
+	} // EmitInit
+
+	void CodeGenerator::Snapshot(AST* tree)
+	{
+		// Run the top-level statements at build time for as long as
+		// all they do is build objects out of constants and functions:
+		//   var x = e, x = e, x.k = e, F.prototype = e, F.prototype.k = e
+		// with e a literal, an object literal, a top-level function or
+		// a variable set by an earlier such statement. The resulting
+		// heap is emitted as static data, and jsmain_ starts after it.
+		restStatements = tree;
+		if (!bSnapshot || !tree) {
+			return;
+		}
+		// global functions that are never reassigned
+		Bindings& decls = global_scope->Declarations();
+		for (Bindings::iterator ii=decls.begin(); ii!=decls.end(); ++ii) {
+			Binding& binding = (*ii).second;
+			if (binding.isFunction() && FuncBody(binding.Definition())) {
+				StoreCounter sc = { (const char*)(*ii).first, 0 };
+				Walk(tree, CountStore, &sc);
+				if (sc.count == 0) {
+					snapFuncs.push_back(sc.id);
+				}
+			}
+		}
+		for (; restStatements && Type(restStatements)==tSTATLIST; restStatements = restStatements->third) {
+			AST* stat = restStatements->first;
+			if (!stat || Type(stat)==tFUNCTION) {
+				continue;
+			}
+			int nobjs = snapObjects.size();
+			bool bDone = false;
+			if (Type(stat)==tVAR) {
+				// evaluate all the initializers before storing any
+				std::vector<SnapValue> inits;
+				AST* d;
+				bDone = true;
+				for (d = stat; d && bDone; d = d->third) {
+					SnapValue v;
+					if (d->first && d->second) {
+						bDone = SnapEval(d->second, v);
+						inits.push_back(v);
+					}
+				}
+				for (d = stat; d && bDone; d = d->third) {
+					Binding decl;
+					aScope* owner;
+					if (d->first && d->second &&
+						(!global_scope->FindDeclaration(Name(d->first), decl, owner) || !decl.isVar())) {
+						bDone = false;
+					}
+				}
+				int i = 0;
+				for (d = stat; d && bDone; d = d->third) {
+					if (d->first && d->second) {
+						SnapStore(d->first, inits[i++]);
+					}
+				}
+			} else if (Type(stat)==tASSIGN) {
+				SnapValue v;
+				bDone = SnapEval(RHS(stat), v) && SnapStore(LHS(stat), v);
+			}
+			if (!bDone) {
+				snapObjects.erase(snapObjects.begin() + nobjs, snapObjects.end());
+				break;
+			}
+		}
+	} // Snapshot
+
+	bool CodeGenerator::SnapFunction(AST* ident)
+	{
+		return ident && Type(ident)==tIDENT &&
+			std::find(snapFuncs.begin(), snapFuncs.end(), Name(ident))!=snapFuncs.end();
+	} // SnapFunction
+
+	bool CodeGenerator::SnapEval(AST* e, SnapValue& v)
+	{
+		// the value of e at build time, if it has one
+		v.expr = e;
+		v.obj = -1;
+		if (!e) {
+			return false;
+		}
+		bool bNeg;
+		switch (Type(e)) {
+		case tSTRING:
+		case tTRUE:
+		case tFALSE:
+			return true;
+		case tFUNEX:
+			// only a top-level one has a static func_ object
+			return e->Scope()->Depth()==1;
+		case tIDENT:
+			if (SnapFunction(e)) {
+				return true;
+			} else {
+				std::map<const char*,SnapValue>::iterator ii = snapGlobals.find(Name(e));
+				if (ii != snapGlobals.end()) {
+					v = (*ii).second;
+					return true;
+				}
+			}
+			return false;
+		case tOBJLIT:
+			v.obj = snapObjects.size();
+			snapObjects.push_back(SnapObject());
+			for (AST* p = e; p && p->first; p = p->third) {
+				SnapValue pv;
+				if (!SnapEval(p->second, pv)) {
+					return false;
+				}
+				SnapSet(v.obj, Name(p->first), pv);
+			}
+			return true;
+		default:
+			return NumberLiteral(e, bNeg)!=NULL;
+		}
+	} // SnapEval
+
+	bool CodeGenerator::SnapStore(AST* target, const SnapValue& v)
+	{
+		// target = v, if target is something the snapshot can hold
+		if (Type(target)==tIDENT) {
+			Binding decl;
+			aScope* owner;
+			if (!global_scope->FindDeclaration(Name(target), decl, owner) || !decl.isVar()) {
+				return false;
+			}
+			snapGlobals[Name(target)] = v;
+			return true;
+		}
+		if (Type(target)!=tDOT) {
+			return false;
+		}
+		AST* base = LeftOperand(target);
+		const char* key = Name(RightOperand(target));
+		if (0==strcmp(key, "prototype")) {
+			if (!SnapFunction(base) || v.obj < 0) {
+				return false;
+			}
+			snapProtos[Name(base)] = v.obj;
+			return true;
+		}
+		int obj = -1;
+		if (Type(base)==tDOT && 0==strcmp(Name(RightOperand(base)), "prototype") &&
+			SnapFunction(LeftOperand(base))) {
+			const char* fname = Name(LeftOperand(base));
+			std::map<const char*,int>::iterator ii = snapProtos.find(fname);
+			if (ii == snapProtos.end()) {
+				// F.prototype, made on first use
+				obj = snapProtos[fname] = snapObjects.size();
+				snapObjects.push_back(SnapObject());
+			} else {
+				obj = (*ii).second;
+			}
+		} else if (Type(base)==tIDENT) {
+			std::map<const char*,SnapValue>::iterator ii = snapGlobals.find(Name(base));
+			if (ii != snapGlobals.end()) {
+				obj = (*ii).second.obj;
+			}
+		}
+		if (obj < 0) {
+			return false;
+		}
+		SnapSet(obj, key, v);
+		return true;
+	} // SnapStore
+
+	void CodeGenerator::SnapSet(int obj, const char* key, const SnapValue& v)
+	{
+		SnapObject& o = snapObjects[obj];
+		for (int k = 0; k < (int)o.keys.size(); k++) {
+			if (o.keys[k]==key) {
+				o.values[k] = v;
+				return;
+			}
+		}
+		PoolId(key);
+		o.keys.push_back(key);
+		o.values.push_back(v);
+	} // SnapSet
+
+	void CodeGenerator::EmitSnapValue(const SnapValue& v)
+	{
+		// the argument of the value_ constructor for v
+		if (v.obj >= 0) {
+			emitf("&snap_[%d]", v.obj);
+			return;
+		}
+		bool bNeg;
+		const char* text;
+		Binding decl;
+		aScope* owner;
+		switch (Type(v.expr)) {
+		case tSTRING:
+			emitString(Name(v.expr));
+			break;
+		case tTRUE:
+		case tFALSE:
+			emit(Type(v.expr)==tTRUE ? "true" : "false");
+			break;
+		case tFUNEX:
+			emitf("(func_*)&%s_func_", FuncName(v.expr));
+			break;
+		case tIDENT:
+			global_scope->FindDeclaration(Name(v.expr), decl, owner);
+			emitf("(func_*)&%s_func_", FuncName(decl.Definition()));
+			break;
+		default:
+			text = NumberLiteral(v.expr, bNeg);
+			emitf("(double)%s%s", bNeg ? "-" : "", text);
+			break;
+		}
+	} // EmitSnapValue
+
+	void CodeGenerator::EmitSnapshot(void)
+	{
+		// The objects and the global variables left by the setup
+		// code, all constant-initialized.
+		int s;
+		if (!snapObjects.empty()) {
+			emit("\n// heap snapshot\n");
+		}
+		for (s = 0; s < (int)snapObjects.size(); s++) {
+			SnapObject& o = snapObjects[s];
+			if (o.keys.empty()) {
+				continue;
+			}
+			emitf("static value_ snap%d_slots_[] = {", s);
+			for (int k = 0; k < (int)o.values.size(); k++) {
+				emit(k ? ",\n\tvalue_(" : "\n\tvalue_(");
+				EmitSnapValue(o.values[k]);
+				emit(")");
+			}
+			emit("\n};\n");
+		}
+		if (!snapObjects.empty()) {
+			emitf("obj_ snap_[%d] = {\n", snapObjects.size());
+			for (s = 0; s < (int)snapObjects.size(); s++) {
+				int n = snapObjects[s].keys.size();
+				if (n) {
+					emitf("\tobj_(&snap%d_shape_, snap%d_slots_, %d),\n", s, s, n);
+				} else {
+					emit("\tobj_(),\n");
+				}
+			}
+			emit("};\n");
+		}
+		for (std::map<const char*,SnapValue>::iterator ii = snapGlobals.begin(); ii != snapGlobals.end(); ++ii) {
+			emitf("value_ %s(", (*ii).first);
+			EmitSnapValue((*ii).second);
+			emit(");\n");
+		}
+		emit("\n");
+	} // EmitSnapshot
+
+	const char* CodeGenerator::LayoutOf(AST* cons)
+	{
+		// name of the predicted layout for new cons, or NULL
+		if (!cons || Type(cons)!=tIDENT) {
+			return NULL;
+		}
+		Binding decl;
+		aScope* owner;
+		if (!ActiveScope()->FindDeclaration(Name(cons), decl, owner) || owner!=global_scope) {
+			return NULL;
+		}
+		std::map<const char*,Keys>::iterator ii = layouts.find(Name(cons));
+		return ii != layouts.end() ? (*ii).first : NULL;
+	} // LayoutOf
+
+	void CodeGenerator::EmitStatics(AST* tree)
+	{
+		// Every object literal gets a static shape_, shared by all
+		// the literals with the same keys in the same order.
+		// Array literals of constants become read-only tables.
+		Walk(tree, CollectStatic, this);
+		PredictLayouts(tree);
+		Snapshot(tree);
+		EmitPool();
+		if (!constArrays.empty()) {
+			emit("// constant arrays\n");
+		}
+		for (int a = 0; a < (int)constArrays.size(); a++) {
+			AST* list = constArrays[a]->first;
+			bool bNum = ConstArrayType(constArrays[a])==tNUMBER;
+			emitf("static const %s arr%d_[] = {", bNum ? "double" : "char* const", a);
+			for (int i = 0; list; list = list->second, i++) {
+				emit(i ? (i % 16 ? "," : ",\n\t") : "");
+				if (bNum) {
+					bool bNeg;
+					const char* text = NumberLiteral(list->first, bNeg);
+					emitf("%s%s", bNeg ? "-" : "", text);
+				} else {
+					emitString(Name(list->first));
+				}
+			}
+			emit("};\n");
+		}
+		EmitRegexes();
+		if (!shapes.empty()) {
+			emit("// object shapes\n");
+		}
+		for (int n = 0; n < (int)shapes.size(); n++) {
+			Keys& keys = shapes[n];
+			char ids[32];
+			sprintf(ids, "shape%d_ids_", n);
+			EmitIdTable(ids, keys);
+			std::string name = "{";
+			for (int k = 0; k < (int)keys.size(); k++) {
+				name += k ? "," : "";
+				name += keys[k];
+			}
+			name += "}";
+			emitf("static const shape_ shape%d_ = { %d, shape%d_ids_, %s };\n", n, keys.size(), n, Quoted(name.c_str()).c_str());
+		}
+		emit("\n");
+		EmitLayouts();
+		if (!snapObjects.empty()) {
+			// defined after the functions, which they can refer to
+			emit("// heap snapshot of the top-level setup code\n");
+			emitf("extern obj_ snap_[%d];\n", snapObjects.size());
+		}
+		for (int s = 0; s < (int)snapObjects.size(); s++) {
+			Keys& keys = snapObjects[s].keys;
+			if (!keys.empty()) {
+				char ids[32];
+				sprintf(ids, "snap%d_ids_", s);
+				EmitIdTable(ids, keys);
+				emitf("static const shape_ snap%d_shape_ = { %d, snap%d_ids_ };\n", s, keys.size(), s);
+			}
+		}
+		if (!snapObjects.empty()) {
+			emit("\n");
+		}
+		EmitInit();
+	} // EmitStatics
+
+	void CodeGenerator::ObjectLiteral(AST* lit)
+	{
+		// { k1: e1, k2: e2, ... } is built in one allocation,
+		// with the values stored straight into its slots.
+		std::map<AST*,int>::iterator ii = litShapes.find(lit);
+		if (ii == litShapes.end()) {
+			// {}
+			emit("value_(new obj_)");
+			return;
+		}
+		int n = (*ii).second;
+		Keys& keys = shapes[n];
+		// the values go in by key, so any with effects are evaluated
+		// first, in the order they're written
+		std::vector<AST*> values;
+		std::vector<std::string> use;
+		AST* e;
+		for (e = lit; e; e = e->third) {
+			values.push_back(e->second);
+		}
+		bool bOpen = InOrder(values, false, use);
+		emitf("MakeObject_(&shape%d_", n);
+		for (int k = 0; k < (int)keys.size(); k++) {
+			emit(",value_((");
+			// A repeated key: evaluate every value, keep the last.
+			bool bFirst = true;
+			int i = 0;
+			for (e = lit; e; e = e->third, i++) {
+				if (Name(e->first)==keys[k]) {
+					if (!bFirst) {
+						emit(",");
+					}
+					emit("(");
+					if (use[i].empty()) {
+						ExprValue(e->second);
+					} else {
+						emit(use[i].c_str());
+					}
+					emit(")");
+					bFirst = false;
+				}
+			}
+			emit("))");
+		}
+		emit(bOpen ? "))" : ")");
+	} // ObjectLiteral
+
+	void CodeGenerator::ArrayLiteral(AST* lit)
+	{
+		std::map<AST*,int>::iterator ii = litArrays.find(lit);
+		if (ii != litArrays.end()) {
+			// [ constants ] => wrap the static table, copy on write
+			emitf("ConstArray_(%d,arr%d_)", ListLength(lit->first), (*ii).second);
+			return;
+		}
+		emitf("MakeArray_(%d", ListLength(lit->first));
+		for (AST* list = lit->first; list; list = list->second) {
+			assert(Type(list)==tCOMMA);
+			emit(",value_(");
+			if (list->first) {
+				ExprValue(list->first);
+			} else {
+				emit("undefined");
+			}
+			emit(")");
+		}
+		emit(")");
+	} // ArrayLiteral
+
 	void CodeGenerator::TopLevelDefs(AST* tree)
 	{
 		if (!tree || Type(tree)==tINVALID) {
@@ -151,22 +1719,34 @@ namespace js2cpp {
 		// implicitly defined.
 		aScope* scope = tree->Scope();
 		Bindings& decls = scope->Declarations();
+		std::string members;		// --isolate: the globals_ members
 
-		for (Bindings::iterator ii=decls.begin(); ii!=decls.end(); ++ii) {
+		Bindings::iterator ii;
+		for (ii=decls.begin(); ii!=decls.end(); ++ii) {
 			Binding& binding = (*ii).second;
 			const char* id = (const char*)(*ii).first;
 			emit(indent_str);
+			if (bIsolate && !binding.isExtern()) {
+				members += "\tvalue_ ";
+				members += id;
+				members += ";\n";
+			}
 			if (binding.isReference()) {
 				// referenced but never defined
 				// TODO: Reference to such a variable before it is set
 				// is supposed to throw an exception.
-				emitf("value_ %s;\n", id);
+				if (!bIsolate) {
+					emitf("value_ %s;\n", id);
+				}
 			} else if (binding.isExtern()) {
 				// External variable
 				emitf("extern value_ %s;\n", id);
 			} else if (binding.isVar()) {
 				// Local (global) variable
-				emitf("value_ %s;\n", id);
+				// (if the snapshot has its value, it's defined there)
+				if (!bIsolate) {
+					emitf("%svalue_ %s;\n", snapGlobals.count(id) ? "extern " : "", id);
+				}
 			} else if (binding.isFunction()) {
 				// Function
 				// do a tricky declare & initialize.
@@ -185,12 +1765,22 @@ namespace js2cpp {
 				emit(indent_str);
 				emitf("%s_foc_ %s_func_;\n", fname, fname);
 				// declare variable that holds function value:
-				emit(indent_str);
-				emitf("value_ %s(&%s_func_);\n", id, fname);
+				// (an isolate's is set by InitializeVars)
+				if (!bIsolate) {
+					emit(indent_str);
+					emitf("value_ %s(&%s_func_);\n", id, fname);
+				}
 			} else {
 				assert(false);
 			}
 		}
+		if (bIsolate) {
+			// one of these per isolate, made by jsmain_
+			emit("\nstruct globals_ {\n");
+			emit(members.c_str());
+			emit("};\n");
+			emit("#define gv_ ((globals_*)globalsp_)\n");
+		}
 
 		// Emit function definitions
 		emit("\n// literal functions\n");
@@ -223,6 +1813,19 @@ namespace js2cpp {
 
 	void CodeGenerator::InitializeVars(AST* tree)
 	{
+		// --isolate: global function variables start out holding their
+		// functions (otherwise the linker sets them up)
+		if (!bIsolate) {
+			return;
+		}
+		Bindings& decls = tree->Scope()->Declarations();
+		for (Bindings::iterator ii=decls.begin(); ii!=decls.end(); ++ii) {
+			Binding& binding = (*ii).second;
+			if (binding.isFunction()) {
+				const char* fname = FuncName(binding.Definition());
+				emitf("%sgv_->%s = value_(&%s_func_);\n", indent_str, (const char*)(*ii).first, fname);
+			}
+		}
 	} // InitializeVars
 
 	void CodeGenerator::DeclareFunctionClass(AST* fun)
@@ -231,31 +1834,40 @@ namespace js2cpp {
 		emit("\n");		// just for readability
 		aScope* scope = fun->Scope();
 		int depth = scope->Depth();		// levels of nesting
+		// Static metadata shared by all its func_ objects
+		AST* ident = FuncIdent(fun);
+		emitf("static JS_CONSTEXPR const funcinfo_ %s_info_ = { \"%s\", %d, %s",
+			fname, ident ? Name(ident) : "", ArgCount(fun), IsPure(fun) ? "true" : "false");
+		std::map<const char*,int>::iterator pp = snapProtos.find(ident ? Name(ident) : "");
+		if (Type(fun)==tFUNCTION && depth==1 && pp != snapProtos.end()) {
+			// its prototype is in the snapshot
+			emitf(", &snap_[%d]", (*pp).second);
+		}
+		emit(" };\n");
 		// Forward declare the class that represents the literal function
 		emitf("class %s_foc_ : public func_ {\n", fname);
 		emitf("public:\n");
 		// emit 'defining scope' links for each NLNG scope:
-		for (int d = 1; d < depth; d++) {
-			emitf("  %s_locals_& nlng%d_;\n", scope->AtDepth(d)->Name(), d);
+		int d;
+		for (d = 1; d < depth; d++) {
+			emitf("  %s_locals_& nlng%d_;\n", FuncName(scope->AtDepth(d)->Tree()), d);
 		}
-		// Create constructor for func_ objects for this function:
-		emitf("  %s_foc_(", fname);
+		// Create constructor for func_ objects for this function.
+		// A top-level function's is a constant expression, so its
+		// one func_ object is laid down by the linker.
+		emitf("  %s%s_foc_(", depth==1 ? "JS_CONSTEXPR " : "", fname);
 		for (d = 1; d < depth; d++) {
 			if (d > 1) {
 				emit(",");
 			}
-			emitf("%s_locals_* pl%d_", scope->AtDepth(d)->Name(), d);
+			emitf("%s_locals_* pl%d_", FuncName(scope->AtDepth(d)->Tree()), d);
 		}
-		emit(")");
+		// (one made by new, below the top level, is its isolate's own)
+		emitf(") : func_(&%s_info_%s)", fname, depth==1 ? "" : ",false");
 		for (d = 1; d < depth; d++) {
-			if (d==1) {
-				emit(" : ");
-			} else {
-				emit(",");
-			}
-			emitf("nlng%d_(*pl%d_)", d, d);
+			emitf(",nlng%d_(*pl%d_)", d, d);
 		}
-		emitf(" { length=%d; }\n", ArgCount(fun));
+		emit(" {}\n");
 		emitf("  virtual value_ call(value_,int,...);\n");
 		emitf("};\n");
 		emit("\n");
@@ -309,20 +1921,31 @@ namespace js2cpp {
 			// Begin the actual function body
 			emitf("value_ %s_foc_::call(value_ this_,int nargs_,...) {\n", name);
 			indent();
+			if (bInstrument) {
+				emitf("%scallprobe_ probe_(%d);\n", indent_str, (int)instrumented.size());
+				instrumented.push_back(def);
+			}
 			// push into scope of function
 			aScope* old_local_scope = local_scope;
 			local_scope = def->Scope();
 			Log("Inside scope %s\n", local_scope->Name());
+			// (a call restores its caller's site when it returns)
+			int oldSite = curSite;
+			const char* oldFunction = curFunction;
+			curSite = 0;
+			curFunction = FuncIdent(def) ? FuncIdent(def)->Name() : "(anonymous)";
 
 			EmitLocals(def, bHeapLocals);
 			BindFormals(formals);
-			emit("\n");
-			Statements(body);
+			TempStatements(body, false);
+			CppLines();
 			// Throw out a 'safety' return in case
 			// the body falls thru without returning a value:
 			emitf("%sreturn undefined;\n", indent_str);
 			dedent();
 			emitf("%s} // call\n\n", indent_str);
+			curSite = oldSite;
+			curFunction = oldFunction;
 
 			// pop out to surrounding scope, if any
 			Log("Leaving scope %s\n", local_scope->Name());
@@ -355,6 +1978,9 @@ namespace js2cpp {
 				emitf("value_ %s;\n", id);
 			}
 		} // for
+		if (bHeapProf) {
+			emitf("%s  static void* operator new(size_t n) { return heapnew_(n); }\n", indent_str);
+		}
 		emitf("%s};\n\n", indent_str);
 	} // DeclareLocalStruct
 
@@ -367,6 +1993,9 @@ namespace js2cpp {
 		const char* fname = FuncName(tree);
 		if (bHeap) {
 			// allocate locals on heap
+			if (bHeapProf) {
+				emitf("%sallocsite_ = %d;\n", indent_str, AddHeapSite(tree, "locals"));
+			}
 			emit(indent_str);
 			emitf("%s_locals_& locals_ = *(new %s_locals_);\n", fname, fname);
 		} else {
@@ -383,6 +2012,9 @@ namespace js2cpp {
 			if (binding.isFunction()) {
 				// nested function def
 				AST* nestedfn = binding.Definition();
+				if (bHeapProf) {
+					emitf("%sallocsite_ = %d;\n", indent_str, AddHeapSite(nestedfn, "closure"));
+				}
 				emit(indent_str);
 				emitf("locals_.%s = ", FuncName(nestedfn));
 				EmitFuncVal(nestedfn);
@@ -399,10 +2031,28 @@ namespace js2cpp {
 
 		switch (Type(tree)) {
 		case tDOT:
-			emit("(");
-			ExprValue(LeftOperand(tree));
-			// TODO: intern any string handed to .ref
-			emitf(").dotref(\"%s\")", RightOperand(tree)->Name());
+			{
+				std::string shape;
+				int k;
+				if (bFeedback) {
+					emitf("(fbshape_(%d,", AddFeedbackSite(tree, "ref"));
+					ExprValue(LeftOperand(tree));
+					emit(")");
+				} else if (MonoShape(tree, "ref", shape, k)) {
+					emit("dotrefmono_(");
+					ExprValue(LeftOperand(tree));
+					emitf(",%s,%d,", shape.c_str(), k);
+					EmitId(RightOperand(tree)->Name());
+					emit(")");
+					break;
+				} else {
+					emit("(");
+					ExprValue(LeftOperand(tree));
+				}
+			}
+			emit(").dotref(");
+			EmitId(RightOperand(tree)->Name());
+			emit(")");
 			break;
 
 		case tLBRACKET:
@@ -426,13 +2076,27 @@ namespace js2cpp {
 		if (!tree || Type(tree)==tINVALID) {
 			return;
 		}
+		if (bHeapProf && tree != siting) {
+			const char* what = AllocSite(tree);
+			if (what) {
+				SitedExpr(tree, what);
+				return;
+			}
+		}
 
 		switch (Type(tree)) {
 		case tINVALID:
 			return;
 
 		case tNUMBER:
-			emitf("value_(%s)", tree->token.m_name);
+			{
+				std::map<std::string,int>::iterator ii = numIndex.find(Name(tree));
+				if (ii != numIndex.end()) {
+					emitf("num_[%d]", (*ii).second);
+				} else {
+					emitf("value_(%s)", tree->token.m_name);
+				}
+			}
 			break;
 
 		case tIDENT:
@@ -445,6 +2109,10 @@ namespace js2cpp {
 						emit("locals_.");
 					} else if (owner == global_scope) {
 						// no prefix needed, just a bare reference
+						// (but an isolate's globals are its own)
+						if (bIsolate && !decl.isExtern()) {
+							emit("gv_->");
+						}
 					} else {
 						// NLNG reference
 						emitf("nlng%d_.", owner->Depth());
@@ -475,13 +2143,20 @@ namespace js2cpp {
 			break;
 
 		case tSTRING:
-			emit("value_(");
-			emitString(tree->token.m_name);
-			emit(")");
+			{
+				std::string lit = CLiteral(Name(tree));
+				std::map<std::string,int>::iterator ii = strIndex.find(lit);
+				if (ii != strIndex.end()) {
+					emitf("str_[%d]", (*ii).second);
+				} else {
+					emitf("value_(%s)", lit.c_str());
+				}
+			}
 			break;
 
 		case tREGEX:
-			emitf("rx_(\"%s\")", tree->token.m_name);
+			// compiled by EmitRegexes
+			emitf("rx_(&rx%d_)", regexIndex[Name(tree)]);
 			break;
 
 		case tFUNEX:
@@ -489,25 +2164,12 @@ namespace js2cpp {
 			EmitFuncVal(tree);
 			break;
 
+		case tOBJLIT:
+			ObjectLiteral(tree);
+			break;
+
 		case tARRAYLIT:
-			// array literal
-			{
-				emit(indent_str);
-				emitf("MakeArray_(%d", ListLength(tree->first));
-				AST* list = tree->first;
-				while (list) {
-					emit(",");
-					assert(Type(list)==tCOMMA);
-					emitf("\n%s", indent_str);
-					if (list->first) {
-						ExprValue(list->first);
-					} else {
-						emit("undefined");
-					}
-					list = list->second;
-				} // while
-				emit(");\n");
-			}
+			ArrayLiteral(tree);
 			break;
 
 		case tVAR:
@@ -532,9 +2194,24 @@ namespace js2cpp {
 		case tASSREM:
 		case tASSSL:
 		case tASSSRSX:
+		case tASSSRZX:
 		case tASSAND:
 		case tASSXOR:
 		case tASSOR:
+			if (TypedElementOp(tree) || ElementOp(tree)) {
+				break;
+			}
+			if (Type(tree)==tASSIGN && LHS(tree) && Type(LHS(tree))==tLBRACKET) {
+				// indexed store: o.put(x,v)
+				emit("(");
+				ExprValue(LHS(tree)->first);
+				emit(").put(");
+				ExprValue(LHS(tree)->second);
+				emit(",(");
+				ExprValue(RHS(tree));
+				emit("))");
+				break;
+			}
 			RefExpr(LHS(tree));
 			emit(tree->token.m_name);
 			ExprValue(RHS(tree));
@@ -546,6 +2223,9 @@ namespace js2cpp {
 			break;
 
 		case tPLUS:
+			if (ArithSite(tree)) {
+				break;
+			}
 			if (tree->first) {
 				ExprValue(tree->first);
 				emit(tree->token.m_name);
@@ -554,6 +2234,9 @@ namespace js2cpp {
 			break;
 
 		case tMINUS:
+			if (ArithSite(tree)) {
+				break;
+			}
 			if (tree->first) {
 				ExprValue(tree->first);
 			}
@@ -576,6 +2259,9 @@ namespace js2cpp {
 		case tXOR:
 		case tREM:
 		case tDIV:
+			if (ArithSite(tree)) {
+				break;
+			}
 			emit("(");
 			ExprValue(LeftOperand(tree));
 			emit(")");
@@ -596,13 +2282,54 @@ namespace js2cpp {
 			break;
 
 		case tDOT:
-			emit("(");
-			ExprValue(LeftOperand(tree));
-			emitf(").dot(\"%s\")", RightOperand(tree)->Name());
+			if (MathConstant(tree)) {
+				emitf("value_(%s)", MathConstant(tree));
+				break;
+			}
+			if (0==strcmp(RightOperand(tree)->Name(), "length") && TypedArrayKind(LeftOperand(tree))) {
+				emit("value_((double)typed_(");
+				ExprValue(LeftOperand(tree));
+				emit(")->length)");
+				break;
+			}
+			{
+				std::string shape;
+				int k;
+				if (bFeedback) {
+					emitf("(fbshape_(%d,", AddFeedbackSite(tree, "dot"));
+					ExprValue(LeftOperand(tree));
+					emit(")");
+				} else if (MonoShape(tree, "dot", shape, k)) {
+					emit("dotmono_(");
+					ExprValue(LeftOperand(tree));
+					emitf(",%s,%d,", shape.c_str(), k);
+					EmitId(RightOperand(tree)->Name());
+					emit(")");
+					break;
+				} else {
+					emit("(");
+					ExprValue(LeftOperand(tree));
+				}
+			}
+			emit(").dot(");
+			EmitId(RightOperand(tree)->Name());
+			emit(")");
 			break;
 
 		case tLBRACKET:
 			// array indexing
+			{
+				const char* kind = TypedArrayKind(tree->first);
+				if (kind) {
+					// direct typed load
+					emitf("%s_get_(", kind);
+					ExprValue(tree->first);
+					emit(",");
+					ExprNumber(tree->second);
+					emit(")");
+					break;
+				}
+			}
 			emit("(");
 			ExprValue(tree->first);
 			emit(").at(");
@@ -611,6 +2338,9 @@ namespace js2cpp {
 			break;
 
 		case tPLUSPLUS:
+			if (TypedElementOp(tree) || ElementOp(tree)) {
+				break;
+			}
 			if (IsPrefix(tree)) {
 				emit("preinc_(");
 				RefExpr(RightOperand(tree));
@@ -623,6 +2353,9 @@ namespace js2cpp {
 			break;
 
 		case tMINUSMINUS:
+			if (TypedElementOp(tree) || ElementOp(tree)) {
+				break;
+			}
 			if (IsPrefix(tree)) {
 				emit("predec_(");
 				RefExpr(RightOperand(tree));
@@ -651,9 +2384,23 @@ namespace js2cpp {
 					cons = op;
 					args = NULL;
 				}
-				ExprValue(cons);
-				emit(".toFunc()->call");
-				emitf("(value_(new obj_),%d", ListLength(args));
+				int n = ListLength(args);
+				if (n > 8) {
+					// TODO: construct_ forwards at most 8 args, with callv_
+					ExprValue(cons);
+					emit(".toFunc()->call");
+					emitf("(value_(new obj_),%d", n);
+				} else {
+					// new F with a predicted layout gets its slots up front
+					const char* layout = LayoutOf(cons);
+					emit("construct_(");
+					ExprValue(cons);
+					if (layout) {
+						emitf(",&%s_layout_,%d", layout, n);
+					} else {
+						emitf(",0,%d", n);
+					}
+				}
 				if (args) {
 					emit(",");
 					ExprList(args);
@@ -709,17 +2456,396 @@ namespace js2cpp {
 		} // switch
 	}
 
+	const char* CodeGenerator::AllocSite(AST* tree)
+	{
+		// --heapprof: if the code for tree allocates, or calls what
+		// may, say what it is, else NULL
+		switch (Type(tree)) {
+		case tOBJLIT:
+			return "object literal";
+		case tARRAYLIT:
+			return "array literal";
+		case tFUNEX:
+			// (top-level ones are static)
+			return tree->Scope()->Depth() > 1 ? "closure" : NULL;
+		case tNEW:
+			return "new";
+		case tPLUS:
+			return tree->first && !IsNumeric(tree) ? "+" : NULL;
+		case tLPAREN:
+			return MathIntrinsic(tree) < 0 ? "call" : NULL;
+		case tASSPLUS:
+			return "+=";
+		default:
+			if (isAssOp(Type(tree))) {
+				AST* target = LHS(tree);
+				if (Type(target)==tDOT ||
+					(Type(target)==tLBRACKET && !TypedArrayKind(target->first))) {
+					return "property store";
+				}
+			}
+			return NULL;
+		} // switch
+	} // AllocSite
+
+	int CodeGenerator::AddHeapSite(AST* tree, const char* what)
+	{
+		HeapSite site;
+		site.file = tree->token.m_sourceName;
+		site.line = tree->token.m_line;
+		site.function = curFunction;
+		site.what = what;
+		heapSites.push_back(site);
+		return heapSites.size() - 1;
+	}
+
+	void CodeGenerator::SitedExpr(AST* tree, const char* what)
+	{
+		// (allocsite_=S,tree): S is current while tree runs, though
+		// not while its operands do, as any site among them sets its
+		// own - so inside another site P, sited_(P,...) puts P back
+		// once the inner one is done.
+		int site = AddHeapSite(tree, what);
+		int outer = curSite;
+		AST* oldSiting = siting;
+		if (outer) {
+			emitf("sited_(%d,", outer);
+		}
+		emitf("(allocsite_=%d,", site);
+		curSite = site;
+		siting = tree;
+		ExprValue(tree);
+		siting = oldSiting;
+		curSite = outer;
+		emit(outer ? "))" : ")");
+	} // SitedExpr
+
+	void CodeGenerator::EmitHeapSites(void)
+	{
+		if (!bHeapProf) {
+			return;
+		}
+		emit("// --heapprof: the allocation sites\n");
+		emit("extern const heapsite_ heapsites_[] = {\n");
+		emit("  {0,0,0,0},\n");
+		for (int i = 1; i < (int)heapSites.size(); i++) {
+			HeapSite& site = heapSites[i];
+			emitf("  {%s,%d,%s,%s},\n", Quoted(site.file ? site.file : "").c_str(), site.line,
+				Quoted(site.function).c_str(), Quoted(site.what).c_str());
+		}
+		emit("};\n");
+		emitf("extern const int nheapsites_ = %d;\n\n", (int)heapSites.size());
+	} // EmitHeapSites
+
+	void CodeGenerator::EmitFunctionTable(void)
+	{
+		if (!bInstrument) {
+			return;
+		}
+		emit("// --instrument: the functions, by callprobe_ index\n");
+		emit("extern const fninfo_ jsfunctions_[] = {\n");
+		for (int i = 0; i < (int)instrumented.size(); i++) {
+			AST* def = instrumented[i];
+			Token& token = def->token;
+			emitf("  {%s,%s,%d},\n", Quoted(FuncIdent(def) ? FuncIdent(def)->Name() : "(anonymous)").c_str(),
+				Quoted(token.m_sourceName ? token.m_sourceName : "").c_str(), token.m_line);
+		}
+		if (instrumented.empty()) {
+			emit("  {0,0,0}\n");
+		}
+		emit("};\n");
+		emitf("extern const int njsfunctions_ = %d;\n\n", (int)instrumented.size());
+	} // EmitFunctionTable
+
+	bool CodeGenerator::LoadProfile(const char* path)
+	{
+		// Read what a --feedback run saw (see jsfeedback.cpp)
+		FILE* f = fopen(path, "r");
+		if (!f) {
+			return false;
+		}
+		char line[1024];
+		while (fgets(line, sizeof line, f)) {
+			line[strcspn(line, "\r\n")] = '\0';
+			if (line[0]=='#' || !line[0]) {
+				continue;
+			}
+			// file:line:col <tab> kind <tab> types... <tab> seen...
+			std::vector<std::string> fields;
+			for (char* p = line; p; ) {
+				char* tab = strchr(p, '\t');
+				fields.push_back(tab ? std::string(p, tab - p) : std::string(p));
+				p = tab ? tab + 1 : NULL;
+			}
+			std::string::size_type c = fields[0].rfind(':');
+			std::string::size_type l = c==std::string::npos || !c ? c : fields[0].rfind(':', c - 1);
+			if (fields.size() < 3 || l==std::string::npos) {
+				continue;
+			}
+			// (the file as it was named to the translator, which put it in fbsites_)
+			std::string key = fields[0] + " " + fields[1];
+			profile[key] = std::vector<std::string>(fields.begin() + 2, fields.end());
+		}
+		fclose(f);
+		return true;
+	} // LoadProfile
+
+	int CodeGenerator::AddFeedbackSite(AST* tree, const char* kind)
+	{
+		FeedbackSite site = { tree, kind };
+		fbSites.push_back(site);
+		return fbSites.size() - 1;
+	}
+
+	const std::vector<std::string>* CodeGenerator::Seen(AST* tree, const char* kind)
+	{
+		// what the profile says was seen at tree, or NULL
+		if (profile.empty()) {
+			return NULL;
+		}
+		char pos[32];
+		sprintf(pos, ":%d:%d ", tree->token.m_line, tree->token.m_ichar);
+		std::string key = std::string(tree->token.m_sourceName ? tree->token.m_sourceName : "") + pos + kind;
+		std::map<std::string,std::vector<std::string> >::iterator ii = profile.find(key);
+		return ii==profile.end() ? NULL : &(*ii).second;
+	}
+
+	bool CodeGenerator::MonoShape(AST* dot, const char* kind, std::string& shape, int& k)
+	{
+		// Was o in o.id always an object of one static shape with an
+		// id slot? Then set shape to the C++ for it, and k to the slot
+		const std::vector<std::string>* seen = Seen(dot, kind);
+		if (!seen || seen->size() != 2 || (*seen)[0] != "object") {
+			return false;
+		}
+		const std::string& name = (*seen)[1];
+		Keys* keys = NULL;
+		char buf[256];
+		if (name[0]=='{') {
+			// object literal, {x,y}
+			std::map<std::string,int>::iterator ii = shapeIndex.find(name.substr(1, name.size() - 2) + ",");
+			if (ii != shapeIndex.end()) {
+				keys = &shapes[(*ii).second];
+				sprintf(buf, "&shape%d_", (*ii).second);
+			}
+		} else if (0==name.compare(0, 4, "new ")) {
+			// instance, new F
+			for (std::map<const char*,Keys>::iterator jj = layouts.begin(); jj != layouts.end(); ++jj) {
+				if (name.substr(4)==(*jj).first) {
+					keys = &(*jj).second;
+					_snprintf(buf, sizeof buf, "&%s_layout_.shape", (*jj).first);
+				}
+			}
+		}
+		const char* id = RightOperand(dot)->Name();
+		for (k = 0; keys && k < (int)keys->size(); k++) {
+			if (0==strcmp((*keys)[k], id)) {
+				shape = buf;
+				nSpecialized++;
+				return true;
+			}
+		}
+		return false;
+	} // MonoShape
+
+	bool CodeGenerator::ArithSite(AST* tree)
+	{
+		// a op b: with --feedback, emit it noting the types of a and
+		// b; with a profile where both were always numbers, emit it
+		// as a helper that does numbers inline. Else return false.
+		static const struct { TokenType tt; const char* helper; } ops[] = {
+			{ tPLUS, "numadd_" }, { tMINUS, "numsub_" }, { tSPLAT, "nummul_" }, { tDIV, "numdiv_" },
+			{ tREM, "nummod_" }, { tLT, "numlt_" }, { tGT, "numgt_" },
+		};
+		int i;
+		for (i = 0; i < LENGTH(ops) && ops[i].tt != Type(tree); i++) {
+		}
+		AST* a = LeftOperand(tree);
+		AST* b = RightOperand(tree);
+		if (i==LENGTH(ops) || !a || !b || (IsNumeric(a) && IsNumeric(b))) {
+			return false;
+		}
+		if (bFeedback) {
+			int site = AddFeedbackSite(tree, Name(tree));
+			emitf("(fbtype_(%d,0,", site);
+			ExprValue(a);
+			emitf("))%s(fbtype_(%d,1,", Name(tree), site);
+			ExprValue(b);
+			emit("))");
+			return true;
+		}
+		const std::vector<std::string>* seen = Seen(tree, Name(tree));
+		if (!seen || seen->size() != 2 || (*seen)[0] != "number" || (*seen)[1] != "number") {
+			return false;
+		}
+		nSpecialized++;
+		emitf("%s(", ops[i].helper);
+		ExprValue(a);
+		emit(",");
+		ExprValue(b);
+		emit(")");
+		return true;
+	} // ArithSite
+
+	bool CodeGenerator::DirectCall(AST* call)
+	{
+		// f(args), where f was always the global function F: emit a
+		// guarded non-virtual call to F's class, and return true
+		AST* func = call->first;
+		const std::vector<std::string>* seen = Seen(call, "call");
+		if (Type(func)!=tIDENT || !seen || seen->size() != 2 || (*seen)[0] != "function") {
+			return false;
+		}
+		Binding decl;
+		aScope* owner;
+		if (!ActiveScope()->FindDeclaration(Name(func), decl, owner) || owner != global_scope ||
+			!decl.isFunction() || !FuncBody(decl.Definition()) || (*seen)[1] != Name(func)) {
+			return false;
+		}
+		// (the arguments are emitted twice, so they must be simple)
+		AST* args = call->second;
+		for (AST* list = args; list; list = Type(list)==tCOMMA ? list->second : NULL) {
+			if (!IsSimple(Type(list)==tCOMMA ? list->first : list)) {
+				return false;
+			}
+		}
+		nSpecialized++;
+		const char* fname = FuncName(decl.Definition());
+		int n = ListLength(args);
+		emit("((");
+		ExprValue(func);
+		emit(").t==value_::TFUNC && (");
+		ExprValue(func);
+		emitf(").v.f==(func_*)&%s_func_ ? %s_func_.%s_foc_::call(global_,%d", fname, fname, fname, n);
+		if (args) {
+			emit(",");
+			ExprList(args);
+		}
+		emit(") : (");
+		ExprValue(func);
+		emitf(").toFunc()->call(global_,%d", n);
+		if (args) {
+			emit(",");
+			ExprList(args);
+		}
+		emit("))");
+		return true;
+	} // DirectCall
+
+	void CodeGenerator::EmitFeedbackSites(void)
+	{
+		if (!bFeedback) {
+			return;
+		}
+		emit("// --feedback: the sites, by index\n");
+		emit("extern const fbsite_ fbsites_[] = {\n");
+		for (int i = 0; i < (int)fbSites.size(); i++) {
+			Token& token = fbSites[i].tree->token;
+			emitf("  {%s,%d,%d,%s},\n", Quoted(token.m_sourceName ? token.m_sourceName : "").c_str(),
+				token.m_line, token.m_ichar, Quoted(fbSites[i].kind).c_str());
+		}
+		if (fbSites.empty()) {
+			emit("  {0,0,0,0}\n");
+		}
+		emit("};\n");
+		emitf("extern const int nfbsites_ = %d;\n\n", (int)fbSites.size());
+	} // EmitFeedbackSites
+
+	void CodeGenerator::ExprNumber(AST* tree)
+	{
+		// Emit code that computes the value of an expression tree
+		// as an unboxed double.
+		switch (Type(tree)) {
+		case tNUMBER:
+			emitf("(double)%s", Name(tree));
+			break;
+
+		case tLPAREN:
+			{
+				int m = MathIntrinsic(tree);
+				if (m >= 0) {
+					EmitMathCall(tree, m);
+					break;
+				}
+			}
+			emit("(double)(");
+			ExprValue(tree);
+			emit(")");
+			break;
+
+		case tDOT:
+			{
+				const char* k = MathConstant(tree);
+				if (k) {
+					emit(k);
+					break;
+				}
+			}
+			emit("(double)(");
+			ExprValue(tree);
+			emit(")");
+			break;
+
+		case tSPLAT:
+		case tDIV:
+		case tMINUS:
+		case tPLUS:
+			if (!IsNumeric(tree)) {
+				emit("(double)(");
+				ExprValue(tree);
+				emit(")");
+				break;
+			}
+			// these operators apply ToNumber to both sides
+			emit("(");
+			if (tree->first) {
+				ExprNumber(tree->first);
+			}
+			emit(Name(tree));
+			ExprNumber(tree->second);
+			emit(")");
+			break;
+
+		case tREM:
+			emit("fmod(");
+			ExprNumber(tree->first);
+			emit(",");
+			ExprNumber(tree->second);
+			emit(")");
+			break;
+
+		case tLBRACKET:
+			{
+				const char* kind = TypedArrayKind(tree->first);
+				if (kind) {
+					emitf("%s_getd_(", kind);
+					ExprValue(tree->first);
+					emit(",");
+					ExprNumber(tree->second);
+					emit(")");
+					break;
+				}
+			}
+			// ** fall thru **
+		default:
+			emit("(double)(");
+			ExprValue(tree);
+			emit(")");
+			break;
+		} // switch
+	} // ExprNumber
+
 	void CodeGenerator::ExprList(AST* list)
 	{
-		if (Type(list)==tCOMMA) {
+		while (Type(list)==tCOMMA) {
 			ExprValue(list->first);
-			if (list->second) {
-				emit(",");
-				ExprList(list->second);
+			list = list->second;
+			if (!list) {
+				return;
 			}
-		} else {
-			ExprValue(list);
+			emit(",");
 		}
+		ExprValue(list);
 	} // ExprList
 
 	void CodeGenerator::EmitCall(AST *tree)
@@ -729,13 +2855,23 @@ namespace js2cpp {
 		if (!func) {
 			return;
 		}
+		int m = MathIntrinsic(tree);
+		if (m >= 0) {
+			// Math.f(...) on the real Math: call f directly
+			emit("value_(");
+			EmitMathCall(tree, m);
+			emit(")");
+			return;
+		}
 		if (Type(func)==tDOT) {
 			// ah-ha, a named method call
 			// generate (left).dotcall(method-name-string,base,#args,arg0,arg1,...)
 			const char* id = RightOperand(func)->Name();
 			emit("(");
 			ExprValue(LeftOperand(func));
-			emitf(").dotcall(\"%s\",", id);
+			emit(").dotcall(");
+			EmitId(id);
+			emit(",");
 		} else if (Type(func)==tLBRACKET) {
 			// indexed call
 			emit("(");
@@ -743,6 +2879,13 @@ namespace js2cpp {
 			emit(").eltcall(");
 			ExprValue(func->second);
 			emit(",");
+		} else if (DirectCall(tree)) {
+			return;
+		} else if (bFeedback && Type(func)==tIDENT) {
+			// (noting what it calls)
+			emitf("(fbcallee_(%d,", AddFeedbackSite(tree, "call"));
+			ExprValue(func);
+			emit(")).toFunc()->call(global_,");
 		} else {
 			// function call (with this === global obj)
 			emit("(");
@@ -843,6 +2986,157 @@ namespace js2cpp {
 		}
 	} // Statements
 
+	void CodeGenerator::SourceLine(AST* tree)
+	{	// --lines: what follows comes from tree's line of the JS
+		Token& token = tree->token;
+		if (!bLines || token.m_line <= 0 || !token.m_sourceName) {
+			return;
+		}
+		if (token.m_sourceName[0]=='*') {
+			return;				// (*predefined* has no file to show)
+		}
+		// (the compiler counts on from the last one: say it only if that's wrong)
+		if (!jsLine || token.m_line != jsLine + cppLine - jsLineAt || token.m_sourceName != jsFile) {
+			emitf("#line %d %s\n", token.m_line, Quoted(token.m_sourceName).c_str());
+			jsLine = token.m_line;
+			jsLineAt = cppLine;
+			jsFile = token.m_sourceName;
+		}
+	} // SourceLine
+
+	void CodeGenerator::CppLines(void)
+	{	// --lines: back to the .cpp's own line numbers
+		if (!bLines || !jsLine) {
+			return;
+		}
+		// (the line after the directive)
+		emitf("#line %d %s\n", cppLine + 2, Quoted(linesCpp.c_str()).c_str());
+		jsLine = 0;
+		jsFile = NULL;
+	} // CppLines
+
+	// (collects what TempStatements emits, to put the temporaries first)
+	class StringSink : public CodeSink
+	{
+	public:
+		virtual void emit(const char* s) { text += s; }
+		std::string	text;
+	};
+
+	void CodeGenerator::TempStatements(AST* tree, bool bTop)
+	{	// the statements of a function body (or jsmain_'s, if bTop),
+		// after a line declaring the temporaries they turn out to
+		// need, or a blank one, so --lines' count holds either way
+		int oldTemps = nTemps;
+		bool oldOk = bTemps;
+		CodeSink* out = m_psink;
+		StringSink body;
+		nTemps = 0;
+		bTemps = true;
+		cppLine++;			// (the declaration line)
+		m_psink = &body;
+		if (bTop) {
+			TopLevelStatements(tree);
+		} else {
+			Statements(tree);
+		}
+		m_psink = out;
+		std::string decl = "\n";
+		if (nTemps) {
+			decl = indent_str;
+			decl += "value_ ";
+			for (int i = 0; i < nTemps; i++) {
+				char name[20];
+				sprintf(name, i ? ", tmp%d_" : "tmp%d_", i);
+				decl += name;
+			}
+			decl += ";\n";
+		}
+		m_psink->emit(decl.c_str());
+		m_psink->emit(body.text.c_str());
+		nTemps = oldTemps;
+		bTemps = oldOk;
+	} // TempStatements
+
+	int CodeGenerator::Temp(void)
+	{	// a new temporary, tmpN_
+		assert(bTemps);
+		return nTemps++;
+	}
+
+	std::string CodeGenerator::Once(AST* e)
+	{	// e's value, to use more than once: a simple e as it is, anything
+		// else is put in a temporary first (emitting "tmpN_=(e),")
+		char name[20];
+		if (IsSimple(e)) {
+			CodeSink* out = m_psink;
+			StringSink text;
+			m_psink = &text;
+			ExprValue(e);
+			m_psink = out;
+			return "(" + text.text + ")";
+		}
+		sprintf(name, "tmp%d_", Temp());
+		emitf("%s=(", name);
+		ExprValue(e);
+		emit("),");
+		return name;
+	} // Once
+
+	bool CodeGenerator::HasEffects(AST* tree)
+	{	// Could evaluating tree store anything, or call anything that
+		// might? (A function expression only makes a closure.)
+		if (!tree) {
+			return false;
+		}
+		TokenType tt = Type(tree);
+		if (isAssOp(tt) || tt==tPLUSPLUS || tt==tMINUSMINUS || tt==tNEW || tt==tDELETE ||
+			(tt==tLPAREN && MathIntrinsic(tree) < 0)) {
+			return true;
+		}
+		if (tt==tFUNEX) {
+			return false;
+		}
+		return HasEffects(tree->first) || HasEffects(tree->second) || HasEffects(tree->third);
+	} // HasEffects
+
+	bool CodeGenerator::InOrder(const std::vector<AST*>& es, bool bNumber, std::vector<std::string>& use)
+	{	// es, in source order, are to be a call's arguments, which C++
+		// evaluates in no set order (MSVC's right to left). If any has
+		// an effect, emit "(tmpN_=(e)," for each but the last that isn't
+		// a constant, and return true: the caller closes the ')' after
+		// the call. use gets what to emit for each instead of it ("" to
+		// emit it as it is); bNumber: the temporaries hold ExprNumbers.
+		use.assign(es.size(), "");
+		bool bEffects = false;
+		int i;
+		for (i = 0; i < (int)es.size(); i++) {
+			bEffects = bEffects || HasEffects(es[i]);
+		}
+		if (!bEffects || !bTemps) {
+			return false;
+		}
+		bool bOpen = false;
+		for (i = 0; i+1 < (int)es.size(); i++) {
+			TokenType tt = Type(es[i]);
+			if (tt==tNUMBER || tt==tSTRING || tt==tFUNEX) {
+				continue;
+			}
+			char name[20];
+			sprintf(name, "tmp%d_", Temp());
+			emitf("%s%s=(", bOpen ? "" : "(", name);
+			if (bNumber) {
+				ExprNumber(es[i]);
+			} else {
+				ExprValue(es[i]);
+			}
+			emit("),");
+			use[i] = bNumber ? std::string(name) + ".v.d" : name;
+			bOpen = true;
+		}
+		return bOpen;
+	} // InOrder
+
 	void CodeGenerator::Block(AST* tree)
 	{	// emit the code for tree, inside braces
 		emitf("%s{\n", indent_str);
@@ -864,6 +3158,9 @@ namespace js2cpp {
 		if (!tree || Type(tree)==tINVALID) {
 			return;
 		}
+		if (Type(tree)!=tSTATLIST && Type(tree)!=tLBRACE) {
+			SourceLine(tree);
+		}
 
 		switch (Type(tree)) {
 		case tSTATLIST:
@@ -997,14 +3294,15 @@ namespace js2cpp {
 		}
 	} // ForLoop
 
-	void CodeGenerator::emitString(const char *s)
+	std::string CLiteral(const char *s)
+	// JS string literal => C++ string literal
 	{
 		if (*s == '\"') {
 			// quoted with double-quotes, compatible
 			// with C++ string literals already.
 			// TODO: completely?
 			// A. Obviously not, since JS strings are UTF-16...
-			emit(s);
+			return s;
 		} else {
 			// single-quoted
 			assert(*s=='\'');
@@ -1080,9 +3378,15 @@ namespace js2cpp {
 			// with a double-quote:
 			t[-1] = '\"';
 			t[0] = 0;
-			emit(buf);
+			std::string r(buf);
 			delete[] buf;
+			return r;
 		}
+	} // CLiteral
+
+	void CodeGenerator::emitString(const char *s)
+	{
+		emit(CLiteral(s).c_str());
 	} // emitString
 
 } // namespace
\ No newline at end of file
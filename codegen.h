@@ -6,6 +6,9 @@
 #include "errcodes.h"
 #include "stringtab.h"
 #include "scope.h"
+#include <map>
+#include <vector>
+#include <string>
 
 namespace js2cpp {
 
@@ -19,6 +22,13 @@ public:
 	~CodeGenerator();
 
 	void Program(AST* tree);
+	void SnapshotMode(bool b) { bSnapshot = b; }
+	void IsolateMode(bool b) { bIsolate = b; }
+	void HeapProfileMode(bool b) { bHeapProf = b; }
+	void InstrumentMode(bool b) { bInstrument = b; }
+	void FeedbackMode(bool b) { bFeedback = b; }
+	bool LoadProfile(const char* path);
+	void LinesMode(bool b, const char* cppName) { bLines = b; linesCpp = cppName; }
 
 private:
 	void TopLevelStatements(AST* tree);
@@ -26,10 +36,19 @@ private:
 	void InitializeVars(AST* tree);
 	void EmitFunctionBody(AST* def);
 	void Statements(AST* tree);
+	void TempStatements(AST* tree, bool bTop);
+	int Temp(void);
+	std::string Once(AST* e);
+	bool HasEffects(AST* tree);
+	bool InOrder(const std::vector<AST*>& es, bool bNumber, std::vector<std::string>& use);
 	void Block(AST* tree);
 	void Statement(AST* tree);
+	void SourceLine(AST* tree);
+	void CppLines(void);
+	bool ElementOp(AST* tree);
 	void RefExpr(AST* tree);
 	void ExprValue(AST* tree);
+	void ExprNumber(AST* tree);
 	void EmitCall(AST* tree);
 	void EmitFuncVal(AST *fun);
 	void BindFormals(AST* tree);
@@ -37,12 +56,65 @@ private:
 	void EmitLocals(AST* tree, bool bHeap);
 	void ExprList(AST* tree);
 	void ForLoop(AST* tree);
+	typedef std::vector<const char*> Keys;
+
+	void EmitStatics(AST* tree);
+	void ObjectLiteral(AST* lit);
+	void ArrayLiteral(AST* lit);
+	int PoolString(const std::string& lit);
+	int PoolId(const char* name);
+	void EmitId(const char* name);
+	void EmitPool(void);
+	void PredictLayouts(AST* tree);
+	void EmitLayouts(void);
+	void EmitRegexes(void);
+	void EmitIdTable(const char* name, Keys& keys);
+	void EmitInit(void);
+	struct SnapValue;
+	void Snapshot(AST* tree);
+	bool SnapEval(AST* e, SnapValue& v);
+	bool SnapStore(AST* target, const SnapValue& v);
+	bool SnapFunction(AST* ident);
+	void SnapSet(int obj, const char* key, const SnapValue& v);
+	void EmitSnapValue(const SnapValue& v);
+	void EmitSnapshot(void);
+	const char* LayoutOf(AST* cons);
+	static void CollectStatic(AST* node, void* context);
 
 	const char* FuncName(AST* fun);
 	int ArgCount(AST* fun);
 
+	const char* TypedArrayKind(AST* expr);
+	bool IsPure(AST* fun);
+	bool Purity(AST* fun, bool& bAssumed);
+	bool PureTree(AST* fun, bool& bAssumed);
+	bool PureStore(AST* target, aScope* scope, aScope* fs);
+	bool PureCall(AST* callee, aScope* scope, aScope* fs, bool& bAssumed);
+	bool FreshLocal(AST* expr, aScope* scope, aScope* fs);
+	bool Reassigned(aScope* owner, const char* id);
+	bool TypedElementOp(AST* tree);
+
+	bool IsGlobal(AST* expr, const char* name);
+	int MathIntrinsic(AST* call);
+	const char* MathConstant(AST* dot);
+	void EmitMathCall(AST* call, int m);
+	void MathArg(AST* arg, const std::string& use);
+	bool IsNumeric(AST* tree);
+
 	void DeclareFunctionClass(AST* fun);
 
+	const char* AllocSite(AST* tree);
+	int AddHeapSite(AST* tree, const char* what);
+	void SitedExpr(AST* tree, const char* what);
+	void EmitHeapSites(void);
+	void EmitFunctionTable(void);
+	int AddFeedbackSite(AST* tree, const char* kind);
+	const std::vector<std::string>* Seen(AST* tree, const char* kind);
+	bool MonoShape(AST* dot, const char* kind, std::string& shape, int& k);
+	bool ArithSite(AST* tree);
+	bool DirectCall(AST* call);
+	void EmitFeedbackSites(void);
+
 	void emitString(const char *s);
 
 	void emit(const char *pz);
@@ -55,6 +127,10 @@ private:
 private:
 	CodeSink*	m_psink;
 	ErrorSink&	err;
+	// value_ temporaries (tmpN_) of the function being emitted, where
+	// the order things are evaluated in has to be pinned down
+	int			nTemps;
+	bool		bTemps;			// (only in function bodies and jsmain_)
 
 	char		spaces[256];
 	char*		indent_str;
@@ -65,6 +141,84 @@ private:
 
 	aScope* ActiveScope(void) const { return local_scope ? local_scope : global_scope; }
 
+	typedef std::map<std::pair<aScope*,const char*>,const char*> TypedVars;
+	TypedVars	typedVars;		// (scope,var) -> typed array constructor, or NULL
+	std::map<AST*,int>	purity;		// function -> PURE_... (see IsPure)
+	std::map<std::pair<aScope*,const char*>,bool>	reassigned;	// (scope,function) -> stored to?
+
+	std::vector<Keys>			shapes;			// keys of each static shape
+	std::map<std::string,int>	shapeIndex;		// "k1,k2,..." -> index in shapes
+	std::map<AST*,int>			litShapes;		// object literal -> its shape
+	std::vector<std::string>	strPool;		// pooled C string literals
+	std::map<std::string,int>	strIndex;		// ... -> index in strPool
+	std::vector<const char*>	numPool;		// pooled number literals
+	std::map<std::string,int>	numIndex;		// ... -> index in numPool
+	std::vector<const char*>	newTargets;		// F in new F(...), each once
+	std::map<const char*,std::vector<AST*> > protoMethods;	// F -> functions put on F.prototype
+	std::map<const char*,Keys>	layouts;		// F -> predicted this.x ids
+	std::vector<AST*>			constArrays;	// all-constant array literals
+	std::map<AST*,int>			litArrays;		// ... -> index in constArrays
+	std::vector<AST*>			regexes;		// regex literals, one per distinct text
+	std::map<std::string,int>	regexIndex;		// "/pattern/flags" -> index in regexes
+	std::string					initCode;		// body of jsinit_, the only startup code
+
+	// --snapshot: the leading top-level statements that only build
+	// objects out of constants are run here, and their heap emitted
+	struct SnapValue {
+		AST*	expr;			// a constant or a function, if obj < 0
+		int		obj;			// else index in snapObjects
+	};
+	struct SnapObject {
+		Keys					keys;
+		std::vector<SnapValue>	values;
+	};
+	bool						bSnapshot;
+	// --isolate: the program's globals are members of a globals_ that
+	// jsmain_ makes, reached through the thread-local globalsp_, so the program
+	// can run on several threads at once (see runisolates_)
+	bool						bIsolate;
+	// --heapprof: allocating expressions are numbered, and set
+	// allocsite_ while they run (see SitedExpr)
+	struct HeapSite {
+		const char*		file;
+		int				line;
+		const char*		function;	// "" at top level
+		const char*		what;
+	};
+	bool						bHeapProf;
+	std::vector<HeapSite>		heapSites;		// [0] is no site
+	int							curSite;		// site of the expression being emitted
+	AST*						siting;			// ... which SitedExpr is emitting
+	const char*					curFunction;	// JS function being emitted, "" at top level
+	// --instrument: each function's call starts with a callprobe_ on
+	// its index here
+	bool						bInstrument;
+	std::vector<AST*>			instrumented;
+	// --feedback: property, arithmetic and call sites note what they
+	// see (jsfeedback.cpp); --profile: what such a run saw at each,
+	// by "file:line:col kind", specializes them
+	struct FeedbackSite {
+		AST*			tree;
+		const char*		kind;
+	};
+	bool						bFeedback;
+	std::vector<FeedbackSite>	fbSites;
+	std::map<std::string,std::vector<std::string> >	profile;
+	int							nSpecialized;
+	std::vector<SnapObject>		snapObjects;
+	std::map<const char*,SnapValue>	snapGlobals;	// global var -> value after setup
+	std::map<const char*,int>	snapProtos;		// F -> F.prototype, in snapObjects
+	Keys						snapFuncs;		// global functions never reassigned
+	AST*						restStatements;	// top-level statements left for jsmain_
+	// --lines: each statement is marked with #line for its JS source;
+	// the code around the JS goes back to the .cpp's own numbering
+	bool						bLines;
+	std::string					linesCpp;		// the .cpp, for that
+	int							cppLine;		// lines emitted so far
+	int							jsLine;			// last #line given, 0 after going back
+	int							jsLineAt;		// cppLine just after it
+	const char*					jsFile;
+
 };
 
 class CodeSink
@@ -2,6 +2,10 @@
 //
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <string>
 #include "version.h"
 #include "sugar.h"
 #include "jsargs.h"
@@ -9,7 +13,9 @@
 #include "jsparse.h"
 #include "ASTprint.h"
 #include "AST.h"
+#include "scope.h"
 #include "codegen.h"
+#include "phases.h"
 
 #ifdef _WIN32
 #include "windows.h"
@@ -36,7 +42,7 @@ class CodeOut : public CodeSink
 {
 public:
 	CodeOut(FILE* f) : m_f(f) {}
-	~CodeOut() { fclose(m_f); m_f=NULL; }
+	~CodeOut() { PhaseTimer timer(PH_WRITE); fclose(m_f); m_f=NULL; }
 
 	virtual void emit(const char *s);
 private:
@@ -60,20 +66,62 @@ private:
 };
 
 
-void translate(SourceFile *psrc, CodeSink* pcpp, ErrorSink *perr, JsArgs &args)
+static void CountNode(AST* node, void* context)
+// (for --stats)
+{
+	TranslationCounts& counts = *(TranslationCounts*)context;
+	counts.nodes++;
+	if (node->HasScope()) {
+		counts.scopes++;
+		counts.bindings += node->Scope()->Declarations().size();
+	}
+}
+
+void translate(SourceFile *psrc, CodeSink* pcpp, const char *cppName, ErrorSink *perr, JsArgs &args, TranslationCounts &counts)
 {
 	Lexer lex(psrc, perr);
 	Parser parser(&lex, perr);
-	AST* tree = parser.Parse();
-	FILE *lst = fopen("c:\\parsetree.txt", "w");
-	if (lst) {
-		fprintf(lst, "----- Parse Tree -----\n");
-		TreePrint(lst, tree);
-		fprintf(lst, "----------------------\n");
-		fclose(lst);
+	AST* tree;
+	{
+		PhaseTimer timer(PH_PARSE);
+		tree = parser.Parse();
+	}
+	counts.tokens = lex.Tokens();
+	if (args.bStats) {
+		Walk(tree, CountNode, &counts);
+	}
+	if (args.ParseTree) {
+		FILE *lst = fopen(args.ParseTree, "w");
+		if (lst) {
+			fprintf(lst, "----- Parse Tree -----\n");
+			TreePrint(lst, tree);
+			fprintf(lst, "----------------------\n");
+			fclose(lst);
+		} else {
+			fprintf(stderr, "warning: cannot write %s\n", args.ParseTree);
+		}
 	}
 	CodeGenerator coder(pcpp, perr);
-	coder.Program(tree);
+	if (args.bSnapshot && args.bIsolate) {
+		// the snapshot heap is static data, which isolates would share
+		fprintf(stderr, "warning: --snapshot is ignored with --isolate\n");
+	}
+	coder.SnapshotMode(args.bSnapshot && !args.bIsolate);
+	coder.IsolateMode(args.bIsolate);
+	coder.HeapProfileMode(args.bHeapProf);
+	coder.InstrumentMode(args.bInstrument);
+	coder.FeedbackMode(args.bFeedback);
+	coder.LinesMode(args.bLines, cppName);
+	{
+		PhaseTimer timer(PH_CODEGEN);
+		if (args.Profile && args.bFeedback) {
+			// (its sites would record what the profile already says)
+			fprintf(stderr, "warning: --profile is ignored with --feedback\n");
+		} else if (args.Profile && !coder.LoadProfile(args.Profile)) {
+			fprintf(stderr, "warning: cannot read profile %s\n", args.Profile);
+		}
+		coder.Program(tree);
+	}
 	delete tree;
 } // translate
 
@@ -87,6 +135,10 @@ int main(int argc, char* argv[])
 	JsArgs args(argc, argv);
 	const char *pzSrc = args.Filename[0];
 	SourceFile src;
+	if (args.bStats) {
+		PhaseTimer::Start();
+		StringTable::bReport = true;
+	}
 
 	if (args.szErr[0]) {
 		// argument error
@@ -99,23 +151,34 @@ int main(int argc, char* argv[])
 		fprintf(stderr, "%s\n", src.LastError());
 		nExit = 3;
 	} else {
-		char szDrive[_MAX_DRIVE], szDir[_MAX_DIR], szName[_MAX_FNAME], szExt[_MAX_EXT];
-		char szCpp[_MAX_PATH];
-		char szSourceFile[_MAX_PATH];
-		_splitpath(pzSrc, szDrive, szDir, szName, szExt);
-		_makepath(szCpp, szDrive, szDir, szName, "cpp");
-		_makepath(szSourceFile, NULL, NULL, szName, szExt);
-		
+		// the .cpp goes beside the source; errors name just the file
+		std::string path(pzSrc);
+		std::string::size_type name = path.find_last_of("/\\:");
+		name = (name==std::string::npos) ? 0 : name + 1;
+		std::string::size_type ext = path.rfind('.');
+		if (ext==std::string::npos || ext < name) {
+			ext = path.size();
+		}
+		std::string cppPath = path.substr(0, ext) + ".cpp";
+		const char* szCpp = cppPath.c_str();
+		const char* szSourceFile = pzSrc + name;
+
 		FILE *cf = fopen(szCpp, "w");
 		if (!cf) {
 			fprintf(stderr, "%s: %s", strerror(errno), szCpp);
 			nExit = 4;
 		} else {
-			CodeOut code(cf);
-			ErrorOut errOut(szSourceFile);
-			translate(&src, &code, &errOut, args);
-			if (errOut.Errors() > 0) {
-				nExit = 21;
+			TranslationCounts counts = { 0, 0, 0, 0 };
+			{
+				CodeOut code(cf);
+				ErrorOut errOut(szSourceFile);
+				translate(&src, &code, szCpp, &errOut, args, counts);
+				if (errOut.Errors() > 0) {
+					nExit = 21;
+				}
+			}
+			if (args.bStats) {
+				PhaseReport(stderr, pzSrc, counts);
 			}
 		}
 	}
@@ -128,6 +191,7 @@ int main(int argc, char* argv[])
 
 void CodeOut::emit(const char *s)
 {
+	PhaseTimer timer(PH_WRITE);
 	fputs(s, m_f);
 #ifdef _WIN32
 #ifdef _DEBUG
@@ -196,6 +260,7 @@ const char *SourceFile::LastError(void)
 
 bool SourceFile::Open(const char *filename)
 {
+	PhaseTimer timer(PH_READ);
 	Close();
 	m_szErr[0] = '\0';
 	m_file = fopen(filename, "r");
@@ -222,6 +287,7 @@ void SourceFile::Close(void)
 
 bool SourceFile::ReadLine(char *buffer, int buflen)
 {
+	PhaseTimer timer(PH_READ);
 	if (m_bEOF || !fgets(buffer, buflen, m_file)) {
 		m_bEOF = true;
 		*buffer = '\0';
@@ -108,26 +108,90 @@ SOURCE=.\jsargs.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=.\jsatom.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\jsconsole.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=.\jscpprt.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=.\jsevent.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\jsfeedback.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\jsfs.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\jsheap.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\jsinstr.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\jsisolate.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\jsjson.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=.\jslex.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=.\jsmath.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\jsparallel.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=.\jsparse.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=.\jsregex.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\jsregexp.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=.\jssrctxt.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=.\jsstats.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\jstyped.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=.\log.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=.\phases.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=.\scope.cpp
 # End Source File
 # Begin Source File
@@ -164,6 +228,10 @@ SOURCE=.\jscpprt.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\jshash.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\jslex.h
 # End Source File
 # Begin Source File
@@ -172,10 +240,18 @@ SOURCE=.\jsparse.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\jsregex.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\jsrt.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\jsrtpriv.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\jssrctxt.h
 # End Source File
 # Begin Source File
@@ -184,6 +260,10 @@ SOURCE=.\log.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\phases.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\scope.h
 # End Source File
 # Begin Source File
@@ -1,18 +1,55 @@
 
 #include "jsargs.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "sugar.h"
 
 JsArgs::JsArgs(int argc, char *argv[])
-: nFiles(0)
+: nFiles(0),
+  bSnapshot(false),
+  bIsolate(false),
+  bHeapProf(false),
+  bInstrument(false),
+  bFeedback(false),
+  Profile(NULL),
+  bLines(false),
+  bStats(false),
+  ParseTree(NULL)
 {
 	szErr[0] = (char)0;
 	memset(Filename, 0, sizeof Filename);
 	for (int i = 1; (i < argc) && !szErr[0]; i++) {
 		const char *arg = argv[i];
 		if (*arg=='-' || *arg=='/') {
-			// option or switch
-			_snprintf(szErr, LENGTH(szErr), "unrecognized switch: %s", arg);
+			// option or switch: -name, --name or /name
+			const char* name = arg + (arg[0]=='-' && arg[1]=='-' ? 2 : 1);
+			if (0==strcmp(name, "snapshot")) {
+				bSnapshot = true;
+			} else if (0==strcmp(name, "isolate")) {
+				bIsolate = true;
+			} else if (0==strcmp(name, "heapprof")) {
+				bHeapProf = true;
+			} else if (0==strcmp(name, "instrument")) {
+				bInstrument = true;
+			} else if (0==strcmp(name, "feedback")) {
+				bFeedback = true;
+			} else if (0==strncmp(name, "profile=", 8) && name[8]) {
+				free((void*)Profile);
+				Profile = strdup(name + 8);
+			} else if (0==strcmp(name, "lines")) {
+				bLines = true;
+			} else if (0==strcmp(name, "stats")) {
+				bStats = true;
+			} else if (0==strcmp(name, "parsetree")) {
+				free((void*)ParseTree);
+				ParseTree = strdup("parsetree.txt");
+			} else if (0==strncmp(name, "parsetree=", 10) && name[10]) {
+				free((void*)ParseTree);
+				ParseTree = strdup(name + 10);
+			} else {
+				_snprintf(szErr, LENGTH(szErr), "unrecognized switch: %s", arg);
+			}
 		} else if (nFiles==MAX_SRC_FILES) {
 			if (!szErr[0]) {
 				_snprintf(szErr, LENGTH(szErr), "more than %d source files", MAX_SRC_FILES);
@@ -25,6 +62,8 @@ JsArgs::JsArgs(int argc, char *argv[])
 
 JsArgs::~JsArgs()
 {
+	free((void*)Profile);
+	free((void*)ParseTree);
 	for (int i = 0; i < nFiles; i++) {
 		free((void*)Filename[i]);
 	}
@@ -13,5 +13,15 @@ public:
 	int			nFiles;						// number of source files
 	const char* Filename[MAX_SRC_FILES];	// table of source files
 	char		szErr[128];					// error message, if any
+
+	bool		bSnapshot;					// --snapshot: run top-level setup at build time
+	bool		bIsolate;					// --isolate: globals per isolate, so it can run on many threads
+	bool		bHeapProf;					// --heapprof: profile the heap by allocation site
+	bool		bInstrument;				// --instrument: count and time calls to each function
+	bool		bFeedback;					// --feedback: record types, shapes and callees at each site
+	const char*	Profile;					// --profile=file: what --feedback recorded, or NULL
+	bool		bLines;						// --lines: #line directives, so tools show the JS source
+	bool		bStats;						// --stats: time and allocation by phase, and counts
+	const char*	ParseTree;					// --parsetree[=file]: dump the parse tree (parsetree.txt), or NULL
 };
 
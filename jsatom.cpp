@@ -0,0 +1,115 @@
+// jsatom.cpp - atoms (interned strings)
+//
+// Property ids are compared by address, so every id has to be the
+// one canonical copy of its text. Generated code interns its literal
+// pool once at startup; the runtime interns computed keys (o[k]).
+// The table is plain zero-initialised data, so it works from inside
+// other modules' static constructors. Isolates share it, under a lock.
+
+#include <stdlib.h>
+#include <string.h>
+#include "jscpprt.h"
+#include "jsrtpriv.h"
+#include "jshash.h"
+
+static const char**	atoms;			// open addressing, NULL = empty
+static unsigned*	hashes;
+static unsigned		capacity;		// power of 2
+static unsigned		count;
+static volatile long	lock;
+
+static void grow(void)
+{
+	unsigned oldcap = capacity;
+	const char** oldatoms = atoms;
+	unsigned* oldhashes = hashes;
+	capacity = capacity ? capacity*2 : 256;
+	atoms = (const char**)calloc(capacity, sizeof atoms[0]);
+	hashes = (unsigned*)malloc(capacity * sizeof hashes[0]);
+	if (!atoms || !hashes) {
+		throw bad_alloc();
+	}
+	for (unsigned i = 0; i < oldcap; i++) {
+		if (oldatoms[i]) {
+			unsigned j = oldhashes[i] & (capacity-1);
+			while (atoms[j]) {
+				j = (j+1) & (capacity-1);
+			}
+			atoms[j] = oldatoms[i];
+			hashes[j] = oldhashes[i];
+		}
+	}
+	free(oldatoms);
+	free(oldhashes);
+}
+
+static const char* lookup(const char* s, int len, unsigned hash, bool bAdd, bool bCopy)
+{
+	spinlock_ hold(lock);
+	STAT_(ATOM_FIND);
+	if (!capacity) {
+		if (!bAdd) {
+			return NULL;
+		}
+		grow();
+	}
+	unsigned i = hash & (capacity-1);
+	while (atoms[i]) {
+		STAT_(ATOM_PROBE);
+		if (hashes[i]==hash && 0==strncmp(atoms[i], s, len) && atoms[i][len]==0) {
+			return atoms[i];
+		}
+		i = (i+1) & (capacity-1);
+	}
+	if (!bAdd) {
+		return NULL;
+	}
+	if (bCopy) {
+		char* p = (char*)malloc(len+1);
+		if (!p) {
+			throw bad_alloc();
+		}
+		memcpy(p, s, len);
+		p[len] = 0;
+		s = p;
+	}
+	if (2*(count+1) > capacity) {
+		grow();
+		i = hash & (capacity-1);
+		while (atoms[i]) {
+			i = (i+1) & (capacity-1);
+		}
+	}
+	atoms[i] = s;
+	hashes[i] = hash;
+	count++;
+	STAT_(ATOM_NEW);
+	return s;
+}
+
+const char* intern_(const char* s)
+{
+	int len = strlen(s);
+	return lookup(s, len, jshash_(s, len), true, true);
+}
+
+const char* intern_(const char* s, int len)
+{
+	return lookup(s, len, jshash_(s, len), true, true);
+}
+
+const char* intern_(atom_& a)
+{
+	if (a.len < 0) {
+		// the compiler couldn't measure it (escapes)
+		a.len = strlen(a.s);
+		a.hash = jshash_(a.s, a.len);
+	}
+	return a.s = lookup(a.s, a.len, a.hash, true, false);
+}
+
+const char* atomfind_(const char* s)
+{
+	int len = strlen(s);
+	return lookup(s, len, jshash_(s, len), false, false);
+}
@@ -0,0 +1,198 @@
+// jsconsole.cpp - console.log, print, and the output buffer under them
+//
+// Output goes into a per-thread buffer that is written out with one
+// system call when it fills, at exit, and before the event loop waits.
+// When stdout is a terminal it is also written at the end of each
+// line, so interactive programs see their output as it happens; when
+// it is a file or a pipe a log-heavy program makes a write per 64K.
+// Values are formatted straight into the buffer, numbers by fmtnum_,
+// so printing doesn't allocate.
+
+#ifdef _WIN32
+#include "windows.h"
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <io.h>
+#define write_(fd, p, n)	_write(fd, p, n)
+#define isatty_(fd)			_isatty(fd)
+#else
+#include <unistd.h>
+#include <errno.h>
+#define write_(fd, p, n)	write(fd, p, n)
+#define isatty_(fd)			isatty(fd)
+#endif
+#include "jscpprt.h"
+#include "jsrtpriv.h"
+#include "sugar.h"
+
+#define OUT_SIZE	(64 * 1024)
+
+struct outbuf_
+{
+	int		fd;
+	bool	linebuf;		// write at the end of each line (a terminal)
+	int		len;
+	char	text[OUT_SIZE];
+};
+
+// a thread's buffers, made when it first prints
+static JS_THREAD outbuf_* bufs[2];
+
+static void FlushAtExit(void)
+{
+	flushout_();
+}
+
+static void Write(outbuf_* b)
+{
+	const char* p = b->text;
+	int n = b->len;
+	while (n > 0) {
+		int k = write_(b->fd, p, n);
+		if (k < 0) {
+#ifndef _WIN32
+			if (errno == EINTR) {
+				continue;
+			}
+#endif
+			break;				// nowhere to write it: drop it
+		}
+		p += k;
+		n -= k;
+	}
+	b->len = 0;
+}
+
+static outbuf_* Buffer(int fd)
+{
+	outbuf_* b = bufs[fd - 1];
+	if (!b) {
+		static bool registered;
+		if (!registered) {
+			registered = true;
+			atexit(FlushAtExit);
+		}
+		b = (outbuf_*)malloc(sizeof(outbuf_));
+		if (!b) {
+			throw bad_alloc();
+		}
+		b->fd = fd;
+		// stderr is written at the end of every call anyway
+		b->linebuf = fd == 1 && isatty_(fd);
+		b->len = 0;
+		bufs[fd - 1] = b;
+	}
+	return b;
+}
+
+static void Append(outbuf_* b, const char* s, int len)
+{
+	while (len > 0) {
+		int room = OUT_SIZE - b->len;
+		if (room == 0) {
+			Write(b);
+			room = OUT_SIZE;
+		}
+		int n = len < room ? len : room;
+		memcpy(b->text + b->len, s, n);
+		b->len += n;
+		s += n;
+		len -= n;
+	}
+}
+
+static void AppendValue(outbuf_* b, const value_& v)
+{
+	const char* s;
+	switch (v.t) {
+	case value_::TSTR:
+		s = v.v.s;
+		break;
+	case value_::TNUM:
+		if (OUT_SIZE - b->len < FMTNUM_MAX) {
+			Write(b);
+		}
+		b->len += fmtnum_(v.v.d, b->text + b->len);
+		return;
+	default:
+		s = v.toString();
+		break;
+	}
+	Append(b, s, strlen(s));
+}
+
+void out_(const char* s, int len)
+{
+	Append(Buffer(1), s, len);
+}
+
+void outvalue_(const value_& v)
+{
+	AppendValue(Buffer(1), v);
+}
+
+void flushout_(void)
+{
+	for (int i = 0; i < 2; i++) {
+		if (bufs[i] && bufs[i]->len) {
+			Write(bufs[i]);
+		}
+	}
+}
+
+static void Log(int fd, int nargs, const value_* argv)
+// the arguments separated by spaces, and a newline
+{
+	if (fd == 2 && bufs[0] && bufs[0]->len) {
+		Write(bufs[0]);			// keep stdout's lines ahead of stderr's
+	}
+	outbuf_* b = Buffer(fd);
+	for (int i = 0; i < nargs; i++) {
+		if (i) {
+			Append(b, " ", 1);
+		}
+		AppendValue(b, argv[i]);
+	}
+	Append(b, "\n", 1);
+	if (fd == 2 || b->linebuf) {
+		Write(b);
+	}
+}
+
+class log_class_ : public func_ {
+public:
+	JS_CONSTEXPR log_class_(int fd) : func_(0), fd(fd) {}
+	virtual value_ call(value_ this_, int nargs, ...)
+	{
+		Log(fd, nargs, ARGV_(nargs));
+		return undefined;
+	}
+private:
+	int		fd;
+};
+
+static log_class_ log_func_(1);		// log, info, and print
+static log_class_ error_func_(2);	// error, warn
+
+class console_ : public builtin_
+{
+public:
+	JS_CONSTEXPR console_() : builtin_("console") {}
+	virtual value_ dot(const char* id)
+	{
+		if (0==strcmp(id, "log") || 0==strcmp(id, "info")) {
+			return value_(&log_func_);
+		}
+		if (0==strcmp(id, "error") || 0==strcmp(id, "warn")) {
+			return value_(&error_func_);
+		}
+		return builtin_::dot(id);
+	}
+};
+
+static console_ console_object_;
+value_ console(&console_object_);
+value_ print(&log_func_);
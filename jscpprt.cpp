@@ -1,41 +1,55 @@
 
+#ifdef _WIN32
 #include "windows.h"
+#endif
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "jscpprt.h"
-#include <exception>
+#include "jsrtpriv.h"
 #include <limits>
+#include <new>
 #include <math.h>
 #include <time.h>
+#ifdef _WIN32
 #include <sys\timeb.h>
-
-value_ global_(new obj_);
+#else
+#include <sys/time.h>
+#endif
+
+static obj_ global_object_;
+static value_ main_global_(&global_object_);
+JS_THREAD value_* globalp_ = &main_global_;		// runisolates_ sets each thread's
+JS_THREAD void* globalsp_;		// jsmain_ sets it
 value_ true_(true);
 value_ false_(false);
+value_ null_(value_::TNULL);
 value_ undefined;			// the prototypical undefined variable
 
-static value_ NaN(std::numeric_limits<double>::quiet_NaN());
+double NaN_ = std::numeric_limits<double>::quiet_NaN();
 
 char *pzAppTitle_;
 
-class TypeError : public exception {
-public:
-	virtual const char* what() const throw() { return "TypeError"; }
-};
-
-class incomp_operand : public exception {
-public:
-	virtual const char *what() const throw() { return "incompatible operand"; }
-};
-
-class bad_alloc : public exception {
-public:
-	virtual const char *what() const throw() { return "memory allocation failed"; }
-};
+void typeerror_(void)
+{
+	throw TypeError();
+}
 
-class not_imp : public exception {
-public:
-	virtual const char *what() const throw() { return "unimplemented feature"; }
-};
+long toint32_slow_(double d)
+// ToInt32 for values outside the int32 range: modulo 2^32
+{
+	if (!_finite(d)) {
+		return 0;
+	}
+	double m = fmod(_copysign(floor(fabs(d)), d), 4294967296.0);
+	if (m < 0) {
+		m += 4294967296.0;
+	}
+	if (m >= 2147483648.0) {
+		m -= 4294967296.0;
+	}
+	return (long)m;
+}
 
 /////////////////////////////////////////////////////////////////////
 // Objects
@@ -45,54 +59,92 @@ obj_::~obj_()
 	prop* p = props;
 	while (p) {
 		prop* p2 = p->next;
+		HEAPFREE_(p);
 		delete p;
 		p = p2;
 	}
 }
 
+value_* obj_::slot(const char* id)
+// in-object slot named id, or NULL
+// assumes id has been made address-unique!
+{
+	if (shape) {
+		for (int i = 0; i < nslots; i++) {
+			STAT_(SLOT_PROBE);
+			if (shape->ids[i]==id) {
+				return &slots[i];
+			}
+		}
+	}
+	return NULL;
+}
+
 value_ obj_::dot(const char* id)
 // search parents, always return a value
 {
+	value_* sl = slot(id);
+	if (sl && !sl->isHole()) {
+		STAT_(SLOT_HIT);
+		return *sl;
+	}
+	// (a hole: it may be on the prototype)
 	prop* p = props;
 	while (p && p->id!=id) {
+		STAT_(PROP_PROBE);
 		p = p->next;
 	}
 	if (p) {
+		STAT_(PROP_HIT);
 		return p->value;
 	}
-	// TODO: search parents!
+	if (proto) {
+		STAT_(PROTO_HOP);
+		return proto->dot(id);
+	}
+	STAT_(FIND_MISS);
 	return undefined;
 }
 
 value_ obj_::at(value_ x)
 {
-	const char* id = x;
-	prop* p = props;
-	while (p && strcmp(p->id,id)) {
-		p = p->next;
-	}
-	if (p) {
-		return p->value;
+	// a key that was never interned can't be a property
+	const char* id = atomfind_(x);
+	if (!id) {
+		STAT_(FIND_MISS);
+		return undefined;
 	}
-	// TODO: search up the prototype chain!
-	return undefined;
+	return obj_::dot(id);
 }
 
 value_& obj_::dotref(const char* id)
 // search this obj only, add new prop if necessary
 // assumes id has been made address-unique!
 {
+	value_* sl = slot(id);
+	if (sl) {
+		STAT_(SLOT_HIT);
+		if (sl->isHole()) {
+			*sl = undefined;		// an own property now
+		}
+		return *sl;
+	}
 	prop* p = props;
 	while (p && p->id!=id) {
+		STAT_(PROP_PROBE);
 		p = p->next;
 	}
 	if (p) {
+		STAT_(PROP_HIT);
 		return p->value;
 	}
+	STAT_(FIND_MISS);
+	STAT_(PROP_ADD);
 	p = new prop;
 	if (!p) {
 		throw bad_alloc();
 	}
+	HEAPALLOC_(p, sizeof(prop));
 	p->id = id;
 	p->value = undefined;
 	p->next = props;
@@ -100,37 +152,348 @@ value_& obj_::dotref(const char* id)
 	return p->value;
 }
 
+void obj_::DropProp(const char* id)
+// assumes id has been made address-unique!
+{
+	prop** pp = &props;
+	while (*pp && (*pp)->id!=id) {
+		pp = &(*pp)->next;
+	}
+	if (*pp) {
+		prop* p = *pp;
+		*pp = p->next;
+		HEAPFREE_(p);
+		delete p;
+	}
+}
+
 value_& obj_::atref(value_ x)
 // index into this object
 {
-	// convert to string rep:
-	const char* id = x;
-	prop* p = props;
-	while (p && strcmp(p->id,id)!=0) {
-		p = p->next;
+	// convert to string rep, and that to an atom:
+	return obj_::dotref(intern_(x));
+}
+
+value_ obj_::put(value_ x, value_ v)
+// o[x] = v
+{
+	atref(x) = v;
+	return v;
+}
+
+obj_* NewShaped_(const shape_* shape, const value_* values)
+// one allocation holds the obj_ and its slots
+{
+	// keep the slots 8-byte aligned for their doubles:
+	size_t head = (sizeof(obj_) + 7) & ~7;
+	char* mem = (char*)::operator new(head + shape->count * sizeof(value_));
+	STAT_(ALLOC_OBJ);
+	STAT_(ALLOC_SHAPED);
+	STATN_(OBJ_BYTES, head + shape->count * sizeof(value_));
+	HEAPALLOC_(mem, head + shape->count * sizeof(value_));
+	value_* slots = (value_*)(mem + head);
+	for (int i = 0; i < shape->count; i++) {
+		new (&slots[i]) value_(values[i]);
 	}
-	if (p) {
-		return p->value;
+	return new (mem) obj_(shape, slots, shape->count);
+}
+
+void* obj_::operator new(size_t n)
+{
+	void* p = ::operator new(n);
+	STAT_(ALLOC_OBJ);
+	STATN_(OBJ_BYTES, n);
+	HEAPALLOC_(p, n);
+	return p;
+}
+
+void obj_::operator delete(void* p)
+{
+	HEAPFREE_(p);
+	::operator delete(p);
+}
+
+#ifdef JS_STATS
+void* array_::operator new(size_t n)
+{
+	STAT_(ALLOC_ARRAY);
+	return obj_::operator new(n);
+}
+#endif
+
+value_ MakeObject_(const shape_* shape, ...)
+// Object literal with a known set of keys: the values go
+// straight into its slots.
+{
+	return value_(NewShaped_(shape, (value_*)(&shape+1)));
+}
+
+int obj_::SlotsUsed(void) const
+{
+	int n = nslots;
+	while (n > 0 && slots[n-1].isHole()) {
+		n--;
 	}
-	p = new prop;
-	if (!p) {
-		throw bad_alloc();
+	return n;
+}
+
+void obj_::ForEachOwn(propfn_ fn, void* context)
+{
+	int i;
+	for (i = 0; i < nslots; i++) {
+		if (!slots[i].isHole()) {
+			fn(shape->ids[i], slots[i], context);
+		}
+	}
+	// props is newest first
+	int n = 0;
+	prop* p;
+	for (p = props; p; p = p->next) {
+		n++;
+	}
+	prop* local[32];
+	prop** order = n <= 32 ? local : new prop*[n];
+	for (i = n, p = props; p; p = p->next) {
+		order[--i] = p;
+	}
+	for (i = 0; i < n; i++) {
+		fn(order[i]->id, order[i]->value, context);
+	}
+	if (order != local) {
+		delete[] order;
 	}
-	p->id = strdup(id);
-	p->value = undefined;
-	p->next = props;
-	props = p;
-	return p->value;
+}
+
+static obj_* MakeInstance_(layout_* layout)
+// empty object with layout's shape and reserved slots
+{
+	int n = layout->reserve;
+	if (layout->made == LAYOUT_WATCH) {
+		// slack tracking: keep only what the watched ones used
+		n = 0;
+		for (int i = 0; i < LAYOUT_WATCH; i++) {
+			int used = layout->watched[i]->SlotsUsed();
+			if (used > n) {
+				n = used;
+			}
+		}
+		layout->reserve = n;
+	}
+	size_t head = (sizeof(obj_) + 7) & ~7;
+	char* mem = (char*)::operator new(head + n * sizeof(value_));
+	STAT_(ALLOC_OBJ);
+	STAT_(ALLOC_SHAPED);
+	STATN_(OBJ_BYTES, head + n * sizeof(value_));
+	HEAPALLOC_(mem, head + n * sizeof(value_));
+	value_* slots = (value_*)(mem + head);
+	for (int i = 0; i < n; i++) {
+		new (&slots[i]) value_(value_::hole());
+	}
+	obj_* o = new (mem) obj_(&layout->shape, slots, n);
+	if (layout->made < LAYOUT_WATCH) {
+		layout->watched[layout->made] = o;
+	}
+	if (layout->made <= LAYOUT_WATCH) {
+		layout->made++;
+	}
+	return o;
 }
 
 /////////////////////////////////////////////////////////////////////
 // Functions
 
-value_::value_(func_* pfunc)
+value_ func_::dot(const char* id)
+{
+	if (0==strcmp(id, "length")) {
+		return value_(length);
+	}
+	if (0==strcmp(id, "name")) {
+		return value_(info ? info->name : "");
+	}
+	if (0==strcmp(id, "prototype")) {
+		// made on first use, unless the snapshot has one
+		value_& p = Own(true)->obj_::dotref(id);
+		if (p.isUndefined()) {
+			p = info && info->prototype ? value_(info->prototype) : value_(new obj_);
+		}
+		return p;
+	}
+	return Own(false)->obj_::dot(id);
+}
+
+value_& func_::dotref(const char* id)
+{
+	return Own(true)->obj_::dotref(id);
+}
+
+value_ func_::at(value_ x)
+{
+	const char* id = atomfind_(x);
+	return id ? dot(id) : undefined;
+}
+
+value_& func_::atref(value_ x)
+{
+	return dotref(intern_(x));
+}
+
+struct ownprops_
+{	// open addressing, on the object's address
+	int				count;
+	int				cap;		// a power of 2
+	const obj_**	objs;
+	obj_**			props;
+};
+
+JS_THREAD ownprops_* ownpropsp_;
+
+obj_* func_::Own(bool make)
+// Where this function's properties are: itself, but in an isolate,
+// a static one's are in an object of the isolate's (made if make,
+// else the function itself, whose own list nothing then writes to).
 {
-	t = TFUNC;
-	v.f = pfunc;
-	pfunc->atref("length") = pfunc->length;
+	if (!shared || nisolates_ < 2) {
+		return this;
+	}
+	obj_* o = ownprops_find_(this, make);
+	return o ? o : this;
+}
+
+obj_* ownprops_find_(const obj_* obj, bool make)
+{
+	ownprops_* t = ownpropsp_;
+	if (!t) {
+		if (!make) {
+			return NULL;
+		}
+		t = ownpropsp_ = new ownprops_;
+		t->count = t->cap = 0;
+		t->objs = NULL;
+		t->props = NULL;
+	}
+	int i;
+	if (t->cap) {
+		for (i = ((size_t)obj >> 4) & (t->cap-1); t->objs[i]; i = (i+1) & (t->cap-1)) {
+			if (t->objs[i]==obj) {
+				return t->props[i];
+			}
+		}
+	}
+	if (!make) {
+		return NULL;
+	}
+	if (2 * (t->count+1) > t->cap) {
+		int cap = t->cap ? 2 * t->cap : 64;
+		const obj_** objs = new const obj_*[cap];
+		obj_** props = new obj_*[cap];
+		memset(objs, 0, cap * sizeof *objs);
+		for (int j = 0; j < t->cap; j++) {
+			if (t->objs[j]) {
+				for (i = ((size_t)t->objs[j] >> 4) & (cap-1); objs[i]; i = (i+1) & (cap-1)) {
+				}
+				objs[i] = t->objs[j];
+				props[i] = t->props[j];
+			}
+		}
+		delete[] t->objs;
+		delete[] t->props;
+		t->objs = objs;
+		t->props = props;
+		t->cap = cap;
+	}
+	for (i = ((size_t)obj >> 4) & (t->cap-1); t->objs[i]; i = (i+1) & (t->cap-1)) {
+	}
+	obj_* o = new obj_;
+	o->proto = obj->proto;
+	t->objs[i] = obj;
+	t->props[i] = o;
+	t->count++;
+	return o;
+}
+
+/////////////////////////////////////////////////////////////////////
+// Built-in objects
+
+obj_* builtin_::Own(bool make)
+// as func_::Own
+{
+	if (nisolates_ < 2) {
+		return this;
+	}
+	obj_* o = ownprops_find_(this, make);
+	return o ? o : this;
+}
+
+value_ builtin_::dot(const char* id)
+{
+	return Own(false)->obj_::dot(id);
+}
+
+value_& builtin_::dotref(const char* id)
+{
+	return Own(true)->obj_::dotref(id);
+}
+
+value_ builtin_::at(value_ x)
+{
+	const char* id = atomfind_(x);
+	return id ? dot(id) : undefined;
+}
+
+value_& builtin_::atref(value_ x)
+{
+	return dotref(intern_(x));
+}
+
+// closure_alloc_ - size classes of 8, 16, ... 128 bytes
+#define CLOSURE_GRAIN	8
+#define CLOSURE_CLASSES	16
+#define CLOSURE_BLOCK	65536
+
+// each isolate allocates from its own blocks
+static JS_THREAD void*	closure_free[CLOSURE_CLASSES];	// free list per size class
+static JS_THREAD char*	closure_next;					// rest of the current block
+static JS_THREAD size_t	closure_left;
+
+void* closure_alloc_::alloc(size_t n)
+{
+	STAT_(ALLOC_CLOSURE);
+	size_t c = (n + CLOSURE_GRAIN-1) / CLOSURE_GRAIN;
+	void* p;
+	if (c==0 || c > CLOSURE_CLASSES) {
+		p = ::operator new(n);
+		HEAPALLOC_(p, n);
+		return p;
+	}
+	p = closure_free[c-1];
+	if (p) {
+		closure_free[c-1] = *(void**)p;
+		HEAPALLOC_(p, n);
+		return p;
+	}
+	size_t size = c * CLOSURE_GRAIN;
+	if (closure_left < size) {
+		// the tail of the old block is left unused
+		closure_next = (char*)::operator new(CLOSURE_BLOCK);
+		closure_left = CLOSURE_BLOCK;
+	}
+	p = closure_next;
+	closure_next += size;
+	closure_left -= size;
+	HEAPALLOC_(p, n);
+	return p;
+}
+
+void closure_alloc_::free(void* p, size_t n)
+{
+	HEAPFREE_(p);
+	size_t c = (n + CLOSURE_GRAIN-1) / CLOSURE_GRAIN;
+	if (c==0 || c > CLOSURE_CLASSES) {
+		::operator delete(p);
+		return;
+	}
+	*(void**)p = closure_free[c-1];
+	closure_free[c-1] = p;
 }
 
 
@@ -140,7 +503,7 @@ value_::value_(func_* pfunc)
 // constructor body
 class Array_class_ : public func_ {
 public:
-	Array_class_() { length = 0; }
+	JS_CONSTEXPR Array_class_() : func_(0) {}
 	virtual value_ call(value_ this_, int nargs, ...)
 	{
 		this_ = value_(new array_());
@@ -148,12 +511,14 @@ public:
 	}
 };
 // constructor
-value_ Array(new Array_class_);
+static Array_class_ Array_func_;
+value_ Array(&Array_func_);
 
 value_ MakeArray_(int len, ...)
 {
 	array_* a = new array_();
 	if (len) {
+		a->Reserve(len);
 		value_* arg = (value_*)(&len+1);
 		for (int i = 0; i < len; i++) {
 			a->atref(i) = arg[i];
@@ -162,76 +527,361 @@ value_ MakeArray_(int len, ...)
 	return a;
 }
 
+// Array literal made only of constants: the compiler emits the
+// elements as a static table, and the array just points at it
+// until somebody writes to it.
+value_ ConstArray_(int len, const double* table)
+{
+	return value_(new array_(len, table));
+}
+
+value_ ConstArray_(int len, const char* const* table)
+{
+	return value_(new array_(len, table));
+}
+
+static int index_(const value_& x)
+// x as an array index, or -1
+// A string is one only in its canonical form ("7", not "07" or "7.0"),
+// so a["7"] and a[7] are the same element, and a["07"] is a prop.
+{
+	if (x.t==value_::TNUM) {
+		double d = x.v.d;
+		if (d >= 0 && d < 2147483647.0 && d==(int)d) {
+			return (int)d;
+		}
+	} else if (x.t==value_::TSTR) {
+		const char* s = x.v.s;
+		if (s[0]=='0') {
+			return s[1] ? -1 : 0;
+		}
+		int i = 0;
+		for (; *s >= '0' && *s <= '9'; s++) {
+			if (i > (2147483646 - (*s - '0')) / 10) {
+				return -1;
+			}
+			i = i * 10 + (*s - '0');
+		}
+		return *s || s==x.v.s ? -1 : i;
+	}
+	return -1;
+}
+
+// A write more than this far past the end of the vector (and past
+// twice its size) makes the array sparse rather than filling the gap.
+#define SPARSE_GAP	1024
+// the most elements a vector can have
+#define MAX_DENSE	(int)(0x7FFFFFFF / sizeof(value_))
+
+array_::~array_()
+{
+	HEAPFREE_(pdata);
+	delete[] (value_*)pdata;
+}
+
+void array_::Reserve(int n)
+{
+	Unshare();
+	if (n <= cap) {
+		return;
+	}
+	if (n > MAX_DENSE) {
+		throw RangeError();
+	}
+	int newcap = cap ? cap : 4;
+	while (newcap < n) {
+		newcap = newcap > MAX_DENSE / 2 ? MAX_DENSE : newcap * 2;
+	}
+	value_* v = new value_[newcap];
+	HEAPALLOC_(v, newcap * sizeof(value_));
+	value_* old = (value_*)pdata;
+	for (int i = 0; i < dense; i++) {
+		v[i] = old[i];
+	}
+	HEAPFREE_(old);
+	delete[] old;
+	pdata = v;
+	cap = newcap;
+}
+
+void array_::Unshare(void)
+{
+	if (!cnum && !cstr) {
+		return;
+	}
+	// (just the vector's part: any sparse tail is already in the props)
+	value_* v = new value_[dense ? dense : 1];
+	HEAPALLOC_(v, (dense ? dense : 1) * sizeof(value_));
+	for (int i = 0; i < dense; i++) {
+		v[i] = elt(i);
+	}
+	pdata = v;
+	cap = dense ? dense : 1;
+	cnum = NULL; cstr = NULL;
+}
+
+value_* array_::Resize(int n)
+{
+	Reserve(n);
+	value_* v = (value_*)pdata;
+	for (int i = n; i < dense; i++) {
+		v[i] = undefined;
+	}
+	len = dense = n;
+	return v;
+}
+
+void array_::Densify(void)
+{
+	if (dense==len) {
+		return;
+	}
+	Reserve(len);
+	value_* v = (value_*)pdata;
+	for (; dense < len; dense++) {
+		const char* id = atomfind_(value_(dense));
+		v[dense] = id ? obj_::dot(id) : undefined;
+		if (id) {
+			DropProp(id);
+		}
+	}
+}
+
+value_ array_::elt(int i) const
+{
+	if (i >= dense) {
+		return const_cast<array_*>(this)->obj_::at(value_(i));
+	}
+	if (cnum) {
+		return value_(cnum[i]);
+	}
+	if (cstr) {
+		return value_(cstr[i]);
+	}
+	return ((value_*)pdata)[i];
+}
+
+value_ array_::dot(const char* id)
+{
+	if (0==strcmp(id, "length")) {
+		return value_(len);
+	}
+	if (0==strncmp(id, "parallel", 8)) {
+		value_ m = parallelmethod_(id);
+		if (!m.isUndefined()) {
+			return m;
+		}
+	}
+	return obj_::dot(id);
+}
+
+value_ array_::at(value_ x)
+{
+	int i = index_(x);
+	if (i < 0) {
+		STAT_(INDEX_KEY);
+		return obj_::at(x);
+	}
+	STAT_(INDEX);
+	return i < len ? elt(i) : undefined;
+}
+
+value_& array_::atref(value_ x)
+{
+	int i = index_(x);
+	if (i < 0) {
+		STAT_(INDEX_KEY);
+		return obj_::atref(x);
+	}
+	STAT_(INDEX);
+	if (i < dense) {
+		Unshare();
+	} else if (dense < len || (i > 2*dense && i - dense > SPARSE_GAP)) {
+		// sparse: past the vector, the elements are props
+		if (i >= len) {
+			len = i+1;
+		}
+		return obj_::atref(value_(i));
+	} else {
+		Reserve(i+1);
+		dense = len = i+1;
+	}
+	return ((value_*)pdata)[i];
+}
+
 const char* array_::toString(void)
 {
 	if (flags & VALMAP) {
 		// not implemented yet
 		throw not_imp();
 	}
-	value_* vector = (value_*)pdata;
 	if (0==len) {
 		return "";
 	}
 	if (1==len) {
 		// single element, just render that
-		return vector[0].toString();
+		return elt(0).toString();
 	}
 	// multi-element array, build up by concatenation
-	value_ s = vector[0].toString();
+	value_ s = elt(0).toString();
 	for (int i = 1; i < len; i++) {
 		s += ",";
-		s += vector[i].toString();
+		s += elt(i).toString();
 	}
 	return s;
 }
 
 /////////////////////////////////////////////////////////////////////
-// Date
-
-class date
-{
-public:
-	static double now(void);
-};
+// Date, and performance.now
 
-double date::now(void)
+double Date_now_(void)
+// wall clock, milliseconds since 1970
 {
+#ifdef _WIN32
 	struct timeb t;
 	ftime(&t);
 	return t.time*1000.0+t.millitm;
+#else
+	struct timeval t;
+	gettimeofday(&t, NULL);
+	return t.tv_sec*1000.0+t.tv_usec/1000;
+#endif
+}
+
+#ifdef _WIN32
+static LARGE_INTEGER clock_origin_, clock_freq_;
+#else
+static struct timespec clock_origin_;
+#endif
+
+double performance_now_(void)
+// monotonic milliseconds since the first reading (jsmain takes one
+// at startup), to a fraction of a microsecond
+{
+#ifdef _WIN32
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	if (!clock_freq_.QuadPart) {
+		QueryPerformanceFrequency(&clock_freq_);
+		clock_origin_ = now;
+	}
+	return (double)(now.QuadPart - clock_origin_.QuadPart) * 1000.0 / (double)clock_freq_.QuadPart;
+#else
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (!clock_origin_.tv_sec && !clock_origin_.tv_nsec) {
+		clock_origin_ = now;
+	}
+	// whole seconds and nanoseconds apart, so the sum keeps its precision
+	return (double)(now.tv_sec - clock_origin_.tv_sec) * 1000.0 +
+		   (double)(now.tv_nsec - clock_origin_.tv_nsec) / 1000000.0;
+#endif
 }
 
+class date_ : public obj_
+{
+public:
+	date_(double t) : obj_("Date"), time(t) {}
+	virtual value_ dot(const char* id);
+	double		time;		// the time value, ms since 1970
+};
+
 class getTime_class_ : public func_ {
 public:
-	getTime_class_() { length = 0; }
+	JS_CONSTEXPR getTime_class_() : func_(0) {}
 	virtual value_ call(value_ this_, int nargs, ...)
 	{
-		return this_.dot("[[value]]");
+		if (this_.t != value_::TOBJ || strcmp(this_.v.o->Class(), "Date")) {
+			throw TypeError();
+		}
+		return value_(((date_*)this_.v.o)->time);
 	}
 };
 
-static value_ getTime(new getTime_class_);
+static getTime_class_ getTime_func_;
+
+value_ date_::dot(const char* id)
+{
+	if (0==strcmp(id, "getTime") || 0==strcmp(id, "valueOf")) {
+		return value_(&getTime_func_);
+	}
+	return obj_::dot(id);
+}
+
+class now_class_ : public func_ {
+public:
+	JS_CONSTEXPR now_class_(double (*clock)(void)) : func_(0), clock(clock) {}
+	virtual value_ call(value_ this_, int nargs, ...)
+	{
+		return value_(clock());
+	}
+private:
+	double		(*clock)(void);
+};
+
+static now_class_ Date_now_func_(Date_now_);
+static now_class_ performance_now_func_(performance_now_);
+
+class writeHeapProfile_class_ : public func_ {
+public:
+	JS_CONSTEXPR writeHeapProfile_class_() : func_(1) {}
+	virtual value_ call(value_ this_, int nargs, ...)
+	{
+		// false if it wasn't translated with --heapprof
+		value_* argv = ARGV_(nargs);
+		return value_(writeheapprofile_(nargs > 0 ? argv[0].toString() : "heap.pprof"));
+	}
+};
+
+static writeHeapProfile_class_ writeHeapProfile_func_;
 
 class Date_class_ : public func_ {
 public:
-	Date_class_() { length=0; }
+	JS_CONSTEXPR Date_class_() : func_(0) {}
 	virtual value_ call(value_ this_, int nargs, ...)
 	{
-		// TODO: move this into prototype:
-		this_.dotref("getTime") = getTime;
-		
 		if (nargs==0) {
 			// "set to the current time (UTC)"
-			this_.dotref("[[value]]") = date::now();
-		} else {
-			// TODO: handle 1,2,...7 args
-			throw not_imp();
+			return value_(new date_(Date_now_()));
 		}
-		return this_;
+		value_* argv = ARGV_(nargs);
+		if (nargs==1 && argv[0].t==value_::TNUM) {
+			// a time value
+			return value_(new date_(argv[0].v.d));
+		}
+		// TODO: handle a date string, and 2,...7 args
+		throw not_imp();
+	}
+	virtual value_ dot(const char* id)
+	{
+		if (0==strcmp(id, "now")) {
+			return value_(&Date_now_func_);
+		}
+		return func_::dot(id);
 	}
 };
 // constructor
-value_ Date(new Date_class_);
+static Date_class_ Date_func_;
+value_ Date(&Date_func_);
+
+class performance_ : public builtin_
+{
+public:
+	JS_CONSTEXPR performance_() : builtin_("performance") {}
+	virtual value_ dot(const char* id)
+	{
+		if (0==strcmp(id, "now")) {
+			return value_(&performance_now_func_);
+		}
+		if (0==strcmp(id, "writeHeapProfile")) {
+			return value_(&writeHeapProfile_func_);
+		}
+		return builtin_::dot(id);
+	}
+};
+
+static performance_ performance_object_;
+value_ performance(&performance_object_);
 
 
 /////////////////////////////////////////////////////////////////////
@@ -239,45 +889,58 @@ value_ Date(new Date_class_);
 
 class alert_class_ : public func_ {
 public:
-	alert_class_() { length=1; }
+	JS_CONSTEXPR alert_class_() : func_(1) {}
 	virtual value_ call(value_ this_, int nargs, ...)
 	{
 		value_ msg;
 		if (nargs > 0) {
 			msg = ((value_*)(&nargs+1))[0];
 		}
+#ifdef JS_GUI
+		// a windowed program has no console to print to
 		MessageBox(NULL, msg.toString(), pzAppTitle_, MB_ICONEXCLAMATION | MB_OK);
+#else
+		outvalue_(msg);
+		out_("\n", 1);
+#endif
 		return undefined;
 	}
 };
-value_ alert(new alert_class_);
+static alert_class_ alert_func_;
+value_ alert(&alert_func_);
 
 class Object_class_ : public func_ {
 public:
-	Object_class_() { length=0; }
+	JS_CONSTEXPR Object_class_() : func_(0) {}
 	virtual value_ call(value_ this_, int nargs, ...)
 	{
 		return this_;
 	}
 };
 
-value_ Object(new Object_class_);
+static Object_class_ Object_func_;
+value_ Object(&Object_func_);
 
 /////////////////////////////////////////////////////////////////////
 // value_ methods
 
 value_ value_::dot(const char* id)
 {
-	if (t==TOBJ) {
+	STAT_(DOT);
+	if (t>=TOBJ) {
 		return v.o->dot(id);
 	}
-	// TODO: support properties of primitive values
+	if (t==TSTR) {
+		return strdot_(v.s, id);
+	}
+	// TODO: support properties of the other primitive values
 	throw incomp_operand();
 } // dot
 
 value_& value_::dotref(const char* id)
 {
-	if (t==TOBJ) {
+	STAT_(DOTREF);
+	if (t>=TOBJ) {
 		return v.o->dotref(id);
 	}
 	// TODO: support properties of primitive values
@@ -286,6 +949,7 @@ value_& value_::dotref(const char* id)
 
 value_ value_::eltcall(value_ x, int nargs, ...)
 {
+	STAT_(ELTCALL);
 	value_ base = *this;
 	if (base.t < TOBJ) {
 		base = base.toObject();
@@ -322,12 +986,13 @@ value_ value_::eltcall(value_ x, int nargs, ...)
 
 value_ value_::dotcall(const char* id, int nargs, ...)
 {
-	if (t<TOBJ) {
+	STAT_(DOTCALL);
+	if (t<TOBJ && t!=TSTR) {
 		// not an object
 		throw incomp_operand();
 	}
 	// get the function member
-	value_ m = v.o->dot(id);
+	value_ m = dot(id);
 	if (m.t != TFUNC) {
 		throw incomp_operand();
 	}
@@ -357,9 +1022,59 @@ value_ value_::dotcall(const char* id, int nargs, ...)
 	} // switch
 }
 
+value_ callv_(func_* f, value_ this_, int nargs, const value_* argv)
+// f.apply(this_, argv), for callers holding the arguments in an array
+{
+	STAT_(CALLV);
+	switch (nargs) {
+	case 0:
+		return f->call(this_, nargs);
+	case 1:
+		return f->call(this_, nargs, argv[0]);
+	case 2:
+		return f->call(this_, nargs, argv[0], argv[1]);
+	case 3:
+		return f->call(this_, nargs, argv[0], argv[1], argv[2]);
+	case 4:
+		return f->call(this_, nargs, argv[0], argv[1], argv[2], argv[3]);
+	case 5:
+		return f->call(this_, nargs, argv[0], argv[1], argv[2], argv[3], argv[4]);
+	case 6:
+		return f->call(this_, nargs, argv[0], argv[1], argv[2], argv[3], argv[4], argv[5]);
+	case 7:
+		return f->call(this_, nargs, argv[0], argv[1], argv[2], argv[3], argv[4], argv[5], argv[6]);
+	case 8:
+		return f->call(this_, nargs, argv[0], argv[1], argv[2], argv[3], argv[4], argv[5], argv[6], argv[7]);
+	default:
+		throw not_imp();
+	}
+}
+
+value_ construct_(value_ cons, layout_* layout, int nargs, ...)
+// new cons(args): layout, if given, is the compiler's guess at
+// the shape of what cons will build
+{
+	STAT_(CONSTRUCT);
+	func_* func = cons.toFunc();
+	static const char* prototype_id = intern_("prototype");
+	// a built-in makes its own object, bar Object (so a pure function
+	// can new one without making the constructor's prototype)
+	value_ proto = func->info || func==&Object_func_ ? func->dot(prototype_id) : undefined;
+	obj_* o = layout ? MakeInstance_(layout) : new obj_;
+	if (proto.t >= value_::TOBJ) {
+		o->proto = proto.v.o;
+	}
+	value_ self(o);
+	// (the compiler sends at most 8 args, as many as callv_ forwards)
+	value_ r = callv_(func, self, nargs, (value_*)(&nargs+1));
+	// a constructor that returns an object replaces this
+	return r.t >= value_::TOBJ ? r : self;
+}
+
 value_ value_::at(value_ x)
 {
-	if (t==TOBJ) {
+	STAT_(AT);
+	if (t>=TOBJ) {
 		return v.o->at(x);
 	}
 	// TODO: support properties of primitive values
@@ -368,13 +1083,24 @@ value_ value_::at(value_ x)
 
 value_& value_::atref(value_ x)
 {
-	if (t==TOBJ) {
+	STAT_(ATREF);
+	if (t>=TOBJ) {
 		return v.o->atref(x);
 	}
 	// TODO: support properties of primitive values
 	throw incomp_operand();
 } // dotref
 
+value_ value_::put(value_ x, value_ val)
+{
+	STAT_(PUT);
+	if (t>=TOBJ) {
+		return v.o->put(x, val);
+	}
+	// TODO: support properties of primitive values
+	throw incomp_operand();
+} // put
+
 value_ value_::toPrimitive(void) const
 {
 	// TODO: implement this!
@@ -398,14 +1124,14 @@ const char *value_::toString(void) const
 	}
 	if (t==TNUM) {
 		if (_finite(v.d)) {
-			char buf[32];
-			//TODO: implement ECMAScript spec:
-			if (v.d==(long)v.d) {
-				sprintf(buf, "%ld", (long)v.d);
-			} else {
-				sprintf(buf, "%g", v.d);
-			}
-			return strdup(buf);
+			char buf[FMTNUM_MAX];
+			int n = fmtnum_(v.d, buf);
+			STAT_(NUM_TO_STR);
+			STAT_(ALLOC_STRING);
+			STATN_(STRING_BYTES, n + 1);
+			char* s = strdup(buf);
+			HEAPALLOC_(s, n + 1);
+			return s;
 		}
 		if (_isnan(v.d)) {
 			return "NaN";
@@ -422,12 +1148,117 @@ const char *value_::toString(void) const
 	if (t==TNULL) {
 		return "null";
 	}
+	STAT_(OBJ_TO_STR);
 	if (t==TARRAY) {
 		return ((array_*)v.o)->toString();
 	}
 	return toPrimitive().toString();
 } // toString
 
+int fmtnum_(double d, char* buf)
+// Number::toString(10)
+{
+	if (d != d) {
+		strcpy(buf, "NaN");
+		return 3;
+	}
+	if (!_finite(d)) {
+		strcpy(buf, d > 0 ? "Infinity" : "-Infinity");
+		return d > 0 ? 8 : 9;
+	}
+	char* p = buf;
+	if (d < 0) {
+		*p++ = '-';
+		d = -d;
+	}
+	if (d < 9007199254740992.0 && d == floor(d)) {
+		// integer: the common case, no printf
+		char digits[20];
+		int n = 0;
+		if (d < 4294967296.0) {
+			unsigned long u = (unsigned long)d;
+			do {
+				digits[n++] = (char)('0' + u % 10);
+				u /= 10;
+			} while (u);
+		} else {
+			do {
+				double q = floor(d / 10);
+				digits[n++] = (char)('0' + (int)(d - q*10));
+				d = q;
+			} while (d > 0);
+		}
+		while (n > 0) {
+			*p++ = digits[--n];
+		}
+		*p = 0;
+		return p - buf;
+	}
+	// shortest %e that reads back as d. If 15 digits do, they are
+	// the shortest once trailing zeros go, except for denormals.
+	char e[FMTNUM_MAX];
+	int prec;
+	for (prec = d < 2.2250738585072014e-308 ? 1 : 15; prec < 17; prec++) {
+		sprintf(e, "%.*e", prec-1, d);
+		if (strtod(e, NULL)==d) {
+			break;
+		}
+	}
+	if (prec==17) {
+		sprintf(e, "%.16e", d);
+	}
+	// e is D.DDDDe[+-]XX: collect the digits k and exponent n
+	char k[20];
+	int nk = 0;
+	const char* s;
+	for (s = e; *s != 'e'; s++) {
+		if (*s != '.') {
+			k[nk++] = *s;
+		}
+	}
+	while (nk > 1 && k[nk-1]=='0') {
+		nk--;
+	}
+	int n = atoi(s+1) + 1;		// decimal point goes after n digits
+	int i;
+	if (nk <= n && n <= 21) {
+		// ddd000
+		for (i = 0; i < n; i++) {
+			*p++ = i < nk ? k[i] : '0';
+		}
+	} else if (0 < n && n <= 21) {
+		// ddd.ddd
+		for (i = 0; i < nk; i++) {
+			if (i==n) {
+				*p++ = '.';
+			}
+			*p++ = k[i];
+		}
+	} else if (-6 < n && n <= 0) {
+		// 0.000ddd
+		*p++ = '0';
+		*p++ = '.';
+		for (i = n; i < 0; i++) {
+			*p++ = '0';
+		}
+		for (i = 0; i < nk; i++) {
+			*p++ = k[i];
+		}
+	} else {
+		// d.ddde+xx
+		*p++ = k[0];
+		if (nk > 1) {
+			*p++ = '.';
+			for (i = 1; i < nk; i++) {
+				*p++ = k[i];
+			}
+		}
+		p += sprintf(p, "e%c%d", n > 0 ? '+' : '-', n > 0 ? n-1 : 1-n);
+	}
+	*p = 0;
+	return p - buf;
+}
+
 bool value_::toBool(void) const
 {
 	if (t==TBOOL || t==TNUM) {
@@ -466,18 +1297,19 @@ double value_::toNumber(void) const
 		return v.d;
 	}
 	if (t==TUNDEF) {
-		return NaN;
+		return NaN_;
 	}
 	if (t==TNULL) {
 		return 0.0;
 	}
 	if (t==TSTR) {
+		STAT_(STR_TO_NUM);
 		double f;
 		char c;
-		if (1==sscanf(v.s, "%g %c", &f, &c)) {
+		if (1==sscanf(v.s, "%lg %c", &f, &c)) {
 			return f;
 		}
-		return NaN;
+		return NaN_;
 	}
 	throw incomp_operand();
 }
@@ -519,6 +1351,36 @@ value_ postinc_(value_& v)
 	return d;
 }
 
+value_ postdec_(value_& v)
+// decrement v but return its previous value
+{
+	double d = v.toNumber();
+	v = d-1;
+	return d;
+}
+
+value_ preinc_(value_& v)
+{
+	v = v.toNumber()+1;
+	return v;
+}
+
+value_ predec_(value_& v)
+{
+	v = v.toNumber()-1;
+	return v;
+}
+
+value_ eltinc_(value_ o, value_ x, int d, bool post)
+// o[x] += d, returning the old value (post) or the new one: the
+// compiler's ++/-- on elements, which may have no value_ to refer
+// to (typed arrays)
+{
+	double old = o.at(x).toNumber();
+	o.put(x, value_(old + d));
+	return value_(post ? old : old + d);
+}
+
 // identity
 value_ identical_(value_& a, value_& b)
 {
@@ -549,6 +1411,9 @@ value_ identical_(value_& a, value_& b)
 // assignment
 value_& value_::operator+=(const value_& b)
 {
+	if (t==TNUM && b.t==TSTR) {
+		*this = value_(toString());		// and concatenate
+	}
 	if (t==TNUM) {
 		v.d += (double)b;
 	} else if (t==TSTR) {
@@ -559,6 +1424,9 @@ value_& value_::operator+=(const value_& b)
 		if (!s) {
 			throw bad_alloc();
 		}
+		STAT_(ALLOC_STRING);
+		STATN_(STRING_BYTES, len+blen+1);
+		HEAPALLOC_(s, len+blen+1);
 		memcpy(s, v.s, len);
 		memcpy(s+len, sb, blen+1);
 		v.s = s;
@@ -591,12 +1459,16 @@ value_ value_::operator-(const value_& b) const
 // binary +
 value_ value_::operator+(const value_& b) const
 {
-	if (t==value_::TSTR) {
+	if (t==value_::TSTR || (t==value_::TNUM && b.t==value_::TSTR)) {
+		const char *sa = (const char *)*this;
 		const char *sb = (const char *)b;
-		int alen = strlen(v.s);
+		int alen = strlen(sa);
 		int blen = strlen(sb);
 		char *s = (char*)malloc(alen+blen+1);
-		memcpy(s, v.s, alen);
+		STAT_(ALLOC_STRING);
+		STATN_(STRING_BYTES, alen+blen+1);
+		HEAPALLOC_(s, alen+blen+1);
+		memcpy(s, sa, alen);
 		memcpy(s+alen, sb, blen+1);
 		return value_(s);
 	}
@@ -659,4 +1531,16 @@ bool value_::operator<(const value_& b) const
 		return v.d < (double)b;
 	}
 	throw incomp_operand();
+}
+
+// relation >
+bool value_::operator>(const value_& b) const
+{
+	if (t==value_::TSTR) {
+		return strcmp(v.s, b) > 0;
+	}
+	if (t==value_::TNUM) {
+		return v.d > (double)b;
+	}
+	throw incomp_operand();
 }
\ No newline at end of file
@@ -1,8 +1,30 @@
 // jscpprt.h - js to cpp runtime
 
+#include <math.h>
+#include <stddef.h>
+#include "jsregex.h"
+
+// Constructors (and static data) that can be evaluated at compile
+// time, so the runtime's globals and the generated program's function
+// objects and constants are built by the linker, not by startup code.
+#if __cplusplus >= 201103L || (defined(_MSC_VER) && _MSC_VER >= 1900)
+#define JS_CONSTEXPR constexpr
+#else
+#define JS_CONSTEXPR
+#endif
+
+// Per-thread (per-isolate) data; only for types with a constant
+// initializer, not value_.
+#ifdef _MSC_VER
+#define JS_THREAD __declspec(thread)
+#else
+#define JS_THREAD __thread
+#endif
+
 class obj_;
 class func_;
 class array_;
+class typedarray_;
 
 class value_
 {
@@ -18,16 +40,21 @@ public:
 		TARRAY,			// array (all kinds)
 	} VALTYPE;
 
-	value_(void) : t(TUNDEF) {}
-	value_(bool x) : t(TBOOL) { v.d=(double)x; }
-	value_(int i) : t(TNUM) { v.d = i; }
-	value_(long l) : t(TNUM) { v.d = l; }
-	value_(double n) : t(TNUM) { v.d = n; }
-	value_(const char *s) : t(TSTR) { v.s = s; }
-	value_(obj_* pobj) : t(TOBJ) { v.o = pobj; }
-	value_(func_* pfunc);
+	JS_CONSTEXPR value_(void) : t(TUNDEF), v() {}
+	JS_CONSTEXPR value_(bool x) : t(TBOOL), v((double)x) {}
+	JS_CONSTEXPR value_(int i) : t(TNUM), v((double)i) {}
+	JS_CONSTEXPR value_(long l) : t(TNUM), v((double)l) {}
+	JS_CONSTEXPR value_(double n) : t(TNUM), v(n) {}
+	JS_CONSTEXPR value_(const char *s) : t(TSTR), v(s) {}
+	JS_CONSTEXPR value_(obj_* pobj) : t(TOBJ), v(pobj) {}
+	JS_CONSTEXPR value_(func_* pfunc) : t(TFUNC), v(pfunc) {}
+	JS_CONSTEXPR value_(VALTYPE type) : t(type), v() {}		// TUNDEF or TNULL
 
 	inline bool isUndefined(void) const  { return t==TUNDEF; }
+	// A reserved object slot nothing has been stored in yet is a hole:
+	// not an own property, and undefined if one ever gets out.
+	inline bool isHole(void) const		 { return t==TUNDEF && v.d < 0; }
+	static value_ hole(void)			 { value_ h; h.v.d = -1; return h; }
 	inline operator bool() const		 { return toBool(); }
 	inline operator const char *() const { return toString(); }
 	inline operator long() const		 { return toInt32(); }
@@ -54,6 +81,7 @@ public:
 	value_& dotref(const char* id);
 	value_ at(value_ x);
 	value_& atref(value_ x);
+	value_ put(value_ x, value_ val);
 
 	value_ dotcall(const char* id, int nargs, ...);
 	value_ eltcall(value_ x, int nargs, ...);
@@ -61,7 +89,12 @@ public:
 	value_& operator+=(const value_& b);
 
 	short	t;				// type of value_
-	union {
+	union val_ {
+		JS_CONSTEXPR val_() : d(0) {}
+		JS_CONSTEXPR val_(double n) : d(n) {}
+		JS_CONSTEXPR val_(const char* p) : s(p) {}
+		JS_CONSTEXPR val_(obj_* p) : o(p) {}
+		JS_CONSTEXPR val_(func_* p) : f(p) {}
 		const char *s;		// pointer to malloc'd string (TSTR)
 		double	d;			// 64-bit IEEE float (TNUM)
 		obj_*	o;			// object pointer (TOBJ)
@@ -78,6 +111,30 @@ public:
 };
 
 
+// Atoms - interned strings (jsatom.cpp). Property ids are compared
+// by address, so every id passed to dot/dotref must be an atom.
+struct atom_
+{
+	const char*	s;			// text; the canonical copy once interned
+	int			len;		// strlen(s), or -1 if not measured
+	unsigned	hash;		// jshash_(s, len)
+};
+
+const char* intern_(const char* s);		// the atom for s (copies s if new)
+const char* intern_(const char* s, int len);	// ... for the len chars at s
+const char* intern_(atom_& a);			// the atom for a static string
+const char* atomfind_(const char* s);	// the atom for s, or NULL if none
+
+// Layout of an object's in-object slots. Shapes are emitted
+// statically by the compiler, one per distinct set of keys.
+// The ids are atoms.
+struct shape_
+{
+	int					count;		// number of slots
+	const char* const*	ids;		// slot names, in slot order
+	const char*			name;		// "{x,y}" or "new F" (type feedback), or NULL
+};
+
 class prop
 {
 public:
@@ -90,26 +147,92 @@ class obj_
 {
 
 public:
-	obj_() : klass("Object"), props(0) {}
-	~obj_();
-
-	value_ dot(const char* id);		// find a constant property (o.id) - always return a value
-	value_& dotref(const char* id);	// search this obj only, add new prop if necessary
-	value_ at(value_ x);			// find run-time dynamic property o[x]
-	value_& atref(value_ x);
+	JS_CONSTEXPR obj_() : proto(0), klass("Object"), shape(0), slots(0), nslots(0), props(0) {}
+	JS_CONSTEXPR obj_(const shape_* s, value_* sl, int n) : proto(0), klass("Object"), shape(s), slots(sl), nslots(n), props(0) {}
+	virtual ~obj_();
+	// (for JS_STATS and the heap profile)
+	static void* operator new(size_t n);
+	static void* operator new(size_t, void* p) { return p; }
+	static void operator delete(void* p);
+	static void operator delete(void*, void*) {}
+
+	virtual value_ dot(const char* id);		// find a constant property (o.id) - always return a value
+	virtual value_& dotref(const char* id);	// search this obj only, add new prop if necessary
+	virtual value_ at(value_ x);			// find run-time dynamic property o[x]
+	virtual value_& atref(value_ x);
+	virtual value_ put(value_ x, value_ v);	// o[x] = v, returns v
+
+	const char* Class(void) const { return klass; }	// [[Class]]
+	int SlotsUsed(void) const;				// 1 + index of last slot stored into
+	const shape_* Shape(void) const { return shape; }
+	value_* ShapeSlot(const shape_* s, int k)	// slot k, if this has shape s and the slot
+	{											// (a hole if it's never been stored into)
+		return shape==s && k < nslots ? &slots[k] : 0;
+	}
+
+	// Call fn on each own property, in the order they were added
+	// (slots first). Slots never stored into are skipped.
+	typedef void (*propfn_)(const char* id, value_& v, void* context);
+	void ForEachOwn(propfn_ fn, void* context);
+
+	obj_*			proto;		// [[Prototype]], or NULL
+
+protected:
+	JS_CONSTEXPR obj_(const char* k) : proto(0), klass(k), shape(0), slots(0), nslots(0), props(0) {}
+	void DropProp(const char* id);		// remove own prop id, if there is one
 
-private:
 	const char*		klass;
-	prop*			props;
+	const shape_*	shape;		// in-object slots, if any
+	value_*			slots;		// slot values, in shape order
+	int				nslots;		// slots allocated, <= shape->count
+private:
+	prop*			props;		// everything else
+
+	value_* slot(const char* id);		// find slot by atom
 };
 
 
+// Closures are small, made often (each time a nested function
+// expression is evaluated) and all about the same size, so they
+// come out of big blocks, with a free list per 8-byte size class.
+class closure_alloc_
+{
+public:
+	static void* alloc(size_t n);
+	static void free(void* p, size_t n);
+};
+
+// What every instance of a compiled function shares.
+// Emitted statically (JS_CONSTEXPR) by the compiler, one per function.
+struct funcinfo_
+{
+	const char*	name;		// "" if anonymous
+	int			length;		// number of declared formals
+	bool		pure;		// stores nothing outside itself: may run on many threads at once
+	obj_*		prototype;	// from the build-time snapshot, or NULL
+};
+
 class func_ : public obj_
 {
 public:
-	func_() {}
+	JS_CONSTEXPR func_(int len = 0) : obj_("Function"), info(0), length(len), shared(true) {}
+	JS_CONSTEXPR func_(const funcinfo_* fi) : obj_("Function"), info(fi), length(fi->length), shared(true) {}
+	func_(const funcinfo_* fi, bool sh) : obj_("Function"), info(fi), length(fi->length), shared(sh) {}
 	virtual value_ call(value_ this_, int nargs_, ...) = 0;
+	virtual value_ dot(const char* id);		// length and name come from info
+	virtual value_& dotref(const char* id);
+	virtual value_ at(value_ x);
+	virtual value_& atref(value_ x);
+
+	static void* operator new(size_t n) { return closure_alloc_::alloc(n); }
+	static void operator delete(void* p, size_t n) { closure_alloc_::free(p, n); }
+
+	const funcinfo_*	info;	// or NULL for built-ins
 	int			length;
+	bool		shared;		// static, seen by every isolate (not a closure made by new)
+
+private:
+	obj_* Own(bool make);	// where its properties are, in this isolate
 };
 
 
@@ -121,17 +244,101 @@ public:
 		NONINT = 2,				// some indices are non-integers
 	} FLAGS;
 
-	array_() : flags(0), lo(0), len(0), pdata(0) {}
+	array_() : flags(0), lo(0), len(0), dense(0), pdata(0), cap(0), cnum(0), cstr(0) { klass = "Array"; }
+	// wrap a static table of constants, copied on first write:
+	array_(int n, const double* table) : flags(0), lo(0), len(n), dense(n), pdata(0), cap(0), cnum(table), cstr(0) { klass = "Array"; }
+	array_(int n, const char* const* table) : flags(0), lo(0), len(n), dense(n), pdata(0), cap(0), cnum(0), cstr(table) { klass = "Array"; }
+	~array_();
+#ifdef JS_STATS
+	static void* operator new(size_t n);
+#endif
 
-	value_ get(value_ x);		// get the value at index x
-	value_& ref(value_ x);		// reference the value at index x
+	virtual value_ dot(const char* id);
+	virtual value_ at(value_ x);
+	virtual value_& atref(value_ x);
 
 	const char* toString(void);
+	void Reserve(int n);		// make room for n elements in the vector
+	value_* Resize(int n);		// make it n undefined elements, all in the vector
+	void Densify(void);			// move every element into the vector
+	value_ elt(int i) const;	// element i, 0 <= i < len
 
 	unsigned		flags;
 	int				lo;			// lowest integer index
-	int				len;		// length (if compact vector)
+	int				len;		// length
+	int				dense;		// elements 0..dense-1 are in the vector, the rest
+								// (sparse, after a write far past the end) are props
 	void*			pdata;		// pointer to a 'map' or to a value_ vector
+	int				cap;		// allocated size of the value_ vector
+private:
+	const double*		cnum;	// shared constant table, or NULL
+	const char* const*	cstr;
+	void Unshare(void);			// copy a constant table into pdata
+};
+
+/////////////////////////////////////////////////////////////////////
+// Binary data - ArrayBuffer, typed arrays, DataView
+
+class arraybuffer_ : public obj_
+{
+public:
+	arraybuffer_(long n);		// n bytes of zero-filled, aligned storage
+	arraybuffer_(void* p, long n);	// adopt what another's Detach gave up
+	~arraybuffer_();
+
+	virtual value_ dot(const char* id);
+	void* Detach(void);			// give up the storage (a transfer): this and its views are empty now
+
+	void*			data;		// raw storage (16-byte aligned)
+	long			byteLength;
+	typedarray_*	views;		// the typed arrays on it, to empty when it's detached
+};
+
+class typedarray_ : public obj_
+{
+public:
+	typedef enum {
+		INT8,
+		UINT8,
+		UINT8C,					// Uint8ClampedArray
+		INT16,
+		UINT16,
+		INT32,
+		UINT32,
+		FLOAT32,
+		FLOAT64,
+	} KIND;
+
+	typedarray_(KIND k, arraybuffer_* buf, long offset, long n);
+
+	virtual value_ dot(const char* id);
+	virtual value_ at(value_ x);
+	virtual value_& atref(value_ x);
+	virtual value_ put(value_ x, value_ v);
+
+	double get(long i) const;		// element i, i must be in range
+	void set(long i, double d);		// store d (converted) at i, i must be in range
+
+	static int ElementSize(KIND k);
+
+	KIND			kind;
+	arraybuffer_*	buffer;		// underlying storage
+	long			byteOffset;	// offset of element 0 in buffer
+	long			length;		// number of elements
+	void*			data;		// address of element 0
+	typedarray_*	nextView;	// on the same buffer
+};
+
+class dataview_ : public obj_
+{
+public:
+	dataview_(arraybuffer_* buf, long offset, long n);
+
+	virtual value_ dot(const char* id);
+
+	arraybuffer_*	buffer;
+	long			byteOffset;
+	long			byteLength;
 };
 
 // private RT functions used by compiler:
@@ -139,16 +346,394 @@ value_ preinc_(value_& v);
 value_ predec_(value_& v);
 value_ postinc_(value_& v);
 value_ postdec_(value_& v);
+value_ eltinc_(value_ o, value_ x, int d, bool post);	// o[x]++ etc., by at and put
 value_ new_(void);			// create and return a new empty object
 value_ identical_(value_& a, value_& b);
 
 value_ MakeArray_(int len, ...);
+value_ ConstArray_(int len, const double* table);		// table must be static
+value_ ConstArray_(int len, const char* const* table);
+value_ MakeObject_(const shape_* shape, ...);	// one value per slot
+
+// Instance layout the compiler predicts for new F(...), from the
+// this.x = ... stores in F and in the methods on F.prototype, most
+// likely first. The first LAYOUT_WATCH instances get every slot;
+// after that, instances only reserve as many as those used.
+#define LAYOUT_WATCH 8
+
+struct layout_
+{
+	shape_		shape;				// predicted ids
+	int			reserve;			// slots for the next instance
+	int			made;				// instances so far
+	obj_*		watched[LAYOUT_WATCH];
+};
+
+value_ construct_(value_ cons, layout_* layout, int nargs, ...);	// new cons(...)
+
+void typeerror_(void);		// throw a TypeError
+long toint32_slow_(double d);
+
+inline long toint32_(double d)
+// ECMA ToInt32 on a double
+{
+	if (d >= -2147483648.0 && d < 2147483648.0) {
+		return (long)d;				// in range, just truncate (NaN fails both tests)
+	}
+	return toint32_slow_(d);
+}
+
+// a op b for the int32 operators (o[x] op= b, done as a get and a put)
+inline value_ band_(const value_& a, const value_& b) { return value_(a.toInt32() & b.toInt32()); }
+inline value_ bor_(const value_& a, const value_& b)  { return value_(a.toInt32() | b.toInt32()); }
+inline value_ bxor_(const value_& a, const value_& b) { return value_(a.toInt32() ^ b.toInt32()); }
+inline value_ shl_(const value_& a, const value_& b)
+{
+	return value_((int)((unsigned int)a.toInt32() << (b.toInt32() & 31)));
+}
+inline value_ shr_(const value_& a, const value_& b)
+{
+	return value_((int)a.toInt32() >> (b.toInt32() & 31));
+}
+inline value_ ushr_(const value_& a, const value_& b)
+{
+	return value_((double)((unsigned int)a.toInt32() >> (b.toInt32() & 31)));
+}
+
+inline unsigned char clamp8_(double d)
+// ToUint8Clamp (Uint8ClampedArray stores)
+{
+	if (!(d > 0)) return 0;			// includes NaN
+	if (d >= 255) return 255;
+	long n = (long)d;
+	double f = d - n;
+	if (f > 0.5 || (f == 0.5 && (n & 1))) {
+		n++;						// round half to even
+	}
+	return (unsigned char)n;
+}
 
 // standard functions and objects
 
 extern value_ true_;
 extern value_ false_;
-extern value_ global_;
+extern JS_THREAD value_* globalp_;	// each isolate has its own global object
+#define global_ (*globalp_)
+extern JS_THREAD void* globalsp_;	// and its own block of globals (--isolate)
 extern value_ null_;
 extern value_ undefined;
+extern double NaN_;
+
+/////////////////////////////////////////////////////////////////////
+// Typed array element access, used by the compiler when it can prove
+// that a variable only ever holds a typed array of one kind.
+// For a constructor C this defines:
+//	C_get_(a,i)		a[i] as a value_ (undefined if out of range)
+//	C_getd_(a,i)	a[i] as a double (NaN if out of range)
+//	C_put_(a,i,v)	a[i] = v, ignored if out of range, returns v
+//	C_add_(a,i,d,post)	a[i] += d, returns old (post) or new value
+
+inline typedarray_* typed_(const value_& a)
+{
+	if (a.t != value_::TOBJ) {
+		typeerror_();
+	}
+	return (typedarray_*)a.v.o;
+}
+
+#define TYPED_ACCESS_(C, CTYPE, STORE)											\
+inline double C##_getd_(const value_& a, double x) {								\
+	typedarray_* p = typed_(a); long i = (long)x;								\
+	if (i == x && (unsigned long)i < (unsigned long)p->length) {				\
+		return (double)((CTYPE*)p->data)[i];									\
+	}																			\
+	return NaN_;																\
+}																				\
+inline value_ C##_get_(const value_& a, double x) {								\
+	typedarray_* p = typed_(a); long i = (long)x;								\
+	if (i == x && (unsigned long)i < (unsigned long)p->length) {				\
+		return value_((double)((CTYPE*)p->data)[i]);							\
+	}																			\
+	return undefined;															\
+}																				\
+inline value_ C##_put_(const value_& a, double x, const value_& v) {				\
+	typedarray_* p = typed_(a); long i = (long)x;								\
+	if (i == x && (unsigned long)i < (unsigned long)p->length) {				\
+		double d = v.toNumber();												\
+		((CTYPE*)p->data)[i] = STORE(d);										\
+	}																			\
+	return v;																	\
+}																				\
+inline value_ C##_add_(const value_& a, double x, double delta, bool post) {	\
+	typedarray_* p = typed_(a); long i = (long)x;								\
+	if (i == x && (unsigned long)i < (unsigned long)p->length) {				\
+		CTYPE* e = (CTYPE*)p->data + i;											\
+		double old = (double)*e;												\
+		*e = STORE(old + delta);												\
+		return value_(post ? old : (double)*e);									\
+	}																			\
+	return value_(NaN_);														\
+}
+
+#define STORE_INT_(d)		toint32_(d)
+#define STORE_CLAMP_(d)		clamp8_(d)
+#define STORE_FLOAT_(d)		(d)
+
+TYPED_ACCESS_(Int8Array,			signed char,	STORE_INT_)
+TYPED_ACCESS_(Uint8Array,			unsigned char,	STORE_INT_)
+TYPED_ACCESS_(Uint8ClampedArray,	unsigned char,	STORE_CLAMP_)
+TYPED_ACCESS_(Int16Array,			short,			STORE_INT_)
+TYPED_ACCESS_(Uint16Array,			unsigned short,	STORE_INT_)
+TYPED_ACCESS_(Int32Array,			int,			STORE_INT_)
+TYPED_ACCESS_(Uint32Array,			unsigned int,	STORE_INT_)
+TYPED_ACCESS_(Float32Array,			float,			STORE_FLOAT_)
+TYPED_ACCESS_(Float64Array,			double,			STORE_FLOAT_)
+
+/////////////////////////////////////////////////////////////////////
+// JSON
+
+value_ JSON_parse_(const char* text, int len);	// text[len] is 0; throws SyntaxError
+value_ JSON_stringify_(value_ v);		// undefined if v has no JSON text
+
+/////////////////////////////////////////////////////////////////////
+// RegExp
+
+value_ rx_(const rxprog_* prog);		// regex literal; prog is static, compiled by js2cpp
+
+/////////////////////////////////////////////////////////////////////
+// Output (jsconsole.cpp): console.log, print and alert write into a
+// buffer, which is written out when full, at the end of a line if
+// stdout is a terminal, before the event loop waits, and at exit.
+
+void out_(const char* s, int len);		// stdout
+void outvalue_(const value_& v);		// v as String(v) would be, to stdout
+void flushout_(void);					// write out this thread's buffers
+
+/////////////////////////////////////////////////////////////////////
+// Event loop (jsevent.cpp). jsmain_ ends by running it: callbacks run
+// one at a time, each followed by the microtasks it queued, until no
+// timer, posted task or watched socket is left to call back.
+
+typedef void (*task_)(void* context);
+typedef void (*iotask_)(int fd, int events, void* context);
+
+#define IO_READ		1
+#define IO_WRITE	2
+
+struct timer_;
+struct watcher_;
+
+void microtask_(task_ fn, void* context);		// after the current callback
+void post_(task_ fn, void* context);			// on a later turn of the loop
+timer_* settimer_(double ms, double interval, task_ fn, void* context);
+	// fn after ms, then every interval ms if interval > 0
+void cleartimer_(timer_* t);					// t won't run (again)
+watcher_* watch_(int fd, iotask_ fn, void* context);
+void watchevents_(watcher_* w, int events);	// IO_READ|IO_WRITE to wait for, 0 = none
+void unwatch_(watcher_* w);						// stop watching fd (doesn't close it)
+void runloop_(void);
+
+/////////////////////////////////////////////////////////////////////
+// Isolates (jsisolate.cpp). A program translated with --isolate keeps
+// its globals in a block of its own per thread, so several copies of
+// it can run at once, each with its own global object, event loop and
+// output buffer; they talk through the isolate object (post, onmessage).
+
+int runisolates_(int (*entry)(...), int n);	// entry on n threads; the first nonzero result
+void once_(long* done, void (*fn)(void));	// fn, unless done: the first caller runs it, others wait
+
+/////////////////////////////////////////////////////////////////////
+// Parallel array methods (jsparallel.cpp): a.parallelMap(f) and
+// parallelFilter, parallelReduce, parallelForEach and parallelSort
+// share the work out to a pool of threads when a is big and f is pure
+// (see funcinfo_); otherwise they run on the calling thread.
+// parallelReduce's f must be associative.
+
+value_ parallelmethod_(const char* id);		// array method id, or undefined
+
+/////////////////////////////////////////////////////////////////////
+// Heap profile (jsheap.cpp). A program translated with --heapprof
+// numbers the expressions that allocate (literals, closures, new, +,
+// calls, property stores) and keeps allocsite_ at the one running;
+// the runtime counts what it allocates against it, and writes a pprof
+// profile at exit, to the file named by JS_HEAPPROF (heap.pprof), or
+// when the program calls performance.writeHeapProfile(path).
+// Allocations are all counted; blocks still live are sampled, one
+// every JS_HEAPPROF_RATE bytes (64K; 1 to follow every block).
+
+struct heapsite_
+{
+	const char*	file;
+	int			line;
+	const char*	function;	// the JS function it is in, "" at top level
+	const char*	what;		// "object literal", "call", ...
+};
+
+extern JS_THREAD int allocsite_;		// index in the sites, 0 when not profiling
+void heapprofile_(const heapsite_* sites, int n);	// profile, against sites[1..n-1]
+bool writeheapprofile_(const char* path);		// false if not profiling
+void* heapnew_(size_t n);				// ::operator new, counted
+
+inline value_ sited_(int site, const value_& v)
+// v, once the site around it is current again
+{
+	allocsite_ = site;
+	return v;
+}
+
+/////////////////////////////////////////////////////////////////////
+// Call profile (jsinstr.cpp). A program translated with --instrument
+// starts each JS function's call with a callprobe_, which counts the
+// call and times it (TSC) in the calling context it was made from.
+// At exit the runtime writes a call graph report (calls, inclusive
+// and exclusive time per function, and caller -> callee edges) to
+// $JS_INSTRUMENT.txt and folded stacks for flame graphs to
+// $JS_INSTRUMENT.folded (JS_INSTRUMENT: jscalls).
+
+struct fninfo_
+{
+	const char*	name;		// "(anonymous)" for a function literal with none
+	const char*	file;
+	int			line;
+};
+
+void instrument_(const fninfo_* fns, int n);	// profile calls to fns[0..n-1]
+void callenter_(int fn);
+void callexit_(void);
+
+class callprobe_
+{
+public:
+	callprobe_(int fn) { callenter_(fn); }
+	~callprobe_() { callexit_(); }		// (a throw too)
+};
+
+/////////////////////////////////////////////////////////////////////
+// Type feedback (jsfeedback.cpp). A program translated with --feedback
+// records what it sees at its property sites (the receiver's type and
+// shape), arithmetic sites (the operand types) and call sites (the
+// function called), and at exit writes it to $JS_FEEDBACK
+// (jsfeedback.txt). js2cpp --profile=that-file then specializes each
+// site for what was seen there, with the generic code behind a guard:
+// the helpers below.
+
+struct fbsite_
+{
+	const char*	file;
+	int			line;
+	int			col;
+	const char*	kind;		// "dot", "ref", "call", or the operator
+};
+
+void feedback_(const fbsite_* sites, int n);	// record, for sites[0..n-1]
+value_ fbtype_(int site, int operand, const value_& v);	// v, its type noted
+value_ fbshape_(int site, const value_& o);		// o, its type and shape noted
+value_ fbcallee_(int site, const value_& f);	// f, noted as called
 
+inline value_ dotmono_(const value_& o, const shape_* s, int k, const char* id)
+// o.id, where o was always an object of shape s (id is its slot k)
+{
+	if (o.t==value_::TOBJ) {
+		value_* sl = o.v.o->ShapeSlot(s, k);
+		if (sl && !sl->isHole()) {
+			return *sl;
+		}
+	}
+	// (a hole isn't an own property: id may be on the prototype)
+	return value_(o).dot(id);
+}
+
+inline value_& dotrefmono_(const value_& o, const shape_* s, int k, const char* id)
+{
+	if (o.t==value_::TOBJ) {
+		value_* sl = o.v.o->ShapeSlot(s, k);
+		if (sl) {
+			if (sl->isHole()) {
+				*sl = undefined;		// an own property now
+			}
+			return *sl;
+		}
+	}
+	return value_(o).dotref(id);
+}
+
+// a op b, where both were always numbers
+inline value_ numadd_(const value_& a, const value_& b)
+{
+	return a.t==value_::TNUM && b.t==value_::TNUM ? value_(a.v.d + b.v.d) : a + b;
+}
+
+inline value_ numsub_(const value_& a, const value_& b)
+{
+	return a.t==value_::TNUM && b.t==value_::TNUM ? value_(a.v.d - b.v.d) : a - b;
+}
+
+inline value_ nummul_(const value_& a, const value_& b)
+{
+	return a.t==value_::TNUM && b.t==value_::TNUM ? value_(a.v.d * b.v.d) : a * b;
+}
+
+inline value_ numdiv_(const value_& a, const value_& b)
+{
+	return a.t==value_::TNUM && b.t==value_::TNUM ? value_(a.v.d / b.v.d) : a / b;
+}
+
+inline value_ nummod_(const value_& a, const value_& b)
+{
+	return a.t==value_::TNUM && b.t==value_::TNUM ? value_(fmod(a.v.d, b.v.d)) : a % b;
+}
+
+inline bool numlt_(const value_& a, const value_& b)
+{
+	return a.t==value_::TNUM && b.t==value_::TNUM ? a.v.d < b.v.d : a < b;
+}
+
+inline bool numgt_(const value_& a, const value_& b)
+{
+	return a.t==value_::TNUM && b.t==value_::TNUM ? a.v.d > b.v.d : a > b;
+}
+
+/////////////////////////////////////////////////////////////////////
+// Math - the compiler calls these (and plain libm functions like
+// floor and sqrt) directly on doubles when Math is the global one.
+// Likewise Date.now() and performance.now().
+
+double Math_random_(void);
+double Date_now_(void);					// ms since 1970
+double performance_now_(void);			// monotonic ms, sub-microsecond
+
+inline double Math_round_(double d)
+{
+	double r = floor(d);
+	if (d - r >= 0.5) {
+		r += 1;
+	}
+	if (r == 0 && d < 0) {
+		return -0.0;			// Math.round(-0.2) is -0
+	}
+	return r;
+}
+
+inline double Math_min_(double a, double b)
+{
+	if (a < b) return a;
+	if (b < a) return b;
+	if (a != a || b != b) return NaN_;
+	return (a == 0 && 1/a < 0) ? a : b;		// min(0,-0) is -0
+}
+
+inline double Math_max_(double a, double b)
+{
+	if (a > b) return a;
+	if (b > a) return b;
+	if (a != a || b != b) return NaN_;
+	return (a == 0 && 1/a > 0) ? a : b;		// max(0,-0) is 0
+}
+
+inline double Math_pow_(double x, double y)
+{
+	// differs from C pow: pow(1,NaN) and pow(1,Infinity) are NaN
+	if (y != y) return NaN_;
+	if ((x == 1 || x == -1) && (y - y) != (y - y)) return NaN_;
+	return pow(x, y);
+}
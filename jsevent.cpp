@@ -0,0 +1,1007 @@
+// jsevent.cpp - the event loop
+//
+// After the top-level code, jsmain_ runs the loop until nothing is
+// left that could call back: timers (setTimeout, setInterval) on a
+// hierarchical timing wheel, posted tasks (a file read a chunk per
+// turn), and sockets, watched with epoll on Linux and select
+// elsewhere. Each callback is followed by the microtasks it queued.
+// The loop's state is all per thread: each isolate runs its own.
+
+#ifdef _WIN32
+#include "windows.h"
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "jscpprt.h"
+#include "jsrtpriv.h"
+#include "sugar.h"
+
+#ifdef _WIN32
+// windows.h brings in winsock
+#ifdef _MSC_VER
+#pragma comment(lib, "wsock32.lib")
+#endif
+#define closesock_(s)	closesocket(s)
+#define sockerror_()	WSAGetLastError()
+#define EWOULDBLOCK_	WSAEWOULDBLOCK
+#define EINPROGRESS_	WSAEWOULDBLOCK
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#ifdef __linux__
+#define EVENT_EPOLL
+#include <sys/epoll.h>
+#else
+#include <sys/select.h>
+#endif
+#define closesock_(s)	close(s)
+#define sockerror_()	errno
+#define EWOULDBLOCK_	EAGAIN
+#define EINPROGRESS_	EINPROGRESS
+#endif
+
+static uint64_ NowMs(void)
+// monotonic milliseconds, performance.now's clock
+{
+	return (uint64_)performance_now_();
+}
+
+/////////////////////////////////////////////////////////////////////
+// Task queues: microtasks, and tasks posted for a later turn
+
+struct taskq_
+{
+	task_*	fns;
+	void**	contexts;
+	int		head;			// next to run
+	int		count;
+	int		cap;			// power of 2
+};
+
+static JS_THREAD taskq_ microtasks, posted;
+
+static void Push(taskq_& q, task_ fn, void* context)
+{
+	if (q.count == q.cap) {
+		int cap = q.cap ? 2 * q.cap : 64;
+		task_* fns = (task_*)malloc(cap * sizeof fns[0]);
+		void** contexts = (void**)malloc(cap * sizeof contexts[0]);
+		for (int i = 0; i < q.count; i++) {
+			fns[i] = q.fns[(q.head + i) & (q.cap - 1)];
+			contexts[i] = q.contexts[(q.head + i) & (q.cap - 1)];
+		}
+		free(q.fns);
+		free(q.contexts);
+		q.fns = fns;
+		q.contexts = contexts;
+		q.head = 0;
+		q.cap = cap;
+	}
+	int tail = (q.head + q.count++) & (q.cap - 1);
+	q.fns[tail] = fn;
+	q.contexts[tail] = context;
+}
+
+static bool Pop(taskq_& q, task_& fn, void*& context)
+{
+	if (!q.count) {
+		return false;
+	}
+	fn = q.fns[q.head];
+	context = q.contexts[q.head];
+	q.head = (q.head + 1) & (q.cap - 1);
+	q.count--;
+	return true;
+}
+
+void microtask_(task_ fn, void* context)
+{
+	Push(microtasks, fn, context);
+}
+
+void post_(task_ fn, void* context)
+{
+	Push(posted, fn, context);
+}
+
+static void RunMicrotasks(void)
+{
+	task_ fn;
+	void* context;
+	while (Pop(microtasks, fn, context)) {
+		fn(context);
+	}
+}
+
+/////////////////////////////////////////////////////////////////////
+// Timers: a hierarchical timing wheel, 1 ms ticks. Level 0 holds what
+// is due in the next 64 ms, one slot per tick; each level up has slots
+// 64 times as wide, and a slot is re-sorted into the level below when
+// the wheel gets to it. Adding or removing a timer is O(1).
+
+#define WHEEL_BITS		6
+#define WHEEL_SIZE		(1 << WHEEL_BITS)
+#define WHEEL_MASK		(WHEEL_SIZE - 1)
+#define WHEEL_LEVELS	4		// 64 ms, 4.1 s, 4.4 min, 4.7 h; later waits at the top
+
+struct timer_
+{
+	timer_*		next;		// circular list of the slot
+	timer_*		prev;
+	uint64_		due;		// tick
+	double		interval;	// ms, 0 for once
+	task_		fn;
+	void*		context;
+};
+
+static JS_THREAD timer_	wheel[WHEEL_LEVELS][WHEEL_SIZE];	// list heads
+static JS_THREAD uint64_	wheelTick;			// every timer due by this tick has run
+static JS_THREAD int		ntimers;
+static JS_THREAD timer_*	running;			// timer whose callback is running
+static JS_THREAD bool		runningCleared;		// ... and it was cleared
+
+static void Unlink(timer_* t)
+{
+	t->prev->next = t->next;
+	t->next->prev = t->prev;
+	t->next = t->prev = t;
+}
+
+static void Append(timer_* head, timer_* t)
+{
+	if (!head->next) {
+		head->next = head->prev = head;		// first use of this slot
+	}
+	t->prev = head->prev;
+	t->next = head;
+	head->prev->next = t;
+	head->prev = t;
+}
+
+static bool IsEmpty(timer_* head)
+{
+	return !head->next || head->next == head;
+}
+
+static void Place(timer_* t)
+// into the slot for its due tick, which is after wheelTick
+{
+	uint64_ due = t->due;
+	uint64_ horizon = (uint64_)1 << (WHEEL_BITS * WHEEL_LEVELS);
+	if (due - wheelTick >= horizon) {
+		due = wheelTick + horizon - 1;		// comes back down when its slot cascades
+	}
+	int level = 0;
+	while (level < WHEEL_LEVELS - 1 && due - wheelTick >= (uint64_)1 << (WHEEL_BITS * (level + 1))) {
+		level++;
+	}
+	Append(&wheel[level][(int)(due >> (WHEEL_BITS * level)) & WHEEL_MASK], t);
+}
+
+static void Cascade(timer_* head)
+// re-sort a slot into the levels below
+{
+	while (!IsEmpty(head)) {
+		timer_* t = head->next;
+		Unlink(t);
+		Place(t);
+	}
+}
+
+static uint64_ Ticks(double ms)
+{
+	return ms >= 1 ? (uint64_)ms : 1;		// NaN and 0 mean soon
+}
+
+timer_* settimer_(double ms, double interval, task_ fn, void* context)
+{
+	if (!ntimers) {
+		wheelTick = NowMs();
+	}
+	timer_* t = (timer_*)malloc(sizeof(timer_));
+	t->due = wheelTick + Ticks(ms);
+	t->interval = interval > 0 ? interval : 0;
+	t->fn = fn;
+	t->context = context;
+	Place(t);
+	ntimers++;
+	return t;
+}
+
+void cleartimer_(timer_* t)
+{
+	if (t == running) {
+		runningCleared = true;
+		return;
+	}
+	Unlink(t);
+	free(t);
+	ntimers--;
+}
+
+static void RunTimers(uint64_ now)
+{
+	if (!ntimers) {
+		wheelTick = now;
+		return;
+	}
+	while (wheelTick < now) {
+		uint64_ tick = ++wheelTick;
+		for (int level = 1; level < WHEEL_LEVELS && (tick & WHEEL_MASK) == 0; level++) {
+			tick >>= WHEEL_BITS;
+			Cascade(&wheel[level][(int)tick & WHEEL_MASK]);
+		}
+		// take the slot's list first, so timers set by the callbacks
+		// wait for their own tick; clearing one still unlinks it
+		timer_* slot = &wheel[0][(int)wheelTick & WHEEL_MASK];
+		if (IsEmpty(slot)) {
+			continue;
+		}
+		timer_ due;
+		due.next = slot->next;
+		due.prev = slot->prev;
+		due.next->prev = due.prev->next = &due;
+		slot->next = slot->prev = slot;
+		while (due.next != &due) {
+			timer_* t = due.next;
+			Unlink(t);
+			running = t;
+			runningCleared = false;
+			t->fn(t->context);
+			running = NULL;
+			if (t->interval > 0 && !runningCleared) {
+				t->due = wheelTick + Ticks(t->interval);
+				Place(t);
+			} else {
+				free(t);
+				ntimers--;
+			}
+			RunMicrotasks();
+		}
+	}
+}
+
+static int TimerWait(uint64_ now)
+// ms until the wheel next has something to do, -1 if no timers
+{
+	if (!ntimers) {
+		return -1;
+	}
+	uint64_ next = (wheelTick | WHEEL_MASK) + 1;		// the next cascade
+	for (int i = 1; i < WHEEL_SIZE; i++) {
+		if (!IsEmpty(&wheel[0][(int)(wheelTick + i) & WHEEL_MASK])) {
+			next = wheelTick + i;
+			break;
+		}
+	}
+	return next > now ? (int)(next - now) : 0;
+}
+
+/////////////////////////////////////////////////////////////////////
+// I/O readiness
+
+struct watcher_
+{
+	int			fd;
+	int			events;		// IO_READ|IO_WRITE
+	iotask_		fn;			// NULL once unwatched
+	void*		context;
+	watcher_*	nextDead;
+};
+
+static JS_THREAD int			nwatching;		// watchers with events, which keep the loop going
+static JS_THREAD watcher_*	dead;			// unwatched, freed after the current poll
+
+#ifdef EVENT_EPOLL
+static JS_THREAD int epfd = -1;
+#else
+static JS_THREAD watcher_**	watchers;
+static JS_THREAD int			nwatchers, capwatchers;
+#endif
+
+watcher_* watch_(int fd, iotask_ fn, void* context)
+{
+	watcher_* w = (watcher_*)malloc(sizeof(watcher_));
+	w->fd = fd;
+	w->events = 0;
+	w->fn = fn;
+	w->context = context;
+	w->nextDead = NULL;
+#ifdef EVENT_EPOLL
+	if (epfd < 0) {
+		epfd = epoll_create(64);
+	}
+#else
+	if (nwatchers == capwatchers) {
+		capwatchers = capwatchers ? 2 * capwatchers : 16;
+		watchers = (watcher_**)realloc(watchers, capwatchers * sizeof watchers[0]);
+	}
+	watchers[nwatchers++] = w;
+#endif
+	return w;
+}
+
+void watchevents_(watcher_* w, int events)
+{
+	if (events == w->events) {
+		return;
+	}
+#ifdef EVENT_EPOLL
+	struct epoll_event ev;
+	ev.events = ((events & IO_READ) ? (unsigned)EPOLLIN : 0) | ((events & IO_WRITE) ? (unsigned)EPOLLOUT : 0);
+	ev.data.ptr = w;
+	epoll_ctl(epfd, !w->events ? EPOLL_CTL_ADD : !events ? EPOLL_CTL_DEL : EPOLL_CTL_MOD, w->fd, &ev);
+#endif
+	nwatching += (events != 0) - (w->events != 0);
+	w->events = events;
+}
+
+void unwatch_(watcher_* w)
+{
+	watchevents_(w, 0);
+	w->fn = NULL;
+	w->nextDead = dead;
+	dead = w;
+#ifndef EVENT_EPOLL
+	for (int i = 0; i < nwatchers; i++) {
+		if (watchers[i] == w) {
+			watchers[i] = watchers[--nwatchers];
+			break;
+		}
+	}
+#endif
+}
+
+static void Ready(watcher_* w, int events)
+{
+	if (w->fn && (events &= w->events) != 0) {
+		w->fn(w->fd, events, w->context);
+		RunMicrotasks();
+	}
+}
+
+static void Poll(int ms)
+// wait up to ms (-1 = no limit) and call back whatever is ready
+{
+#ifdef EVENT_EPOLL
+	struct epoll_event evs[64];
+	int n = epoll_wait(epfd, evs, LENGTH(evs), ms);
+	for (int i = 0; i < n; i++) {
+		int events = 0;
+		if (evs[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+			events |= IO_READ;
+		}
+		if (evs[i].events & (EPOLLOUT | EPOLLHUP | EPOLLERR)) {
+			events |= IO_WRITE;
+		}
+		Ready((watcher_*)evs[i].data.ptr, events);
+	}
+#else
+	struct timeval tv, *ptv = NULL;
+	if (ms >= 0) {
+		tv.tv_sec = ms / 1000;
+		tv.tv_usec = (ms % 1000) * 1000;
+		ptv = &tv;
+	}
+	if (!nwatching) {
+		// Windows' select wants at least one socket
+#ifdef _WIN32
+		Sleep(ms);
+#else
+		select(0, NULL, NULL, NULL, ptv);
+#endif
+		return;
+	}
+	fd_set rd, wr;
+	FD_ZERO(&rd);
+	FD_ZERO(&wr);
+	int maxfd = 0;
+	int i, n = nwatchers;
+	for (i = 0; i < n; i++) {
+		watcher_* w = watchers[i];
+		if (w->events & IO_READ) {
+			FD_SET(w->fd, &rd);
+		}
+		if (w->events & IO_WRITE) {
+			FD_SET(w->fd, &wr);
+		}
+		if (w->events && w->fd > maxfd) {
+			maxfd = w->fd;
+		}
+	}
+	if (select(maxfd + 1, &rd, &wr, NULL, ptv) <= 0) {
+		return;
+	}
+	// the callbacks can add and remove watchers: go by a copy
+	watcher_** ready = (watcher_**)malloc(n * sizeof ready[0]);
+	memcpy(ready, watchers, n * sizeof ready[0]);
+	for (i = 0; i < n; i++) {
+		watcher_* w = ready[i];
+		int events = (FD_ISSET(w->fd, &rd) ? IO_READ : 0) | (FD_ISSET(w->fd, &wr) ? IO_WRITE : 0);
+		Ready(w, events);
+	}
+	free(ready);
+#endif
+	while (dead) {
+		watcher_* w = dead;
+		dead = w->nextDead;
+		free(w);
+	}
+}
+
+/////////////////////////////////////////////////////////////////////
+// The loop
+
+void runloop_(void)
+{
+	RunMicrotasks();
+	for (;;) {
+		uint64_ now = NowMs();
+		RunTimers(now);
+		// just the tasks posted so far; what they post waits a turn
+		int n = posted.count;
+		task_ fn;
+		void* context;
+		while (n-- > 0 && Pop(posted, fn, context)) {
+			fn(context);
+			RunMicrotasks();
+		}
+		if (!ntimers && !posted.count && !nwatching) {
+			break;
+		}
+		int wait = posted.count ? 0 : TimerWait(NowMs());
+		if (wait) {
+			flushout_();		// what's been printed, before sleeping
+		}
+		Poll(wait);
+	}
+}
+
+/////////////////////////////////////////////////////////////////////
+// setTimeout, setInterval, clearTimeout, clearInterval, queueMicrotask
+
+#define TIMER_ARGS	4
+
+struct jstimer_
+{
+	timer_*		timer;
+	func_*		fn;
+	int			nargs;
+	value_		args[TIMER_ARGS];
+	int			slot;		// in jstimers
+	bool		repeat;
+};
+
+// id = slot + 1 + generation * 2^24, so a stale id can't clear
+// the timer that reuses its slot
+#define TIMER_SLOT_BITS	24
+
+static JS_THREAD jstimer_**	jstimers;
+static JS_THREAD unsigned*	jsgens;
+static JS_THREAD int*			jsfree;
+static JS_THREAD int			njsfree, njstimers, capjstimers;
+
+static double TimerId(jstimer_* t)
+{
+	return t->slot + 1 + (double)jsgens[t->slot] * (1 << TIMER_SLOT_BITS);
+}
+
+static void FreeTimer(jstimer_* t)
+{
+	jstimers[t->slot] = NULL;
+	jsgens[t->slot]++;
+	jsfree[njsfree++] = t->slot;
+	delete t;
+}
+
+static void OnTimer(void* context)
+{
+	jstimer_* t = (jstimer_*)context;
+	if (!t->repeat) {
+		t->timer = NULL;
+	}
+	func_* fn = t->fn;
+	int nargs = t->nargs;
+	value_ args[TIMER_ARGS];
+	for (int i = 0; i < nargs; i++) {
+		args[i] = t->args[i];
+	}
+	if (!t->repeat) {
+		FreeTimer(t);
+	}
+	callv_(fn, global_, nargs, args);
+}
+
+class settimer_class_ : public func_ {
+public:
+	JS_CONSTEXPR settimer_class_(bool r) : func_(2), repeat(r) {}
+	virtual value_ call(value_ this_, int nargs, ...)
+	{
+		value_* argv = ARGV_(nargs);
+		if (nargs < 1 || argv[0].t != value_::TFUNC) {
+			throw TypeError();
+		}
+		if (nargs - 2 > TIMER_ARGS) {
+			throw not_imp();
+		}
+		double ms = nargs > 1 ? argv[1].toNumber() : 0;
+		jstimer_* t = new jstimer_;
+		t->fn = argv[0].v.f;
+		t->nargs = nargs > 2 ? nargs - 2 : 0;
+		for (int i = 0; i < t->nargs; i++) {
+			t->args[i] = argv[i + 2];
+		}
+		t->repeat = repeat;
+		if (njsfree) {
+			t->slot = jsfree[--njsfree];
+		} else {
+			if (njstimers == capjstimers) {
+				capjstimers = capjstimers ? 2 * capjstimers : 64;
+				jstimers = (jstimer_**)realloc(jstimers, capjstimers * sizeof jstimers[0]);
+				jsgens = (unsigned*)realloc(jsgens, capjstimers * sizeof jsgens[0]);
+				jsfree = (int*)realloc(jsfree, capjstimers * sizeof jsfree[0]);
+			}
+			jsgens[njstimers] = 0;
+			t->slot = njstimers++;
+		}
+		jstimers[t->slot] = t;
+		t->timer = settimer_(ms, repeat ? (ms >= 1 ? ms : 1) : 0, OnTimer, t);
+		return value_(TimerId(t));
+	}
+private:
+	bool repeat;
+};
+
+class cleartimer_class_ : public func_ {
+public:
+	JS_CONSTEXPR cleartimer_class_() : func_(1) {}
+	virtual value_ call(value_ this_, int nargs, ...)
+	{
+		if (nargs < 1) {
+			return undefined;
+		}
+		double id = ARGV_(nargs)[0].toNumber();
+		if (!(id >= 1)) {
+			return undefined;
+		}
+		double gen = floor((id - 1) / (1 << TIMER_SLOT_BITS));
+		int slot = (int)(id - 1 - gen * (1 << TIMER_SLOT_BITS));
+		if (slot < njstimers && jstimers[slot] && jsgens[slot] == gen) {
+			jstimer_* t = jstimers[slot];
+			if (t->timer) {
+				cleartimer_(t->timer);
+			}
+			FreeTimer(t);
+		}
+		return undefined;
+	}
+};
+
+static void OnMicrotask(void* context)
+{
+	func_* fn = (func_*)context;
+	fn->call(global_, 0);
+}
+
+class queueMicrotask_class_ : public func_ {
+public:
+	JS_CONSTEXPR queueMicrotask_class_() : func_(1) {}
+	virtual value_ call(value_ this_, int nargs, ...)
+	{
+		if (nargs < 1 || ARGV_(nargs)[0].t != value_::TFUNC) {
+			throw TypeError();
+		}
+		microtask_(OnMicrotask, ARGV_(nargs)[0].v.f);
+		return undefined;
+	}
+};
+
+static settimer_class_ setTimeout_func_(false), setInterval_func_(true);
+static cleartimer_class_ clearTimer_func_;
+static queueMicrotask_class_ queueMicrotask_func_;
+value_ setTimeout(&setTimeout_func_);
+value_ setInterval(&setInterval_func_);
+value_ clearTimeout(&clearTimer_func_);
+value_ clearInterval(&clearTimer_func_);
+value_ queueMicrotask(&queueMicrotask_func_);
+
+/////////////////////////////////////////////////////////////////////
+// Sockets: net.listen(port, onconnection) and net.connect(port, host,
+// onconnect) give Socket objects, which have write(text) and close(),
+// and call their ondata(text) and onclose() properties.
+
+#define RECV_SIZE	(64 * 1024)
+
+static void NetInit(void)
+{
+#ifdef _WIN32
+	static bool started;
+	if (!started) {
+		WSADATA wsa;
+		WSAStartup(MAKEWORD(1, 1), &wsa);
+		started = true;
+	}
+#endif
+}
+
+static void NonBlocking(int fd)
+{
+#ifdef _WIN32
+	unsigned long on = 1;
+	ioctlsocket(fd, FIONBIO, &on);
+#else
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+#endif
+	int one = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (const char*)&one, sizeof one);
+}
+
+static bool Address(value_ port, value_ host, struct sockaddr_in& addr)
+{
+	memset(&addr, 0, sizeof addr);
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons((unsigned short)port.toInt32());
+	if (host.isUndefined() || host.t == value_::TNULL) {
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		return true;
+	}
+	const char* name = host.toString();
+	unsigned long a = inet_addr(name);
+	if (a == INADDR_NONE) {
+		struct hostent* h = gethostbyname(name);
+		if (!h) {
+			return false;
+		}
+		memcpy(&a, h->h_addr, sizeof a);
+	}
+	addr.sin_addr.s_addr = a;
+	return true;
+}
+
+class socket_ : public obj_
+{
+public:
+	socket_(int s);
+
+	virtual value_ dot(const char* id);
+
+	bool Write(const char* s, int n);
+	void Close(void);
+	static void OnReady(int fd, int events, void* context);
+
+	int			fd;
+	watcher_*	w;
+	char*		out;		// what send hasn't taken yet
+	int			outlen;
+	int			outcap;
+	bool		closing;	// close once out is sent
+};
+
+socket_::socket_(int s)
+	: obj_("Socket"), fd(s), w(watch_(s, OnReady, this)), out(NULL), outlen(0), outcap(0), closing(false)
+{
+	watchevents_(w, IO_READ);
+}
+
+static value_ Handler(obj_* o, const char* name)
+// o's callback property name, undefined if it isn't a function
+{
+	value_ f = o->dot(intern_(name));
+	return f.t == value_::TFUNC ? f : undefined;
+}
+
+bool socket_::Write(const char* s, int n)
+{
+	if (fd < 0 || closing) {
+		return false;
+	}
+	int sent = 0;
+	if (!outlen) {
+		sent = send(fd, s, n, 0);
+		if (sent < 0) {
+			if (sockerror_() != EWOULDBLOCK_) {
+				Close();
+				return false;
+			}
+			sent = 0;
+		}
+	}
+	if (sent < n) {
+		if (outlen + n - sent > outcap) {
+			outcap = 2 * outcap + n - sent;
+			out = (char*)realloc(out, outcap);
+		}
+		memcpy(out + outlen, s + sent, n - sent);
+		outlen += n - sent;
+		watchevents_(w, IO_READ | IO_WRITE);
+	}
+	return true;
+}
+
+void socket_::Close(void)
+{
+	if (fd < 0) {
+		return;
+	}
+	unwatch_(w);
+	closesock_(fd);
+	fd = -1;
+	free(out);
+	out = NULL;
+	outlen = 0;
+	value_ onclose = Handler(this, "onclose");
+	if (onclose.t == value_::TFUNC) {
+		onclose.v.f->call(value_(this), 0);
+	}
+}
+
+void socket_::OnReady(int fd, int events, void* context)
+{
+	socket_* s = (socket_*)context;
+	if ((events & IO_WRITE) && s->outlen) {
+		int sent = send(fd, s->out, s->outlen, 0);
+		if (sent < 0 && sockerror_() != EWOULDBLOCK_) {
+			s->Close();
+			return;
+		}
+		if (sent > 0) {
+			memmove(s->out, s->out + sent, s->outlen - sent);
+			s->outlen -= sent;
+		}
+		if (!s->outlen) {
+			if (s->closing) {
+				s->Close();
+				return;
+			}
+			watchevents_(s->w, IO_READ);
+		}
+	}
+	if (events & IO_READ) {
+		char buf[RECV_SIZE];
+		int n = recv(fd, buf, sizeof buf, 0);
+		if (n < 0 && sockerror_() == EWOULDBLOCK_) {
+			return;
+		}
+		if (n <= 0) {
+			s->Close();
+			return;
+		}
+		value_ ondata = Handler(s, "ondata");
+		if (ondata.t == value_::TFUNC) {
+			char* text = (char*)malloc(n + 1);
+			memcpy(text, buf, n);
+			text[n] = 0;
+			ondata.v.f->call(value_(s), 1, value_(text));
+		}
+	}
+}
+
+class socketwrite_ : public func_ {
+public:
+	JS_CONSTEXPR socketwrite_() : func_(1) {}
+	virtual value_ call(value_ this_, int nargs, ...)
+	{
+		if (this_.t != value_::TOBJ || strcmp(this_.v.o->Class(), "Socket")) {
+			throw TypeError();
+		}
+		const char* s = nargs ? ARGV_(nargs)[0].toString() : "";
+		return value_(((socket_*)this_.v.o)->Write(s, strlen(s)));
+	}
+};
+
+class socketclose_ : public func_ {
+public:
+	JS_CONSTEXPR socketclose_() : func_(0) {}
+	virtual value_ call(value_ this_, int nargs, ...)
+	{
+		if (this_.t != value_::TOBJ || strcmp(this_.v.o->Class(), "Socket")) {
+			throw TypeError();
+		}
+		socket_* s = (socket_*)this_.v.o;
+		if (s->outlen) {
+			s->closing = true;		// after the rest is sent
+		} else {
+			s->Close();
+		}
+		return undefined;
+	}
+};
+
+static socketwrite_ socketwrite_func_;
+static socketclose_ socketclose_func_;
+
+value_ socket_::dot(const char* id)
+{
+	if (0==strcmp(id, "write")) {
+		return value_(&socketwrite_func_);
+	}
+	if (0==strcmp(id, "close")) {
+		return value_(&socketclose_func_);
+	}
+	return obj_::dot(id);
+}
+
+// a listening socket
+class server_ : public obj_
+{
+public:
+	server_(int s, func_* cb) : obj_("Server"), fd(s), w(watch_(s, OnAccept, this)), onconnection(cb)
+	{
+		watchevents_(w, IO_READ);
+	}
+
+	virtual value_ dot(const char* id);
+
+	static void OnAccept(int fd, int events, void* context);
+
+	int			fd;
+	watcher_*	w;
+	func_*		onconnection;
+};
+
+void server_::OnAccept(int fd, int events, void* context)
+{
+	server_* server = (server_*)context;
+	for (;;) {
+		int s = accept(fd, NULL, NULL);
+		if (s < 0) {
+			break;
+		}
+		NonBlocking(s);
+		socket_* sock = new socket_(s);
+		server->onconnection->call(value_(server), 1, value_(sock));
+		if (server->fd < 0) {
+			break;					// closed by the callback
+		}
+	}
+}
+
+class serverclose_ : public func_ {
+public:
+	JS_CONSTEXPR serverclose_() : func_(0) {}
+	virtual value_ call(value_ this_, int nargs, ...)
+	{
+		if (this_.t != value_::TOBJ || strcmp(this_.v.o->Class(), "Server")) {
+			throw TypeError();
+		}
+		server_* server = (server_*)this_.v.o;
+		if (server->fd >= 0) {
+			unwatch_(server->w);
+			closesock_(server->fd);
+			server->fd = -1;
+		}
+		return undefined;
+	}
+};
+
+static serverclose_ serverclose_func_;
+
+value_ server_::dot(const char* id)
+{
+	if (0==strcmp(id, "close")) {
+		return value_(&serverclose_func_);
+	}
+	return obj_::dot(id);
+}
+
+class listen_class_ : public func_ {
+public:
+	JS_CONSTEXPR listen_class_() : func_(2) {}
+	virtual value_ call(value_ this_, int nargs, ...)
+	{
+		// listen(port, onconnection), on the loopback interface
+		value_* argv = ARGV_(nargs);
+		if (nargs < 2 || argv[1].t != value_::TFUNC) {
+			throw TypeError();
+		}
+		NetInit();
+		struct sockaddr_in addr;
+		Address(argv[0], undefined, addr);
+		int s = socket(AF_INET, SOCK_STREAM, 0);
+		int one = 1;
+		setsockopt(s, SOL_SOCKET, SO_REUSEADDR, (const char*)&one, sizeof one);
+		if (s < 0 || bind(s, (struct sockaddr*)&addr, sizeof addr) < 0 || listen(s, 128) < 0) {
+			if (s >= 0) {
+				closesock_(s);
+			}
+			return null_;
+		}
+		NonBlocking(s);
+		return value_(new server_(s, argv[1].v.f));
+	}
+};
+
+struct connecting_
+{
+	int			fd;
+	watcher_*	w;
+	func_*		onconnect;
+};
+
+static void OnConnect(int fd, int events, void* context)
+// connected, or not: onconnect(socket) or onconnect(null)
+{
+	connecting_* c = (connecting_*)context;
+	int err = 0;
+#ifdef _WIN32
+	int len = sizeof err;
+#else
+	socklen_t len = sizeof err;
+#endif
+	getsockopt(fd, SOL_SOCKET, SO_ERROR, (char*)&err, &len);
+	unwatch_(c->w);
+	func_* onconnect = c->onconnect;
+	delete c;
+	if (err) {
+		closesock_(fd);
+		onconnect->call(global_, 1, null_);
+	} else {
+		onconnect->call(global_, 1, value_(new socket_(fd)));
+	}
+}
+
+class connect_class_ : public func_ {
+public:
+	JS_CONSTEXPR connect_class_() : func_(3) {}
+	virtual value_ call(value_ this_, int nargs, ...)
+	{
+		// connect(port, host, onconnect)
+		value_* argv = ARGV_(nargs);
+		if (nargs < 3 || argv[2].t != value_::TFUNC) {
+			throw TypeError();
+		}
+		NetInit();
+		struct sockaddr_in addr;
+		int s = -1;
+		if (Address(argv[0], argv[1], addr)) {
+			s = socket(AF_INET, SOCK_STREAM, 0);
+		}
+		if (s >= 0) {
+			NonBlocking(s);
+			if (connect(s, (struct sockaddr*)&addr, sizeof addr) < 0 && sockerror_() != EINPROGRESS_) {
+				closesock_(s);
+				s = -1;
+			}
+		}
+		if (s < 0) {
+			argv[2].v.f->call(global_, 1, null_);
+			return undefined;
+		}
+		connecting_* c = new connecting_;
+		c->fd = s;
+		c->onconnect = argv[2].v.f;
+		c->w = watch_(s, OnConnect, c);
+		watchevents_(c->w, IO_WRITE);
+		return undefined;
+	}
+};
+
+static listen_class_ listen_func_;
+static connect_class_ connect_func_;
+
+class net_ : public builtin_
+{
+public:
+	JS_CONSTEXPR net_() : builtin_("net") {}
+	virtual value_ dot(const char* id)
+	{
+		if (0==strcmp(id, "listen")) {
+			return value_(&listen_func_);
+		}
+		if (0==strcmp(id, "connect")) {
+			return value_(&connect_func_);
+		}
+		return builtin_::dot(id);
+	}
+};
+
+static net_ net_object_;
+value_ net(&net_object_);
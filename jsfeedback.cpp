@@ -0,0 +1,164 @@
+// jsfeedback.cpp - type feedback for the compiler (--feedback)
+//
+// For each site the program was compiled with, the types seen (of the
+// receiver or callee, or of each operand) and up to FB_SEEN shapes or
+// functions; past that the site is megamorphic. The notes aren't
+// locked: threads racing on one site can lose an observation, which
+// only makes the compiler a little more hopeful.
+//
+// The file is text, a line per site that ran, tab-separated:
+//	file:line:col	kind	types...	seen...
+// types are like number or number|string (one per operand for the
+// arithmetic kinds); seen are shape names ({x,y}, new F) for dot and
+// ref, function names for call, ? for one the compiler can't name,
+// and * once there were too many.
+
+#ifdef _WIN32
+#include "windows.h"
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "jscpprt.h"
+#include "jsrtpriv.h"
+#include "sugar.h"
+
+#define FB_SEEN	4
+
+struct fbseen_
+{
+	unsigned	types[2];		// 1 << value_::t, per operand
+	const void*	seen[FB_SEEN];	// shapes or func_s, in order seen
+	bool		mega;			// more than FB_SEEN
+};
+
+static const fbsite_*	sites;
+static int				nsites;
+static fbseen_*			notes;
+static long				started;
+static char				noshape;	// an object without a static shape
+
+static void Write(void);
+
+static void Start(void)
+{
+	notes = (fbseen_*)calloc(nsites ? nsites : 1, sizeof(fbseen_));
+	if (!notes) {
+		throw bad_alloc();
+	}
+	atexit(Write);
+}
+
+void feedback_(const fbsite_* s, int n)
+// (each isolate's jsmain_ calls it, with the same sites)
+{
+	sites = s;
+	nsites = n;
+	once_(&started, Start);
+}
+
+static void Note(fbseen_& f, const void* p)
+{
+	if (f.mega) {
+		return;
+	}
+	for (int i = 0; i < FB_SEEN; i++) {
+		if (f.seen[i]==p) {
+			return;
+		}
+		if (!f.seen[i]) {
+			f.seen[i] = p;
+			return;
+		}
+	}
+	f.mega = true;
+}
+
+value_ fbtype_(int site, int operand, const value_& v)
+{
+	notes[site].types[operand] |= 1 << v.t;
+	return v;
+}
+
+value_ fbshape_(int site, const value_& o)
+{
+	fbseen_& f = notes[site];
+	f.types[0] |= 1 << o.t;
+	if (o.t==value_::TOBJ) {
+		const shape_* shape = o.v.o->Shape();
+		Note(f, shape && shape->name ? (const void*)shape : &noshape);
+	}
+	return o;
+}
+
+value_ fbcallee_(int site, const value_& fn)
+{
+	fbseen_& f = notes[site];
+	f.types[0] |= 1 << fn.t;
+	if (fn.t==value_::TFUNC) {
+		Note(f, fn.v.f);
+	}
+	return fn;
+}
+
+/////////////////////////////////////////////////////////////////////
+// The file
+
+static const char* const typenames[] = {
+	"undefined", "null", "boolean", "string", "number", "object", "function", "array",
+};
+
+static void Types(FILE* f, unsigned types)
+{
+	const char* sep = "";
+	for (int t = 0; t < LENGTH(typenames); t++) {
+		if (types & (1 << t)) {
+			fprintf(f, "%s%s", sep, typenames[t]);
+			sep = "|";
+		}
+	}
+}
+
+static const char* SeenName(const fbsite_& site, const void* p)
+{
+	if (0==strcmp(site.kind, "call")) {
+		const funcinfo_* info = ((const func_*)p)->info;
+		return info && *info->name ? info->name : "?";
+	}
+	return p==&noshape ? "?" : ((const shape_*)p)->name;
+}
+
+static void Write(void)
+{
+	const char* path = getenv("JS_FEEDBACK");
+	if (!path || !*path) {
+		path = "jsfeedback.txt";
+	}
+	FILE* f = fopen(path, "w");
+	if (!f) {
+		fprintf(stderr, "cannot write type feedback %s\n", path);
+		return;
+	}
+	fprintf(f, "# js2cpp type feedback: use with js2cpp --profile=%s\n", path);
+	for (int i = 0; i < nsites; i++) {
+		const fbsite_& site = sites[i];
+		fbseen_& n = notes[i];
+		if (!n.types[0] && !n.types[1]) {
+			continue;			// never ran
+		}
+		fprintf(f, "%s:%d:%d\t%s\t", site.file, site.line, site.col, site.kind);
+		Types(f, n.types[0]);
+		if (n.types[1]) {
+			fprintf(f, "\t");
+			Types(f, n.types[1]);
+		}
+		for (int j = 0; j < FB_SEEN && n.seen[j]; j++) {
+			fprintf(f, "\t%s", SeenName(site, n.seen[j]));
+		}
+		if (n.mega) {
+			fprintf(f, "\t*");
+		}
+		fprintf(f, "\n");
+	}
+	fclose(f);
+}
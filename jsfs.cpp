@@ -0,0 +1,382 @@
+// jsfs.cpp - the fs object: reading files
+//
+// fs.readFileSync(path) maps the file and gives the mapping itself as
+// the string, so nothing is copied: the zero that ends it is the
+// mapping's own zero fill past the end of the file. fs.lines(path)
+// reads big chunks and hands out lines as slices of them, with no
+// allocation per line. fs.readFile(path, callback) reads on turns of
+// the event loop.
+
+#ifdef _WIN32
+#include "windows.h"
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS	MAP_ANON
+#endif
+#endif
+#include "jscpprt.h"
+#include "jsrtpriv.h"
+#include "sugar.h"
+
+/////////////////////////////////////////////////////////////////////
+// fs.readFileSync(path): like every string, the text lives as long
+// as the program
+
+static const char* ReadAll(FILE* f)
+// what's left of f, when it can't be mapped (a pipe, say)
+{
+	long len = 0, cap = 64 * 1024;
+	char* buf = (char*)malloc(cap + 1);
+	size_t n;
+	while (buf && (n = fread(buf + len, 1, cap - len, f)) > 0) {
+		len += n;
+		if (len == cap) {
+			cap *= 2;
+			buf = (char*)realloc(buf, cap + 1);
+		}
+	}
+	if (!buf) {
+		throw bad_alloc();
+	}
+	buf[len] = 0;
+	return buf;
+}
+
+#ifdef _WIN32
+static const char* MapFile(const char* path)
+{
+	HANDLE h = CreateFile(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, NULL);
+	if (h == INVALID_HANDLE_VALUE) {
+		throw io_error();
+	}
+	SYSTEM_INFO si;
+	GetSystemInfo(&si);
+	DWORD high;
+	DWORD size = GetFileSize(h, &high);
+	const char* text = NULL;
+	// past the end of the file the last page is zero: unless the file
+	// fills it, there's the terminator
+	if (!high && size % si.dwPageSize) {
+		HANDLE m = CreateFileMapping(h, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (m) {
+			text = (const char*)MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0);
+			CloseHandle(m);			// the view keeps the mapping
+		}
+	}
+	CloseHandle(h);
+	if (!text) {
+		FILE* f = fopen(path, "rb");
+		if (!f) {
+			throw io_error();
+		}
+		text = ReadAll(f);
+		fclose(f);
+	}
+	return text;
+}
+#else
+static const char* MapFile(const char* path)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		throw io_error();
+	}
+	struct stat st;
+	if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+		FILE* f = fdopen(fd, "rb");
+		const char* text = ReadAll(f);
+		fclose(f);
+		return text;
+	}
+	// Reserve zeroed pages for the file and a byte more, then map the
+	// file over the front of them: whatever the file's size, a zero
+	// follows it.
+	size_t page = sysconf(_SC_PAGESIZE);
+	size_t size = (size_t)st.st_size;
+	size_t total = (size / page + 1) * page;
+	void* p = mmap(NULL, total, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p != MAP_FAILED && size &&
+		mmap(p, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+		munmap(p, total);
+		p = MAP_FAILED;
+	}
+	close(fd);
+	if (p == MAP_FAILED) {
+		throw bad_alloc();
+	}
+	return (const char*)p;
+}
+#endif
+
+class readFileSync_class_ : public func_ {
+public:
+	JS_CONSTEXPR readFileSync_class_() : func_(1) {}
+	virtual value_ call(value_ this_, int nargs, ...)
+	{
+		value_* argv = ARGV_(nargs);
+		if (nargs < 1) {
+			throw TypeError();
+		}
+		return value_(MapFile(argv[0].toString()));
+	}
+};
+
+static readFileSync_class_ readFileSync_func_;
+
+/////////////////////////////////////////////////////////////////////
+// fs.lines(path): a reader whose next() gives the next line, without
+// its \n or \r\n, and null at the end. The file is read a megabyte at a
+// time, each into a buffer of its own, and each line ends where its \n
+// was: like every string, the buffers are never reused or freed.
+
+#define LINE_CHUNK	(1024 * 1024)
+
+class lines_ : public obj_
+{
+public:
+	lines_(FILE* f);
+	virtual value_ dot(const char* id);
+	value_ Next(void);
+	void Close(void);
+private:
+	bool Fill(void);
+
+	FILE*	f;				// NULL at the end
+	char*	chunk;			// the one lines are coming from, with a byte
+							// more for the last line's zero
+	long	pos;			// where the next line starts in it
+	long	end;			// bytes read into it
+};
+
+lines_::lines_(FILE* file) : obj_("LineReader"), f(file), chunk(NULL), pos(0), end(0)
+{
+	// fread straight into the chunks, not through stdio's buffer
+	setvbuf(f, NULL, _IONBF, 0);
+}
+
+bool lines_::Fill(void)
+// read on into a new chunk, carrying over the partial line;
+// false at the end of the file
+{
+	if (!f) {
+		return false;
+	}
+	long tail = end - pos;
+	// (a line longer than a chunk makes a bigger one)
+	long cap = tail + (LINE_CHUNK > tail ? LINE_CHUNK : tail);
+	char* next = (char*)malloc(cap + 1);
+	if (!next) {
+		throw bad_alloc();
+	}
+	size_t n = fread(next + tail, 1, cap - tail, f);
+	if (n == 0) {
+		// the partial line stays where it is
+		free(next);
+		Close();
+		return false;
+	}
+	if (tail) {
+		memcpy(next, chunk + pos, tail);
+	}
+	chunk = next;
+	pos = 0;
+	end = tail + n;
+	return true;
+}
+
+value_ lines_::Next(void)
+{
+	for (;;) {
+		char* start = chunk + pos;
+		char* nl = end > pos ? (char*)memchr(start, '\n', end - pos) : NULL;
+		if (nl) {
+			pos = nl + 1 - chunk;
+			if (nl > start && nl[-1] == '\r') {
+				nl--;
+			}
+			*nl = 0;
+			return value_(start);
+		}
+		if (!Fill()) {
+			break;
+		}
+	}
+	if (pos < end) {
+		// the last line, with no \n after it
+		char* start = chunk + pos;
+		chunk[end] = 0;
+		pos = end;
+		return value_(start);
+	}
+	return null_;
+}
+
+void lines_::Close(void)
+// stop reading; the chunks stay, as lines from them may be in use
+{
+	if (f) {
+		fclose(f);
+		f = NULL;
+	}
+}
+
+class linesNext_class_ : public func_ {
+public:
+	JS_CONSTEXPR linesNext_class_() : func_(0) {}
+	virtual value_ call(value_ this_, int nargs, ...)
+	{
+		if (this_.t != value_::TOBJ || strcmp(this_.v.o->Class(), "LineReader")) {
+			throw TypeError();
+		}
+		return ((lines_*)this_.v.o)->Next();
+	}
+};
+
+class linesClose_class_ : public func_ {
+public:
+	JS_CONSTEXPR linesClose_class_() : func_(0) {}
+	virtual value_ call(value_ this_, int nargs, ...)
+	{
+		if (this_.t != value_::TOBJ || strcmp(this_.v.o->Class(), "LineReader")) {
+			throw TypeError();
+		}
+		((lines_*)this_.v.o)->Close();
+		return undefined;
+	}
+};
+
+static linesNext_class_ linesNext_func_;
+static linesClose_class_ linesClose_func_;
+
+value_ lines_::dot(const char* id)
+{
+	if (0==strcmp(id, "next")) {
+		return value_(&linesNext_func_);
+	}
+	if (0==strcmp(id, "close")) {
+		return value_(&linesClose_func_);
+	}
+	return obj_::dot(id);
+}
+
+class lines_class_ : public func_ {
+public:
+	JS_CONSTEXPR lines_class_() : func_(1) {}
+	virtual value_ call(value_ this_, int nargs, ...)
+	{
+		value_* argv = ARGV_(nargs);
+		if (nargs < 1) {
+			throw TypeError();
+		}
+		FILE* f = fopen(argv[0].toString(), "rb");
+		if (!f) {
+			throw io_error();
+		}
+		return value_(new lines_(f));
+	}
+};
+
+static lines_class_ lines_func_;
+
+/////////////////////////////////////////////////////////////////////
+// fs.readFile(path, callback): the file is read a chunk per turn of
+// the event loop, so timers and sockets get their turns in between,
+// and callback(err, text) comes when it's all in
+
+#define READ_CHUNK	(64 * 1024)
+
+struct fileread_
+{
+	FILE*		f;
+	func_*		callback;
+	char*		buf;
+	long		len;
+	long		cap;
+	const char*	error;
+};
+
+static void ReadChunk(void* context)
+{
+	fileread_* r = (fileread_*)context;
+	if (r->f) {
+		if (r->len + READ_CHUNK + 1 > r->cap) {
+			r->cap = 2 * r->cap + READ_CHUNK + 1;
+			r->buf = (char*)realloc(r->buf, r->cap);
+		}
+		size_t n = fread(r->buf + r->len, 1, READ_CHUNK, r->f);
+		r->len += n;
+		if (n == READ_CHUNK) {
+			post_(ReadChunk, r);
+			return;
+		}
+		if (ferror(r->f)) {
+			r->error = "read error";
+		}
+		fclose(r->f);
+	}
+	value_ args[2];
+	if (r->error) {
+		free(r->buf);
+		args[0] = value_(r->error);
+	} else {
+		r->buf[r->len] = 0;
+		args[0] = null_;
+		args[1] = value_(r->buf);
+	}
+	func_* callback = r->callback;
+	delete r;
+	callv_(callback, global_, 2, args);
+}
+
+class readFile_class_ : public func_ {
+public:
+	JS_CONSTEXPR readFile_class_() : func_(2) {}
+	virtual value_ call(value_ this_, int nargs, ...)
+	{
+		value_* argv = ARGV_(nargs);
+		if (nargs < 2 || argv[1].t != value_::TFUNC) {
+			throw TypeError();
+		}
+		fileread_* r = new fileread_;
+		r->f = fopen(argv[0].toString(), "rb");
+		r->callback = argv[1].v.f;
+		r->buf = NULL;
+		r->len = r->cap = 0;
+		r->error = r->f ? NULL : "cannot open file";
+		post_(ReadChunk, r);
+		return undefined;
+	}
+};
+
+static readFile_class_ readFile_func_;
+
+class fs_ : public builtin_
+{
+public:
+	JS_CONSTEXPR fs_() : builtin_("fs") {}
+	virtual value_ dot(const char* id)
+	{
+		if (0==strcmp(id, "readFile")) {
+			return value_(&readFile_func_);
+		}
+		if (0==strcmp(id, "readFileSync")) {
+			return value_(&readFileSync_func_);
+		}
+		if (0==strcmp(id, "lines")) {
+			return value_(&lines_func_);
+		}
+		return builtin_::dot(id);
+	}
+};
+
+static fs_ fs_object_;
+value_ fs(&fs_object_);
@@ -0,0 +1,16 @@
+// jshash.h - string hash shared by the compiler and the runtime
+// The compiler precomputes atom hashes with it, so the two must agree.
+#ifndef JSHASH_H
+#define JSHASH_H
+
+inline unsigned jshash_(const char* s, int n)
+// 32-bit FNV-1a
+{
+	unsigned h = 2166136261u;
+	while (n--) {
+		h = (h ^ (unsigned char)*s++) * 16777619u;
+	}
+	return h;
+}
+
+#endif
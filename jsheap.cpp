@@ -0,0 +1,365 @@
+// jsheap.cpp - heap profile by allocation site (--heapprof)
+//
+// Every allocation the runtime makes for JS is counted against
+// allocsite_, the site the generated code says is running: objects,
+// property cells, array storage, closures, strings, ArrayBuffers. A
+// block now and then (one per JS_HEAPPROF_RATE bytes allocated) is
+// remembered until it's freed, which estimates what each site still
+// holds. Each thread counts into its own block of counters.
+//
+// The profile is the protobuf pprof reads (profile.proto), not
+// compressed: one sample per site, whose one frame is the site's JS
+// function, file and line, labeled with what the site is. Nothing
+// allocated for JS is collected, so in use mostly equals allocated
+// except for array storage that grew, and closures and objects the
+// runtime deleted.
+
+#ifdef _WIN32
+#include "windows.h"
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "jscpprt.h"
+#include "jsrtpriv.h"
+
+JS_THREAD int allocsite_;
+JS_THREAD void* heaplive_;
+
+struct sample_
+{
+	void*	p;				// NULL = empty, GONE = freed
+	int		site;
+	long	size;
+	long	weight;			// bytes it stands for, a multiple of rate
+};
+
+#define GONE	((void*)1)
+
+struct heapthread_
+{
+	heapthread_*	next;
+	uint64_*		counts;		// per site: allocations, then bytes
+	long			until;		// bytes to allocate before the next sample
+	sample_*		samples;	// live ones, open addressing on p
+	unsigned		cap;		// power of 2
+	unsigned		used;		// live or GONE
+};
+
+static const heapsite_*	sites;
+static int				nsites;
+static long				rate = 64 * 1024;
+static heapthread_*		threads;
+static volatile long	lock;
+static long				started;
+static JS_THREAD heapthread_* self;
+
+static void WriteAtExit(void);
+
+static void Start(void)
+{
+	const char* r = getenv("JS_HEAPPROF_RATE");
+	if (r && atol(r) > 0) {
+		rate = atol(r);
+	}
+	atexit(WriteAtExit);
+}
+
+void heapprofile_(const heapsite_* s, int n)
+// (each isolate's jsmain_ calls it, with the same sites)
+{
+	sites = s;
+	nsites = n;
+	once_(&started, Start);
+}
+
+static heapthread_* Self(void)
+{
+	if (!self) {
+		heapthread_* t = (heapthread_*)calloc(1, sizeof(heapthread_));
+		uint64_* counts = (uint64_*)calloc(2 * nsites, sizeof(uint64_));
+		if (!t || !counts) {
+			throw bad_alloc();
+		}
+		t->counts = counts;
+		t->until = rate;
+		spinlock_ hold(lock);
+		t->next = threads;
+		threads = t;
+		self = t;
+	}
+	return self;
+}
+
+static unsigned Hash(void* p, unsigned cap)
+{
+	return ((unsigned)((size_t)p >> 4) * 2654435761u) & (cap - 1);
+}
+
+static void Grow(heapthread_* t)
+// double the table, or just clear out the freed ones
+{
+	unsigned oldcap = t->cap;
+	sample_* old = t->samples;
+	unsigned live = 0;
+	unsigned i;
+	for (i = 0; i < oldcap; i++) {
+		if (old[i].p && old[i].p != GONE) {
+			live++;
+		}
+	}
+	t->cap = oldcap ? (4 * live >= oldcap ? 2 * oldcap : oldcap) : 256;
+	t->samples = (sample_*)calloc(t->cap, sizeof(sample_));
+	if (!t->samples) {
+		throw bad_alloc();
+	}
+	t->used = live;
+	for (i = 0; i < oldcap; i++) {
+		if (old[i].p && old[i].p != GONE) {
+			unsigned j = Hash(old[i].p, t->cap);
+			while (t->samples[j].p) {
+				j = (j + 1) & (t->cap - 1);
+			}
+			t->samples[j] = old[i];
+		}
+	}
+	free(old);
+}
+
+void heapalloc_(void* p, size_t n)
+{
+	heapthread_* t = Self();
+	int site = allocsite_ < nsites ? allocsite_ : 0;
+	t->counts[2*site]++;
+	t->counts[2*site+1] += n;
+	t->until -= (long)n;
+	if (t->until > 0) {
+		return;
+	}
+	// a sample: it stands for the bytes since the last one
+	long k = 1 + (-t->until) / rate;
+	t->until += k * rate;
+	// (writeheapprofile_ may be reading the table on another thread)
+	spinlock_ hold(lock);
+	if (2 * (t->used + 1) > t->cap) {
+		Grow(t);
+	}
+	unsigned i = Hash(p, t->cap);
+	while (t->samples[i].p && t->samples[i].p != GONE) {
+		i = (i + 1) & (t->cap - 1);
+	}
+	if (!t->samples[i].p) {
+		t->used++;
+	}
+	t->samples[i].p = p;
+	t->samples[i].site = site;
+	t->samples[i].size = (long)n;
+	t->samples[i].weight = k * rate;
+	heaplive_ = t->samples;
+}
+
+void heapfree_(void* p)
+{
+	heapthread_* t = self;
+	if (!t || !p) {
+		return;
+	}
+	unsigned i = Hash(p, t->cap);
+	while (t->samples[i].p) {
+		if (t->samples[i].p == p) {
+			t->samples[i].p = GONE;
+			return;
+		}
+		i = (i + 1) & (t->cap - 1);
+	}
+}
+
+void* heapnew_(size_t n)
+{
+	void* p = ::operator new(n);
+	HEAPALLOC_(p, n);
+	return p;
+}
+
+/////////////////////////////////////////////////////////////////////
+// Writing profile.proto
+
+struct pb_
+{
+	char*	buf;
+	size_t	len;
+	size_t	cap;
+};
+
+static void Put(pb_& b, const void* p, size_t n)
+{
+	if (b.len + n > b.cap) {
+		b.cap = 2 * (b.len + n) + 256;
+		b.buf = (char*)realloc(b.buf, b.cap);
+		if (!b.buf) {
+			throw bad_alloc();
+		}
+	}
+	memcpy(b.buf + b.len, p, n);
+	b.len += n;
+}
+
+static void Varint(pb_& b, uint64_ v)
+{
+	unsigned char c[10];
+	int n = 0;
+	do {
+		c[n] = (unsigned char)(v & 0x7f);
+		v >>= 7;
+		if (v) {
+			c[n] |= 0x80;
+		}
+		n++;
+	} while (v);
+	Put(b, c, n);
+}
+
+static void Int(pb_& b, int field, uint64_ v)
+{
+	Varint(b, field << 3);		// wire type 0, varint
+	Varint(b, v);
+}
+
+static void Bytes(pb_& b, int field, const void* p, size_t n)
+{
+	Varint(b, (field << 3) | 2);	// wire type 2, length-delimited
+	Varint(b, n);
+	Put(b, p, n);
+}
+
+static void Message(pb_& b, int field, pb_& m)
+// m as field of b; m is emptied for reuse
+{
+	Bytes(b, field, m.buf, m.len);
+	m.len = 0;
+}
+
+static int String(pb_& b, const char* s, int& nstrings)
+// s added to the string table (field 6), by index
+{
+	Bytes(b, 6, s, strlen(s));
+	return nstrings++;
+}
+
+static void ValueType(pb_& b, int field, int type, int unit)
+{
+	pb_ m = { NULL, 0, 0 };
+	Int(m, 1, type);
+	Int(m, 2, unit);
+	Message(b, field, m);
+	free(m.buf);
+}
+
+bool writeheapprofile_(const char* path)
+{
+	if (!sites) {
+		return false;
+	}
+	// in use: from the samples of every thread
+	uint64_* inuse = (uint64_*)calloc(2 * nsites, sizeof(uint64_));
+	if (!inuse) {
+		throw bad_alloc();
+	}
+	heapthread_* t;
+	int i;
+	{
+		spinlock_ hold(lock);
+		for (t = threads; t; t = t->next) {
+			for (unsigned j = 0; j < t->cap; j++) {
+				sample_& s = t->samples[j];
+				if (s.p && s.p != GONE) {
+					inuse[2*s.site] += s.weight / (s.size ? s.size : 1);
+					inuse[2*s.site+1] += s.weight;
+				}
+			}
+		}
+	}
+
+	pb_ b = { NULL, 0, 0 }, m = { NULL, 0, 0 }, line = { NULL, 0, 0 }, packed = { NULL, 0, 0 };
+	int nstrings = 0;
+	String(b, "", nstrings);
+	int allocObjects = String(b, "alloc_objects", nstrings);
+	int allocSpace = String(b, "alloc_space", nstrings);
+	int inuseObjects = String(b, "inuse_objects", nstrings);
+	int inuseSpace = String(b, "inuse_space", nstrings);
+	int count = String(b, "count", nstrings);
+	int bytes = String(b, "bytes", nstrings);
+	int space = String(b, "space", nstrings);
+	int kind = String(b, "kind", nstrings);
+	ValueType(b, 1, allocObjects, count);
+	ValueType(b, 1, allocSpace, bytes);
+	ValueType(b, 1, inuseObjects, count);
+	ValueType(b, 1, inuseSpace, bytes);
+	ValueType(b, 11, space, bytes);
+	Int(b, 12, rate);
+
+	for (i = 1; i < nsites; i++) {
+		uint64_ n = 0, size = 0;
+		{
+			spinlock_ hold(lock);
+			for (t = threads; t; t = t->next) {
+				n += t->counts[2*i];
+				size += t->counts[2*i+1];
+			}
+		}
+		if (!n) {
+			continue;
+		}
+		const heapsite_& site = sites[i];
+		// a function and a location per site, both numbered i
+		Int(m, 1, i);
+		Int(m, 2, String(b, *site.function ? site.function : "(top level)", nstrings));
+		Int(m, 4, String(b, site.file, nstrings));
+		Message(b, 5, m);
+		Int(line, 1, i);
+		Int(line, 2, site.line);
+		Int(m, 1, i);
+		Message(m, 4, line);
+		Message(b, 4, m);
+		// the sample
+		Varint(packed, i);
+		Message(m, 1, packed);
+		Varint(packed, n);
+		Varint(packed, size);
+		Varint(packed, inuse[2*i]);
+		Varint(packed, inuse[2*i+1]);
+		Message(m, 2, packed);
+		Int(line, 1, kind);
+		Int(line, 2, String(b, site.what, nstrings));
+		Message(m, 3, line);
+		Message(b, 2, m);
+	}
+	free(inuse);
+	free(m.buf);
+	free(line.buf);
+	free(packed.buf);
+
+	FILE* f = fopen(path, "wb");
+	bool ok = f && fwrite(b.buf, 1, b.len, f) == b.len;
+	if (f) {
+		fclose(f);
+	}
+	free(b.buf);
+	if (!ok) {
+		throw io_error();
+	}
+	return true;
+}
+
+static void WriteAtExit(void)
+{
+	const char* path = getenv("JS_HEAPPROF");
+	if (!path || !*path) {
+		path = "heap.pprof";
+	}
+	try {
+		writeheapprofile_(path);
+	} catch (...) {
+		fprintf(stderr, "cannot write heap profile %s\n", path);
+	}
+}
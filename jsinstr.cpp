@@ -0,0 +1,425 @@
+// jsinstr.cpp - call profile of the JS functions (--instrument)
+//
+// Each thread keeps a calling context tree: a node per function per
+// chain of callers it was called through, with its calls, the ticks
+// spent inside it (inclusive) and inside it but not in its callees
+// (self). callenter_ finds or adds the child of the current node and
+// pushes it; callexit_ pops it and adds up the time. Recursion makes
+// the tree as deep as the recursion went.
+//
+// At exit the trees of all threads are added together. Per-function
+// totals and caller -> callee edges come out of it (a function's
+// inclusive time counts only its outermost activation, so recursion
+// isn't counted twice), and each node is a line of the folded stacks,
+// weighted by its self time in microseconds. Threads still running
+// then may be part way through a call, which isn't counted.
+
+#ifdef _WIN32
+#include "windows.h"
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(_MSC_VER) && !defined(_M_IX86)
+#include <intrin.h>
+#endif
+#include "jscpprt.h"
+#include "jsrtpriv.h"
+
+struct callnode_
+{
+	callnode_*	child;		// first callee
+	callnode_*	sibling;	// next callee of the same caller
+	int			fn;			// index in fns, -1 at the root
+	uint64_		calls;
+	uint64_		incl;		// ticks
+	uint64_		self;
+};
+
+struct frame_
+{
+	callnode_*	node;
+	uint64_		start;
+	uint64_		callees;	// ticks spent in calls it made
+};
+
+struct callthread_
+{
+	callthread_*	next;
+	callnode_		root;
+	frame_*			stack;
+	int				depth;
+	int				cap;
+};
+
+static const fninfo_*	fns;
+static int				nfns;
+static callthread_*		threads;
+static volatile long	lock;
+static long				started;
+static uint64_			tick0;		// Ticks() and performance_now_() at the start
+static double			ms0;
+static JS_THREAD callthread_* self;
+
+static uint64_ Ticks(void)
+// the time stamp counter, or a clock in ns where there isn't one
+{
+#if defined(_MSC_VER) && defined(_M_IX86)
+	uint64_ t;
+	__asm {
+		rdtsc
+		mov dword ptr [t], eax
+		mov dword ptr [t+4], edx
+	}
+	return t;
+#elif defined(_MSC_VER)
+	return __rdtsc();
+#elif defined(__i386__) || defined(__x86_64__)
+	unsigned lo, hi;
+	__asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+	return ((uint64_)hi << 32) | lo;
+#else
+	return (uint64_)(performance_now_() * 1e6);
+#endif
+}
+
+static void Report(void);
+
+static void Start(void)
+{
+	tick0 = Ticks();
+	ms0 = performance_now_();
+	atexit(Report);
+}
+
+void instrument_(const fninfo_* f, int n)
+// (each isolate's jsmain_ calls it, with the same functions)
+{
+	fns = f;
+	nfns = n;
+	once_(&started, Start);
+}
+
+static callthread_* Self(void)
+{
+	callthread_* t = (callthread_*)calloc(1, sizeof(callthread_));
+	if (!t) {
+		throw bad_alloc();
+	}
+	t->root.fn = -1;
+	spinlock_ hold(lock);
+	t->next = threads;
+	threads = t;
+	self = t;
+	return t;
+}
+
+static callnode_* Child(callnode_* parent, int fn)
+// parent's node for fn, moved to the front, or a new one
+{
+	callnode_** link = &parent->child;
+	callnode_* c;
+	for (c = *link; c; link = &c->sibling, c = *link) {
+		if (c->fn == fn) {
+			*link = c->sibling;
+			break;
+		}
+	}
+	if (!c) {
+		c = (callnode_*)calloc(1, sizeof(callnode_));
+		if (!c) {
+			throw bad_alloc();
+		}
+		c->fn = fn;
+	}
+	c->sibling = parent->child;
+	parent->child = c;
+	return c;
+}
+
+void callenter_(int fn)
+{
+	callthread_* t = self ? self : Self();
+	if (t->depth == t->cap) {
+		int cap = t->cap ? 2 * t->cap : 256;
+		frame_* stack = (frame_*)realloc(t->stack, cap * sizeof(frame_));
+		if (!stack) {
+			throw bad_alloc();
+		}
+		t->stack = stack;
+		t->cap = cap;
+	}
+	callnode_* node = Child(t->depth ? t->stack[t->depth-1].node : &t->root, fn);
+	node->calls++;
+	frame_& f = t->stack[t->depth++];
+	f.node = node;
+	f.callees = 0;
+	f.start = Ticks();
+}
+
+void callexit_(void)
+{
+	uint64_ now = Ticks();
+	callthread_* t = self;
+	frame_& f = t->stack[--t->depth];
+	uint64_ d = now - f.start;
+	f.node->incl += d;
+	f.node->self += d - f.callees;
+	if (t->depth) {
+		t->stack[t->depth-1].callees += d;
+	}
+}
+
+/////////////////////////////////////////////////////////////////////
+// The report
+
+static double Double(uint64_ n)
+// (MSVC 6 can't convert an unsigned __int64)
+{
+#ifdef _MSC_VER
+	return (double)(__int64)n;
+#else
+	return (double)n;
+#endif
+}
+
+static void Merge(callnode_* into, callnode_* from)
+{
+	for (callnode_* c = from->child; c; c = c->sibling) {
+		callnode_* m = Child(into, c->fn);
+		m->calls += c->calls;
+		m->incl += c->incl;
+		m->self += c->self;
+		Merge(m, c);
+	}
+}
+
+struct fntotal_
+{
+	double	calls;
+	double	incl;		// ms
+	double	self;
+	int		active;		// activations on the path being walked
+};
+
+struct edge_
+{
+	int		caller;		// -1: top level
+	int		callee;
+	double	calls;
+	double	incl;		// ms
+};
+
+static fntotal_*	totals;
+static edge_*		edges;
+static int			nedges, edgecap;		// open addressing, on (caller, callee)
+static double		msPerTick;
+
+static edge_& Edge(int caller, int callee);
+
+static void GrowEdges(void)
+{
+	edge_* old = edges;
+	int oldcap = edgecap;
+	edgecap = edgecap ? 2 * edgecap : 256;
+	edges = (edge_*)calloc(edgecap, sizeof(edge_));
+	if (!edges) {
+		throw bad_alloc();
+	}
+	int i;
+	for (i = 0; i < edgecap; i++) {
+		edges[i].callee = -1;		// empty
+	}
+	nedges = 0;
+	for (i = 0; i < oldcap; i++) {
+		if (old[i].callee >= 0) {
+			edge_& e = Edge(old[i].caller, old[i].callee);
+			e.calls = old[i].calls;
+			e.incl = old[i].incl;
+		}
+	}
+	free(old);
+}
+
+static edge_& Edge(int caller, int callee)
+{
+	if (2 * (nedges + 1) > edgecap) {
+		GrowEdges();
+	}
+	unsigned i = ((unsigned)(caller + 1) * 2654435761u + (unsigned)callee) & (edgecap - 1);
+	for (; edges[i].callee >= 0; i = (i + 1) & (edgecap - 1)) {
+		if (edges[i].caller == caller && edges[i].callee == callee) {
+			return edges[i];
+		}
+	}
+	nedges++;
+	edges[i].caller = caller;
+	edges[i].callee = callee;
+	return edges[i];
+}
+
+static void Total(callnode_* node, int caller)
+{
+	fntotal_& t = totals[node->fn];
+	double incl = Double(node->incl) * msPerTick;
+	t.calls += Double(node->calls);
+	t.self += Double(node->self) * msPerTick;
+	edge_& e = Edge(caller, node->fn);
+	e.calls += Double(node->calls);
+	if (!t.active) {
+		// outermost: its callees' time is in this already
+		t.incl += incl;
+		e.incl += incl;
+	}
+	t.active++;
+	for (callnode_* c = node->child; c; c = c->sibling) {
+		Total(c, node->fn);
+	}
+	t.active--;
+}
+
+static void Fold(FILE* f, callnode_* node, char*& path, size_t& cap, size_t len)
+// a line per node: its callers' frames and its own, then its self time
+{
+	const fninfo_& fn = fns[node->fn];
+	size_t need = len + strlen(fn.name) + strlen(fn.file) + 32;
+	if (need > cap) {
+		cap = 2 * need;
+		path = (char*)realloc(path, cap);
+		if (!path) {
+			throw bad_alloc();
+		}
+	}
+	len += sprintf(path + len, "%s%s (%s:%d)", len ? ";" : "", fn.name, fn.file, fn.line);
+	double us = Double(node->self) * msPerTick * 1000;
+	if (us >= 0.5) {
+		fprintf(f, "%s %.0f\n", path, us);
+	}
+	for (callnode_* c = node->child; c; c = c->sibling) {
+		Fold(f, c, path, cap, len);
+	}
+	path[len] = '\0';
+}
+
+static int ByIncl(const void* a, const void* b)
+// most first, then in source order
+{
+	int i = *(const int*)a, j = *(const int*)b;
+	if (totals[i].incl != totals[j].incl) {
+		return totals[i].incl > totals[j].incl ? -1 : 1;
+	}
+	return i - j;
+}
+
+static const char* Name(int fn)
+{
+	return fn < 0 ? "(top level)" : fns[fn].name;
+}
+
+static void Report(void)
+{
+	flushout_();
+	double ticks = Double(Ticks() - tick0);
+	msPerTick = ticks > 0 ? (performance_now_() - ms0) / ticks : 0;
+
+	callnode_ all;
+	memset(&all, 0, sizeof all);
+	all.fn = -1;
+	int nthreads = 0;
+	callthread_* t;
+	{
+		spinlock_ hold(lock);
+		for (t = threads; t; t = t->next) {
+			Merge(&all, &t->root);
+			nthreads++;
+		}
+	}
+	totals = (fntotal_*)calloc(nfns ? nfns : 1, sizeof(fntotal_));
+	int* order = (int*)calloc(nfns ? nfns : 1, sizeof(int));
+	if (!totals || !order) {
+		return;
+	}
+	callnode_* c;
+	for (c = all.child; c; c = c->sibling) {
+		Total(c, -1);
+	}
+	double calls = 0, ms = 0;
+	int i, j;
+	for (i = 0; i < nfns; i++) {
+		order[i] = i;
+		calls += totals[i].calls;
+		ms += totals[i].self;
+	}
+	qsort(order, nfns, sizeof order[0], ByIncl);
+
+	const char* base = getenv("JS_INSTRUMENT");
+	if (!base || !*base) {
+		base = "jscalls";
+	}
+	char* path = (char*)malloc(strlen(base) + 16);
+	if (!path) {
+		return;
+	}
+	sprintf(path, "%s.txt", base);
+	FILE* f = fopen(path, "w");
+	if (!f) {
+		fprintf(stderr, "cannot write call profile %s\n", path);
+		free(path);
+		return;
+	}
+	fprintf(f, "%.0f calls, %.3f ms in JS functions, on %d thread%s\n\n",
+		calls, ms, nthreads, nthreads == 1 ? "" : "s");
+	fprintf(f, "     calls     incl ms     self ms  self%%  function\n");
+	for (i = 0; i < nfns; i++) {
+		fntotal_& ft = totals[order[i]];
+		if (ft.calls) {
+			const fninfo_& fn = fns[order[i]];
+			fprintf(f, "%10.0f %11.3f %11.3f %5.1f%%  %s (%s:%d)\n", ft.calls, ft.incl, ft.self,
+				ms ? 100 * ft.self / ms : 0, fn.name, fn.file, fn.line);
+		}
+	}
+	fprintf(f, "\ncall graph: each function, who called it and what it called\n");
+	for (i = 0; i < nfns; i++) {
+		int fn = order[i];
+		fntotal_& ft = totals[fn];
+		if (!ft.calls) {
+			continue;
+		}
+		fprintf(f, "\n%s (%s:%d): %.0f calls, %.3f ms, %.3f ms self\n",
+			fns[fn].name, fns[fn].file, fns[fn].line, ft.calls, ft.incl, ft.self);
+		for (j = 0; j < edgecap; j++) {
+			if (edges[j].callee == fn) {
+				fprintf(f, "  from %s: %.0f calls\n", Name(edges[j].caller), edges[j].calls);
+			}
+		}
+		for (j = 0; j < edgecap; j++) {
+			edge_& e = edges[j];
+			if (e.callee >= 0 && e.caller == fn) {
+				if (e.callee == fn) {
+					// (its time is in the outermost call's)
+					fprintf(f, "  calls itself: %.0f calls\n", e.calls);
+				} else {
+					fprintf(f, "  calls %s (%s:%d): %.0f calls, %.3f ms\n",
+						fns[e.callee].name, fns[e.callee].file, fns[e.callee].line, e.calls, e.incl);
+				}
+			}
+		}
+	}
+	fclose(f);
+
+	sprintf(path, "%s.folded", base);
+	f = fopen(path, "w");
+	if (!f) {
+		fprintf(stderr, "cannot write call profile %s\n", path);
+		free(path);
+		return;
+	}
+	char* stack = NULL;
+	size_t cap = 0;
+	for (c = all.child; c; c = c->sibling) {
+		Fold(f, c, stack, cap, 0);
+	}
+	free(stack);
+	fclose(f);
+	free(path);
+}
@@ -0,0 +1,413 @@
+// jsisolate.cpp - isolates: copies of one program, each on its thread
+//
+// A program translated with --isolate keeps its globals in a block
+// jsmain_ makes, reached through a thread-local pointer; the runtime
+// keeps its own per-thread state the same way (global object, event
+// loop, closure free lists, output buffer, Math.random, JSON's shape
+// cache). runisolates_ runs n copies of jsmain_ at once. The atom
+// table and the literal pools are shared: atoms under a lock, the pool
+// interned once (once_).
+//
+// In JS each copy sees an isolate object: isolate.id (0..count-1),
+// isolate.count, isolate.post(id, message) and isolate.onmessage =
+// function (message, from) {...}. Strings are passed as they are, as
+// they never change and are never freed; an ArrayBuffer is handed over
+// (the sender's is left empty); anything else goes as JSON text.
+// Messages come in through the event loop, which a pipe (a loopback
+// UDP socket on Windows) wakes up; while onmessage is a function the
+// loop keeps waiting for them as long as other isolates are running.
+// Set it to null to stop listening.
+
+#ifdef _WIN32
+#include "windows.h"
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#endif
+#include "jscpprt.h"
+#include "jsrtpriv.h"
+#include "sugar.h"
+
+volatile long nthreads_;
+
+enum {
+	MSG_VALUE,				// a primitive or a string, in v
+	MSG_BUFFER,				// an ArrayBuffer's storage
+	MSG_JSON,				// anything else, as JSON text
+};
+
+struct message_
+{
+	message_*	next;
+	int			from;
+	int			kind;		// MSG_...
+	value_		v;
+	void*		data;		// MSG_BUFFER
+	long		len;
+	const char*	json;		// MSG_JSON
+};
+
+struct isolate_
+{
+	int				id;
+	int				(*entry)(...);
+	int				result;
+	value_			global;		// its global object
+	value_			onmessage;	// isolate.onmessage
+	volatile long	lock;		// on the queue
+	message_*		head;		// messages not yet delivered
+	message_**		tail;
+	int				wake;		// readable when there are messages
+#ifdef _WIN32
+	struct sockaddr_in wakeaddr;
+	HANDLE			thread;
+#else
+	int				wakew;		// write end of the pipe
+	pthread_t		thread;
+#endif
+	watcher_*		w;			// on wake, made by the isolate itself
+	bool			watching;
+};
+
+static isolate_*		isolates;
+int						nisolates_ = 1;
+static volatile long	running;		// isolates not yet finished
+static isolate_			solo;			// when there's just the one program
+static JS_THREAD isolate_* self;		// the current thread's
+
+static isolate_* Self(void)
+{
+	return self ? self : &solo;
+}
+
+static bool Alone(void)
+// no other isolate left that could post to this one
+{
+	return running - (self ? 1 : 0) <= 0;
+}
+
+void once_(long* done, void (*fn)(void))
+{
+	static volatile long lock;
+	if (*(volatile long*)done) {
+		return;
+	}
+	while (atomicswap_(&lock, 1)) {
+		yield_();
+	}
+	if (!*done) {
+		fn();
+		*done = 1;
+	}
+	atomicswap_(&lock, 0);
+}
+
+/////////////////////////////////////////////////////////////////////
+// Waking an isolate's loop
+
+static void OpenWake(isolate_* iso)
+{
+#ifdef _WIN32
+	SOCKET s = socket(AF_INET, SOCK_DGRAM, 0);
+	memset(&iso->wakeaddr, 0, sizeof iso->wakeaddr);
+	iso->wakeaddr.sin_family = AF_INET;
+	iso->wakeaddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	int len = sizeof iso->wakeaddr;
+	if (s == INVALID_SOCKET ||
+		bind(s, (struct sockaddr*)&iso->wakeaddr, sizeof iso->wakeaddr) != 0 ||
+		getsockname(s, (struct sockaddr*)&iso->wakeaddr, &len) != 0) {
+		throw bad_alloc();
+	}
+	unsigned long on = 1;
+	ioctlsocket(s, FIONBIO, &on);
+	iso->wake = (int)s;
+#else
+	int fds[2];
+	if (pipe(fds) != 0) {
+		throw bad_alloc();
+	}
+	fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL, 0) | O_NONBLOCK);
+	fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL, 0) | O_NONBLOCK);
+	iso->wake = fds[0];
+	iso->wakew = fds[1];
+#endif
+}
+
+static void CloseWake(isolate_* iso)
+{
+#ifdef _WIN32
+	closesocket(iso->wake);
+#else
+	close(iso->wake);
+	close(iso->wakew);
+#endif
+}
+
+static void Wake(isolate_* iso)
+{
+	// if it's full, there's already a wake-up waiting
+#ifdef _WIN32
+	sendto(iso->wake, "", 1, 0, (struct sockaddr*)&iso->wakeaddr, sizeof iso->wakeaddr);
+#else
+	write(iso->wakew, "", 1);
+#endif
+}
+
+static void Drain(isolate_* iso)
+{
+	char buf[256];
+#ifdef _WIN32
+	while (recv(iso->wake, buf, sizeof buf, 0) > 0) {
+	}
+#else
+	while (read(iso->wake, buf, sizeof buf) > 0) {
+	}
+#endif
+}
+
+/////////////////////////////////////////////////////////////////////
+// Messages
+
+static message_* Take(isolate_* iso)
+{
+	spinlock_ hold(iso->lock);
+	message_* m = iso->head;
+	if (m) {
+		iso->head = m->next;
+		if (!iso->head) {
+			iso->tail = &iso->head;
+		}
+	}
+	return m;
+}
+
+static void Put(isolate_* iso, message_* m)
+{
+	{
+		spinlock_ hold(iso->lock);
+		if (!iso->tail) {
+			iso->tail = &iso->head;
+		}
+		m->next = NULL;
+		*iso->tail = m;
+		iso->tail = &m->next;
+	}
+	// (the solo one's wake-up is only made once it listens)
+	if (iso != &solo || iso->w) {
+		Wake(iso);
+	}
+}
+
+static message_* Pack(value_ v)
+{
+	message_* m = new message_;
+	m->from = Self()->id;
+	m->data = NULL;
+	m->len = 0;
+	m->json = NULL;
+	if (v.t < value_::TOBJ) {
+		m->kind = MSG_VALUE;
+		m->v = v;
+	} else if (v.t == value_::TOBJ && 0==strcmp(v.v.o->Class(), "ArrayBuffer")) {
+		arraybuffer_* buf = (arraybuffer_*)v.v.o;
+		m->kind = MSG_BUFFER;
+		m->len = buf->byteLength;
+		m->data = buf->Detach();
+	} else {
+		m->kind = MSG_JSON;
+		value_ text = JSON_stringify_(v);
+		m->json = text.isUndefined() ? NULL : text.v.s;
+	}
+	return m;
+}
+
+static value_ Unpack(message_* m)
+{
+	switch (m->kind) {
+	case MSG_BUFFER:
+		return value_(new arraybuffer_(m->data, m->len));
+	case MSG_JSON:
+		return m->json ? JSON_parse_(m->json, strlen(m->json)) : undefined;
+	}
+	return m->v;
+}
+
+static void Watch(isolate_* iso, bool on)
+{
+	if (iso->watching != on) {
+		iso->watching = on;
+		watchevents_(iso->w, on ? IO_READ : 0);
+	}
+}
+
+static void OnWake(int fd, int events, void* context)
+{
+	isolate_* iso = (isolate_*)context;
+	Drain(iso);
+	// no handler: they wait for one
+	while (iso->onmessage.t == value_::TFUNC) {
+		message_* m = Take(iso);
+		if (!m) {
+			break;
+		}
+		value_ args[2];
+		args[0] = Unpack(m);
+		args[1] = value_(m->from);
+		delete m;
+		callv_(iso->onmessage.v.f, global_, 2, args);
+	}
+	if (iso->onmessage.t != value_::TFUNC || (Alone() && !iso->head)) {
+		Watch(iso, false);		// not listening, or nothing more can come: let the loop end
+	}
+}
+
+static void Listen(isolate_* iso)
+// isolate.onmessage is being set; OnWake, on the loop's next turn, sees
+// to what, and to any messages that came before
+{
+	if (!iso->w) {
+		if (iso == &solo) {
+			OpenWake(iso);
+		}
+		iso->w = watch_(iso->wake, OnWake, iso);
+	}
+	Watch(iso, true);
+	Wake(iso);
+}
+
+/////////////////////////////////////////////////////////////////////
+// Threads
+
+#ifdef _WIN32
+static unsigned __stdcall Run(void* context)
+#else
+static void* Run(void* context)
+#endif
+{
+	isolate_* iso = (isolate_*)context;
+	self = iso;
+	globalp_ = &iso->global;
+	iso->result = iso->entry();
+	flushout_();
+	// the others may be waiting on it
+	atomicadd_(&running, -1);
+	for (int i = 0; i < nisolates_; i++) {
+		if (i != iso->id) {
+			Wake(&isolates[i]);
+		}
+	}
+	return 0;
+}
+
+int runisolates_(int (*entry)(...), int n)
+{
+#ifdef _WIN32
+	WSADATA wsa;
+	WSAStartup(MAKEWORD(1, 1), &wsa);
+#endif
+	isolates = new isolate_[n];
+	nisolates_ = n;
+	running = n;
+	atomicadd_(&nthreads_, n);
+	int i;
+	for (i = 0; i < n; i++) {
+		isolate_* iso = &isolates[i];
+		iso->id = i;
+		iso->entry = entry;
+		iso->result = 0;
+		iso->global = value_(new obj_);
+		iso->lock = 0;
+		iso->head = NULL;
+		iso->tail = &iso->head;
+		iso->w = NULL;
+		iso->watching = false;
+		OpenWake(iso);
+	}
+	for (i = 0; i < n; i++) {
+#ifdef _WIN32
+		isolates[i].thread = (HANDLE)_beginthreadex(NULL, 0, Run, &isolates[i], 0, NULL);
+#else
+		pthread_create(&isolates[i].thread, NULL, Run, &isolates[i]);
+#endif
+	}
+	int result = 0;
+	for (i = 0; i < n; i++) {
+#ifdef _WIN32
+		WaitForSingleObject(isolates[i].thread, INFINITE);
+		CloseHandle(isolates[i].thread);
+#else
+		pthread_join(isolates[i].thread, NULL);
+#endif
+		if (!result) {
+			result = isolates[i].result;
+		}
+	}
+	// (not before: the last to finish wakes the others)
+	for (i = 0; i < n; i++) {
+		CloseWake(&isolates[i]);
+	}
+	atomicadd_(&nthreads_, -n);
+	return result;
+}
+
+/////////////////////////////////////////////////////////////////////
+// The isolate object: one for all, each thread sees its own isolate_
+
+class post_class_ : public func_ {
+public:
+	JS_CONSTEXPR post_class_() : func_(2) {}
+	virtual value_ call(value_ this_, int nargs, ...)
+	{
+		value_* argv = ARGV_(nargs);
+		double to = nargs > 0 ? argv[0].toNumber() : -1;
+		if (!(to >= 0 && to < nisolates_ && to == (int)to)) {
+			throw RangeError();
+		}
+		isolate_* iso = isolates ? &isolates[(int)to] : &solo;
+		Put(iso, Pack(nargs > 1 ? argv[1] : undefined));
+		return undefined;
+	}
+};
+
+static post_class_ post_func_;
+
+class isolateobj_ : public builtin_
+{
+public:
+	JS_CONSTEXPR isolateobj_() : builtin_("Isolate") {}
+	virtual value_ dot(const char* id)
+	{
+		if (0==strcmp(id, "id")) {
+			return value_(Self()->id);
+		}
+		if (0==strcmp(id, "count")) {
+			return value_(nisolates_);
+		}
+		if (0==strcmp(id, "post")) {
+			return value_(&post_func_);
+		}
+		if (0==strcmp(id, "onmessage")) {
+			return Self()->onmessage;
+		}
+		return builtin_::dot(id);
+	}
+	virtual value_& dotref(const char* id)
+	{
+		if (0==strcmp(id, "onmessage")) {
+			isolate_* iso = Self();
+			Listen(iso);
+			return iso->onmessage;
+		}
+		return builtin_::dotref(id);
+	}
+};
+
+static isolateobj_ isolate_object_;
+value_ isolate(&isolate_object_);
@@ -0,0 +1,1122 @@
+// jsjson.cpp - the JSON object
+//
+// JSON.parse makes two passes, after simdjson. The first finds every
+// structural character ({}[]:,) outside of strings and every quote
+// that isn't escaped, 16 bytes at a time. The second walks that
+// index, so it only looks inside a string to copy it. Objects with
+// the same keys in the same order share one shape_, from a cache,
+// and get their slots in the same allocation; keys are atoms.
+// JSON.stringify writes everything into one growing buffer.
+
+#ifdef _WIN32
+#include "windows.h"
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "jscpprt.h"
+#include "jsrtpriv.h"
+#include "jshash.h"
+#include "sugar.h"
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define JSON_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(_MSC_VER) && _MSC_VER >= 1400
+#include <intrin.h>
+#endif
+
+#define JSON_MAXDEPTH	4096	// nesting, either way
+#define JSON_SHAPE_MAX	64		// bigger objects keep their keys as props
+#define JSON_SHAPES		4096	// key sets cached; past that, props too
+
+static int lowbit(unsigned m)
+// index of the lowest set bit of m, which isn't 0
+{
+#if defined(__GNUC__)
+	return __builtin_ctz(m);
+#elif defined(_MSC_VER) && _MSC_VER >= 1400
+	unsigned long i;
+	_BitScanForward(&i, m);
+	return (int)i;
+#else
+	int i = 0;
+	while (!(m & 1)) {
+		m >>= 1;
+		i++;
+	}
+	return i;
+#endif
+}
+
+static bool IsArray(obj_* o)
+{
+	return 0==strcmp(o->Class(), "Array");
+}
+
+/////////////////////////////////////////////////////////////////////
+// Stage 1: the structural index
+
+static unsigned Classify(const char* p, unsigned& quotes, unsigned& slashes, unsigned& controls)
+// For the 16 bytes at p, a bit mask of the structural characters,
+// and of the quotes, backslashes and control characters.
+{
+#ifdef JSON_SSE2
+	__m128i v = _mm_loadu_si128((const __m128i*)p);
+	// c | 0x20 turns [ and ] into { and }
+	__m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+	__m128i s = _mm_or_si128(
+		_mm_or_si128(_mm_cmpeq_epi8(lower, _mm_set1_epi8('{')), _mm_cmpeq_epi8(lower, _mm_set1_epi8('}'))),
+		_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(':')), _mm_cmpeq_epi8(v, _mm_set1_epi8(','))));
+	quotes = _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')));
+	slashes = _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\\')));
+	// unsigned c <= 0x1F
+	__m128i ctl = _mm_set1_epi8(0x1F);
+	controls = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(v, ctl), ctl));
+	return _mm_movemask_epi8(s);
+#else
+	unsigned s = 0;
+	quotes = slashes = controls = 0;
+	for (int i = 0; i < 16; i++) {
+		unsigned bit = 1u << i;
+		switch (p[i]) {
+		case '{': case '}': case '[': case ']': case ':': case ',':
+			s |= bit;
+			break;
+		case '"':
+			quotes |= bit;
+			break;
+		case '\\':
+			slashes |= bit;
+			break;
+		default:
+			if ((unsigned char)p[i] < 0x20) {
+				controls |= bit;
+			}
+			break;
+		}
+	}
+	return s;
+#endif
+}
+
+static int Index(const char* src, int len, unsigned* idx)
+// Positions of the structurals outside strings and of the unescaped
+// quotes, in order. Returns how many, or -1 if a string is left open
+// or has a control character in it.
+{
+	int n = 0;
+	unsigned inside = 0;		// all ones when a block ends inside a string
+	bool escape = false;		// ... right after a backslash
+	char tail[16];
+	for (int i = 0; i < len; i += 16) {
+		const char* p = src + i;
+		if (len - i < 16) {
+			memset(tail, ' ', sizeof tail);
+			memcpy(tail, p, len - i);
+			p = tail;
+		}
+		unsigned quotes, slashes, controls;
+		unsigned s = Classify(p, quotes, slashes, controls);
+		if (slashes || escape) {
+			// backslashes are rare enough to just walk
+			unsigned escaped = 0;
+			for (int b = 0; b < 16; b++) {
+				if (escape) {
+					escaped |= 1u << b;
+					escape = false;
+				} else if (slashes & (1u << b)) {
+					escape = true;
+				}
+			}
+			quotes &= ~escaped;
+		}
+		// prefix xor: bits from each opening quote up to its closing one
+		unsigned str = quotes ^ (quotes << 1);
+		str ^= str << 2;
+		str ^= str << 4;
+		str ^= str << 8;
+		str = (str ^ inside) & 0xFFFF;
+		inside = (str & 0x8000) ? 0xFFFF : 0;
+		if (controls & str) {
+			return -1;
+		}
+		unsigned m = (s & ~str) | quotes;
+		while (m) {
+			idx[n++] = i + lowbit(m);
+			m &= m - 1;
+		}
+	}
+	return inside ? -1 : n;
+}
+
+/////////////////////////////////////////////////////////////////////
+// Shapes of parsed objects, by key sequence
+
+// (per isolate: no locking, and a shape is only shared within one)
+static JS_THREAD const shape_**	shapes;			// open addressing, NULL = empty
+static JS_THREAD unsigned*		shapeHashes;
+static JS_THREAD unsigned		shapeCap;		// power of 2
+static JS_THREAD unsigned		shapeCount;
+
+static unsigned KeysHash(const char** keys, int n)
+{
+	unsigned h = 2166136261u ^ n;
+	for (int i = 0; i < n; i++) {
+		h = (h ^ (unsigned)(size_t)keys[i]) * 16777619u;
+	}
+	return h;
+}
+
+static void GrowShapes(void)
+{
+	unsigned oldcap = shapeCap;
+	const shape_** old = shapes;
+	unsigned* oldhashes = shapeHashes;
+	shapeCap = shapeCap ? shapeCap*2 : 64;
+	shapes = (const shape_**)calloc(shapeCap, sizeof shapes[0]);
+	shapeHashes = (unsigned*)malloc(shapeCap * sizeof shapeHashes[0]);
+	if (!shapes || !shapeHashes) {
+		throw bad_alloc();
+	}
+	for (unsigned i = 0; i < oldcap; i++) {
+		if (old[i]) {
+			unsigned j = oldhashes[i] & (shapeCap-1);
+			while (shapes[j]) {
+				j = (j+1) & (shapeCap-1);
+			}
+			shapes[j] = old[i];
+			shapeHashes[j] = oldhashes[i];
+		}
+	}
+	free(old);
+	free(oldhashes);
+}
+
+static const shape_* ShapeOf(const char** keys, int n)
+// the shape with these keys in this order, or NULL if one repeats or
+// the cache is full (shapes live as long as their objects: never freed)
+{
+	unsigned h = KeysHash(keys, n);
+	if (2*(shapeCount+1) > shapeCap && shapeCount < JSON_SHAPES) {
+		GrowShapes();
+	}
+	unsigned i = h & (shapeCap-1);
+	while (shapes[i]) {
+		if (shapeHashes[i]==h && shapes[i]->count==n &&
+			0==memcmp(shapes[i]->ids, keys, n * sizeof keys[0])) {
+			STAT_(SHAPE_HIT);
+			return shapes[i];
+		}
+		i = (i+1) & (shapeCap-1);
+	}
+	STAT_(SHAPE_MISS);
+	if (shapeCount >= JSON_SHAPES) {
+		return NULL;
+	}
+	// new key set: once per shape, check for {"a":1,"a":2}
+	int j;
+	for (j = 1; j < n; j++) {
+		for (int k = 0; k < j; k++) {
+			if (keys[k]==keys[j]) {
+				return NULL;
+			}
+		}
+	}
+	shape_* shape = (shape_*)malloc(sizeof(shape_) + n * sizeof keys[0]);
+	if (!shape) {
+		throw bad_alloc();
+	}
+	const char** ids = (const char**)(shape+1);
+	memcpy(ids, keys, n * sizeof keys[0]);
+	shape->count = n;
+	shape->ids = ids;
+	shape->name = NULL;			// (not one the compiler can name)
+	shapes[i] = shape;
+	shapeHashes[i] = h;
+	shapeCount++;
+	return shape;
+}
+
+/////////////////////////////////////////////////////////////////////
+// Stage 2: build the values
+
+static unsigned Hex4(const char* s, const char* end)
+{
+	if (end - s < 4) {
+		throw SyntaxError();
+	}
+	unsigned c = 0;
+	for (int i = 0; i < 4; i++) {
+		char h = s[i];
+		c <<= 4;
+		if (h >= '0' && h <= '9') {
+			c |= h - '0';
+		} else if ((h|0x20) >= 'a' && (h|0x20) <= 'f') {
+			c |= (h|0x20) - 'a' + 10;
+		} else {
+			throw SyntaxError();
+		}
+	}
+	return c;
+}
+
+static int Unescape(const char* s, int n, char* out)
+// decode the n chars of a string's text into out (UTF-8),
+// which needs n+1 bytes; returns the decoded length
+{
+	char* o = out;
+	const char* end = s + n;
+	while (s < end) {
+		if (*s != '\\') {
+			*o++ = *s++;
+			continue;
+		}
+		s++;		// an escape can't be last, it would hide the quote
+		switch (*s++) {
+		case '"':	*o++ = '"';		break;
+		case '\\':	*o++ = '\\';	break;
+		case '/':	*o++ = '/';		break;
+		case 'b':	*o++ = '\b';	break;
+		case 'f':	*o++ = '\f';	break;
+		case 'n':	*o++ = '\n';	break;
+		case 'r':	*o++ = '\r';	break;
+		case 't':	*o++ = '\t';	break;
+		case 'u':
+			{
+				unsigned c = Hex4(s, end);
+				s += 4;
+				if (c >= 0xD800 && c < 0xDC00 && end - s >= 6 && s[0]=='\\' && s[1]=='u') {
+					unsigned lo = Hex4(s+2, end);
+					if (lo >= 0xDC00 && lo < 0xE000) {
+						c = 0x10000 + ((c - 0xD800) << 10) + (lo - 0xDC00);
+						s += 6;
+					}
+				}
+				if (c < 0x80) {
+					*o++ = (char)c;
+				} else if (c < 0x800) {
+					*o++ = (char)(0xC0 | (c >> 6));
+					*o++ = (char)(0x80 | (c & 0x3F));
+				} else if (c < 0x10000) {
+					*o++ = (char)(0xE0 | (c >> 12));
+					*o++ = (char)(0x80 | ((c >> 6) & 0x3F));
+					*o++ = (char)(0x80 | (c & 0x3F));
+				} else {
+					*o++ = (char)(0xF0 | (c >> 18));
+					*o++ = (char)(0x80 | ((c >> 12) & 0x3F));
+					*o++ = (char)(0x80 | ((c >> 6) & 0x3F));
+					*o++ = (char)(0x80 | (c & 0x3F));
+				}
+			}
+			break;
+		default:
+			throw SyntaxError();
+		}
+	}
+	*o = 0;
+	return o - out;
+}
+
+static const double powers10[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static bool IsDigit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+class jsonparser_
+{
+public:
+	jsonparser_(const char* text, int len);
+	~jsonparser_();
+
+	value_ Parse(void);
+
+private:
+	const char*		src;		// 0-terminated at len
+	int				len;
+	unsigned*		idx;		// from stage 1
+	int				nidx;
+	int				k;			// next entry in idx
+	int				depth;
+	// members and elements of the objects and arrays being built
+	const char**	keys;
+	value_*			vals;
+	int				top;
+	int				cap;
+
+	void Fail(void) { throw SyntaxError(); }
+	int Skip(int p) const;
+	void Expect(int p, char c);
+	int Close(int p);
+	value_ Value(int& p);
+	value_ Object(int& p);
+	value_ Array(int& p);
+	const char* String(int& p);
+	const char* Key(int& p);
+	double Number(int& p);
+	value_ Word(int& p, const char* w, const value_& v);
+	void Push(const char* key, const value_& v);
+};
+
+jsonparser_::jsonparser_(const char* text, int n)
+: src(text), len(n), idx(0), nidx(0), k(0), depth(0), keys(0), vals(0), top(0), cap(0)
+{
+}
+
+jsonparser_::~jsonparser_()
+{
+	free(idx);
+	free(keys);
+	delete[] vals;
+}
+
+value_ jsonparser_::Parse(void)
+{
+	idx = (unsigned*)malloc((len + 1) * sizeof idx[0]);
+	if (!idx) {
+		throw bad_alloc();
+	}
+	nidx = Index(src, len, idx);
+	if (nidx < 0) {
+		Fail();
+	}
+	int p = 0;
+	value_ v = Value(p);
+	if (Skip(p) != len || k != nidx) {
+		Fail();
+	}
+	return v;
+}
+
+int jsonparser_::Skip(int p) const
+// past any whitespace at p
+{
+	while (src[p]==' ' || src[p]=='\n' || src[p]=='\r' || src[p]=='\t') {
+		p++;
+	}
+	return p;
+}
+
+void jsonparser_::Expect(int p, char c)
+// c must be at p, and be the next structural
+{
+	if (src[p] != c || k >= nidx || idx[k] != (unsigned)p) {
+		Fail();
+	}
+	k++;
+}
+
+int jsonparser_::Close(int p)
+// the string opening at p: position of its closing quote
+{
+	Expect(p, '"');
+	if (k >= nidx || src[idx[k]] != '"') {
+		Fail();
+	}
+	return idx[k++];
+}
+
+value_ jsonparser_::Value(int& p)
+{
+	p = Skip(p);
+	switch (src[p]) {
+	case '{':
+		return Object(p);
+	case '[':
+		return Array(p);
+	case '"':
+		return value_(String(p));
+	case 't':
+		return Word(p, "true", true_);
+	case 'f':
+		return Word(p, "false", false_);
+	case 'n':
+		return Word(p, "null", null_);
+	default:
+		return value_(Number(p));
+	}
+}
+
+value_ jsonparser_::Object(int& p)
+{
+	Expect(p++, '{');
+	if (++depth > JSON_MAXDEPTH) {
+		Fail();
+	}
+	int base = top;
+	p = Skip(p);
+	if (src[p] != '}') {
+		for (;;) {
+			p = Skip(p);
+			const char* key = Key(p);
+			p = Skip(p);
+			Expect(p++, ':');
+			value_ v = Value(p);
+			Push(key, v);
+			p = Skip(p);
+			if (src[p] != ',') {
+				break;
+			}
+			Expect(p++, ',');
+		}
+	}
+	Expect(p++, '}');
+	int n = top - base;
+	obj_* o = NULL;
+	if (n > 0 && n <= JSON_SHAPE_MAX) {
+		const shape_* shape = ShapeOf(keys + base, n);
+		if (shape) {
+			o = NewShaped_(shape, vals + base);
+		}
+	}
+	if (!o) {
+		// empty, big, a key repeats (the last one wins), or no more shapes
+		o = new obj_;
+		for (int i = base; i < top; i++) {
+			o->dotref(keys[i]) = vals[i];
+		}
+	}
+	top = base;
+	depth--;
+	return value_(o);
+}
+
+value_ jsonparser_::Array(int& p)
+{
+	Expect(p++, '[');
+	if (++depth > JSON_MAXDEPTH) {
+		Fail();
+	}
+	int base = top;
+	p = Skip(p);
+	if (src[p] != ']') {
+		for (;;) {
+			Push(NULL, Value(p));
+			p = Skip(p);
+			if (src[p] != ',') {
+				break;
+			}
+			Expect(p++, ',');
+		}
+	}
+	Expect(p++, ']');
+	array_* a = new array_;
+	int n = top - base;
+	if (n) {
+		value_* elts = a->Resize(n);
+		for (int i = 0; i < n; i++) {
+			elts[i] = vals[base+i];
+		}
+	}
+	top = base;
+	depth--;
+	return value_(a);
+}
+
+const char* jsonparser_::String(int& p)
+{
+	int open = p;
+	int close = Close(p);
+	p = close + 1;
+	int n = close - open - 1;
+	char* s = (char*)malloc(n + 1);
+	if (!s) {
+		throw bad_alloc();
+	}
+	HEAPALLOC_(s, n + 1);
+	if (memchr(src + open + 1, '\\', n)) {
+		Unescape(src + open + 1, n, s);
+	} else {
+		memcpy(s, src + open + 1, n);
+		s[n] = 0;
+	}
+	return s;
+}
+
+const char* jsonparser_::Key(int& p)
+{
+	int open = p;
+	int close = Close(p);
+	p = close + 1;
+	int n = close - open - 1;
+	if (!memchr(src + open + 1, '\\', n)) {
+		return intern_(src + open + 1, n);
+	}
+	char local[256];
+	char* s = n < (int)sizeof local ? local : (char*)malloc(n + 1);
+	if (!s) {
+		throw bad_alloc();
+	}
+	const char* id = intern_(s, Unescape(src + open + 1, n, s));
+	if (s != local) {
+		free(s);
+	}
+	return id;
+}
+
+double jsonparser_::Number(int& p)
+{
+	// -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+	const char* s = src + p;
+	const char* start = s;
+	bool bNeg = (*s=='-');
+	if (bNeg) {
+		s++;
+	}
+	if (!IsDigit(*s)) {
+		Fail();
+	}
+	double m = 0;				// the digits, exact while there are <= 15
+	int digits = 0;
+	int scale = 0;				// power of 10 to apply to m
+	if (*s=='0') {
+		s++;
+	} else {
+		while (IsDigit(*s)) {
+			m = m*10 + (*s++ - '0');
+			digits++;
+		}
+	}
+	if (*s=='.') {
+		s++;
+		if (!IsDigit(*s)) {
+			Fail();
+		}
+		while (IsDigit(*s)) {
+			m = m*10 + (*s++ - '0');
+			digits++;
+			scale--;
+		}
+	}
+	if (*s=='e' || *s=='E') {
+		s++;
+		int sign = 1;
+		if (*s=='+' || *s=='-') {
+			sign = (*s++=='-') ? -1 : 1;
+		}
+		if (!IsDigit(*s)) {
+			Fail();
+		}
+		int e = 0;
+		while (IsDigit(*s)) {
+			if (e < 100000) {
+				e = e*10 + (*s - '0');
+			}
+			s++;
+		}
+		scale += sign * e;
+	}
+	p = s - src;
+	if (digits <= 15 && scale >= -22 && scale <= 22) {
+		// both m and 10^scale are exact, so one rounding
+		double d = scale < 0 ? m / powers10[-scale] : m * powers10[scale];
+		return bNeg ? -d : d;
+	}
+	return strtod(start, NULL);
+}
+
+value_ jsonparser_::Word(int& p, const char* w, const value_& v)
+{
+	int n = strlen(w);
+	if (strncmp(src + p, w, n)) {
+		Fail();
+	}
+	p += n;
+	return v;
+}
+
+void jsonparser_::Push(const char* key, const value_& v)
+{
+	if (top==cap) {
+		int newcap = cap ? cap*2 : 64;
+		const char** newkeys = (const char**)realloc(keys, newcap * sizeof keys[0]);
+		if (!newkeys) {
+			throw bad_alloc();
+		}
+		keys = newkeys;
+		value_* newvals = new value_[newcap];
+		for (int i = 0; i < top; i++) {
+			newvals[i] = vals[i];
+		}
+		delete[] vals;
+		vals = newvals;
+		cap = newcap;
+	}
+	keys[top] = key;
+	vals[top++] = v;
+}
+
+value_ JSON_parse_(const char* text, int len)
+{
+	jsonparser_ parser(text, len);
+	return parser.Parse();
+}
+
+struct revivekeys_
+{
+	const char**	ids;
+	int				n, cap;
+};
+
+static void CollectKey(const char* id, value_& v, void* context)
+{
+	revivekeys_& rk = *(revivekeys_*)context;
+	if (rk.n==rk.cap) {
+		rk.cap = rk.cap ? rk.cap*2 : 16;
+		rk.ids = (const char**)realloc(rk.ids, rk.cap * sizeof rk.ids[0]);
+		if (!rk.ids) {
+			throw bad_alloc();
+		}
+	}
+	rk.ids[rk.n++] = id;
+}
+
+static value_ Revive(value_ holder, value_ key, func_* reviver)
+// JSON.parse's Internalize: bottom up, each value goes through
+// reviver. (There's no delete, so a member the reviver drops by
+// returning undefined is left undefined.)
+{
+	value_ val = holder.at(key);
+	if (val.t==value_::TOBJ) {
+		obj_* o = val.v.o;
+		if (IsArray(o)) {
+			int n = ((array_*)o)->len;
+			for (int i = 0; i < n; i++) {
+				char name[FMTNUM_MAX];
+				fmtnum_(i, name);
+				val.atref(value_(i)) = Revive(val, value_(strdup(name)), reviver);
+			}
+		} else {
+			// the reviver may add members: take the keys first
+			revivekeys_ rk = { NULL, 0, 0 };
+			o->ForEachOwn(CollectKey, &rk);
+			for (int i = 0; i < rk.n; i++) {
+				val.atref(value_(rk.ids[i])) = Revive(val, value_(rk.ids[i]), reviver);
+			}
+			free(rk.ids);
+		}
+	}
+	return reviver->call(holder, 2, key, val);
+}
+
+/////////////////////////////////////////////////////////////////////
+// JSON.stringify
+
+static const char* Plain(const char* s, const char* end)
+// the first char in [s,end) that needs escaping, or end
+{
+#ifdef JSON_SSE2
+	__m128i quote = _mm_set1_epi8('"');
+	__m128i slash = _mm_set1_epi8('\\');
+	__m128i ctl = _mm_set1_epi8(0x1F);
+	while (end - s >= 16) {
+		__m128i v = _mm_loadu_si128((const __m128i*)s);
+		__m128i x = _mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, slash)),
+			_mm_cmpeq_epi8(_mm_max_epu8(v, ctl), ctl));
+		unsigned m = _mm_movemask_epi8(x);
+		if (m) {
+			return s + lowbit(m);
+		}
+		s += 16;
+	}
+#endif
+	while (s < end && (unsigned char)*s >= 0x20 && *s != '"' && *s != '\\') {
+		s++;
+	}
+	return s;
+}
+
+class jsonwriter_
+{
+public:
+	jsonwriter_();
+	~jsonwriter_();
+
+	bool Value(value_ holder, const char* key, int index, value_ v);
+	void Member(obj_* o, const char* id, value_& v, bool& first);
+	const char* Text(void);			// the result, which the caller owns
+
+	func_*			replacer;		// replacer function, or NULL
+	const char**	allow;			// replacer array, as atoms, or NULL
+	int				nallow;
+	char			gap[11];		// indent per level, "" for none
+
+private:
+	char*	buf;
+	int		len;
+	int		cap;
+	int		level;				// nesting, for the indent
+	obj_**	stack;				// the objects we're inside, for cycles
+	int		nstack;
+	int		capstack;
+
+	char* Room(int n);			// where to put n more chars
+	void Put(char c) { *Room(1) = c; len++; }
+	void Put(const char* s, int n) { memcpy(Room(n), s, n); len += n; }
+	void Newline(void);
+	void Quote(const char* s);
+	void Object(obj_* o);
+	void Array(array_* a);
+	void Enter(obj_* o);
+	void Leave(void) { nstack--; level--; }
+	value_ Key(const char* key, int index);
+};
+
+jsonwriter_::jsonwriter_()
+: replacer(0), allow(0), nallow(0),
+  buf(0), len(0), cap(0), level(0), stack(0), nstack(0), capstack(0)
+{
+	gap[0] = 0;
+}
+
+jsonwriter_::~jsonwriter_()
+{
+	free(buf);
+	free(allow);
+	free(stack);
+}
+
+char* jsonwriter_::Room(int n)
+{
+	if (len + n >= cap) {
+		int newcap = cap ? cap : 256;
+		while (len + n >= newcap) {
+			newcap *= 2;
+		}
+		char* p = (char*)realloc(buf, newcap);
+		if (!p) {
+			throw bad_alloc();
+		}
+		buf = p;
+		cap = newcap;
+	}
+	return buf + len;
+}
+
+const char* jsonwriter_::Text(void)
+{
+	*Room(1) = 0;
+	char* s = (char*)realloc(buf, len + 1);
+	buf = NULL;
+	len = cap = 0;
+	return s;
+}
+
+void jsonwriter_::Newline(void)
+{
+	if (gap[0]) {
+		Put('\n');
+		int n = strlen(gap);
+		for (int i = 0; i < level; i++) {
+			Put(gap, n);
+		}
+	}
+}
+
+void jsonwriter_::Quote(const char* s)
+{
+	const char* end = s + strlen(s);
+	Room(end - s + 2);
+	Put('"');
+	for (;;) {
+		const char* run = s;
+		s = Plain(s, end);
+		Put(run, s - run);
+		if (s==end) {
+			break;
+		}
+		char c = *s++;
+		switch (c) {
+		case '"':	Put("\\\"", 2);	break;
+		case '\\':	Put("\\\\", 2);	break;
+		case '\b':	Put("\\b", 2);	break;
+		case '\f':	Put("\\f", 2);	break;
+		case '\n':	Put("\\n", 2);	break;
+		case '\r':	Put("\\r", 2);	break;
+		case '\t':	Put("\\t", 2);	break;
+		default:
+			len += sprintf(Room(7), "\\u%04x", (unsigned char)c);
+			break;
+		}
+	}
+	Put('"');
+}
+
+value_ jsonwriter_::Key(const char* key, int index)
+// the key a toJSON or replacer call sees: a string
+{
+	if (key) {
+		return value_(key);
+	}
+	char name[FMTNUM_MAX];
+	fmtnum_(index, name);
+	return value_(strdup(name));
+}
+
+bool jsonwriter_::Value(value_ holder, const char* key, int index, value_ v)
+// Write v, holder[key] (or holder[index]). False, and nothing
+// written, if v has no JSON text (undefined, a function).
+{
+	if (v.t >= value_::TOBJ) {
+		static const char* toJSON_id = intern_("toJSON");
+		value_ f = v.dot(toJSON_id);
+		if (f.isFunction()) {
+			v = f.toFunc()->call(v, 1, Key(key, index));
+		}
+	}
+	if (replacer) {
+		v = replacer->call(holder, 2, Key(key, index), v);
+	}
+	switch (v.t) {
+	case value_::TNULL:
+		Put("null", 4);
+		return true;
+	case value_::TBOOL:
+		if (v.v.d) {
+			Put("true", 4);
+		} else {
+			Put("false", 5);
+		}
+		return true;
+	case value_::TNUM:
+		if (_finite(v.v.d)) {
+			len += fmtnum_(v.v.d, Room(FMTNUM_MAX));
+		} else {
+			Put("null", 4);
+		}
+		return true;
+	case value_::TSTR:
+		Quote(v.v.s);
+		return true;
+	case value_::TOBJ:
+	case value_::TARRAY:
+		if (IsArray(v.v.o)) {
+			Array((array_*)v.v.o);
+		} else {
+			Object(v.v.o);
+		}
+		return true;
+	default:
+		// undefined, functions
+		return false;
+	}
+}
+
+void jsonwriter_::Enter(obj_* o)
+{
+	for (int i = 0; i < nstack; i++) {
+		if (stack[i]==o) {
+			// cyclic structure
+			throw TypeError();
+		}
+	}
+	if (nstack >= JSON_MAXDEPTH) {
+		throw RangeError();
+	}
+	if (nstack==capstack) {
+		capstack = capstack ? capstack*2 : 16;
+		stack = (obj_**)realloc(stack, capstack * sizeof stack[0]);
+		if (!stack) {
+			throw bad_alloc();
+		}
+	}
+	stack[nstack++] = o;
+	level++;
+}
+
+void jsonwriter_::Member(obj_* o, const char* id, value_& v, bool& first)
+{
+	int mark = len;
+	if (!first) {
+		Put(',');
+	}
+	Newline();
+	Quote(id);
+	Put(':');
+	if (gap[0]) {
+		Put(' ');
+	}
+	if (Value(value_(o), id, -1, v)) {
+		first = false;
+	} else {
+		// member left out
+		len = mark;
+	}
+}
+
+struct members_
+{
+	jsonwriter_*	writer;
+	obj_*			o;
+	bool			first;
+};
+
+static void WriteMember(const char* id, value_& v, void* context)
+{
+	members_& m = *(members_*)context;
+	m.writer->Member(m.o, id, v, m.first);
+}
+
+void jsonwriter_::Object(obj_* o)
+{
+	Enter(o);
+	Put('{');
+	members_ m = { this, o, true };
+	if (allow) {
+		for (int i = 0; i < nallow; i++) {
+			value_ v = o->dot(allow[i]);
+			Member(o, allow[i], v, m.first);
+		}
+	} else {
+		o->ForEachOwn(WriteMember, &m);
+	}
+	Leave();
+	if (!m.first) {
+		Newline();
+	}
+	Put('}');
+}
+
+void jsonwriter_::Array(array_* a)
+{
+	if (a->flags & array_::VALMAP) {
+		// not implemented yet (see array_::toString)
+		throw not_imp();
+	}
+	Enter(a);
+	Put('[');
+	int n = a->len;
+	for (int i = 0; i < n; i++) {
+		if (i) {
+			Put(',');
+		}
+		Newline();
+		if (!Value(value_(a), NULL, i, a->at(value_(i)))) {
+			Put("null", 4);
+		}
+	}
+	Leave();
+	if (n) {
+		Newline();
+	}
+	Put(']');
+}
+
+value_ JSON_stringify_(value_ v)
+{
+	jsonwriter_ writer;
+	if (!writer.Value(value_(), "", -1, v)) {
+		return undefined;
+	}
+	return value_(writer.Text());
+}
+
+/////////////////////////////////////////////////////////////////////
+// The JSON object
+
+class JSONparse_ : public func_ {
+public:
+	JS_CONSTEXPR JSONparse_() : func_(2) {}
+	virtual value_ call(value_ this_, int nargs, ...)
+	{
+		value_* argv = ARGV_(nargs);
+		const char* text = nargs > 0 ? argv[0].toString() : "undefined";
+		value_ r = JSON_parse_(text, strlen(text));
+		if (nargs > 1 && argv[1].isFunction()) {
+			obj_* root = new obj_;
+			root->dotref(intern_("")) = r;
+			r = Revive(value_(root), value_(""), argv[1].toFunc());
+		}
+		return r;
+	}
+};
+
+class JSONstringify_ : public func_ {
+public:
+	JS_CONSTEXPR JSONstringify_() : func_(3) {}
+	virtual value_ call(value_ this_, int nargs, ...)
+	{
+		value_* argv = ARGV_(nargs);
+		value_ v = nargs > 0 ? argv[0] : undefined;
+		jsonwriter_ writer;
+		if (nargs > 1) {
+			value_ r = argv[1];
+			if (r.isFunction()) {
+				writer.replacer = r.toFunc();
+			} else if (r.t==value_::TOBJ && IsArray(r.v.o)) {
+				// the members to write, in this order
+				array_* a = (array_*)r.v.o;
+				writer.allow = (const char**)malloc((a->len + 1) * sizeof(const char*));
+				if (!writer.allow) {
+					throw bad_alloc();
+				}
+				for (int i = 0; i < a->len; i++) {
+					value_ e = a->at(value_(i));
+					if (e.t==value_::TSTR || e.t==value_::TNUM) {
+						const char* id = intern_(e.toString());
+						int j = 0;
+						while (j < writer.nallow && writer.allow[j] != id) {
+							j++;
+						}
+						if (j==writer.nallow) {
+							writer.allow[writer.nallow++] = id;
+						}
+					}
+				}
+			}
+		}
+		if (nargs > 2) {
+			value_ space = argv[2];
+			if (space.t==value_::TNUM) {
+				int n = space.toInt32();
+				n = n < 0 ? 0 : n > 10 ? 10 : n;
+				memset(writer.gap, ' ', n);
+				writer.gap[n] = 0;
+			} else if (space.t==value_::TSTR) {
+				strncpy(writer.gap, space.v.s, 10);
+				writer.gap[10] = 0;
+			}
+		}
+		value_ root;
+		if (writer.replacer) {
+			// the replacer's first this is a wrapper { "": v }
+			obj_* o = new obj_;
+			o->dotref(intern_("")) = v;
+			root = value_(o);
+		}
+		if (!writer.Value(root, "", -1, v)) {
+			return undefined;
+		}
+		return value_(writer.Text());
+	}
+};
+
+static JSONparse_ parse_;
+static JSONstringify_ stringify_;
+
+class json_ : public builtin_
+{
+public:
+	JS_CONSTEXPR json_() : builtin_("JSON") {}
+	virtual value_ dot(const char* id)
+	{
+		if (0==strcmp(id, "parse")) {
+			return value_(&parse_);
+		}
+		if (0==strcmp(id, "stringify")) {
+			return value_(&stringify_);
+		}
+		return builtin_::dot(id);
+	}
+};
+
+static json_ json_object_;
+value_ JSON(&json_object_);
@@ -129,6 +129,7 @@ const char * pzTokName[] = {
 	"<StatementList>",
 	"<FunctionExpression>",
 	"<ArrayLiteral>",
+	"<ObjectLiteral>",
 	"<invalid>",
 };
 
@@ -157,6 +158,7 @@ namespace js2cpp {
 		m_buf[0] = 0;
 		m_sourceName = strdup(psrc->Title());
 		m_ttPrev = tEOF;
+		m_nTokens = 0;
 		// Insert keywords into name table
 		for (int i = tMIN_KEYWORD; i <= tMAX_KEYWORD; i++) {
 			TokenType tt = (TokenType)i;
@@ -260,6 +262,7 @@ namespace js2cpp {
 		assert(0==strcmp(pzTokName[tSTATLIST], "<StatementList>"));
 		assert(0==strcmp(pzTokName[tFUNEX], "<FunctionExpression>"));
 		assert(0==strcmp(pzTokName[tARRAYLIT], "<ArrayLiteral>"));
+		assert(0==strcmp(pzTokName[tOBJLIT], "<ObjectLiteral>"));
 
 		assert(isUnaryOp(tNEW));
 		assert(isUnaryOp(tVOID));
@@ -307,6 +310,7 @@ namespace js2cpp {
 
 	TokenType Lexer::GetToken(Token &token)
 	{
+		m_nTokens++;
 		// Handle whitespace
 		while (true) {
 			char c = m_buf[m_ichar++];
@@ -347,12 +351,20 @@ namespace js2cpp {
 			case 0x0C:		// FF
 			case 0x0D:		// CR
 				// end of line
-				m_ichar = 0;
-				if (m_psrc->ReadLine(m_buf, MAX_LINE)) {
-					m_line++;
-					// echo source line to output
-					fprintf(stderr, "%s[%03d] %s", m_sourceName, m_line, m_buf);
-					continue;
+				// (or end of a piece of a line too long for m_buf)
+				{
+					bool bPiece = (c==0 && m_ichar > 1);
+					m_ichar = 0;
+					if (m_psrc->ReadLine(m_buf, MAX_LINE)) {
+						if (bPiece) {
+							fprintf(stderr, "%s", m_buf);
+							continue;
+						}
+						m_line++;
+						// echo source line to output
+						fprintf(stderr, "%s[%03d] %s", m_sourceName, m_line, m_buf);
+						continue;
+					}
 				}
 				m_buf[m_ichar++] = 0;
 				break;
@@ -368,6 +380,17 @@ namespace js2cpp {
 			break;
 		} // while
 
+		if (m_ichar > MAX_LINE/2 && !strchr(m_buf+m_ichar, '\n')) {
+			// A line longer than m_buf comes in pieces (data tables).
+			// Slide the rest to the front and top it up, so a token
+			// shorter than MAX_LINE/2 never straddles two pieces.
+			int n = strlen(m_buf+m_ichar);
+			memmove(m_buf, m_buf+m_ichar, n+1);
+			m_ichar = 0;
+			if (m_psrc->ReadLine(m_buf+n, MAX_LINE-n)) {
+				fprintf(stderr, "%s", m_buf+n);
+			}
+		}
 		token.m_sourceName = m_sourceName;
 		token.m_line = m_line;
 		token.m_ichar = m_ichar;
@@ -573,9 +596,14 @@ namespace js2cpp {
 				m_ttPrev == tCOLON) {
 				// probably regex
 				token.m_type = tREGEX;
-				while (m_buf[m_ichar]!=c && m_buf[m_ichar]) {
+				bool bClass = false;		// a / in [...] doesn't end it
+				while ((bClass || m_buf[m_ichar]!=c) && m_buf[m_ichar]) {
 					if (m_buf[m_ichar]=='\\' && m_buf[m_ichar+1]) {
 						m_ichar++;
+					} else if (m_buf[m_ichar]=='[') {
+						bClass = true;
+					} else if (m_buf[m_ichar]==']') {
+						bClass = false;
 					}
 					m_ichar++;
 				}
@@ -611,6 +639,16 @@ namespace js2cpp {
 		case '9':
 			{
 				token.m_type = tNUMBER;
+				if (c=='0' && (m_buf[m_ichar]=='x' || m_buf[m_ichar]=='X') &&
+					isxdigit(m_buf[m_ichar+1])) {
+					// hex integer, same spelling in C
+					m_ichar++;
+					while (isxdigit(m_buf[m_ichar])) {
+						m_ichar++;
+					}
+					SetTokenText(token);
+					break;
+				}
 				while (isdigit(m_buf[m_ichar])) {
 					m_ichar++;
 				}
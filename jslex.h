@@ -164,6 +164,7 @@ typedef enum {
 	tSTATLIST,			// a sequence of statements
 	tFUNEX,				// function expression (otherwise same as tFUNCTION)
 	tARRAYLIT,			// literal array
+	tOBJLIT,			// literal object
 	tINVALID,			// an invalid tree/node
 } TokenType;
 
@@ -208,6 +209,7 @@ public:
 	~Lexer();
 
 	TokenType GetToken(Token &token);
+	int Tokens(void) const { return m_nTokens; }	// tokens gotten so far
 
 	void Include(SourceText *psrc);		// insert a text stream at current token position
 
@@ -217,6 +219,7 @@ private:
 	ErrorSink*			m_errSink;		// object that accepts errors
 	TokenType			m_ttPrev;		// type of previous token
 	StringTable			m_strtab;		// shared string table
+	int					m_nTokens;		// GetToken calls
 
 	void Push(void);
 	void Pop(void);
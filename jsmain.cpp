@@ -1,34 +1,53 @@
+#ifdef _WIN32
 #include "windows.h"
+#endif
+#include <stdlib.h>
+#include <string.h>
 
 extern int jsmain_(...);
+extern const int jsisolate_;		// translated with --isolate
+extern int runisolates_(int (*entry)(...), int n);
 
 extern char *pzAppTitle_;
+extern double performance_now_(void);
 
-static int common_main(void)
+static int common_main(const char* path)
+// path: the program's, if it's known
 {
+	performance_now_();		// sets its time origin
+#ifdef _WIN32
 	char buffer[_MAX_PATH];
 	::GetModuleFileName(NULL, buffer, _MAX_PATH);
 	char appname[_MAX_PATH];
 	_splitpath(buffer, NULL, NULL, appname, NULL);
 	pzAppTitle_ = strdup(appname);
+#else
+	const char* slash = path ? strrchr(path, '/') : NULL;
+	pzAppTitle_ = strdup(slash ? slash+1 : path ? path : "");
+#endif
 
-	int nret = jsmain_();
+	// JS_ISOLATES=n runs n copies of an --isolate program at once
+	const char* isolates = getenv("JS_ISOLATES");
+	int n = isolates ? atoi(isolates) : 1;
+	int nret = jsisolate_ && n > 1 ? runisolates_(jsmain_, n) : jsmain_();
 
 	free(pzAppTitle_);
 	return nret;
 } // common_main
 
+#ifdef _WIN32
 int APIENTRY WinMain(HINSTANCE hInstance,
                      HINSTANCE hPrevInstance,
                      LPSTR     lpCmdLine,
                      int       nCmdShow)
 {
-	return common_main();
+	return common_main(NULL);
 } // WinMain
+#endif
 
 int main(int argc, char *argv[])
 {
-	return common_main();
+	return common_main(argv[0]);
 } // main
 
 
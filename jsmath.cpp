@@ -0,0 +1,185 @@
+// jsmath.cpp - the Math object
+//
+// The compiler lowers calls like Math.floor(x) straight to libm
+// when it can see that Math is the global one. This object is
+// what everybody else gets, e.g. var m = Math; m.floor(x)
+
+#ifdef _WIN32
+#include "windows.h"
+#endif
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "jscpprt.h"
+#include "jsrtpriv.h"
+#include "sugar.h"
+
+/////////////////////////////////////////////////////////////////////
+// Math.random - xorshift128+
+
+static JS_THREAD uint64_ rng_state[2];		// each isolate its own (seeded by a stack address)
+
+static uint64_ splitmix64(uint64_& x)
+// used only to spread the seed over the state
+{
+	uint64_ z = (x += U64_(0x9E3779B97F4A7C15));
+	z = (z ^ (z >> 30)) * U64_(0xBF58476D1CE4E5B9);
+	z = (z ^ (z >> 27)) * U64_(0x94D049BB133111EB);
+	return z ^ (z >> 31);
+}
+
+static void rng_seed(void)
+{
+	uint64_ x = (uint64_)time(NULL) ^ (uint64_)(size_t)&x;
+	rng_state[0] = splitmix64(x);
+	rng_state[1] = splitmix64(x);
+}
+
+double Math_random_(void)
+{
+	if (rng_state[0]==0 && rng_state[1]==0) {
+		rng_seed();
+	}
+	uint64_ s1 = rng_state[0];
+	const uint64_ s0 = rng_state[1];
+	rng_state[0] = s0;
+	s1 ^= s1 << 23;
+	rng_state[1] = s1 ^ s0 ^ (s1 >> 17) ^ (s0 >> 26);
+	// top 53 bits of the sum make a double in [0,1)
+	return (double)((rng_state[1] + s0) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/////////////////////////////////////////////////////////////////////
+// Math functions as function objects
+
+static double arg(int i, int nargs, value_* argv)
+{
+	return i < nargs ? argv[i].toNumber() : NaN_;
+}
+
+class mathfn1_ : public func_ {
+public:
+	typedef double (*FN)(double);
+	JS_CONSTEXPR mathfn1_(FN f) : func_(1), fn(f) {}
+	virtual value_ call(value_ this_, int nargs, ...)
+	{
+		return value_(fn(arg(0, nargs, ARGV_(nargs))));
+	}
+private:
+	FN fn;
+};
+
+class mathfn2_ : public func_ {
+public:
+	typedef double (*FN)(double,double);
+	JS_CONSTEXPR mathfn2_(FN f) : func_(2), fn(f) {}
+	virtual value_ call(value_ this_, int nargs, ...)
+	{
+		value_* argv = ARGV_(nargs);
+		return value_(fn(arg(0, nargs, argv), arg(1, nargs, argv)));
+	}
+private:
+	FN fn;
+};
+
+// min and max take any number of arguments
+class mathfold_ : public func_ {
+public:
+	typedef double (*FN)(double,double);
+	JS_CONSTEXPR mathfold_(FN f, double id) : func_(2), fn(f), identity(id) {}
+	virtual value_ call(value_ this_, int nargs, ...)
+	{
+		value_* argv = ARGV_(nargs);
+		double r = identity;
+		for (int i = 0; i < nargs; i++) {
+			r = fn(r, argv[i].toNumber());
+		}
+		return value_(r);
+	}
+private:
+	FN fn;
+	double identity;
+};
+
+class mathrandom_ : public func_ {
+public:
+	JS_CONSTEXPR mathrandom_() : func_(0) {}
+	virtual value_ call(value_ this_, int nargs, ...)
+	{
+		return value_(Math_random_());
+	}
+};
+
+static double js_abs(double x) { return fabs(x); }
+static double js_acos(double x) { return acos(x); }
+static double js_asin(double x) { return asin(x); }
+static double js_atan(double x) { return atan(x); }
+static double js_ceil(double x) { return ceil(x); }
+static double js_cos(double x) { return cos(x); }
+static double js_exp(double x) { return exp(x); }
+static double js_floor(double x) { return floor(x); }
+static double js_log(double x) { return log(x); }
+static double js_sin(double x) { return sin(x); }
+static double js_sqrt(double x) { return sqrt(x); }
+static double js_tan(double x) { return tan(x); }
+static double js_atan2(double y, double x) { return atan2(y, x); }
+
+static mathfn1_ abs_(js_abs), acos_(js_acos), asin_(js_asin), atan_(js_atan),
+				ceil_(js_ceil), cos_(js_cos), exp_(js_exp), floor_(js_floor),
+				log_(js_log), round_(Math_round_), sin_(js_sin), sqrt_(js_sqrt),
+				tan_(js_tan);
+static mathfn2_ atan2_(js_atan2), pow_(Math_pow_);
+static mathfold_ max_(Math_max_, -HUGE_VAL), min_(Math_min_, HUGE_VAL);
+static mathrandom_ random_;
+
+static const struct {
+	const char*	name;
+	func_*		fn;
+} math_functions[] = {
+	{ "abs", &abs_ },		{ "acos", &acos_ },		{ "asin", &asin_ },
+	{ "atan", &atan_ },		{ "atan2", &atan2_ },	{ "ceil", &ceil_ },
+	{ "cos", &cos_ },		{ "exp", &exp_ },		{ "floor", &floor_ },
+	{ "log", &log_ },		{ "max", &max_ },		{ "min", &min_ },
+	{ "pow", &pow_ },		{ "random", &random_ },	{ "round", &round_ },
+	{ "sin", &sin_ },		{ "sqrt", &sqrt_ },		{ "tan", &tan_ },
+};
+
+static const struct {
+	const char*	name;
+	double		value;
+} math_constants[] = {
+	{ "E",			2.718281828459045 },
+	{ "LN10",		2.302585092994046 },
+	{ "LN2",		0.6931471805599453 },
+	{ "LOG10E",		0.4342944819032518 },
+	{ "LOG2E",		1.4426950408889634 },
+	{ "PI",			3.141592653589793 },
+	{ "SQRT1_2",	0.7071067811865476 },
+	{ "SQRT2",		1.4142135623730951 },
+};
+
+class math_ : public builtin_
+{
+public:
+	JS_CONSTEXPR math_() : builtin_("Math") {}
+	virtual value_ dot(const char* id);
+};
+
+value_ math_::dot(const char* id)
+{
+	int i;
+	for (i = 0; i < LENGTH(math_functions); i++) {
+		if (0==strcmp(id, math_functions[i].name)) {
+			return value_(math_functions[i].fn);
+		}
+	}
+	for (i = 0; i < LENGTH(math_constants); i++) {
+		if (0==strcmp(id, math_constants[i].name)) {
+			return value_(math_constants[i].value);
+		}
+	}
+	return builtin_::dot(id);
+}
+
+static math_ math_object_;
+value_ Math(&math_object_);
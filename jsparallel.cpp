@@ -0,0 +1,696 @@
+// jsparallel.cpp - parallel array methods, on a work-stealing pool
+//
+// a.parallelMap(f), parallelFilter(f), parallelForEach(f),
+// parallelReduce(f, init) and parallelSort(cmp) do what map, filter,
+// forEach, reduce and sort do. When a is big and f is pure (the
+// compiler marks a function pure in its funcinfo_ when it stores
+// nothing outside itself) the work is shared out to a pool of threads,
+// one per core, or JS_THREADS in all. Each thread starts on a slice of
+// the indices of its own and takes a grain at a time from its front;
+// when that runs out it steals the back half of the biggest slice
+// left. The calling thread works too, and the method returns when it
+// is all done. Otherwise, or inside another one's callback, it all
+// runs on the calling thread.
+//
+// A grain whose callback throws on a worker is run again on the
+// calling thread once the rest are done, so the exception comes out
+// there: a pure callback can be run twice. parallelReduce reduces
+// blocks of the array on their own and then combines their results in
+// order, so f must be associative.
+
+#ifdef _WIN32
+#include "windows.h"
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#include <pthread.h>
+#endif
+#include "jscpprt.h"
+#include "jsrtpriv.h"
+#include "sugar.h"
+
+#define PAR_MIN		2048		// fewer elements than this aren't worth waking threads for
+#define PAR_MAX		64			// threads at most, the caller's included
+#define PAR_BLOCKS	8			// parallelReduce/Sort blocks per thread
+#define PAR_GRAINS	32			// grains per thread's first slice
+
+struct slice_
+// a thread's share of a job: it takes grains from the front, and
+// thieves take halves from the back
+{
+	volatile long	lock;
+	volatile long	lo, hi;
+	char			pad[64 - 3 * sizeof(long)];		// a cache line each
+};
+
+struct failure_
+// a grain whose callback threw
+{
+	long		lo, hi;
+	failure_*	next;
+};
+
+struct job_
+{
+	void			(*body)(job_* job, long lo, long hi);
+	void*			context;
+	long			grain;
+	int				nslices;
+	slice_			slices[PAR_MAX];	// [0] is the caller's, [i] worker i's
+	volatile long	active;			// workers in it
+	volatile long	lock;			// on failures
+	failure_*		failures;
+	value_*			globalp;		// the caller's, for the workers
+	void*			globalsp;
+	ownprops_*		ownpropsp;
+	job_*			next;
+};
+
+static int				nworkers;		// threads in the pool
+static long				started;
+static job_*			jobs;			// being worked on, under mutex
+static JS_THREAD bool	inpool;			// running a job: any inside it run on this thread
+
+#ifdef _WIN32
+static CRITICAL_SECTION	mutex;
+static HANDLE			wakeup;			// a semaphore
+#define LOCK()			EnterCriticalSection(&mutex)
+#define UNLOCK()		LeaveCriticalSection(&mutex)
+#define WAIT()			(UNLOCK(), WaitForSingleObject(wakeup, INFINITE), LOCK())
+#define SIGNAL()		ReleaseSemaphore(wakeup, nworkers, NULL)
+#else
+static pthread_mutex_t	mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	wakeup = PTHREAD_COND_INITIALIZER;
+#define LOCK()			pthread_mutex_lock(&mutex)
+#define UNLOCK()		pthread_mutex_unlock(&mutex)
+#define WAIT()			pthread_cond_wait(&wakeup, &mutex)
+#define SIGNAL()		pthread_cond_broadcast(&wakeup)
+#endif
+
+/////////////////////////////////////////////////////////////////////
+// Sharing out a job
+
+static bool Grab(job_* job, int me, long& lo, long& hi)
+// the next grain of me's own slice
+{
+	slice_* s = &job->slices[me];
+	spinlock_ hold(s->lock);
+	if (s->lo >= s->hi) {
+		return false;
+	}
+	lo = s->lo;
+	hi = s->hi - lo > job->grain ? lo + job->grain : s->hi;
+	s->lo = hi;
+	return true;
+}
+
+static bool Steal(job_* job, int me)
+// the back half of the biggest slice left, for me's own; false when
+// there's nothing left
+{
+	for (;;) {
+		int victim = -1;
+		long most = 0;
+		int i;
+		for (i = 0; i < job->nslices; i++) {
+			long left = job->slices[i].hi - job->slices[i].lo;		// a guess, unlocked
+			if (left > most) {
+				most = left;
+				victim = i;
+			}
+		}
+		if (victim < 0) {
+			return false;
+		}
+		slice_* v = &job->slices[victim];
+		long lo, hi;
+		{
+			spinlock_ hold(v->lock);
+			long left = v->hi - v->lo;
+			if (left <= 0) {
+				continue;			// somebody got there first
+			}
+			lo = left > job->grain ? v->hi - left / 2 : v->lo;
+			hi = v->hi;
+			v->hi = lo;
+		}
+		slice_* s = &job->slices[me];
+		spinlock_ hold(s->lock);
+		s->lo = lo;
+		s->hi = hi;
+		return true;
+	}
+}
+
+static void Failed(job_* job, long lo, long hi)
+{
+	failure_* f = new failure_;
+	f->lo = lo;
+	f->hi = hi;
+	spinlock_ hold(job->lock);
+	f->next = job->failures;
+	job->failures = f;
+}
+
+static void Work(job_* job, int me)
+{
+	long lo, hi;
+	do {
+		while (Grab(job, me, lo, hi)) {
+			try {
+				job->body(job, lo, hi);
+			} catch (...) {
+				Failed(job, lo, hi);
+			}
+		}
+	} while (Steal(job, me));
+}
+
+static job_* Pick(void)
+// a job with work left, under mutex
+{
+	for (job_* job = jobs; job; job = job->next) {
+		for (int i = 0; i < job->nslices; i++) {
+			if (job->slices[i].lo < job->slices[i].hi) {
+				return job;
+			}
+		}
+	}
+	return NULL;
+}
+
+#ifdef _WIN32
+static unsigned __stdcall Worker(void* arg)
+#else
+static void* Worker(void* arg)
+#endif
+{
+	int me = (int)(size_t)arg;
+	inpool = true;
+	LOCK();
+	for (;;) {
+		job_* job = Pick();
+		if (!job) {
+			WAIT();
+			continue;
+		}
+		atomicadd_(&job->active, 1);
+		UNLOCK();
+		globalp_ = job->globalp;
+		globalsp_ = job->globalsp;
+		ownpropsp_ = job->ownpropsp;
+		Work(job, me);
+		atomicadd_(&job->active, -1);		// the caller may be gone after this
+		LOCK();
+	}
+	return 0;
+}
+
+static void StartPool(void)
+{
+	const char* env = getenv("JS_THREADS");
+#ifdef _WIN32
+	SYSTEM_INFO si;
+	GetSystemInfo(&si);
+	int n = env ? atoi(env) : (int)si.dwNumberOfProcessors;
+#else
+	int n = env ? atoi(env) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	if (n > PAR_MAX) {
+		n = PAR_MAX;
+	}
+#ifdef _WIN32
+	InitializeCriticalSection(&mutex);
+	wakeup = CreateSemaphore(NULL, 0, 0x7fffffff, NULL);
+#endif
+	for (int i = 1; i < n; i++) {
+		// they live as long as the program
+#ifdef _WIN32
+		HANDLE h = (HANDLE)_beginthreadex(NULL, 0, Worker, (void*)(size_t)i, 0, NULL);
+		if (!h) {
+			break;
+		}
+		CloseHandle(h);
+#else
+		pthread_t t;
+		if (pthread_create(&t, NULL, Worker, (void*)(size_t)i) != 0) {
+			break;
+		}
+		pthread_detach(t);
+#endif
+		nworkers = i;
+	}
+}
+
+static int Threads(long n, func_* f)
+// how many threads to do n calls of f on
+{
+	if (n < PAR_MIN || inpool || (f && !(f->info && f->info->pure))) {
+		return 1;
+	}
+	once_(&started, StartPool);
+	return nworkers + 1;
+}
+
+static void Run(void (*body)(job_*, long, long), void* context, long count, int nthreads)
+// body over [0, count), on nthreads threads
+{
+	job_ job;
+	job.body = body;
+	job.context = context;
+	if (nthreads <= 1 || count < 2) {
+		body(&job, 0, count);
+		return;
+	}
+	job.nslices = nthreads;
+	long per = count / nthreads, extra = count % nthreads, lo = 0;
+	for (int i = 0; i < nthreads; i++) {
+		slice_* s = &job.slices[i];
+		s->lock = 0;
+		s->lo = lo;
+		lo += per + (i < extra ? 1 : 0);
+		s->hi = lo;
+	}
+	job.grain = count / (nthreads * PAR_GRAINS);
+	if (job.grain < 1) {
+		job.grain = 1;
+	}
+	job.active = 0;
+	job.lock = 0;
+	job.failures = NULL;
+	job.globalp = globalp_;
+	job.globalsp = globalsp_;
+	job.ownpropsp = ownpropsp_;
+
+	atomicadd_(&nthreads_, 1);
+	LOCK();
+	job.next = jobs;
+	jobs = &job;
+	SIGNAL();
+	UNLOCK();
+	inpool = true;
+	Work(&job, 0);
+	inpool = false;
+	// none can join once it's off the list; then wait for those in it
+	LOCK();
+	job_** pp = &jobs;
+	while (*pp != &job) {
+		pp = &(*pp)->next;
+	}
+	*pp = job.next;
+	UNLOCK();
+	while (atomicadd_(&job.active, 0)) {		// (a barrier: their results are in)
+		yield_();
+	}
+	atomicadd_(&nthreads_, -1);
+
+	// grains that threw, in order: the first exception comes out here
+	while (job.failures) {
+		failure_** first = &job.failures;
+		for (failure_** fp = &job.failures; *fp; fp = &(*fp)->next) {
+			if ((*fp)->lo < (*first)->lo) {
+				first = fp;
+			}
+		}
+		failure_* f = *first;
+		*first = f->next;
+		long flo = f->lo, fhi = f->hi;
+		delete f;
+		try {
+			body(&job, flo, fhi);
+		} catch (...) {
+			while (job.failures) {
+				f = job.failures;
+				job.failures = f->next;
+				delete f;
+			}
+			throw;
+		}
+	}
+}
+
+/////////////////////////////////////////////////////////////////////
+// The methods
+
+struct arrayop_
+{
+	array_*		a;
+	func_*		fn;
+	value_*		out;		// parallelMap's results
+	char*		keep;		// parallelFilter's verdicts
+	value_*		partial;	// parallelReduce's, one per block
+	long		block;		// parallelReduce's block size
+};
+
+static value_ Callback(arrayop_* op, long i)
+// fn(a[i], i, a)
+{
+	value_ args[3];
+	args[0] = op->a->elt(i);
+	args[1] = value_(i);
+	args[2] = value_((obj_*)op->a);
+	return callv_(op->fn, global_, 3, args);
+}
+
+static value_ Combine(arrayop_* op, const value_& acc, const value_& x, long i)
+// fn(acc, x, i, a)
+{
+	value_ args[4];
+	args[0] = acc;
+	args[1] = x;
+	args[2] = value_(i);
+	args[3] = value_((obj_*)op->a);
+	return callv_(op->fn, global_, 4, args);
+}
+
+static void MapBody(job_* job, long lo, long hi)
+{
+	arrayop_* op = (arrayop_*)job->context;
+	for (long i = lo; i < hi; i++) {
+		op->out[i] = Callback(op, i);
+	}
+}
+
+static void FilterBody(job_* job, long lo, long hi)
+{
+	arrayop_* op = (arrayop_*)job->context;
+	for (long i = lo; i < hi; i++) {
+		op->keep[i] = Callback(op, i).toBool();
+	}
+}
+
+static void ForEachBody(job_* job, long lo, long hi)
+{
+	arrayop_* op = (arrayop_*)job->context;
+	for (long i = lo; i < hi; i++) {
+		Callback(op, i);
+	}
+}
+
+static void ReduceBody(job_* job, long lo, long hi)
+{
+	arrayop_* op = (arrayop_*)job->context;
+	for (long b = lo; b < hi; b++) {
+		long i = b * op->block;
+		long end = i + op->block < op->a->len ? i + op->block : op->a->len;
+		value_ acc = op->a->elt(i);
+		for (i++; i < end; i++) {
+			acc = Combine(op, acc, op->a->elt(i), i);
+		}
+		op->partial[b] = acc;
+	}
+}
+
+static func_* Callee(int nargs, value_* argv)
+{
+	if (nargs < 1 || argv[0].t != value_::TFUNC) {
+		throw TypeError();
+	}
+	return argv[0].v.f;
+}
+
+static value_ Map(array_* a, int nargs, value_* argv)
+{
+	arrayop_ op;
+	op.a = a;
+	op.fn = Callee(nargs, argv);
+	array_* res = new array_();
+	if (a->len) {
+		op.out = res->Resize(a->len);
+		Run(MapBody, &op, a->len, Threads(a->len, op.fn));
+	}
+	return value_((obj_*)res);
+}
+
+static value_ Filter(array_* a, int nargs, value_* argv)
+{
+	arrayop_ op;
+	op.a = a;
+	op.fn = Callee(nargs, argv);
+	op.keep = (char*)malloc(a->len + 1);
+	if (!op.keep) {
+		throw bad_alloc();
+	}
+	try {
+		Run(FilterBody, &op, a->len, Threads(a->len, op.fn));
+	} catch (...) {
+		free(op.keep);
+		throw;
+	}
+	array_* res = new array_();
+	int n = 0, i;
+	for (i = 0; i < a->len; i++) {
+		n += op.keep[i];
+	}
+	if (n) {
+		value_* out = res->Resize(n);
+		for (i = 0; i < a->len; i++) {
+			if (op.keep[i]) {
+				*out++ = a->elt(i);
+			}
+		}
+	}
+	free(op.keep);
+	return value_((obj_*)res);
+}
+
+static value_ ForEach(array_* a, int nargs, value_* argv)
+{
+	arrayop_ op;
+	op.a = a;
+	op.fn = Callee(nargs, argv);
+	Run(ForEachBody, &op, a->len, Threads(a->len, op.fn));
+	return undefined;
+}
+
+static value_ Reduce(array_* a, int nargs, value_* argv)
+{
+	arrayop_ op;
+	op.a = a;
+	op.fn = Callee(nargs, argv);
+	bool bInit = nargs > 1;
+	if (!a->len && !bInit) {
+		throw TypeError();
+	}
+	int nthreads = Threads(a->len, op.fn);
+	if (nthreads == 1) {
+		value_ acc = bInit ? argv[1] : a->elt(0);
+		for (long i = bInit ? 0 : 1; i < a->len; i++) {
+			acc = Combine(&op, acc, a->elt(i), i);
+		}
+		return acc;
+	}
+	long nblocks = nthreads * PAR_BLOCKS;
+	op.block = (a->len + nblocks - 1) / nblocks;
+	nblocks = (a->len + op.block - 1) / op.block;
+	op.partial = new value_[nblocks];
+	try {
+		Run(ReduceBody, &op, nblocks, nthreads);
+	} catch (...) {
+		delete[] op.partial;
+		throw;
+	}
+	// the blocks' results, in order
+	value_ acc = bInit ? argv[1] : op.partial[0];
+	try {
+		for (long b = bInit ? 0 : 1; b < nblocks; b++) {
+			acc = Combine(&op, acc, op.partial[b], b * op.block);
+		}
+	} catch (...) {
+		delete[] op.partial;
+		throw;
+	}
+	delete[] op.partial;
+	return acc;
+}
+
+/////////////////////////////////////////////////////////////////////
+// parallelSort: blocks merge sorted on their own, then merged in pairs,
+// a round of merges at a time
+
+struct sortop_
+{
+	func_*		cmp;		// or NULL: as strings
+	value_*		src;		// sorted runs of width
+	value_*		dst;		// merged into runs of 2*width
+	long		n;
+	long		width;
+};
+
+static int Compare(func_* cmp, const value_& x, const value_& y)
+{
+	// undefined goes after everything, without asking cmp
+	if (x.isUndefined()) {
+		return y.isUndefined() ? 0 : 1;
+	}
+	if (y.isUndefined()) {
+		return -1;
+	}
+	if (cmp) {
+		value_ args[2];
+		args[0] = x;
+		args[1] = y;
+		double d = callv_(cmp, global_, 2, args).toNumber();
+		return d < 0 ? -1 : d > 0 ? 1 : 0;
+	}
+	return strcmp(x.toString(), y.toString());
+}
+
+static void Merge(func_* cmp, const value_* src, value_* dst, long lo, long mid, long hi)
+// src[lo,mid) and src[mid,hi), each sorted, into dst[lo,hi); stable
+{
+	long i = lo, j = mid, k = lo;
+	while (i < mid && j < hi) {
+		dst[k++] = Compare(cmp, src[j], src[i]) < 0 ? src[j++] : src[i++];
+	}
+	while (i < mid) {
+		dst[k++] = src[i++];
+	}
+	while (j < hi) {
+		dst[k++] = src[j++];
+	}
+}
+
+static void SortRange(func_* cmp, value_* v, value_* tmp, long lo, long hi)
+// v[lo,hi) sorted in place, tmp[lo,hi) to merge through
+{
+	const long RUN = 16;
+	long i, j, w;
+	for (i = lo; i < hi; i += RUN) {
+		// insertion sort each short run
+		long end = i + RUN < hi ? i + RUN : hi;
+		for (j = i + 1; j < end; j++) {
+			value_ x = v[j];
+			long k = j;
+			while (k > i && Compare(cmp, x, v[k-1]) < 0) {
+				v[k] = v[k-1];
+				k--;
+			}
+			v[k] = x;
+		}
+	}
+	value_* src = v;
+	value_* dst = tmp;
+	for (w = RUN; w < hi - lo; w *= 2) {
+		for (i = lo; i < hi; i += 2 * w) {
+			long mid = i + w < hi ? i + w : hi;
+			Merge(cmp, src, dst, i, mid, i + 2 * w < hi ? i + 2 * w : hi);
+		}
+		value_* t = src;
+		src = dst;
+		dst = t;
+	}
+	if (src != v) {
+		for (i = lo; i < hi; i++) {
+			v[i] = src[i];
+		}
+	}
+}
+
+static void SortBody(job_* job, long lo, long hi)
+{
+	sortop_* op = (sortop_*)job->context;
+	for (long b = lo; b < hi; b++) {
+		long end = (b + 1) * op->width < op->n ? (b + 1) * op->width : op->n;
+		SortRange(op->cmp, op->src, op->dst, b * op->width, end);
+	}
+}
+
+static void MergeBody(job_* job, long lo, long hi)
+{
+	sortop_* op = (sortop_*)job->context;
+	for (long p = lo; p < hi; p++) {
+		long start = p * 2 * op->width;
+		long mid = start + op->width < op->n ? start + op->width : op->n;
+		long end = start + 2 * op->width < op->n ? start + 2 * op->width : op->n;
+		Merge(op->cmp, op->src, op->dst, start, mid, end);
+	}
+}
+
+static value_ Sort(array_* a, int nargs, value_* argv)
+{
+	sortop_ op;
+	op.cmp = nargs > 0 && !argv[0].isUndefined() ? Callee(nargs, argv) : NULL;
+	op.n = a->len;
+	if (op.n < 2) {
+		return value_((obj_*)a);
+	}
+	a->Densify();
+	a->Reserve(a->len);				// its own copy, if it was a constant table
+	value_* v = (value_*)a->pdata;
+	value_* tmp = new value_[op.n];
+	try {
+		int nthreads = Threads(op.n, op.cmp);
+		long nblocks = nthreads == 1 ? 1 : nthreads * PAR_BLOCKS;
+		op.width = (op.n + nblocks - 1) / nblocks;
+		nblocks = (op.n + op.width - 1) / op.width;
+		op.src = v;
+		op.dst = tmp;
+		Run(SortBody, &op, nblocks, nthreads);
+		for (; op.width < op.n; op.width *= 2) {
+			Run(MergeBody, &op, (op.n + 2 * op.width - 1) / (2 * op.width), nthreads);
+			value_* t = op.src;
+			op.src = op.dst;
+			op.dst = t;
+		}
+		if (op.src != v) {
+			for (long i = 0; i < op.n; i++) {
+				v[i] = op.src[i];
+			}
+		}
+	} catch (...) {
+		delete[] tmp;
+		throw;
+	}
+	delete[] tmp;
+	return value_((obj_*)a);
+}
+
+typedef value_ (*arraymethod_)(array_* a, int nargs, value_* argv);
+
+class parallel_ : public func_ {
+public:
+	JS_CONSTEXPR parallel_(arraymethod_ m, int len) : func_(len), method(m) {}
+	virtual value_ call(value_ this_, int nargs, ...)
+	{
+		value_* argv = ARGV_(nargs);
+		if (this_.t != value_::TOBJ || strcmp(this_.v.o->Class(), "Array")) {
+			throw TypeError();
+		}
+		array_* a = (array_*)this_.v.o;
+		if (a->flags & array_::VALMAP) {
+			throw not_imp();
+		}
+		return method(a, nargs, argv);
+	}
+private:
+	arraymethod_	method;
+};
+
+static parallel_ map_func_(Map, 1), filter_func_(Filter, 1), forEach_func_(ForEach, 1);
+static parallel_ reduce_func_(Reduce, 1), sort_func_(Sort, 1);
+
+value_ parallelmethod_(const char* id)
+{
+	if (0==strcmp(id, "parallelMap")) {
+		return value_(&map_func_);
+	}
+	if (0==strcmp(id, "parallelFilter")) {
+		return value_(&filter_func_);
+	}
+	if (0==strcmp(id, "parallelForEach")) {
+		return value_(&forEach_func_);
+	}
+	if (0==strcmp(id, "parallelReduce")) {
+		return value_(&reduce_func_);
+	}
+	if (0==strcmp(id, "parallelSort")) {
+		return value_(&sort_func_);
+	}
+	return undefined;
+}
@@ -5,19 +5,23 @@
 #include "jsparse.h"
 #include "AST.h"
 #include "scope.h"
+#include "phases.h"
+#include "sugar.h"
 #include <stdio.h>
+#include <string.h>
 #include <assert.h>
 
-#define LENGTH(a) (sizeof(a)/sizeof((a)[0]))
-
 namespace js2cpp {
 //
 //
 	const char* global_text =
-"extern var alert,undefined;\n"
+"extern var alert,console,print,undefined;\n"
 "extern var Object, Function, Array, String, Boolean, Number, Date, RegExp;\n"
 "extern var Error, EvalError, RangeError, ReferenceError, SyntaxError, TypeError, URIError;\n"
-"extern var Math;\n"
+"extern var Math, JSON, performance, isolate;\n"
+"extern var setTimeout, setInterval, clearTimeout, clearInterval, queueMicrotask, fs, net;\n"
+"extern var ArrayBuffer, DataView, Int8Array, Uint8Array, Uint8ClampedArray;\n"
+"extern var Int16Array, Uint16Array, Int32Array, Uint32Array, Float32Array, Float64Array;\n"
 ;
 
 	GlobalText::GlobalText(const char* s)
@@ -81,6 +85,7 @@ namespace js2cpp {
 			}
 			nPeeked--;
 		} else {
+			PhaseTimer timer(PH_LEX);
 			lex.GetToken(token);
 		}
 		bNewline = (token.m_line != lastline);
@@ -93,6 +98,7 @@ namespace js2cpp {
 			return token;
 		}
 		while (nPeeked < i) {
+			PhaseTimer timer(PH_LEX);
 			lex.GetToken(peeked[nPeeked]);
 			nPeeked++;
 		}
@@ -741,13 +747,16 @@ postfixing:
 
 	AST* Parser::ExprList(void)
 	{
+		// a, b, c => (, a (, b c)) built without recursion
 		AST *a = ConditionalExpr();
-		if (token.m_type == tCOMMA) {
+		AST **tail = &a;
+		while (token.m_type == tCOMMA) {
 			AST *l = new AST(token);
 			Advance();
-			l->first = a;
-			l->second = ExprList();
-			a = l;
+			l->first = *tail;
+			l->second = ConditionalExpr();
+			*tail = l;
+			tail = &l->second;
 		}
 		return a;
 	} // ExprList
@@ -917,6 +926,7 @@ postfixing:
 	{
 		// assume there's a { there.
 		AST *r = new AST(token); Advance();
+		Type(r) = tOBJLIT;
 		AST *list = r;
 		while (token.m_type==tIDENT) {
 			// plug in property-name
@@ -940,20 +950,24 @@ postfixing:
 
 	AST* Parser::ElementList(void)
 	{
+		// Loops rather than recursing, a data table can be huge.
 		AST* list = NULL;
-		if (token.m_type!=tRBRACKET) {
+		AST** tail = &list;
+		while (token.m_type!=tRBRACKET) {
 			if (token.m_type==tCOMMA) {
-				list = new AST(token); Advance();
-				list->second = ElementList();
+				// elision
+				*tail = new AST(token); Advance();
+				tail = &(*tail)->second;
 			} else {
 				AST* e = ConditionalExpr();
-				list = new AST(token);
-				Type(list) = tCOMMA;
-				list->first = e;
-				if (token.m_type==tCOMMA) {
-					Advance();
-					list->second = ElementList();
+				*tail = new AST(token);
+				Type(*tail) = tCOMMA;
+				(*tail)->first = e;
+				tail = &(*tail)->second;
+				if (token.m_type!=tCOMMA) {
+					break;
 				}
+				Advance();
 			}
 		}
 		return list;
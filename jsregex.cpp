@@ -0,0 +1,1001 @@
+// jsregex.cpp - regular expressions: compiler and Pike VM
+//
+// Patterns are ES5 short of backreferences and lookahead, which
+// need backtracking: literals and escapes, ., classes, groups and
+// (?:), |, the greedy and lazy * + ? {n} {n,} {n,m}, and ^ $ \b \B.
+// Strings are bytes, UTF-8 beyond ASCII, so \uXXXX outside a class
+// matches its UTF-8 encoding, and a non-ASCII member of a class
+// stands for any non-ASCII byte.
+
+#include <stdlib.h>
+#include <string.h>
+#include "jsregex.h"
+
+static bool IsWord(int c)
+{
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c=='_';
+}
+
+static bool IsNewline(int c)
+{
+	return c=='\n' || c=='\r';
+}
+
+static int HexDigit(char c)
+{
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	return -1;
+}
+
+static bool TestBit(const unsigned char* bits, int c)
+{
+	return (bits[c >> 3] & (1 << (c & 7))) != 0;
+}
+
+static void SetBit(unsigned char* bits, int c)
+{
+	bits[c >> 3] |= (unsigned char)(1 << (c & 7));
+}
+
+int rxflags_(const char* flags)
+{
+	int f = 0;
+	for (; *flags; flags++) {
+		int bit;
+		switch (*flags) {
+		case 'g': bit = RX_GLOBAL; break;
+		case 'i': bit = RX_ICASE; break;
+		case 'm': bit = RX_MULTILINE; break;
+		default: return -1;
+		}
+		if (f & bit) {
+			return -1;				// repeated flag
+		}
+		f |= bit;
+	}
+	return f;
+}
+
+/////////////////////////////////////////////////////////////////////
+// Compiler: pattern => syntax tree => program
+
+enum { N_EMPTY, N_CHAR, N_ANY, N_CLASS, N_CAT, N_ALT, N_REP, N_GROUP, N_ASSERT };
+
+struct rxnode_
+{
+	int		type;
+	int		x, y;		// CHAR: byte. CLASS: bitmap. REP: min, max (-1 = none). GROUP: number. ASSERT: op
+	int		a, b;		// children
+	bool	greedy;		// REP
+};
+
+struct rxerror_
+{
+	const char*	msg;
+};
+
+class rxcompiler_
+{
+public:
+	rxcompiler_(const char* src, int len, int f);
+	~rxcompiler_();
+
+	rxprog_* Compile(const char** err);
+
+private:
+	int Alt(void);
+	int Cat(void);
+	int Repeat(void);
+	int Atom(void);
+	int Escape(void);
+	int Class(void);
+	int ClassAtom(int k);
+	unsigned CharEscape(unsigned char c);
+	int Code(unsigned code);
+	int Char(int c);
+	bool Count(int& n);
+	void AddSet(int k, char e);
+
+	int Node(int type, int x = 0, int y = 0, int a = -1, int b = -1);
+	int NewClass(void);
+	unsigned char* Bits(int k) { return classes + 32 * k; }
+	void Fail(const char* msg);
+
+	void Emit(int i);
+	void Groups(int i, int& lo, int& hi);
+	void Clear(int i);
+	int Inst(int op, int x = 0, int y = 0);
+	void Analyze(rxprog_* prog, char* prefix);
+
+	const char*		src;
+	const char*		p;
+	const char*		end;
+	int				flags;
+	int				ngroups;
+	rxnode_*		nodes;
+	int				nnodes, capnodes;
+	unsigned char*	classes;
+	int				nclasses, capclasses;
+	rxinst_*		inst;
+	int				ninst, capinst;
+};
+
+rxcompiler_::rxcompiler_(const char* s, int len, int f)
+	: src(s), p(s), end(s + len), flags(f), ngroups(0),
+	  nodes(0), nnodes(0), capnodes(0),
+	  classes(0), nclasses(0), capclasses(0),
+	  inst(0), ninst(0), capinst(0)
+{
+}
+
+rxcompiler_::~rxcompiler_()
+{
+	free(nodes);
+	free(classes);
+	free(inst);
+}
+
+void rxcompiler_::Fail(const char* msg)
+{
+	rxerror_ e;
+	e.msg = msg;
+	throw e;
+}
+
+int rxcompiler_::Node(int type, int x, int y, int a, int b)
+{
+	if (nnodes == capnodes) {
+		capnodes = capnodes ? 2 * capnodes : 64;
+		nodes = (rxnode_*)realloc(nodes, capnodes * sizeof nodes[0]);
+	}
+	rxnode_& n = nodes[nnodes];
+	n.type = type;
+	n.x = x;
+	n.y = y;
+	n.a = a;
+	n.b = b;
+	n.greedy = true;
+	return nnodes++;
+}
+
+int rxcompiler_::NewClass(void)
+{
+	if (nclasses == capclasses) {
+		capclasses = capclasses ? 2 * capclasses : 8;
+		classes = (unsigned char*)realloc(classes, capclasses * 32);
+	}
+	memset(Bits(nclasses), 0, 32);
+	return nclasses++;
+}
+
+int rxcompiler_::Alt(void)
+{
+	int n = Cat();
+	while (p < end && *p=='|') {
+		p++;
+		int r = Cat();
+		n = Node(N_ALT, 0, 0, n, r);
+	}
+	return n;
+}
+
+int rxcompiler_::Cat(void)
+{
+	int n = -1;
+	while (p < end && *p!='|' && *p!=')') {
+		int r = Repeat();
+		n = n < 0 ? r : Node(N_CAT, 0, 0, n, r);
+	}
+	return n < 0 ? Node(N_EMPTY) : n;
+}
+
+bool rxcompiler_::Count(int& n)
+{
+	if (p >= end || *p < '0' || *p > '9') {
+		return false;
+	}
+	n = 0;
+	while (p < end && *p >= '0' && *p <= '9') {
+		if (n < RX_MAXINST) {
+			n = 10 * n + (*p - '0');
+		}
+		p++;
+	}
+	return true;
+}
+
+int rxcompiler_::Repeat(void)
+// an atom and its quantifier, if any
+{
+	int n = Atom();
+	if (p >= end) {
+		return n;
+	}
+	int lo, hi;
+	switch (*p) {
+	case '*':
+		lo = 0, hi = -1;
+		p++;
+		break;
+	case '+':
+		lo = 1, hi = -1;
+		p++;
+		break;
+	case '?':
+		lo = 0, hi = 1;
+		p++;
+		break;
+	case '{':
+		{
+			// {n} {n,} {n,m}; anything else is a literal {
+			const char* brace = p++;
+			if (!Count(lo)) {
+				p = brace;
+				return n;
+			}
+			hi = lo;
+			if (p < end && *p==',') {
+				p++;
+				hi = -1;
+				if (p < end && *p!='}' && !Count(hi)) {
+					p = brace;
+					return n;
+				}
+			}
+			if (p >= end || *p!='}') {
+				p = brace;
+				return n;
+			}
+			p++;
+			if (hi >= 0 && hi < lo) {
+				Fail("numbers out of order in {} quantifier");
+			}
+			if (lo >= RX_MAXINST || hi >= RX_MAXINST) {
+				Fail("regular expression too big");
+			}
+		}
+		break;
+	default:
+		return n;
+	}
+	if (nodes[n].type==N_ASSERT) {
+		Fail("nothing to repeat");
+	}
+	int r = Node(N_REP, lo, hi, n);
+	if (p < end && *p=='?') {
+		nodes[r].greedy = false;
+		p++;
+	}
+	return r;
+}
+
+int rxcompiler_::Atom(void)
+{
+	unsigned char c = *p++;
+	int n;
+	switch (c) {
+	case '(':
+		if (p < end && *p=='?') {
+			if (p + 1 < end && p[1]==':') {
+				p += 2;
+				n = Alt();
+			} else {
+				Fail("lookahead is not supported");
+			}
+		} else {
+			int g = ++ngroups;
+			if (g > RX_MAXGROUPS) {
+				Fail("too many groups");
+			}
+			int body = Alt();
+			n = Node(N_GROUP, g, 0, body);
+		}
+		if (p >= end || *p!=')') {
+			Fail("missing )");
+		}
+		p++;
+		return n;
+	case '[':
+		return Class();
+	case '.':
+		return Node(N_ANY);
+	case '^':
+		return Node(N_ASSERT, RX_BOL);
+	case '$':
+		return Node(N_ASSERT, RX_EOL);
+	case '\\':
+		return Escape();
+	case '*':
+	case '+':
+	case '?':
+		Fail("nothing to repeat");
+	}
+	return Char(c);
+}
+
+int rxcompiler_::Char(int c)
+{
+	if ((flags & RX_ICASE) && ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'))) {
+		int k = NewClass();
+		SetBit(Bits(k), c | 0x20);
+		SetBit(Bits(k), c & ~0x20);
+		return Node(N_CLASS, k);
+	}
+	return Node(N_CHAR, c);
+}
+
+int rxcompiler_::Code(unsigned code)
+// a character outside a class: its UTF-8 bytes
+{
+	if (code < 0x80) {
+		return Char(code);
+	}
+	if (code < 0x800) {
+		return Node(N_CAT, 0, 0, Node(N_CHAR, 0xC0 | (code >> 6)), Node(N_CHAR, 0x80 | (code & 0x3F)));
+	}
+	int n = Node(N_CAT, 0, 0, Node(N_CHAR, 0xE0 | (code >> 12)), Node(N_CHAR, 0x80 | ((code >> 6) & 0x3F)));
+	return Node(N_CAT, 0, 0, n, Node(N_CHAR, 0x80 | (code & 0x3F)));
+}
+
+unsigned rxcompiler_::CharEscape(unsigned char c)
+// the character for \c, either in a class or not
+{
+	int h;
+	switch (c) {
+	case 'n':
+		return '\n';
+	case 'r':
+		return '\r';
+	case 't':
+		return '\t';
+	case 'f':
+		return '\f';
+	case 'v':
+		return '\v';
+	case '0':
+		return 0;
+	case 'c':
+		if (p < end && ((*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z'))) {
+			return *p++ & 31;
+		}
+		return c;
+	case 'x':
+	case 'u':
+		{
+			int digits = c=='x' ? 2 : 4;
+			unsigned code = 0;
+			if (end - p < digits) {
+				return c;
+			}
+			for (int i = 0; i < digits; i++) {
+				if ((h = HexDigit(p[i])) < 0) {
+					return c;			// not an escape after all
+				}
+				code = code * 16 + h;
+			}
+			p += digits;
+			return code;
+		}
+	}
+	return c;
+}
+
+int rxcompiler_::Escape(void)
+// after a \ outside a class
+{
+	if (p >= end) {
+		Fail("\\ at end of pattern");
+	}
+	unsigned char c = *p++;
+	switch (c) {
+	case 'b':
+		return Node(N_ASSERT, RX_WORDB);
+	case 'B':
+		return Node(N_ASSERT, RX_NWORDB);
+	case 'd':
+	case 'D':
+	case 'w':
+	case 'W':
+	case 's':
+	case 'S':
+		{
+			int k = NewClass();
+			AddSet(k, c);
+			return Node(N_CLASS, k);
+		}
+	}
+	if (c >= '1' && c <= '9') {
+		Fail("backreferences are not supported");
+	}
+	return Code(CharEscape(c));
+}
+
+void rxcompiler_::AddSet(int k, char e)
+// add \d \D \w \W \s \S to class k
+{
+	unsigned char set[32];
+	memset(set, 0, sizeof set);
+	int c;
+	switch (e | 0x20) {
+	case 'd':
+		for (c = '0'; c <= '9'; c++) {
+			SetBit(set, c);
+		}
+		break;
+	case 'w':
+		for (c = 0; c < 128; c++) {
+			if (IsWord(c)) {
+				SetBit(set, c);
+			}
+		}
+		break;
+	case 's':
+		SetBit(set, ' ');
+		for (c = '\t'; c <= '\r'; c++) {
+			SetBit(set, c);
+		}
+		break;
+	}
+	unsigned char* bits = Bits(k);
+	for (c = 0; c < 32; c++) {
+		bits[c] |= (e >= 'a') ? set[c] : (unsigned char)~set[c];
+	}
+}
+
+int rxcompiler_::ClassAtom(int k)
+// one member of class k: its code, or -1 if it was a set like \d
+{
+	unsigned char c = *p++;
+	if (c != '\\') {
+		return c;
+	}
+	if (p >= end) {
+		Fail("missing ]");
+	}
+	c = *p++;
+	switch (c) {
+	case 'd':
+	case 'D':
+	case 'w':
+	case 'W':
+	case 's':
+	case 'S':
+		AddSet(k, c);
+		return -1;
+	case 'b':
+		return '\b';
+	}
+	return CharEscape(c);
+}
+
+int rxcompiler_::Class(void)
+// after a [
+{
+	int k = NewClass();
+	bool negate = false;
+	if (p < end && *p=='^') {
+		negate = true;
+		p++;
+	}
+	while (p < end && *p!=']') {
+		int lo = ClassAtom(k);
+		int hi = lo;
+		if (p + 1 < end && *p=='-' && p[1]!=']') {
+			p++;
+			hi = ClassAtom(k);
+			if (lo < 0 || hi < 0) {
+				Fail("bad range in class");
+			}
+			if (hi < lo) {
+				Fail("range out of order in class");
+			}
+		}
+		if (lo < 0) {
+			continue;
+		}
+		unsigned char* bits = Bits(k);
+		for (int c = lo; c <= hi && c < 0x80; c++) {
+			SetBit(bits, c);
+		}
+		if (hi >= 0x80) {
+			for (int b = 0x80; b < 0x100; b++) {
+				SetBit(bits, b);
+			}
+		}
+	}
+	if (p >= end) {
+		Fail("missing ]");
+	}
+	p++;
+	unsigned char* bits = Bits(k);
+	if (flags & RX_ICASE) {
+		for (int c = 'a'; c <= 'z'; c++) {
+			if (TestBit(bits, c) || TestBit(bits, c & ~0x20)) {
+				SetBit(bits, c);
+				SetBit(bits, c & ~0x20);
+			}
+		}
+	}
+	if (negate) {
+		for (int i = 0; i < 32; i++) {
+			bits[i] = (unsigned char)~bits[i];
+		}
+	}
+	return Node(N_CLASS, k);
+}
+
+int rxcompiler_::Inst(int op, int x, int y)
+{
+	if (ninst >= RX_MAXINST) {
+		Fail("regular expression too big");
+	}
+	if (ninst == capinst) {
+		capinst = capinst ? 2 * capinst : 64;
+		inst = (rxinst_*)realloc(inst, capinst * sizeof inst[0]);
+	}
+	inst[ninst].op = op;
+	inst[ninst].x = x;
+	inst[ninst].y = y;
+	return ninst++;
+}
+
+void rxcompiler_::Groups(int i, int& lo, int& hi)
+// widen lo..hi to the numbers of the groups in node i
+{
+	if (i < 0) {
+		return;
+	}
+	rxnode_ n = nodes[i];
+	if (n.type == N_GROUP) {
+		lo = n.x < lo ? n.x : lo;
+		hi = n.x > hi ? n.x : hi;
+	}
+	if (n.type == N_GROUP || n.type == N_REP || n.type == N_CAT || n.type == N_ALT) {
+		Groups(n.a, lo, hi);
+	}
+	if (n.type == N_CAT || n.type == N_ALT) {
+		Groups(n.b, lo, hi);
+	}
+}
+
+void rxcompiler_::Clear(int i)
+// each time round a repeat, the groups in it start out undefined:
+// /((a)|b)+/ on "ab" leaves group 2 undefined
+{
+	int lo = RX_MAXGROUPS + 1, hi = 0;
+	Groups(i, lo, hi);
+	if (lo <= hi) {
+		Inst(RX_CLEAR, 2 * lo, 2 * hi + 2);
+	}
+}
+
+void rxcompiler_::Emit(int i)
+{
+	rxnode_ n = nodes[i];
+	int split, jmp, k;
+	switch (n.type) {
+	case N_EMPTY:
+		break;
+	case N_CHAR:
+		Inst(RX_CHAR, n.x);
+		break;
+	case N_ANY:
+		Inst(RX_ANY);
+		break;
+	case N_CLASS:
+		Inst(RX_CLASS, n.x);
+		break;
+	case N_ASSERT:
+		Inst(n.x);
+		break;
+	case N_CAT:
+		Emit(n.a);
+		Emit(n.b);
+		break;
+	case N_ALT:
+		//	split L1, L2
+		// L1: a
+		//	jmp L3
+		// L2: b
+		// L3:
+		split = Inst(RX_SPLIT, ninst + 1);
+		Emit(n.a);
+		jmp = Inst(RX_JMP);
+		inst[split].y = ninst;
+		Emit(n.b);
+		inst[jmp].x = ninst;
+		break;
+	case N_GROUP:
+		Inst(RX_SAVE, 2 * n.x);
+		Emit(n.a);
+		Inst(RX_SAVE, 2 * n.x + 1);
+		break;
+	case N_REP:
+		// the required copies, the last of them looping back if there's no max
+		for (k = 0; k < n.x; k++) {
+			int top = ninst;
+			Clear(n.a);
+			Emit(n.a);
+			if (n.y < 0 && k == n.x - 1) {
+				if (n.greedy) {
+					Inst(RX_SPLIT, top, ninst + 1);
+				} else {
+					Inst(RX_SPLIT, ninst + 1, top);
+				}
+			}
+		}
+		if (n.y < 0 && n.x == 0) {
+			// L1: split L2, L3
+			// L2: a
+			//	jmp L1
+			// L3:
+			split = Inst(RX_SPLIT);
+			Clear(n.a);
+			Emit(n.a);
+			Inst(RX_JMP, split);
+			inst[split].x = n.greedy ? split + 1 : ninst;
+			inst[split].y = n.greedy ? ninst : split + 1;
+		} else if (n.y > n.x) {
+			// the optional copies, nested: (a(a(a)?)?)?
+			// each split's y links to the one before until the end is known
+			int chain = -1;
+			for (k = n.x; k < n.y; k++) {
+				split = Inst(RX_SPLIT, 0, chain);
+				chain = split;
+				Clear(n.a);
+				Emit(n.a);
+			}
+			while (chain >= 0) {
+				int next = inst[chain].y;
+				inst[chain].x = n.greedy ? chain + 1 : ninst;
+				inst[chain].y = n.greedy ? ninst : chain + 1;
+				chain = next;
+			}
+		}
+		break;
+	}
+}
+
+void rxcompiler_::Analyze(rxprog_* prog, char* prefix)
+// how to find where a match could start
+{
+	const rxinst_* code = prog->inst;
+	prog->skip = RX_SKIP_NONE;
+	prog->prefix = 0;
+	prog->prefixlen = 0;
+	memset(prog->first, 0, sizeof prog->first);
+	if (code[1].op == RX_BOL && !(flags & RX_MULTILINE)) {
+		prog->skip = RX_SKIP_ANCHORED;
+		return;
+	}
+	int pc = 1, n = 0;
+	while (code[pc].op == RX_CHAR) {
+		prefix[n++] = (char)code[pc++].x;
+	}
+	if (n) {
+		prefix[n] = 0;
+		prog->skip = RX_SKIP_PREFIX;
+		prog->prefix = prefix;
+		prog->prefixlen = n;
+		return;
+	}
+	// the bytes any thread can consume first; if one can get to
+	// the match without consuming anything, it can start anywhere
+	int* stack = (int*)malloc(2 * ninst * sizeof(int));
+	char* seen = (char*)calloc(ninst, 1);
+	int sp = 0, c;
+	stack[sp++] = 1;
+	while (sp) {
+		pc = stack[--sp];
+		if (seen[pc]) {
+			continue;
+		}
+		seen[pc] = 1;
+		const rxinst_& in = code[pc];
+		switch (in.op) {
+		case RX_CHAR:
+			SetBit(prog->first, in.x);
+			break;
+		case RX_ANY:
+			for (c = 0; c < 256; c++) {
+				if (!IsNewline(c)) {
+					SetBit(prog->first, c);
+				}
+			}
+			break;
+		case RX_CLASS:
+			for (c = 0; c < 32; c++) {
+				prog->first[c] |= prog->classes[32 * in.x + c];
+			}
+			break;
+		case RX_SPLIT:
+			stack[sp++] = in.y;
+			stack[sp++] = in.x;
+			break;
+		case RX_JMP:
+			stack[sp++] = in.x;
+			break;
+		case RX_MATCH:
+			free(stack);
+			free(seen);
+			return;						// RX_SKIP_NONE
+		default:						// saves and assertions
+			stack[sp++] = pc + 1;
+			break;
+		}
+	}
+	free(stack);
+	free(seen);
+	for (c = 0; c < 32; c++) {
+		if (prog->first[c] != 0xFF) {
+			prog->skip = RX_SKIP_FIRST;
+			break;
+		}
+	}
+}
+
+rxprog_* rxcompiler_::Compile(const char** err)
+{
+	try {
+		int n = Alt();
+		if (p < end) {
+			Fail("unmatched )");
+		}
+		Inst(RX_SAVE, 0);
+		Emit(n);
+		Inst(RX_SAVE, 1);
+		Inst(RX_MATCH);
+	} catch (rxerror_& e) {
+		*err = e.msg;
+		return 0;
+	}
+	// one block: the program, its instructions, classes, source and prefix
+	int srclen = end - src;
+	size_t size = sizeof(rxprog_) + ninst * sizeof(rxinst_) + nclasses * 32 + srclen + 1 + ninst + 1;
+	rxprog_* prog = (rxprog_*)malloc(size);
+	rxinst_* code = (rxinst_*)(prog + 1);
+	unsigned char* bits = (unsigned char*)(code + ninst);
+	char* source = (char*)(bits + nclasses * 32);
+	char* prefix = source + srclen + 1;
+	memcpy(code, inst, ninst * sizeof(rxinst_));
+	if (nclasses) {
+		memcpy(bits, classes, nclasses * 32);
+	}
+	memcpy(source, src, srclen);
+	source[srclen] = 0;
+	prog->source = source;
+	prog->flags = flags;
+	prog->ninst = ninst;
+	prog->inst = code;
+	prog->classes = bits;
+	prog->ngroups = ngroups;
+	Analyze(prog, prefix);
+	return prog;
+}
+
+rxprog_* rxcompile_(const char* source, int len, int flags, const char** err)
+{
+	rxcompiler_ c(source, len, flags);
+	return c.Compile(err);
+}
+
+void rxfree_(rxprog_* prog)
+{
+	free(prog);
+}
+
+/////////////////////////////////////////////////////////////////////
+// Pike VM
+
+struct rxthreads_
+{
+	int		n;
+	int		gen;		// marks[pc]==gen: pc is already on this list
+	int*	pc;
+	int*	caps;		// nsave per thread
+};
+
+class rxvm_
+{
+public:
+	const rxprog_*	prog;
+	const char*		s;
+	int				len;
+	int				nsave;
+	int*			marks;
+
+	void Add(rxthreads_& list, int pc, int* caps, int sp);
+	int Skip(int sp) const;
+};
+
+void rxvm_::Add(rxthreads_& list, int pc, int* caps, int sp)
+// follow pc's empty moves at sp and put the threads that consume
+// on list, in priority order; the first to get to a pc owns it
+{
+	if (marks[pc] == list.gen) {
+		return;
+	}
+	marks[pc] = list.gen;
+	const rxinst_& in = prog->inst[pc];
+	bool ml = (prog->flags & RX_MULTILINE) != 0;
+	switch (in.op) {
+	case RX_JMP:
+		Add(list, in.x, caps, sp);
+		return;
+	case RX_SPLIT:
+		Add(list, in.x, caps, sp);
+		Add(list, in.y, caps, sp);
+		return;
+	case RX_SAVE:
+		{
+			int old = caps[in.x];
+			caps[in.x] = sp;
+			Add(list, pc + 1, caps, sp);
+			caps[in.x] = old;
+		}
+		return;
+	case RX_CLEAR:
+		{
+			int old[2 * (RX_MAXGROUPS + 1)], k;
+			for (k = in.x; k < in.y; k++) {
+				old[k] = caps[k];
+				caps[k] = -1;
+			}
+			Add(list, pc + 1, caps, sp);
+			for (k = in.x; k < in.y; k++) {
+				caps[k] = old[k];
+			}
+		}
+		return;
+	case RX_BOL:
+		if (sp == 0 || (ml && IsNewline(s[sp - 1]))) {
+			Add(list, pc + 1, caps, sp);
+		}
+		return;
+	case RX_EOL:
+		if (sp == len || (ml && IsNewline(s[sp]))) {
+			Add(list, pc + 1, caps, sp);
+		}
+		return;
+	case RX_WORDB:
+	case RX_NWORDB:
+		{
+			bool before = sp > 0 && IsWord((unsigned char)s[sp - 1]);
+			bool after = sp < len && IsWord((unsigned char)s[sp]);
+			if ((before != after) == (in.op == RX_WORDB)) {
+				Add(list, pc + 1, caps, sp);
+			}
+		}
+		return;
+	}
+	memcpy(list.caps + list.n * nsave, caps, nsave * sizeof(int));
+	list.pc[list.n++] = pc;
+}
+
+int rxvm_::Skip(int sp) const
+// the first place at or after sp a match could start, len+1 if none
+{
+	switch (prog->skip) {
+	case RX_SKIP_ANCHORED:
+		return sp == 0 ? 0 : len + 1;
+	case RX_SKIP_PREFIX:
+		{
+			const char* q = s + sp;
+			const char* stop = s + len - prog->prefixlen;
+			while (q <= stop) {
+				q = (const char*)memchr(q, prog->prefix[0], stop - q + 1);
+				if (!q) {
+					break;
+				}
+				if (0==memcmp(q, prog->prefix, prog->prefixlen)) {
+					return q - s;
+				}
+				q++;
+			}
+		}
+		return len + 1;
+	case RX_SKIP_FIRST:
+		while (sp < len && !TestBit(prog->first, (unsigned char)s[sp])) {
+			sp++;
+		}
+		return sp < len ? sp : len + 1;
+	}
+	return sp;
+}
+
+bool rxexec_(const rxprog_* prog, const char* s, int len, int start, int* caps)
+{
+	if (start < 0 || start > len) {
+		return false;
+	}
+	rxvm_ vm;
+	vm.prog = prog;
+	vm.s = s;
+	vm.len = len;
+	vm.nsave = 2 * (prog->ngroups + 1);
+	int n = prog->ninst;
+	int nsave = vm.nsave;
+	// two thread lists, the marks, and a set of captures for new threads
+	int need = 2 * (n + n * nsave) + n + nsave;
+	int local[1024];
+	int* mem = need <= 1024 ? local : (int*)malloc(need * sizeof(int));
+	rxthreads_ lists[2];
+	lists[0].pc = mem;
+	lists[0].caps = mem + n;
+	lists[1].pc = lists[0].caps + n * nsave;
+	lists[1].caps = lists[1].pc + n;
+	vm.marks = lists[1].caps + n * nsave;
+	int* fresh = vm.marks + n;
+	memset(vm.marks, 0, n * sizeof(int));
+	int gen = 0;
+
+	rxthreads_* clist = &lists[0];
+	rxthreads_* nlist = &lists[1];
+	clist->n = 0;
+	bool matched = false;
+	int sp = start;
+	for (;;) {
+		if (!matched) {
+			// a thread starting here comes after all those started earlier
+			if (clist->n == 0) {
+				sp = vm.Skip(sp);
+				if (sp > len) {
+					break;
+				}
+				clist->gen = ++gen;
+			}
+			for (int i = 0; i < nsave; i++) {
+				fresh[i] = -1;
+			}
+			vm.Add(*clist, 0, fresh, sp);
+		}
+		if (clist->n == 0) {
+			if (matched || ++sp > len) {
+				break;
+			}
+			continue;				// nothing starts here
+		}
+		nlist->n = 0;
+		nlist->gen = ++gen;
+		int c = sp < len ? (unsigned char)s[sp] : -1;
+		for (int t = 0; t < clist->n; t++) {
+			const rxinst_& in = prog->inst[clist->pc[t]];
+			int* tcaps = clist->caps + t * nsave;
+			switch (in.op) {
+			case RX_CHAR:
+				if (c == in.x) {
+					vm.Add(*nlist, clist->pc[t] + 1, tcaps, sp + 1);
+				}
+				break;
+			case RX_ANY:
+				if (c >= 0 && !IsNewline(c)) {
+					vm.Add(*nlist, clist->pc[t] + 1, tcaps, sp + 1);
+				}
+				break;
+			case RX_CLASS:
+				if (c >= 0 && TestBit(prog->classes + 32 * in.x, c)) {
+					vm.Add(*nlist, clist->pc[t] + 1, tcaps, sp + 1);
+				}
+				break;
+			case RX_MATCH:
+				// threads after this one have lower priority: drop them
+				matched = true;
+				memcpy(caps, tcaps, nsave * sizeof(int));
+				t = clist->n;
+				break;
+			}
+		}
+		rxthreads_* tmp = clist;
+		clist = nlist;
+		nlist = tmp;
+		if (++sp > len) {
+			break;
+		}
+	}
+	if (mem != local) {
+		free(mem);
+	}
+	return matched;
+}
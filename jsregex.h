@@ -0,0 +1,75 @@
+// jsregex.h - regular expressions
+//
+// A pattern compiles to a program for a Pike VM, which runs all the
+// threads of the pattern's NFA in lock step over the subject: time is
+// linear in the subject (nothing backtracks), and thread priority
+// gives the same leftmost match and captures a backtracking matcher
+// would. js2cpp compiles regex literals when it translates them and
+// emits the program as static data; new RegExp compiles at run time.
+// Neither side knows about value_, so the translator links this too.
+
+#ifndef JSREGEX_H
+#define JSREGEX_H
+
+// instructions
+enum {
+	RX_CHAR,			// the byte x
+	RX_ANY,				// any byte but a line terminator
+	RX_CLASS,			// a byte in bitmap x
+	RX_SPLIT,			// go on at x, and (lower priority) at y
+	RX_JMP,				// go on at x
+	RX_SAVE,			// capture slot x = here
+	RX_BOL,				// ^
+	RX_EOL,				// $
+	RX_WORDB,			// \b
+	RX_NWORDB,			// \B
+	RX_MATCH,
+	RX_CLEAR,			// capture slots x..y-1 = -1 (a repeated atom's groups, each time round)
+};
+
+// flags
+#define RX_GLOBAL		1
+#define RX_ICASE		2
+#define RX_MULTILINE	4
+
+// how a search finds where a match could start
+enum {
+	RX_SKIP_NONE,		// anywhere (the pattern can match empty)
+	RX_SKIP_PREFIX,		// at the literal prefix, by memchr
+	RX_SKIP_FIRST,		// at a byte in first
+	RX_SKIP_ANCHORED,	// only at the start (^ without m)
+};
+
+#define RX_MAXINST		20000		// bigger patterns are refused
+#define RX_MAXGROUPS	99
+
+struct rxinst_
+{
+	int		op;
+	int		x;
+	int		y;
+};
+
+struct rxprog_
+{
+	const char*				source;		// pattern text
+	int						flags;		// RX_GLOBAL...
+	int						ninst;
+	const rxinst_*			inst;
+	const unsigned char*	classes;	// 32-byte bitmaps, RX_CLASS x is at classes + 32*x
+	int						ngroups;	// capturing groups, not counting the whole match
+	int						skip;		// RX_SKIP_...
+	const char*				prefix;		// RX_SKIP_PREFIX: every match starts with this
+	int						prefixlen;
+	unsigned char			first[32];	// RX_SKIP_FIRST: bytes a match can start with
+};
+
+int rxflags_(const char* flags);		// RX_ flags for "gim" letters, -1 if bad
+rxprog_* rxcompile_(const char* source, int len, int flags, const char** err);
+	// NULL and an error message if the pattern is bad or not supported
+void rxfree_(rxprog_* prog);			// only for what rxcompile_ made
+bool rxexec_(const rxprog_* prog, const char* s, int len, int start, int* caps);
+	// leftmost match in s[start..len); caps gets 2*(ngroups+1) offsets,
+	// start and end of the match then of each group, -1 if it didn't take part
+
+#endif
@@ -0,0 +1,522 @@
+// jsregexp.cpp - RegExp objects, and the String methods that take one
+//
+// The matching is jsregex.cpp's. A regex literal was compiled by
+// js2cpp and its program is static data, so rx_ only wraps it;
+// new RegExp compiles at run time.
+
+#ifdef _WIN32
+#include "windows.h"
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "jscpprt.h"
+#include "jsrtpriv.h"
+#include "sugar.h"
+
+#define NCAPS (2 * (RX_MAXGROUPS + 1))
+
+class regexp_ : public obj_
+{
+public:
+	regexp_(const rxprog_* p) : obj_("RegExp"), prog(p), lastIndex(0) {}
+
+	virtual value_ dot(const char* id);
+	virtual value_& dotref(const char* id);
+
+	const rxprog_*	prog;
+	value_			lastIndex;
+};
+
+static regexp_* AsRegExp(const value_& v)
+// the RegExp v is, or NULL
+{
+	if (v.t==value_::TOBJ && 0==strcmp(v.v.o->Class(), "RegExp")) {
+		return (regexp_*)v.v.o;
+	}
+	return NULL;
+}
+
+static const rxprog_* Compile(const char* source, int flags)
+{
+	const char* err;
+	rxprog_* prog = rxcompile_(source, strlen(source), flags, &err);
+	if (!prog) {
+		throw SyntaxError();
+	}
+	return prog;
+}
+
+static value_ arg(int i, int nargs, value_* argv)
+{
+	return i < nargs ? argv[i] : undefined;
+}
+
+static value_ Substr(const char* s, int n)
+// a new string, the n chars at s
+{
+	char* t = (char*)malloc(n + 1);
+	HEAPALLOC_(t, n + 1);
+	memcpy(t, s, n);
+	t[n] = 0;
+	return value_(t);
+}
+
+static value_ Capture(const char* s, const int* caps, int i)
+// group i of a match, undefined if it didn't take part
+{
+	if (caps[2 * i] < 0) {
+		return undefined;
+	}
+	return Substr(s + caps[2 * i], caps[2 * i + 1] - caps[2 * i]);
+}
+
+static value_ MatchArray(const rxprog_* prog, const char* s, const int* caps)
+// what exec returns: the match, its groups, index and input
+{
+	array_* a = new array_();
+	a->Reserve(prog->ngroups + 1);
+	for (int i = 0; i <= prog->ngroups; i++) {
+		a->atref(i) = Capture(s, caps, i);
+	}
+	a->dotref(intern_("index")) = value_(caps[0]);
+	a->dotref(intern_("input")) = value_(s);
+	return value_(a);
+}
+
+static int Next(const int* caps)
+// where to look for the match after this one
+{
+	return caps[1] > caps[0] ? caps[1] : caps[1] + 1;
+}
+
+// a string being built
+class strbuf_
+{
+public:
+	strbuf_() : buf(0), len(0), cap(0) {}
+	void Add(const char* s, int n);
+	value_ Finish(void);
+private:
+	char*	buf;
+	int		len;
+	int		cap;
+};
+
+void strbuf_::Add(const char* s, int n)
+{
+	if (len + n + 1 > cap) {
+		cap = 2 * cap > len + n + 1 ? 2 * cap : len + n + 64;
+		buf = (char*)realloc(buf, cap);
+	}
+	memcpy(buf + len, s, n);
+	len += n;
+}
+
+value_ strbuf_::Finish(void)
+{
+	Add("", 0);
+	buf[len] = 0;
+	return value_(buf);
+}
+
+/////////////////////////////////////////////////////////////////////
+// RegExp.prototype
+
+static value_ Exec(regexp_* re, const char* s)
+// re.exec(s); a global re starts at, and moves, lastIndex
+{
+	int len = strlen(s);
+	int start = 0;
+	bool global = (re->prog->flags & RX_GLOBAL) != 0;
+	if (global) {
+		double i = re->lastIndex.toNumber();
+		if (i != i) {
+			i = 0;
+		}
+		if (i < 0 || i > len) {
+			re->lastIndex = value_(0);
+			return null_;
+		}
+		start = (int)i;
+	}
+	int caps[NCAPS];
+	if (!rxexec_(re->prog, s, len, start, caps)) {
+		if (global) {
+			re->lastIndex = value_(0);
+		}
+		return null_;
+	}
+	if (global) {
+		re->lastIndex = value_(caps[1]);
+	}
+	return MatchArray(re->prog, s, caps);
+}
+
+class regexpmethod_ : public func_ {
+public:
+	typedef value_ (*FN)(regexp_* re, value_ s);
+	JS_CONSTEXPR regexpmethod_(FN f) : func_(1), fn(f) {}
+	virtual value_ call(value_ this_, int nargs, ...)
+	{
+		regexp_* re = AsRegExp(this_);
+		if (!re) {
+			throw TypeError();
+		}
+		return fn(re, arg(0, nargs, ARGV_(nargs)));
+	}
+private:
+	FN fn;
+};
+
+static value_ js_exec(regexp_* re, value_ s)
+{
+	return Exec(re, s.toString());
+}
+
+static value_ js_test(regexp_* re, value_ s)
+{
+	return value_(Exec(re, s.toString()).t != value_::TNULL);
+}
+
+static regexpmethod_ exec_(js_exec), test_(js_test);
+
+value_ regexp_::dot(const char* id)
+{
+	if (0==strcmp(id, "exec")) {
+		return value_(&exec_);
+	}
+	if (0==strcmp(id, "test")) {
+		return value_(&test_);
+	}
+	if (0==strcmp(id, "lastIndex")) {
+		return lastIndex;
+	}
+	if (0==strcmp(id, "source")) {
+		return value_(prog->source);
+	}
+	if (0==strcmp(id, "global")) {
+		return value_((prog->flags & RX_GLOBAL) != 0);
+	}
+	if (0==strcmp(id, "ignoreCase")) {
+		return value_((prog->flags & RX_ICASE) != 0);
+	}
+	if (0==strcmp(id, "multiline")) {
+		return value_((prog->flags & RX_MULTILINE) != 0);
+	}
+	return obj_::dot(id);
+}
+
+value_& regexp_::dotref(const char* id)
+{
+	if (0==strcmp(id, "lastIndex")) {
+		return lastIndex;
+	}
+	return obj_::dotref(id);
+}
+
+value_ rx_(const rxprog_* prog)
+// a regex literal: a new object each time, sharing the program
+{
+	return value_(new regexp_(prog));
+}
+
+class RegExp_class_ : public func_ {
+public:
+	JS_CONSTEXPR RegExp_class_() : func_(2) {}
+	virtual value_ call(value_ this_, int nargs, ...)
+	{
+		value_* argv = ARGV_(nargs);
+		value_ pattern = arg(0, nargs, argv);
+		value_ flags = arg(1, nargs, argv);
+		regexp_* re = AsRegExp(pattern);
+		if (re && flags.isUndefined()) {
+			return value_(new regexp_(re->prog));
+		}
+		int f = flags.isUndefined() ? 0 : rxflags_(flags.toString());
+		if (f < 0) {
+			throw SyntaxError();
+		}
+		const char* source = re ? re->prog->source : pattern.isUndefined() ? "" : pattern.toString();
+		return value_(new regexp_(Compile(source, f)));
+	}
+};
+
+static RegExp_class_ RegExp_func_;
+value_ RegExp(&RegExp_func_);
+
+static regexp_* ToRegExp(value_ v)
+// the pattern argument of match and search
+{
+	regexp_* re = AsRegExp(v);
+	if (!re) {
+		re = new regexp_(Compile(v.isUndefined() ? "" : v.toString(), 0));
+	}
+	return re;
+}
+
+/////////////////////////////////////////////////////////////////////
+// String.prototype methods that take patterns
+
+static value_ js_match(const char* s, int nargs, value_* argv)
+{
+	regexp_* re = ToRegExp(arg(0, nargs, argv));
+	if (!(re->prog->flags & RX_GLOBAL)) {
+		return Exec(re, s);
+	}
+	// global: every match
+	int len = strlen(s);
+	int caps[NCAPS];
+	array_* a = NULL;
+	int n = 0;
+	for (int pos = 0; pos <= len && rxexec_(re->prog, s, len, pos, caps); pos = Next(caps)) {
+		if (!a) {
+			a = new array_();
+		}
+		a->atref(n++) = Capture(s, caps, 0);
+	}
+	re->lastIndex = value_(0);
+	return a ? value_(a) : null_;
+}
+
+static value_ js_search(const char* s, int nargs, value_* argv)
+{
+	regexp_* re = ToRegExp(arg(0, nargs, argv));
+	int caps[NCAPS];
+	if (!rxexec_(re->prog, s, strlen(s), 0, caps)) {
+		return value_(-1);
+	}
+	return value_(caps[0]);
+}
+
+static void Expand(strbuf_& out, const char* rep, const char* s, int len, const int* caps, int ngroups)
+// replacement text rep with $$ $& $` $' $n $nn
+{
+	const char* p = rep;
+	while (*p) {
+		const char* dollar = strchr(p, '$');
+		if (!dollar) {
+			out.Add(p, strlen(p));
+			break;
+		}
+		out.Add(p, dollar - p);
+		p = dollar + 1;
+		char c = *p;
+		if (c=='$') {
+			out.Add("$", 1);
+			p++;
+		} else if (c=='&') {
+			out.Add(s + caps[0], caps[1] - caps[0]);
+			p++;
+		} else if (c=='`') {
+			out.Add(s, caps[0]);
+			p++;
+		} else if (c=='\'') {
+			out.Add(s + caps[1], len - caps[1]);
+			p++;
+		} else if (c >= '0' && c <= '9') {
+			int g = c - '0';
+			int digits = 1;
+			if (p[1] >= '0' && p[1] <= '9' && 10 * g + (p[1] - '0') <= ngroups) {
+				g = 10 * g + (p[1] - '0');
+				digits = 2;
+			}
+			if (g >= 1 && g <= ngroups) {
+				if (caps[2 * g] >= 0) {
+					out.Add(s + caps[2 * g], caps[2 * g + 1] - caps[2 * g]);
+				}
+				p += digits;
+			} else {
+				out.Add("$", 1);
+			}
+		} else {
+			out.Add("$", 1);
+		}
+	}
+}
+
+static value_ CallReplacer(func_* fn, const char* s, const int* caps, int ngroups)
+// fn(match, p1, ..., pn, offset, string)
+{
+	value_ a[8];
+	int n = 0;
+	if (ngroups + 3 > LENGTH(a)) {
+		throw not_imp();
+	}
+	for (int i = 0; i <= ngroups; i++) {
+		a[n++] = Capture(s, caps, i);
+	}
+	a[n++] = value_(caps[0]);
+	a[n++] = value_(s);
+	return callv_(fn, global_, n, a);
+}
+
+static value_ js_replace(const char* s, int nargs, value_* argv)
+{
+	value_ pattern = arg(0, nargs, argv);
+	value_ replacement = arg(1, nargs, argv);
+	func_* fn = replacement.t==value_::TFUNC ? replacement.v.f : NULL;
+	const char* rep = fn ? "" : replacement.toString();
+	int len = strlen(s);
+	int caps[NCAPS];
+	int ngroups = 0;
+	bool global = false;
+	regexp_* re = AsRegExp(pattern);
+	strbuf_ out;
+	int last = 0;						// end of the last match
+	int pos = 0;
+	for (;;) {
+		if (re) {
+			if (pos > len || !rxexec_(re->prog, s, len, pos, caps)) {
+				break;
+			}
+			ngroups = re->prog->ngroups;
+			global = (re->prog->flags & RX_GLOBAL) != 0;
+		} else {
+			// a string pattern: its first occurrence
+			const char* find = pattern.toString();
+			const char* at = strstr(s, find);
+			if (!at) {
+				break;
+			}
+			caps[0] = at - s;
+			caps[1] = caps[0] + strlen(find);
+		}
+		out.Add(s + last, caps[0] - last);
+		if (fn) {
+			const char* r = CallReplacer(fn, s, caps, ngroups).toString();
+			out.Add(r, strlen(r));
+		} else {
+			Expand(out, rep, s, len, caps, ngroups);
+		}
+		last = caps[1];
+		if (!global) {
+			break;
+		}
+		pos = Next(caps);
+	}
+	if (re && (re->prog->flags & RX_GLOBAL)) {
+		re->lastIndex = value_(0);
+	}
+	out.Add(s + last, len - last);
+	return out.Finish();
+}
+
+static int CharLength(const char* s)
+// bytes in the UTF-8 character at s
+{
+	unsigned char c = *s;
+	int n = c < 0xC0 ? 1 : c < 0xE0 ? 2 : c < 0xF0 ? 3 : 4;
+	for (int i = 1; i < n; i++) {
+		if (!s[i]) {
+			return i;
+		}
+	}
+	return n;
+}
+
+static value_ js_split(const char* s, int nargs, value_* argv)
+{
+	value_ sep = arg(0, nargs, argv);
+	value_ lim = arg(1, nargs, argv);
+	unsigned limit = lim.isUndefined() ? 0xFFFFFFFF : (unsigned)lim.toNumber();
+	array_* a = new array_();
+	int n = 0;
+	if (limit == 0) {
+		return value_(a);
+	}
+	int len = strlen(s);
+	if (sep.isUndefined()) {
+		a->atref(0) = value_(s);
+		return value_(a);
+	}
+	regexp_* re = AsRegExp(sep);
+	if (re) {
+		int caps[NCAPS];
+		if (len == 0) {
+			if (!rxexec_(re->prog, s, 0, 0, caps)) {
+				a->atref(0) = value_(s);
+			}
+			return value_(a);
+		}
+		int p = 0, q = 0;				// end of the last piece, where to look next
+		while (q < len && rxexec_(re->prog, s, len, q, caps) && caps[0] < len) {
+			if (caps[1] == p) {
+				q = caps[0] + 1;		// empty match where the last piece ended
+				continue;
+			}
+			a->atref(n++) = Substr(s + p, caps[0] - p);
+			if ((unsigned)n == limit) {
+				return value_(a);
+			}
+			for (int i = 1; i <= re->prog->ngroups; i++) {
+				a->atref(n++) = Capture(s, caps, i);
+				if ((unsigned)n == limit) {
+					return value_(a);
+				}
+			}
+			p = q = caps[1];
+		}
+		a->atref(n) = Substr(s + p, len - p);
+		return value_(a);
+	}
+	const char* t = sep.toString();
+	int tlen = strlen(t);
+	if (tlen == 0) {
+		// every character
+		for (int i = 0; i < len && (unsigned)n < limit; ) {
+			int c = CharLength(s + i);
+			a->atref(n++) = Substr(s + i, c);
+			i += c;
+		}
+		return value_(a);
+	}
+	const char* p = s;
+	const char* at;
+	while ((at = strstr(p, t)) != NULL) {
+		a->atref(n++) = Substr(p, at - p);
+		if ((unsigned)n == limit) {
+			return value_(a);
+		}
+		p = at + tlen;
+	}
+	a->atref(n) = Substr(p, s + len - p);
+	return value_(a);
+}
+
+class strmethod_ : public func_ {
+public:
+	typedef value_ (*FN)(const char* s, int nargs, value_* argv);
+	JS_CONSTEXPR strmethod_(FN f, int len) : func_(len), fn(f) {}
+	virtual value_ call(value_ this_, int nargs, ...)
+	{
+		return fn(this_.toString(), nargs, ARGV_(nargs));
+	}
+private:
+	FN fn;
+};
+
+static strmethod_ match_(js_match, 1), replace_(js_replace, 2),
+					search_(js_search, 1), split_(js_split, 2);
+
+static const struct {
+	const char*	name;
+	func_*		fn;
+} string_methods[] = {
+	{ "match", &match_ },		{ "replace", &replace_ },
+	{ "search", &search_ },		{ "split", &split_ },
+};
+
+value_ strdot_(const char* s, const char* id)
+{
+	if (0==strcmp(id, "length")) {
+		return value_((int)strlen(s));
+	}
+	for (int i = 0; i < LENGTH(string_methods); i++) {
+		if (0==strcmp(id, string_methods[i].name)) {
+			return value_(string_methods[i].fn);
+		}
+	}
+	// TODO: the rest of String.prototype
+	return undefined;
+}
@@ -0,0 +1,215 @@
+// jsrtpriv.h - runtime internals shared by the jscpprt modules
+//
+// Not for inclusion by generated code: the class names here
+// collide with the JS globals of the same name.
+
+#ifndef JSRTPRIV_H
+#define JSRTPRIV_H
+
+#include <exception>
+#ifdef _WIN32
+#include "windows.h"
+#else
+#include <sched.h>
+#include <math.h>
+// the MSVC names for these
+#define _finite(d)		isfinite(d)
+#define _isnan(d)		isnan(d)
+#define _copysign(x, y)	copysign(x, y)
+#endif
+
+// 64-bit unsigned, and constants of that type
+#ifdef _MSC_VER
+typedef unsigned __int64 uint64_;
+#define U64_(c) c##ui64
+#else
+typedef unsigned long long uint64_;
+#define U64_(c) c##ULL
+#endif
+
+// Operation counters (jsstats.cpp), when the runtime is built with
+// JS_STATS; otherwise STAT_ is nothing. Each thread counts into its
+// own block; at exit the sums are reported to stderr, most first, and
+// written as JSON to the file named by the JS_STATS environment
+// variable (jsstats.json if it isn't set).
+#define STAT_LIST_(X)												\
+	X(DOT,			"lookup dot")									\
+	X(DOTREF,		"lookup dotref")								\
+	X(AT,			"lookup at")									\
+	X(ATREF,		"lookup atref")									\
+	X(PUT,			"lookup put")									\
+	X(DOTCALL,		"call dotcall")									\
+	X(ELTCALL,		"call eltcall")									\
+	X(CALLV,		"call callv_")									\
+	X(CONSTRUCT,	"call construct_")								\
+	X(SLOT_HIT,		"find in slot")									\
+	X(PROP_HIT,		"find in property list")						\
+	X(FIND_MISS,	"find missed (undefined or added)")				\
+	X(PROP_ADD,		"find added a property")						\
+	X(SLOT_PROBE,	"probe slot")									\
+	X(PROP_PROBE,	"probe property list")							\
+	X(PROTO_HOP,	"probe prototype")								\
+	X(INDEX,		"array index")									\
+	X(INDEX_KEY,	"array non-index key")							\
+	X(ATOM_FIND,	"atom lookup")									\
+	X(ATOM_NEW,		"atom added")									\
+	X(ATOM_PROBE,	"atom probe")									\
+	X(SHAPE_HIT,	"JSON shape cache hit")							\
+	X(SHAPE_MISS,	"JSON shape cache miss")						\
+	X(NUM_TO_STR,	"convert number toString")						\
+	X(OBJ_TO_STR,	"convert object toString")						\
+	X(STR_TO_NUM,	"convert string toNumber")						\
+	X(ALLOC_OBJ,	"alloc object (any kind)")						\
+	X(OBJ_BYTES,	"alloc object bytes")							\
+	X(ALLOC_SHAPED,	"alloc object with slots")						\
+	X(ALLOC_ARRAY,	"alloc array")									\
+	X(ALLOC_BUFFER,	"alloc ArrayBuffer")							\
+	X(BUFFER_BYTES,	"alloc ArrayBuffer bytes")						\
+	X(ALLOC_VIEW,	"alloc typed array or DataView")				\
+	X(ALLOC_CLOSURE,"alloc closure")								\
+	X(ALLOC_STRING,	"alloc string")									\
+	X(STRING_BYTES,	"alloc string bytes")							\
+	X(THROW_TYPE,	"throw TypeError")								\
+	X(THROW_RANGE,	"throw RangeError")								\
+	X(THROW_SYNTAX,	"throw SyntaxError")							\
+	X(THROW_OPERAND,"throw incompatible operand")					\
+	X(THROW_ALLOC,	"throw bad_alloc")								\
+	X(THROW_NOTIMP,	"throw not_imp")								\
+	X(THROW_IO,		"throw io_error")
+
+#ifdef JS_STATS
+#define STAT_ENUM_(id, name)	STAT_##id,
+enum { STAT_LIST_(STAT_ENUM_) STAT_COUNT };
+#undef STAT_ENUM_
+
+extern JS_THREAD uint64_* stats_;		// this thread's counters
+uint64_* statsblock_(void);				// ... made on first use
+#define STATN_(c, n)	((stats_ ? stats_ : statsblock_())[STAT_##c] += (n))
+#else
+#define STATN_(c, n)	((void)0)
+#endif
+#define STAT_(c)		STATN_(c, 1)
+
+// Heap profile (jsheap.cpp): what the runtime allocates for JS, and
+// frees, while the program has an allocation site (--heapprof)
+void heapalloc_(void* p, size_t n);
+void heapfree_(void* p);
+extern JS_THREAD void* heaplive_;		// this thread's sampled blocks, if any
+#define HEAPALLOC_(p, n)	(allocsite_ ? heapalloc_((p), (n)) : (void)0)
+#define HEAPFREE_(p)		(heaplive_ ? heapfree_(p) : (void)0)
+
+class TypeError : public std::exception {
+public:
+	TypeError() { STAT_(THROW_TYPE); }
+	virtual const char* what() const throw() { return "TypeError"; }
+};
+
+class RangeError : public std::exception {
+public:
+	RangeError() { STAT_(THROW_RANGE); }
+	virtual const char* what() const throw() { return "RangeError"; }
+};
+
+class SyntaxError : public std::exception {
+public:
+	SyntaxError() { STAT_(THROW_SYNTAX); }
+	virtual const char* what() const throw() { return "SyntaxError"; }
+};
+
+class incomp_operand : public std::exception {
+public:
+	incomp_operand() { STAT_(THROW_OPERAND); }
+	virtual const char *what() const throw() { return "incompatible operand"; }
+};
+
+class bad_alloc : public std::exception {
+public:
+	bad_alloc() { STAT_(THROW_ALLOC); }
+	virtual const char *what() const throw() { return "memory allocation failed"; }
+};
+
+class not_imp : public std::exception {
+public:
+	not_imp() { STAT_(THROW_NOTIMP); }
+	virtual const char *what() const throw() { return "unimplemented feature"; }
+};
+
+class io_error : public std::exception {
+public:
+	io_error() { STAT_(THROW_IO); }
+	virtual const char *what() const throw() { return "cannot open file"; }
+};
+
+// Atomic operations, for what threads share
+#ifdef _WIN32
+inline long atomicswap_(volatile long* p, long v) { return InterlockedExchange((long*)p, v); }
+inline long atomicadd_(volatile long* p, long d) { return InterlockedExchangeAdd((long*)p, d) + d; }
+inline void yield_(void) { Sleep(0); }
+#else
+inline long atomicswap_(volatile long* p, long v) { return __sync_lock_test_and_set(p, v); }
+inline long atomicadd_(volatile long* p, long d) { return __sync_add_and_fetch(p, d); }
+inline void yield_(void) { sched_yield(); }
+#endif
+
+// a lock for short critical sections, taken only while other threads
+// run JS, isolates or the parallel pool's (nthreads_ counts them, and
+// goes up before they start)
+extern volatile long nthreads_;
+
+class spinlock_ {
+public:
+	spinlock_(volatile long& l) : lock(nthreads_ ? &l : 0)
+	{
+		if (lock) {
+			while (atomicswap_(lock, 1)) {
+				yield_();
+			}
+		}
+	}
+	~spinlock_() { if (lock) atomicswap_(lock, 0); }
+private:
+	volatile long*	lock;
+};
+
+// While isolates run (nisolates_ > 1), the static function objects
+// (the program's top-level functions, the built-ins) and the built-in
+// objects are every isolate's, so each isolate keeps their properties
+// in its own table (func_::Own, builtin_::Own); a parallel job's
+// workers use their caller's
+extern int nisolates_;			// copies runisolates_ runs, 1 if it doesn't
+struct ownprops_;
+extern JS_THREAD ownprops_* ownpropsp_;
+obj_* ownprops_find_(const obj_* o, bool make);	// o's in this isolate, or NULL
+
+class builtin_ : public obj_
+{	// Math, JSON, console...: a static object, its methods answered by
+	// the subclass's dot, whatever a program stores on it in Own()
+public:
+	JS_CONSTEXPR builtin_(const char* klass) : obj_(klass) {}
+	virtual value_ dot(const char* id);
+	virtual value_& dotref(const char* id);
+	virtual value_ at(value_ x);
+	virtual value_& atref(value_ x);
+private:
+	obj_* Own(bool make);
+};
+
+// Number to string as ECMAScript does it (shortest text that reads
+// back as d). buf must hold FMTNUM_MAX chars; returns the length.
+#define FMTNUM_MAX 32
+int fmtnum_(double d, char* buf);
+
+// object with shape's keys, its slots copied from values, all in one
+// allocation
+obj_* NewShaped_(const shape_* shape, const value_* values);
+
+// property id of the string s: length, or a String.prototype method
+value_ strdot_(const char* s, const char* id);
+
+// f called with the nargs values at argv (at most 8)
+value_ callv_(func_* f, value_ this_, int nargs, const value_* argv);
+
+// arguments of a func_::call, by index
+#define ARGV_(nargs) ((value_*)(&(nargs)+1))
+
+#endif
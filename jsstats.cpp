@@ -0,0 +1,133 @@
+// jsstats.cpp - operation counters (JS_STATS builds only)
+//
+// STAT_ (jsrtpriv.h) counts into a block per thread; the blocks are
+// linked up so the report can add them together at exit. Counts from
+// pool threads still running then may be a little behind.
+
+#ifdef JS_STATS
+
+#ifdef _WIN32
+#include "windows.h"
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "jscpprt.h"
+#include "jsrtpriv.h"
+
+struct counters_
+{
+	counters_*	next;
+	uint64_		n[STAT_COUNT];
+};
+
+#define STAT_NAME_(id, name)	name,
+static const char* const names[STAT_COUNT] = { STAT_LIST_(STAT_NAME_) };
+#undef STAT_NAME_
+
+JS_THREAD uint64_* stats_;
+static counters_*		blocks;
+static volatile long	lock;
+static long				registered;
+
+static void Report(void);
+
+static void Register(void)
+{
+	atexit(Report);
+}
+
+uint64_* statsblock_(void)
+{
+	once_(&registered, Register);
+	counters_* b = (counters_*)calloc(1, sizeof(counters_));
+	if (!b) {
+		throw bad_alloc();
+	}
+	{
+		spinlock_ hold(lock);
+		b->next = blocks;
+		blocks = b;
+	}
+	stats_ = b->n;
+	return stats_;
+}
+
+static double	total[STAT_COUNT];
+static int		order[STAT_COUNT];
+
+static double Double(uint64_ n)
+// (MSVC 6 can't convert an unsigned __int64)
+{
+#ifdef _MSC_VER
+	return (double)(__int64)n;
+#else
+	return (double)n;
+#endif
+}
+
+static int ByCount(const void* a, const void* b)
+// most first, then in list order
+{
+	int i = *(const int*)a, j = *(const int*)b;
+	if (total[i] != total[j]) {
+		return total[i] > total[j] ? -1 : 1;
+	}
+	return i - j;
+}
+
+static double Per(double n, double per)
+{
+	return per ? n / per : 0;
+}
+
+static void Report(void)
+{
+	flushout_();
+	int i;
+	for (i = 0; i < STAT_COUNT; i++) {
+		uint64_ n = 0;
+		spinlock_ hold(lock);
+		for (counters_* b = blocks; b; b = b->next) {
+			n += b->n[i];
+		}
+		total[i] = Double(n);
+		order[i] = i;
+	}
+	qsort(order, STAT_COUNT, sizeof order[0], ByCount);
+
+	fprintf(stderr, "JS_STATS: runtime operation counts\n");
+	for (i = 0; i < STAT_COUNT && total[order[i]]; i++) {
+		fprintf(stderr, "%14.0f  %s\n", total[order[i]], names[order[i]]);
+	}
+	double finds = total[STAT_SLOT_HIT] + total[STAT_PROP_HIT] + total[STAT_FIND_MISS];
+	if (finds) {
+		fprintf(stderr, "  finds: %.1f%% in slots; %.2f slot probes, %.2f property list probes, %.2f prototype hops each\n",
+			100 * Per(total[STAT_SLOT_HIT], finds), Per(total[STAT_SLOT_PROBE], finds),
+			Per(total[STAT_PROP_PROBE], finds), Per(total[STAT_PROTO_HOP], finds));
+	}
+	if (total[STAT_ATOM_FIND]) {
+		fprintf(stderr, "  atoms: %.2f probes a lookup\n", Per(total[STAT_ATOM_PROBE], total[STAT_ATOM_FIND]));
+	}
+	if (total[STAT_ALLOC_STRING]) {
+		fprintf(stderr, "  strings: %.1f bytes each\n", Per(total[STAT_STRING_BYTES], total[STAT_ALLOC_STRING]));
+	}
+
+	const char* path = getenv("JS_STATS");
+	if (!path || !*path) {
+		path = "jsstats.json";
+	}
+	FILE* f = fopen(path, "w");
+	if (!f) {
+		fprintf(stderr, "JS_STATS: cannot write %s\n", path);
+		return;
+	}
+	fprintf(f, "{");
+	for (i = 0; i < STAT_COUNT; i++) {
+		fprintf(f, "%s\n\"%s\": %.0f", i ? "," : "", names[order[i]], total[order[i]]);
+	}
+	fprintf(f, "\n}\n");
+	fclose(f);
+}
+
+#endif
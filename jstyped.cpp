@@ -0,0 +1,497 @@
+// jstyped.cpp - ArrayBuffer, typed arrays and DataView
+//
+// Element storage is raw memory owned by an arraybuffer_, so
+// a Float64Array of n elements costs 8n bytes, not n props.
+
+#ifdef _WIN32
+#include "windows.h"
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "jscpprt.h"
+#include "jsrtpriv.h"
+#include "sugar.h"
+
+static void* aligned_alloc_(long n)
+// n bytes, zero-filled, 16-byte aligned (so SIMD loads are legal)
+{
+	void* p;
+#ifdef _WIN32
+	p = _aligned_malloc(n ? n : 1, 16);
+#else
+	if (posix_memalign(&p, 16, n ? n : 1) != 0) {
+		p = NULL;
+	}
+#endif
+	if (!p) {
+		throw bad_alloc();
+	}
+	memset(p, 0, n);
+	return p;
+}
+
+static void aligned_free_(void* p)
+{
+#ifdef _WIN32
+	_aligned_free(p);
+#else
+	free(p);
+#endif
+}
+
+static long ToIndex(const value_& x)
+// argument used as a length or offset: must be a non-negative integer
+{
+	double d = x.isUndefined() ? 0 : x.toNumber();
+	if (d != d) {
+		return 0;					// NaN counts as 0
+	}
+	if (d < 0 || d >= LONG_MAX || (long)d != d) {
+		throw RangeError();
+	}
+	return (long)d;
+}
+
+static long ByteEnd(long offset, long n, int size)
+// offset + n elements of size bytes, if that fits in a long
+{
+	if (n < 0 || n > (LONG_MAX - offset) / size) {
+		throw RangeError();
+	}
+	return offset + n*size;
+}
+
+// no RTTI in our builds, so test the [[Class]] instead of dynamic_cast:
+
+static arraybuffer_* AsBuffer(const value_& x)
+{
+	if (x.t==value_::TOBJ && 0==strcmp(x.v.o->Class(), "ArrayBuffer")) {
+		return (arraybuffer_*)x.v.o;
+	}
+	return NULL;
+}
+
+static typedarray_* AsTyped(const value_& x)
+{
+	if (x.t==value_::TOBJ) {
+		// typed array classes are all "...Array", but not "Array" itself
+		const char* k = x.v.o->Class();
+		size_t n = strlen(k);
+		if (n > 5 && 0==strcmp(k+n-5, "Array")) {
+			return (typedarray_*)x.v.o;
+		}
+	}
+	return NULL;
+}
+
+static dataview_* AsDataView(const value_& x)
+{
+	if (x.t==value_::TOBJ && 0==strcmp(x.v.o->Class(), "DataView")) {
+		return (dataview_*)x.v.o;
+	}
+	return NULL;
+}
+
+/////////////////////////////////////////////////////////////////////
+// ArrayBuffer
+
+arraybuffer_::arraybuffer_(long n)
+: data(aligned_alloc_(n)), byteLength(n), views(NULL)
+{
+	klass = "ArrayBuffer";
+	STAT_(ALLOC_BUFFER);
+	STATN_(BUFFER_BYTES, n);
+	HEAPALLOC_(data, n);
+}
+
+arraybuffer_::arraybuffer_(void* p, long n)
+: data(p), byteLength(n), views(NULL)
+{
+	klass = "ArrayBuffer";
+}
+
+void* arraybuffer_::Detach(void)
+{
+	void* p = data;
+	data = NULL;
+	byteLength = 0;
+	for (typedarray_* t = views; t; t = t->nextView) {
+		t->data = NULL;
+		t->length = 0;
+		t->byteOffset = 0;
+	}
+	return p;
+}
+
+arraybuffer_::~arraybuffer_()
+{
+	HEAPFREE_(data);
+	aligned_free_(data);
+}
+
+value_ arraybuffer_::dot(const char* id)
+{
+	if (0==strcmp(id, "byteLength")) {
+		return value_(byteLength);
+	}
+	return obj_::dot(id);
+}
+
+class ArrayBuffer_class_ : public func_ {
+public:
+	JS_CONSTEXPR ArrayBuffer_class_() : func_(1) {}
+	virtual value_ call(value_ this_, int nargs, ...)
+	{
+		long n = nargs > 0 ? ToIndex(ARGV_(nargs)[0]) : 0;
+		return value_(new arraybuffer_(n));
+	}
+};
+static ArrayBuffer_class_ ArrayBuffer_func_;
+value_ ArrayBuffer(&ArrayBuffer_func_);
+
+/////////////////////////////////////////////////////////////////////
+// Typed arrays
+
+int typedarray_::ElementSize(KIND k)
+{
+	switch (k) {
+	case INT8:
+	case UINT8:
+	case UINT8C:
+		return 1;
+	case INT16:
+	case UINT16:
+		return 2;
+	case INT32:
+	case UINT32:
+	case FLOAT32:
+		return 4;
+	default:
+		return 8;
+	} // switch
+}
+
+static const char* const typed_names[] = {
+	"Int8Array", "Uint8Array", "Uint8ClampedArray", "Int16Array", "Uint16Array",
+	"Int32Array", "Uint32Array", "Float32Array", "Float64Array"
+};
+
+typedarray_::typedarray_(KIND k, arraybuffer_* buf, long offset, long n)
+: kind(k), buffer(buf), byteOffset(offset), length(n), nextView(NULL)
+{
+	klass = typed_names[k];
+	STAT_(ALLOC_VIEW);
+	data = (char*)buf->data + offset;
+}
+
+static typedarray_* NewView(typedarray_::KIND k, arraybuffer_* buf, long offset, long n)
+// a typed array the buffer knows about, to empty it if it's detached
+{
+	typedarray_* t = new typedarray_(k, buf, offset, n);
+	t->nextView = buf->views;
+	buf->views = t;
+	return t;
+}
+
+double typedarray_::get(long i) const
+{
+	switch (kind) {
+	case INT8:		return ((signed char*)data)[i];
+	case UINT8:
+	case UINT8C:	return ((unsigned char*)data)[i];
+	case INT16:		return ((short*)data)[i];
+	case UINT16:	return ((unsigned short*)data)[i];
+	case INT32:		return ((int*)data)[i];
+	case UINT32:	return ((unsigned int*)data)[i];
+	case FLOAT32:	return ((float*)data)[i];
+	default:		return ((double*)data)[i];
+	} // switch
+}
+
+void typedarray_::set(long i, double d)
+{
+	switch (kind) {
+	case INT8:		((signed char*)data)[i] = (signed char)toint32_(d); break;
+	case UINT8:		((unsigned char*)data)[i] = (unsigned char)toint32_(d); break;
+	case UINT8C:	((unsigned char*)data)[i] = clamp8_(d); break;
+	case INT16:		((short*)data)[i] = (short)toint32_(d); break;
+	case UINT16:	((unsigned short*)data)[i] = (unsigned short)toint32_(d); break;
+	case INT32:		((int*)data)[i] = (int)toint32_(d); break;
+	case UINT32:	((unsigned int*)data)[i] = (unsigned int)toint32_(d); break;
+	case FLOAT32:	((float*)data)[i] = (float)d; break;
+	default:		((double*)data)[i] = d; break;
+	} // switch
+}
+
+static bool ElementIndex(const value_& x, long len, long& i)
+// Is x an in-range integer index? (strings like "3" count too)
+{
+	double d = x.toNumber();
+	i = (long)d;
+	return i == d && i >= 0 && i < len;
+}
+
+value_ typedarray_::dot(const char* id)
+{
+	if (0==strcmp(id, "length")) {
+		return value_(length);
+	}
+	if (0==strcmp(id, "byteLength")) {
+		return value_(length * ElementSize(kind));
+	}
+	if (0==strcmp(id, "byteOffset")) {
+		return value_(byteOffset);
+	}
+	if (0==strcmp(id, "buffer")) {
+		return value_(buffer);
+	}
+	if (0==strcmp(id, "BYTES_PER_ELEMENT")) {
+		return value_(ElementSize(kind));
+	}
+	return obj_::dot(id);
+}
+
+value_ typedarray_::at(value_ x)
+{
+	long i;
+	if (x.t==value_::TNUM) {
+		// integer-indexed: never falls back to named props
+		return ElementIndex(x, length, i) ? value_(get(i)) : undefined;
+	}
+	if (ElementIndex(x, length, i)) {
+		return value_(get(i));
+	}
+	return obj_::at(x);
+}
+
+value_& typedarray_::atref(value_ x)
+{
+	long i;
+	if (x.t==value_::TNUM || ElementIndex(x, length, i)) {
+		// elements are not value_s, so there is nothing to refer to:
+		// the compiler stores through put(), compound assignments too
+		// (CodeGenerator::ElementOp)
+		throw not_imp();
+	}
+	return obj_::atref(x);
+}
+
+value_ typedarray_::put(value_ x, value_ v)
+{
+	long i;
+	if (x.t==value_::TNUM) {
+		if (ElementIndex(x, length, i)) {
+			set(i, v.toNumber());
+		}
+		return v;
+	}
+	if (ElementIndex(x, length, i)) {
+		set(i, v.toNumber());
+		return v;
+	}
+	return obj_::put(x, v);
+}
+
+// The constructor body is shared, the kind is a member.
+class typed_class_ : public func_ {
+public:
+	JS_CONSTEXPR typed_class_(typedarray_::KIND k) : func_(3), kind(k) {}
+	virtual value_ call(value_ this_, int nargs, ...);
+private:
+	typedarray_::KIND kind;
+};
+
+value_ typed_class_::call(value_ this_, int nargs, ...)
+{
+	value_* argv = ARGV_(nargs);
+	int size = typedarray_::ElementSize(kind);
+	value_ a0;
+	if (nargs > 0) {
+		a0 = argv[0];
+	}
+	if (a0.t==value_::TOBJ) {
+		arraybuffer_* buf = AsBuffer(a0);
+		if (buf) {
+			// new T(buffer [, byteOffset [, length]])
+			long offset = nargs > 1 ? ToIndex(argv[1]) : 0;
+			if (offset % size || offset > buf->byteLength) {
+				throw RangeError();
+			}
+			long n;
+			if (nargs > 2 && !argv[2].isUndefined()) {
+				n = ToIndex(argv[2]);
+				if (ByteEnd(offset, n, size) > buf->byteLength) {
+					throw RangeError();
+				}
+			} else {
+				if ((buf->byteLength - offset) % size) {
+					throw RangeError();
+				}
+				n = (buf->byteLength - offset) / size;
+			}
+			return value_(NewView(kind, buf, offset, n));
+		}
+		// new T(array-like): copy the elements
+		long n = ToIndex(a0.dot(intern_("length")));
+		typedarray_* ta = NewView(kind, new arraybuffer_(ByteEnd(0, n, size)), 0, n);
+		typedarray_* src = AsTyped(a0);
+		for (long i = 0; i < n; i++) {
+			ta->set(i, src ? src->get(i) : a0.at(value_(i)).toNumber());
+		}
+		return value_(ta);
+	}
+	// new T(length)
+	long n = ToIndex(a0);
+	return value_(NewView(kind, new arraybuffer_(ByteEnd(0, n, size)), 0, n));
+}
+
+static typed_class_ Int8Array_func_(typedarray_::INT8), Uint8Array_func_(typedarray_::UINT8),
+	Uint8ClampedArray_func_(typedarray_::UINT8C), Int16Array_func_(typedarray_::INT16),
+	Uint16Array_func_(typedarray_::UINT16), Int32Array_func_(typedarray_::INT32),
+	Uint32Array_func_(typedarray_::UINT32), Float32Array_func_(typedarray_::FLOAT32),
+	Float64Array_func_(typedarray_::FLOAT64);
+value_ Int8Array(&Int8Array_func_);
+value_ Uint8Array(&Uint8Array_func_);
+value_ Uint8ClampedArray(&Uint8ClampedArray_func_);
+value_ Int16Array(&Int16Array_func_);
+value_ Uint16Array(&Uint16Array_func_);
+value_ Int32Array(&Int32Array_func_);
+value_ Uint32Array(&Uint32Array_func_);
+value_ Float32Array(&Float32Array_func_);
+value_ Float64Array(&Float64Array_func_);
+
+/////////////////////////////////////////////////////////////////////
+// DataView
+
+static bool host_little_endian(void)
+{
+	unsigned short one = 1;
+	return *(unsigned char*)&one == 1;
+}
+
+// get<Type>(byteOffset [, littleEndian])
+// set<Type>(byteOffset, value [, littleEndian])
+class dvmethod_ : public func_ {
+public:
+	JS_CONSTEXPR dvmethod_(typedarray_::KIND k, bool st) : func_(st ? 2 : 1), kind(k), store(st) {}
+	virtual value_ call(value_ this_, int nargs, ...);
+private:
+	typedarray_::KIND kind;
+	bool store;
+};
+
+value_ dvmethod_::call(value_ this_, int nargs, ...)
+{
+	value_* argv = ARGV_(nargs);
+	dataview_* dv = AsDataView(this_);
+	if (!dv) {
+		throw TypeError();
+	}
+	int size = typedarray_::ElementSize(kind);
+	long offset = nargs > 0 ? ToIndex(argv[0]) : 0;
+	if (ByteEnd(offset, 1, size) > dv->byteLength || dv->byteOffset + offset + size > dv->buffer->byteLength) {
+		// (or the buffer has been detached)
+		throw RangeError();
+	}
+	int iLittle = store ? 2 : 1;
+	bool little = nargs > iLittle && argv[iLittle].toBool();
+	bool swap = (little != host_little_endian());
+	unsigned char* p = (unsigned char*)dv->buffer->data + dv->byteOffset + offset;
+	// go thru an aligned scratch element:
+	double scratch[1];
+	typedarray_ t(kind, dv->buffer, 0, 1);
+	t.data = scratch;
+	unsigned char* s = (unsigned char*)scratch;
+	int i;
+	if (store) {
+		value_ v = nargs > 1 ? argv[1] : undefined;
+		t.set(0, v.toNumber());
+		for (i = 0; i < size; i++) {
+			p[i] = s[swap ? size-1-i : i];
+		}
+		return undefined;
+	}
+	for (i = 0; i < size; i++) {
+		s[i] = p[swap ? size-1-i : i];
+	}
+	return value_(t.get(0));
+}
+
+static struct {
+	const char*		name;
+	dvmethod_		method;
+} dv_methods[] = {
+	{ "getInt8",	dvmethod_(typedarray_::INT8, false) },
+	{ "getUint8",	dvmethod_(typedarray_::UINT8, false) },
+	{ "getInt16",	dvmethod_(typedarray_::INT16, false) },
+	{ "getUint16",	dvmethod_(typedarray_::UINT16, false) },
+	{ "getInt32",	dvmethod_(typedarray_::INT32, false) },
+	{ "getUint32",	dvmethod_(typedarray_::UINT32, false) },
+	{ "getFloat32",	dvmethod_(typedarray_::FLOAT32, false) },
+	{ "getFloat64",	dvmethod_(typedarray_::FLOAT64, false) },
+	{ "setInt8",	dvmethod_(typedarray_::INT8, true) },
+	{ "setUint8",	dvmethod_(typedarray_::UINT8, true) },
+	{ "setInt16",	dvmethod_(typedarray_::INT16, true) },
+	{ "setUint16",	dvmethod_(typedarray_::UINT16, true) },
+	{ "setInt32",	dvmethod_(typedarray_::INT32, true) },
+	{ "setUint32",	dvmethod_(typedarray_::UINT32, true) },
+	{ "setFloat32",	dvmethod_(typedarray_::FLOAT32, true) },
+	{ "setFloat64",	dvmethod_(typedarray_::FLOAT64, true) },
+};
+
+dataview_::dataview_(arraybuffer_* buf, long offset, long n)
+: buffer(buf), byteOffset(offset), byteLength(n)
+{
+	klass = "DataView";
+	STAT_(ALLOC_VIEW);
+}
+
+value_ dataview_::dot(const char* id)
+{
+	// the methods are shared statics, found by name (like Array's
+	// parallel ones), not per-instance props
+	for (int i = 0; i < LENGTH(dv_methods); i++) {
+		if (0==strcmp(id, dv_methods[i].name)) {
+			return value_((func_*)&dv_methods[i].method);
+		}
+	}
+	if (0==strcmp(id, "byteLength")) {
+		return value_(byteLength);
+	}
+	if (0==strcmp(id, "byteOffset")) {
+		return value_(byteOffset);
+	}
+	if (0==strcmp(id, "buffer")) {
+		return value_(buffer);
+	}
+	return obj_::dot(id);
+}
+
+class DataView_class_ : public func_ {
+public:
+	JS_CONSTEXPR DataView_class_() : func_(3) {}
+	virtual value_ call(value_ this_, int nargs, ...)
+	{
+		value_* argv = ARGV_(nargs);
+		arraybuffer_* buf = nargs > 0 ? AsBuffer(argv[0]) : NULL;
+		if (!buf) {
+			throw TypeError();
+		}
+		long offset = nargs > 1 ? ToIndex(argv[1]) : 0;
+		if (offset > buf->byteLength) {
+			throw RangeError();
+		}
+		long n = buf->byteLength - offset;
+		if (nargs > 2 && !argv[2].isUndefined()) {
+			n = ToIndex(argv[2]);
+			if (n > buf->byteLength - offset) {
+				throw RangeError();
+			}
+		}
+		return value_(new dataview_(buf, offset, n));
+	}
+};
+static DataView_class_ DataView_func_;
+value_ DataView(&DataView_func_);
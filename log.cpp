@@ -1,7 +1,10 @@
 // log.cpp - diagnostic logging
 //
+#ifdef _WIN32
 #include "windows.h"
+#endif
 #include "log.h"
+#include "sugar.h"
 #include <stdio.h>
 #include <stdarg.h>
 #include <new>
@@ -18,6 +21,9 @@ void Log(const char* fmt, ...)
 		if (!bufptr) {
 			throw std::bad_alloc();
 		}
+		// (the first try used up the arguments)
+		va_end(arg_ptr);
+		va_start(arg_ptr, fmt);
 		if (_vsnprintf(bufptr, BIGSIZE, fmt, arg_ptr) < 0) {
 			delete[] bufptr;
 			throw "CodeGenerator::emitf buffer overflow";
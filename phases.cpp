@@ -0,0 +1,162 @@
+// phases.cpp - time and allocation by phase of translation (--stats)
+//
+// PhaseTimers mark the phases: where they switch, the time since the
+// last switch goes to the phase that was running. Allocation is
+// counted by operator new, which is replaced here; the string table's
+// and strdup's mallocs aren't in it.
+
+#include "phases.h"
+#include <stdlib.h>
+#include <new>
+#ifdef _WIN32
+#include "windows.h"
+#include <psapi.h>
+#ifdef _MSC_VER
+#pragma comment(lib, "psapi.lib")
+#endif
+#else
+#include <time.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#endif
+
+namespace js2cpp
+{
+
+	bool PhaseTimer::enabled = false;
+	Phase PhaseTimer::current = PH_OTHER;
+
+	static const char* const phaseNames[PH_COUNT] = {
+		"other", "source read", "lex", "parse+scopes", "codegen", "output write"
+	};
+
+	static double	phaseMs[PH_COUNT];
+	static double	phaseBytes[PH_COUNT];		// (operator new, below)
+	static long		phaseAllocs[PH_COUNT];
+	static double	started, switched;
+
+	static double Now(void)
+	// monotonic ms
+	{
+#ifdef _WIN32
+		static LARGE_INTEGER freq;
+		LARGE_INTEGER now;
+		if (!freq.QuadPart) {
+			QueryPerformanceFrequency(&freq);
+		}
+		QueryPerformanceCounter(&now);
+		return (double)now.QuadPart * 1000.0 / (double)freq.QuadPart;
+#else
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		return now.tv_sec * 1e3 + now.tv_nsec / 1e6;
+#endif
+	}
+
+	static long PeakKB(void)
+	{
+#ifdef _WIN32
+		PROCESS_MEMORY_COUNTERS pmc;
+		if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof pmc)) {
+			return 0;
+		}
+		return (long)(pmc.PeakWorkingSetSize / 1024);
+#else
+		struct rusage ru;
+		if (getrusage(RUSAGE_SELF, &ru) != 0) {
+			return 0;
+		}
+#ifdef __APPLE__
+		return ru.ru_maxrss / 1024;		// (bytes there)
+#else
+		return ru.ru_maxrss;
+#endif
+#endif
+	}
+
+	void PhaseTimer::Start(void)
+	{
+		for (int i = 0; i < PH_COUNT; i++) {
+			phaseMs[i] = phaseBytes[i] = 0;
+			phaseAllocs[i] = 0;
+		}
+		started = switched = Now();
+		current = PH_OTHER;
+		enabled = true;
+	}
+
+	void PhaseTimer::Switch(Phase ph)
+	{
+		double now = Now();
+		phaseMs[current] += now - switched;
+		switched = now;
+		current = ph;
+	}
+
+	void PhaseReport(FILE* f, const char* source, const TranslationCounts& counts)
+	{
+		if (!PhaseTimer::enabled) {
+			return;
+		}
+		double now = Now();
+		phaseMs[PhaseTimer::current] += now - switched;
+		switched = now;
+		double total = now - started, bytes = 0;
+		long allocs = 0;
+
+		fprintf(f, "\njs2cpp --stats: %s\n", source);
+		fprintf(f, "  %-14s %10s %6s %12s %9s\n", "phase", "ms", "%", "alloc KB", "allocs");
+		for (int i = 1; i <= PH_COUNT; i++) {
+			int ph = i % PH_COUNT;			// (other last)
+			fprintf(f, "  %-14s %10.3f %5.1f%% %12.1f %9ld\n", phaseNames[ph], phaseMs[ph],
+				total > 0 ? 100 * phaseMs[ph] / total : 0.0, phaseBytes[ph] / 1024, phaseAllocs[ph]);
+			bytes += phaseBytes[ph];
+			allocs += phaseAllocs[ph];
+		}
+		fprintf(f, "  %-14s %10.3f %6s %12.1f %9ld\n", "total", total, "", bytes / 1024, allocs);
+		fprintf(f, "  %d tokens, %d AST nodes, %d scopes, %d bindings, peak RSS %ld KB\n",
+			counts.tokens, counts.nodes, counts.scopes, counts.bindings, PeakKB());
+	} // PhaseReport
+
+} // namespace
+
+///////////////////////////////////////////////////////////////////////
+// Counting allocator
+
+void* operator new(size_t n)
+{
+	using namespace js2cpp;
+	phaseBytes[PhaseTimer::current] += n;
+	phaseAllocs[PhaseTimer::current]++;
+	void* p = malloc(n ? n : 1);
+	if (!p) {
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void* operator new[](size_t n)
+{
+	return operator new(n);
+}
+
+void operator delete(void* p)
+{
+	free(p);
+}
+
+void operator delete[](void* p)
+{
+	free(p);
+}
+
+// (what C++14 calls for objects of known size)
+void operator delete(void* p, size_t)
+{
+	free(p);
+}
+
+void operator delete[](void* p, size_t)
+{
+	free(p);
+}
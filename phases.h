@@ -0,0 +1,51 @@
+// phases.h - time and allocation by phase of translation (--stats)
+#ifndef PHASES_H
+#define PHASES_H
+
+#include <stdio.h>
+
+namespace js2cpp
+{
+
+	typedef enum {
+		PH_OTHER,			// arguments, setup, teardown
+		PH_READ,			// reading the source
+		PH_LEX,
+		PH_PARSE,			// parsing and building the scopes
+		PH_CODEGEN,
+		PH_WRITE,			// writing the .cpp
+		PH_COUNT
+	} Phase;
+
+	class PhaseTimer
+	{	// charges the time and the allocation while it lives to a phase
+		// (nested ones take their share out of the one they're in)
+	public:
+		PhaseTimer(Phase ph) : prev(current) { if (enabled) Switch(ph); }
+		~PhaseTimer() { if (enabled) Switch(prev); }
+
+		static void Start(void);		// turns it on: from here on counts
+		static bool		enabled;
+		static Phase	current;
+
+	private:
+		Phase			prev;
+
+		static void Switch(Phase ph);
+	};
+
+	struct TranslationCounts
+	{	// what translation made, for the report
+		int		tokens;
+		int		nodes;			// AST
+		int		scopes;
+		int		bindings;		// names declared in them
+	};
+
+	void PhaseReport(FILE* f, const char* source, const TranslationCounts& counts);
+	// Write the time and allocation of each phase so far, the counts
+	// and the peak RSS to f.
+
+} // namespace
+
+#endif
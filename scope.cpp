@@ -13,6 +13,12 @@ namespace js2cpp {
 		return value;
 	} // Definition
 
+	AST* Binding::Initialiser(void) const
+	{
+		assert(type==BOUND_VARIABLE);
+		return value;
+	} // Initialiser
+
 	void Binding::MakeExtern(void)
 	{
 		type=BOUND_EXTERN;
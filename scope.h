@@ -49,7 +49,7 @@ namespace js2cpp
 	class aScope
 	{
 	public:
-		aScope(const char* s, aScope* up) : name(s), parent(up), depth(parent ? parent->depth+1 : 0) {}
+		aScope(const char* s, aScope* up) : name(s), parent(up), depth(parent ? parent->depth+1 : 0), tree(NULL) {}
 		~aScope();
 
 		void Start(void);
@@ -59,6 +59,9 @@ namespace js2cpp
 		int Depth(void) const { return depth; }
 		aScope* Parent(void) const { return parent; }
 		aScope* AtDepth(int d);
+		AST* Tree(void) const { return tree; }
+		void SetTree(AST* t) { tree = t; }
+		// the tree (function or program) this scope is attached to
 
 		void Bind(const char* name, Binding bind);
 
@@ -82,6 +85,7 @@ namespace js2cpp
 		const char*	name;		// name of this scope (for errors & logging)
 		Bindings	decls;		// identifiers declared in a scope
 		TreeSet		litfuncs;	// literal functions
+		AST*		tree;		// function or program that owns this scope
 	}; // aScope
 
 } // namespace
@@ -9,6 +9,8 @@
 namespace js2cpp
 {
 
+	bool StringTable::bReport = false;
+
 	StringTable::StringTable()
 	{
 		memset(m_bucket, 0, sizeof m_bucket);
@@ -17,7 +19,6 @@ namespace js2cpp
 	StringTable::~StringTable()
 	{
 		int total = 0, maxdepth = 0;
-		fprintf(stdout, "StringTable destruction report\n");
 		for (int i = 0; i < BUCKETS; i++) {
 			STAtom *atom = m_bucket[i];
 			int depth = 0;
@@ -33,15 +34,18 @@ namespace js2cpp
 				maxdepth = depth;
 			}
 		} // for i
-		fprintf(stdout, "  total entries = %d\n", total);
-		fprintf(stdout, "  average hash bucket size: %0.2f entries\n", (double)total / BUCKETS);
-		fprintf(stdout, "  deepest hash bucket: %d entries\n", maxdepth);
+		if (bReport) {
+			fprintf(stderr, "StringTable destruction report\n");
+			fprintf(stderr, "  total entries = %d\n", total);
+			fprintf(stderr, "  average hash bucket size: %0.2f entries\n", (double)total / BUCKETS);
+			fprintf(stderr, "  deepest hash bucket: %d entries\n", maxdepth);
+		}
 	} // ~StringTable
 
 	STAtom* AddToList(STAtom *&list, const char *pz, int n)
 	{
 		STAtom *atom = list;
-		while (atom && (memcmp(atom->m_name, pz, n) || atom->m_name[n])) {
+		while (atom && (strncmp(atom->m_name, pz, n) || atom->m_name[n])) {
 			atom = atom->m_link;
 		}
 		if (!atom) {
@@ -20,6 +20,9 @@ namespace js2cpp
 		STAtom* Intern(const char *pz, int n);
 		// Intern's the n-character string at pz.
 
+		static bool bReport;
+		// Report on the table when destroyed (--stats)
+
 	private:
 		STAtom		*m_bucket[BUCKETS];
 
@@ -1,4 +1,28 @@
 // sugar.h - sweetener, for a whole-wheat C++ world.
+#ifndef SUGAR_H
+#define SUGAR_H
 
 #define LENGTH(a) (sizeof(a)/sizeof((a)[0]))
 // number of elements in an array a
+
+#ifndef _WIN32
+#include <stdio.h>
+#include <stdarg.h>
+// MSVC's _vsnprintf and _snprintf: -1 when the text doesn't fit
+inline int _vsnprintf(char* buf, size_t n, const char* fmt, va_list ap)
+{
+	int len = vsnprintf(buf, n, fmt, ap);
+	return len >= 0 && (size_t)len < n ? len : -1;
+}
+
+inline int _snprintf(char* buf, size_t n, const char* fmt, ...)
+{
+	va_list ap;
+	va_start(ap, fmt);
+	int len = _vsnprintf(buf, n, fmt, ap);
+	va_end(ap);
+	return len;
+}
+#endif
+
+#endif
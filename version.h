@@ -2,9 +2,223 @@
 
 #define APP_MAJOR 1
 #define APP_MINOR 5
-#define APP_BUILD 1
+#define APP_BUILD 26
 
 /*
+1.05.26 2026.10.18
+--stats: wall time and operator new volume for each phase (source
+read, lex, parse+scopes, codegen, output write), with the token,
+AST node, scope and binding counts and peak RSS, on stderr. The
+parse tree is only dumped with --parsetree[=file], to parsetree.txt
+by default rather than c:\parsetree.txt, and the StringTable
+report only comes with --stats.
+
+1.05.25 2026.10.18
+--lines: a #line directive at each statement, back to the JS
+source, so debuggers, profilers, sanitizers and compiler errors
+show the .js file and line. The code in between (prologues,
+tables, jsmain_) goes back to the .cpp's own numbering.
+
+1.05.24 2026.10.18
+bench/corpus.sh: runs the corpus in bench/corpus (richards,
+deltablue, nbody, strings, oo, json) and utils.js through js2cpp,
+the C++ compiler and the program, and adds a JSON line per program
+to a history (corpus.jsonl): js2cpp and compile time and peak RSS,
+binary size, fastest run time, run peak RSS, first line of output,
+or which stage failed. bench/compare.sh compares the last run with
+an earlier one and flags regressions past a threshold (5%).
+bench/runstat.cpp times a command and gets its peak RSS.
+Fixed: a statement beginning with new after the first in a block
+crashed the compiler (CollectStatic); postdec_, preinc_ and predec_
+are defined (they were only declared).
+
+1.05.23 2026.10.18
+bench/prims.cpp: microbenchmarks of the runtime's primitives (value_
+construction, copying and arithmetic, number/string conversion,
+concatenation, identical_, dot/dotref/at/atref at 1 to 64
+properties in the property list and in slots, array append and
+indexing, func_::call with 0 to 8 arguments), as JSON on stdout.
+
+1.05.22 2026.10.18
+--feedback: the compiler numbers the sites it could specialize
+(property loads and stores, + - * / % < >, calls through a name) and
+wraps each in a recorder (jsfeedback.cpp) that notes the types seen
+and up to 4 shapes or callees. At exit they go to $JS_FEEDBACK
+(jsfeedback.txt), a line per site keyed by file:line:col.
+--profile=file compiles against such a file: a load or store that
+only saw one static shape (object literal or new F) becomes a slot
+access behind a shape guard (dotmono_, dotrefmono_); arithmetic that
+only saw numbers goes through numadd_ etc., numbers inline; a call
+that only saw one top-level function calls its class directly when
+the callee checks out. Shapes carry a name for the file.
+value_::operator> is defined (it was only declared).
+
+1.05.21 2026.10.18
+--instrument: each function's call starts with a callprobe_
+(jsinstr.cpp), which counts it and times it with the TSC in a
+per-thread calling context tree. At exit the trees are added up into
+$JS_INSTRUMENT.txt (jscalls.txt: calls, inclusive and self ms per
+function, callers and callees with their calls and time) and
+$JS_INSTRUMENT.folded (self microseconds per stack, for
+flamegraph.pl). Ticks are turned into ms against performance.now.
+
+1.05.20 2026.10.18
+--heapprof: a heap profile by allocation site (jsheap.cpp). The
+compiler numbers the expressions that allocate or call (literals,
+closures, new, +, calls, property stores, heap locals) and sets
+allocsite_ while each runs; sited_ puts an enclosing site back after
+an inner one. The runtime counts every allocation it makes for JS
+against the site, and samples live blocks one per JS_HEAPPROF_RATE
+bytes (64K) until freed. At exit it writes a pprof profile
+(alloc/inuse objects and space, one frame per site: function, file,
+line; label kind) to $JS_HEAPPROF (heap.pprof);
+performance.writeHeapProfile(path) writes one on demand.
+obj_'s operator new is always declared now.
+
+1.05.19 2026.10.18
+JS_STATS: a runtime built with it counts what it does (jsstats.cpp):
+dot/dotref/at/atref/put and the call helpers, finds in slots or the
+property list and misses, probes along slots, property lists,
+prototypes and the atom table, array index vs key, JSON shape cache
+hits, number/string conversions, allocations by kind (and bytes), and
+the exceptions it throws. Per-thread blocks; at exit a report to
+stderr, most first, and JSON to the file in $JS_STATS (jsstats.json).
+Without JS_STATS, STAT_ is nothing.
+
+1.05.18 2026.10.18
+Arrays get parallelMap/Filter/ForEach/Reduce/Sort (jsparallel.cpp):
+ranges split into slices on a work-stealing pool of JS_THREADS (or
+one per CPU) threads; the caller works too. The compiler marks in
+funcinfo_ the functions that store nothing outside themselves (pure);
+anything else, or under 2048 elements, or from inside the pool, runs
+on the calling thread. A grain that throws is run again on the caller
+in order. reduce's callback must be associative. nisolates_ is now
+nthreads_; --isolate reaches its globals through globalsp_.
+
+1.05.17 2026.10.18
+--isolate: globals go in a struct jsmain_ makes, reached through a
+thread-local pointer (gv_), so JS_ISOLATES=n runs n copies of the
+program on n threads (jsisolate.cpp). Runtime state is per thread too:
+global object, event loop, closure free lists, Math.random, JSON shape
+cache. Atoms are shared under a spin lock taken only while isolates
+run. isolate.id/count/post(id, msg)/onmessage: strings go as they are,
+ArrayBuffers are handed over (Detach), the rest as JSON.
+
+1.05.16 2026.10.18
+fs module moves to jsfs.cpp and gains readFileSync, which maps the
+file and returns the mapping as the string (no copy; a zeroed page
+after the file ends it), and lines(path), a reader whose next() gives
+lines as slices of 1 MB chunks read into a ring of 4, no allocation
+per line. io_error when a file can't be opened.
+
+1.05.15 2026.10.18
+performance.now(): monotonic milliseconds (clock_gettime, or
+QueryPerformanceCounter) since startup, to well under a microsecond.
+The compiler calls it, and Date.now(), directly like the Math
+intrinsics. The event loop's clock is the same one. Date objects keep
+their time value in a C++ member (date_) instead of a "[[value]]"
+property; getTime/valueOf, new Date(ms).
+
+1.05.14 2026.10.18
+console.log/info/error/warn and print (jsconsole.cpp) format straight
+into a 64K per-thread buffer, numbers by fmtnum_, written out when
+full, per line on a terminal, before the event loop sleeps, and at
+exit. alert prints too; MessageBox only when built with JS_GUI.
+
+1.05.13 2026.10.18
+Event loop (jsevent.cpp): microtasks, posted tasks, timers on a
+hierarchical timing wheel, and fd watchers (epoll on Linux, select
+elsewhere). jsmain_ runs the loop after the program's top level.
+setTimeout, setInterval, clearTimeout, clearInterval, queueMicrotask,
+fs.readFile (read a chunk per turn), net.listen and net.connect with
+non-blocking sockets. callv_ calls a func_ with an argument array.
+Fixed the locals class name used by closures nested in function
+literals. bench/echo.cpp measures loopback round trips.
+
+1.05.12 2026.10.18
+Regular expressions (jsregex.cpp): patterns compile to a Pike VM
+program, run in time linear in the subject, with literal-prefix
+(memchr) or first-byte skipping. js2cpp compiles regex literals
+and emits their programs as static tables, rx_ wraps them; new RegExp
+compiles at run time. RegExp exec/test/lastIndex, and String match,
+replace, search, split and length (jsregexp.cpp). No backreferences
+or lookahead. The lexer allows / inside a [...] in a regex.
+
+1.05.11 2026.10.18
+JSON object (jsjson.cpp). parse indexes the structural characters
+and quotes 16 bytes at a time (SSE2 where available), then builds
+from the index; repeated key sets share cached shapes, keys are atoms.
+Reviver supported, except that it can't delete. stringify writes into
+one buffer; replacer function or array, space, toJSON, cycle check.
+Numbers print as ECMAScript says (fmtnum_), here and in toString.
+null_ is defined. bench/json.cpp measures throughput.
+
+1.05.10 2026.10.18
+--snapshot: the leading top-level statements that only build objects
+from constants and top-level functions (var x = {...}, x.k = e,
+F.prototype = {...}, F.prototype.m = function...) are run by the
+compiler, and the heap they leave is emitted as static objects (snap_),
+with jsmain_ starting after them. funcinfo_ can point at a snapshot
+prototype. First command-line switch.
+
+1.05.09 2026.10.18
+No dynamic initialization before main: value_, obj_ and func_ have
+JS_CONSTEXPR constructors, the builtins (Array, Date, Math, the typed
+array constructors, ...) are static objects instead of new'd ones, and
+generated programs emit constexpr funcinfo_ and top-level function
+objects, a literal-initialized constant pool, and id tables that
+jsinit_ points at the atoms first thing in jsmain_.
+bench/startup.sh times startup of a program with many functions.
+
+1.05.08 2026.10.18
+new F(...) goes through construct_, which returns the new object unless
+F returns one. For a global F the compiler predicts the instance shape
+from this.x = ... in F and in methods put on F.prototype, and emits a
+layout_; instances get their slots at allocation. After LAYOUT_WATCH
+instances the reservation shrinks to what those actually used.
+Objects have a [[Prototype]] (obj_::proto), functions a lazy prototype.
+
+1.05.07 2026.10.18
+func_ objects come from closure_alloc_ (size-class free lists carved
+from 64K blocks). Each compiled function has a static funcinfo_ with
+its name and length; func_::dot answers length/name from it, so making
+a function value no longer adds a "length" prop. value_ dot/at/put work
+on functions too. ArgCount counts formals properly.
+
+1.05.06 2026.10.18
+Constant pool: each module interns its distinct string literals and
+property ids once (atoms_, str_[]), with length and hash computed by
+the compiler, and boxes its number literals once (num_[]).
+Atoms live in jsatom.cpp; o[k] interns k, so o[k] and o.k meet.
+
+1.05.05 2026.10.18
+Array literals of only numbers or only strings compile to a static
+const table; ConstArray_ wraps it and array_ copies it on first write.
+array_ now keeps a dense value_ vector (at/atref/length) instead of
+going through the property list.
+ElementList, ExprList, ListLength, ~AST and TreePrint no longer recurse
+once per list element. Lines longer than MAX_LINE no longer split
+tokens. Hex literals (0x...) lex as numbers.
+
+1.05.04 2026.10.18
+Object literals are built in one allocation: obj_ header plus an
+in-object slot per key, laid out by a static shape_ the compiler emits
+once per distinct key list (MakeObject_). Properties added later still
+go on the prop list. The parser now tags literals as tOBJLIT.
+
+1.05.03 2026.10.18
+Native Math object (jsmath.cpp), Math.random is xorshift128+.
+When Math is the unshadowed global, Math.f(x) compiles to a direct call
+on doubles (floor, sqrt, Math_max_ ...) and Math.PI etc. to literals.
+ExprNumber keeps * / % - and numeric + unboxed inside those calls.
+
+1.05.02 2026.10.18
+ArrayBuffer, DataView and the typed arrays (Int8Array ... Float64Array),
+stored in raw aligned memory instead of props.
+Element access on a variable that only ever holds one kind of typed array
+compiles to a direct typed load/store (Float64Array_get_ etc.)
+Indexed stores go thru obj_::put, which is virtual along with dot/at/atref.
+
 1.05.01 2008.03.03 spike
 'Indexed call' works (a[0]=f, a[0](x) calls f(x) with this===a.)
 Checked with the gurus on comp.lang.javascript to make sure I read ECMA262 right.